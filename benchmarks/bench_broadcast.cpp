@@ -0,0 +1,96 @@
+#include <QtTest/QtTest>
+#include <QUdpSocket>
+#include <QHostAddress>
+#include "../src/message.h"
+
+// Cost of one broadcast fan-out at 1, 10, 100 and 1000 peers. The
+// perPeerEncode rows are the old loop (encode the message and parse the
+// peer's host string for every peer); encodeOnce is the current one (one
+// encoding shared by every peer, addresses resolved when the peer was added).
+// Both send real datagrams to a bound loopback socket, so the difference is
+// what the loop itself costs on top of the syscalls.
+class BenchBroadcast : public QObject {
+    Q_OBJECT
+
+private:
+    struct Peer {
+        QString host;
+        QHostAddress address;
+        quint16 port;
+    };
+
+    QUdpSocket sender;
+    QUdpSocket receiver;
+
+    static void addPeerRows() {
+        QTest::addColumn<int>("peers");
+        QTest::newRow("1 peer") << 1;
+        QTest::newRow("10 peers") << 10;
+        QTest::newRow("100 peers") << 100;
+        QTest::newRow("1000 peers") << 1000;
+    }
+
+    QVector<Peer> makePeers(int count) const {
+        // Every peer points at the receiver; it is the per-peer work that matters
+        QVector<Peer> peers;
+        for (int i = 0; i < count; ++i) {
+            peers.append({"127.0.0.1", QHostAddress("127.0.0.1"), receiver.localPort()});
+        }
+        return peers;
+    }
+
+    static Message makeMessage() {
+        Message msg("A broadcast of ordinary chat length, about sixty bytes long.", "Node1", "broadcast", 42);
+        VectorClock clock;
+        for (int i = 1; i <= 8; ++i) {
+            clock.set(NodeRegistry::global().intern(QString("Node%1").arg(i)), static_cast<quint32>(i * 100));
+        }
+        msg.setVectorClock(clock);
+        return msg;
+    }
+
+    void drain() {
+        char byte;
+        while (receiver.hasPendingDatagrams()) {
+            receiver.readDatagram(&byte, 1);  // Truncated reads discard the rest
+        }
+    }
+
+private slots:
+    void initTestCase() {
+        QVERIFY(receiver.bind(QHostAddress::LocalHost, 0));
+    }
+
+    void perPeerEncode_data() { addPeerRows(); }
+    void perPeerEncode() {
+        QFETCH(int, peers);
+        const QVector<Peer> targets = makePeers(peers);
+        const Message msg = makeMessage();
+
+        QBENCHMARK {
+            for (const Peer& peer : targets) {
+                QByteArray datagram = msg.toDatagram(Message::BINARY_FORMAT);
+                sender.writeDatagram(datagram, QHostAddress(peer.host), peer.port);
+            }
+        }
+        drain();
+    }
+
+    void encodeOnce_data() { addPeerRows(); }
+    void encodeOnce() {
+        QFETCH(int, peers);
+        const QVector<Peer> targets = makePeers(peers);
+        const Message msg = makeMessage();
+
+        QBENCHMARK {
+            const QByteArray datagram = msg.toDatagram(Message::BINARY_FORMAT);
+            for (const Peer& peer : targets) {
+                sender.writeDatagram(datagram, peer.address, peer.port);
+            }
+        }
+        drain();
+    }
+};
+
+QTEST_MAIN(BenchBroadcast)
+#include "bench_broadcast.moc"
@@ -0,0 +1,85 @@
+#include <QtTest/QtTest>
+#include <QTemporaryDir>
+#include "../src/durablelog.h"
+
+// Restart cost of the durable log: time to map and replay a log of 10k, 100k
+// and 1M messages into a fresh MessageLog, plus the cost of a group commit.
+// The 1M row writes roughly 100 MB to the temporary directory.
+class BenchDurableLog : public QObject {
+    Q_OBJECT
+
+private:
+    static void addSizeRows() {
+        QTest::addColumn<int>("messages");
+        QTest::newRow("10k messages") << 10000;
+        QTest::newRow("100k messages") << 100000;
+        QTest::newRow("1M messages") << 1000000;
+    }
+
+    static void writeLog(const QString& directory, int messages) {
+        const int origins = 16;
+        QVector<NodeIndex> nodes;
+        for (int i = 0; i < origins; ++i) {
+            nodes.append(NodeRegistry::global().intern(QString("Node%1").arg(i)));
+        }
+
+        DurableLog log;
+        log.open(directory);
+        DurableLog::Checkpoint checkpoint;
+        for (int i = 0; i < messages; ++i) {
+            int origin = i % origins;
+            int seq = i / origins + 1;
+            Message msg(QString("benchmark message %1").arg(i), QString("Node%1").arg(origin), "broadcast", seq);
+            checkpoint.clock.set(nodes.at(origin), static_cast<quint32>(seq));
+            msg.setVectorClock(checkpoint.clock);
+            log.append(msg);
+            if (log.pendingBytes() >= 1024 * 1024) {
+                log.flush(checkpoint);
+            }
+        }
+        log.flush(checkpoint);
+    }
+
+private slots:
+    void recover_data() { addSizeRows(); }
+    void recover() {
+        QFETCH(int, messages);
+        QTemporaryDir dir;
+        writeLog(dir.path(), messages);
+
+        QBENCHMARK_ONCE {
+            DurableLog log;
+            log.open(dir.path());
+            MessageLog store;
+            DurableLog::Checkpoint checkpoint;
+            QCOMPARE(log.recover(store, checkpoint), messages);
+        }
+    }
+
+    void groupCommit_data() {
+        QTest::addColumn<int>("batch");
+        QTest::newRow("1 message per fsync") << 1;
+        QTest::newRow("64 messages per fsync") << 64;
+        QTest::newRow("1024 messages per fsync") << 1024;
+    }
+    void groupCommit() {
+        QFETCH(int, batch);
+        QTemporaryDir dir;
+        DurableLog log;
+        log.open(dir.path());
+        DurableLog::Checkpoint checkpoint;
+        Message msg("benchmark message", "Node0", "broadcast", 1);
+
+        int seq = 0;
+        QBENCHMARK {
+            for (int i = 0; i < batch; ++i) {
+                msg.setSequenceNumber(++seq);
+                log.append(msg);
+            }
+            log.flush(checkpoint);
+        }
+    }
+};
+
+QTEST_MAIN(BenchDurableLog)
+#include "bench_durablelog.moc"
@@ -0,0 +1,66 @@
+#include <QtTest/QtTest>
+#include "../src/peertable.h"
+
+// Per-packet sender lookup at 10, 100, 1000 and 10000 peers: the old scan
+// comparing every peer's address against PeerTable's address index.
+class BenchPeerTable : public QObject {
+    Q_OBJECT
+
+private:
+    static void addPeerRows() {
+        QTest::addColumn<int>("peerCount");
+        QTest::newRow("10 peers") << 10;
+        QTest::newRow("100 peers") << 100;
+        QTest::newRow("1000 peers") << 1000;
+        QTest::newRow("10000 peers") << 10000;
+    }
+
+    static PeerTable makeTable(int peerCount) {
+        PeerTable table;
+        for (int i = 0; i < peerCount; ++i) {
+            QString id = QString("BenchPeer%1").arg(i);
+            table.insert(PeerInfo(id, NodeRegistry::global().intern(id), QHostAddress(0x0a000000u + i / 100),
+                                  static_cast<quint16>(9000 + i % 100)));
+        }
+        return table;
+    }
+
+private slots:
+    void scanByAddress_data() { addPeerRows(); }
+    void scanByAddress() {
+        QFETCH(int, peerCount);
+        const PeerTable table = makeTable(peerCount);
+        int next = 0;
+        NodeIndex found = NodeRegistry::INVALID_NODE;
+
+        QBENCHMARK {
+            const QHostAddress host(0x0a000000u + next / 100);
+            const quint16 port = static_cast<quint16>(9000 + next % 100);
+            for (auto it = table.constBegin(); it != table.constEnd(); ++it) {
+                if (it.value().port == port && it.value().address == host) {
+                    found = it.key();
+                    break;
+                }
+            }
+            next = (next + 7) % peerCount;
+        }
+        QVERIFY(found != NodeRegistry::INVALID_NODE);
+    }
+
+    void indexByAddress_data() { addPeerRows(); }
+    void indexByAddress() {
+        QFETCH(int, peerCount);
+        const PeerTable table = makeTable(peerCount);
+        int next = 0;
+        NodeIndex found = NodeRegistry::INVALID_NODE;
+
+        QBENCHMARK {
+            found = table.findByAddress(QHostAddress(0x0a000000u + next / 100), static_cast<quint16>(9000 + next % 100));
+            next = (next + 7) % peerCount;
+        }
+        QVERIFY(found != NodeRegistry::INVALID_NODE);
+    }
+};
+
+QTEST_MAIN(BenchPeerTable)
+#include "bench_peertable.moc"
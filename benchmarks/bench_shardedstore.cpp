@@ -0,0 +1,83 @@
+#include <QtTest/QtTest>
+#include <thread>
+#include <vector>
+#include "../src/shardedstore.h"
+#include "../src/messageview.h"
+
+// Receive-side work of 1, 2, 4 and 8 SO_REUSEPORT workers: each thread takes
+// its share of 64k pre-encoded chat datagrams (every message arrives twice, as
+// gossip and anti-entropy deliver it) and does what ReceiveWorker does with
+// them: view the header, drop duplicates, decode and store the rest. Datagrams
+// are split by origin, like the kernel's flow hash splits them by sender.
+//
+// The "8 workers, 1 shard" row is the same work against an unsharded store,
+// so every thread serializes on one lock.
+class BenchShardedStore : public QObject {
+    Q_OBJECT
+
+private:
+    static const int ORIGINS = 64;
+    static const int PER_ORIGIN = 512;
+
+    QVector<QByteArray> datagrams;  // Origin-major, each message twice
+
+    void receiveShare(ShardedStore& store, int worker, int workers) const {
+        for (int origin = worker; origin < ORIGINS; origin += workers) {
+            for (int i = 0; i < PER_ORIGIN * 2; ++i) {
+                const QByteArray& datagram = datagrams[origin * PER_ORIGIN * 2 + i];
+                MessageView view(datagram.constData(), datagram.size());
+                NodeIndex node = NodeRegistry::global().intern(view.originData(), view.originSize());
+                if (!store.contains(node, static_cast<quint32>(view.getSequenceNumber()))) {
+                    store.insert(node, view.toMessage());
+                }
+            }
+        }
+    }
+
+private slots:
+    void initTestCase() {
+        VectorClock clock;
+        for (int i = 1; i <= 8; ++i) {
+            clock.set(NodeRegistry::global().intern(QString("Node%1").arg(i)), static_cast<quint32>(i * 100));
+        }
+        for (int origin = 0; origin < ORIGINS; ++origin) {
+            for (int seq = 1; seq <= PER_ORIGIN; ++seq) {
+                Message msg("A chat message of ordinary length, about sixty bytes long.",
+                            QString("Origin%1").arg(origin), "broadcast", seq);
+                msg.setVectorClock(clock);
+                QByteArray datagram = msg.toDatagram(Message::BINARY_FORMAT);
+                datagrams.append(datagram);
+                datagrams.append(datagram);
+            }
+        }
+    }
+
+    void receive_data() {
+        QTest::addColumn<int>("workers");
+        QTest::addColumn<int>("shards");
+        QTest::newRow("1 worker") << 1 << 1;
+        QTest::newRow("2 workers") << 2 << 2;
+        QTest::newRow("4 workers") << 4 << 4;
+        QTest::newRow("8 workers") << 8 << 8;
+        QTest::newRow("8 workers, 1 shard") << 8 << 1;
+    }
+
+    void receive() {
+        QFETCH(int, workers);
+        QFETCH(int, shards);
+
+        QBENCHMARK {
+            ShardedStore store(shards);
+            std::vector<std::thread> threads;
+            for (int worker = 0; worker < workers; ++worker) {
+                threads.emplace_back([this, &store, worker, workers]() { receiveShare(store, worker, workers); });
+            }
+            for (std::thread& thread : threads) {
+                thread.join();
+            }
+        }
+    }
+};
+
+QTEST_MAIN(BenchShardedStore)
+#include "bench_shardedstore.moc"
@@ -0,0 +1,66 @@
+#include <QtTest/QtTest>
+#include <QMap>
+#include "../src/timerwheel.h"
+
+// Cost of one retransmit check with 1k, 10k and 100k messages awaiting ACKs:
+// the old once-a-second scan of every pending entry against the timer wheel,
+// which only touches the timers that are due.
+class BenchTimerWheel : public QObject {
+    Q_OBJECT
+
+private:
+    static void addOutstandingRows() {
+        QTest::addColumn<int>("outstanding");
+        QTest::newRow("1k outstanding") << 1000;
+        QTest::newRow("10k outstanding") << 10000;
+        QTest::newRow("100k outstanding") << 100000;
+    }
+
+private slots:
+    void scanPending_data() { addOutstandingRows(); }
+    void scanPending() {
+        QFETCH(int, outstanding);
+        QMap<quint32, qint64> sentTimes;
+        for (int i = 0; i < outstanding; ++i) {
+            sentTimes.insert(static_cast<quint32>(i), i % 2000);
+        }
+
+        qint64 now = 2000;
+        int due = 0;
+        QBENCHMARK {
+            for (auto it = sentTimes.begin(); it != sentTimes.end(); ++it) {
+                if (now - it.value() > 2000) {
+                    it.value() = now;  // Retransmitted
+                    ++due;
+                }
+            }
+            ++now;
+        }
+        QVERIFY(due >= 0);
+    }
+
+    void advanceWheel_data() { addOutstandingRows(); }
+    void advanceWheel() {
+        QFETCH(int, outstanding);
+        // Deadlines spread over two seconds; everything that fires is rescheduled
+        TimerWheel wheel(0);
+        for (int i = 0; i < outstanding; ++i) {
+            wheel.schedule(1 + i % 2000, static_cast<quint64>(i));
+        }
+
+        QVector<quint64> expired;
+        qint64 now = 0;
+        QBENCHMARK {
+            ++now;
+            expired.clear();
+            wheel.advance(now, expired);
+            for (quint64 key : expired) {
+                wheel.schedule(now + 2000, key);
+            }
+        }
+        QCOMPARE(wheel.size(), outstanding);
+    }
+};
+
+QTEST_MAIN(BenchTimerWheel)
+#include "bench_timerwheel.moc"
@@ -0,0 +1,73 @@
+#include <QtTest/QtTest>
+#include <QElapsedTimer>
+#include "../src/datagramtransport.h"
+
+// Loopback throughput of the socket backends: 100k datagrams of 256 bytes
+// pushed from one transport to another in bursts, each burst drained before
+// the next so neither socket buffer overflows. Both ends use the backend under
+// test. Compare the rows, or run with -perf to count syscalls.
+class BenchTransport : public QObject {
+    Q_OBJECT
+
+private:
+    static const int DATAGRAMS = 100000;
+    static const int DATAGRAM_SIZE = 256;
+
+    // Receives until expected datagrams have arrived or a second has passed
+    static int drain(DatagramTransport& receiver, int expected) {
+        QVector<DatagramTransport::Datagram> batch;
+        QElapsedTimer timer;
+        timer.start();
+        int received = 0;
+        while (received < expected && timer.elapsed() < 1000) {
+            received += receiver.receive(batch);
+        }
+        return received;
+    }
+
+private slots:
+    void throughput_data() {
+        QTest::addColumn<int>("backend");
+        QTest::addColumn<int>("burst");
+        QTest::newRow("QUdpSocket, burst 1") << int(DatagramTransport::QT_SOCKET) << 1;
+        QTest::newRow("QUdpSocket, burst 64") << int(DatagramTransport::QT_SOCKET) << 64;
+        QTest::newRow("recvmmsg/sendmmsg, burst 1") << int(DatagramTransport::BATCHED_MMSG) << 1;
+        QTest::newRow("recvmmsg/sendmmsg, burst 64") << int(DatagramTransport::BATCHED_MMSG) << 64;
+        QTest::newRow("io_uring, burst 1") << int(DatagramTransport::IO_URING) << 1;
+        QTest::newRow("io_uring, burst 64") << int(DatagramTransport::IO_URING) << 64;
+    }
+
+    void throughput() {
+        QFETCH(int, backend);
+        QFETCH(int, burst);
+
+        QScopedPointer<DatagramTransport> sender(DatagramTransport::create(DatagramTransport::Backend(backend)));
+        QScopedPointer<DatagramTransport> receiver(DatagramTransport::create(DatagramTransport::Backend(backend)));
+        if (sender->backend() != backend) {
+            QSKIP("Backend not available on this platform or kernel");
+        }
+        QVERIFY(sender->bind(QHostAddress::LocalHost, 0));
+        QVERIFY(receiver->bind(QHostAddress::LocalHost, 0));
+
+        const QByteArray payload(DATAGRAM_SIZE, 'x');
+        const QHostAddress target(QHostAddress::LocalHost);
+        const quint16 port = receiver->localPort();
+        int received = 0;
+
+        QBENCHMARK_ONCE {
+            for (int sent = 0; sent < DATAGRAMS; sent += burst) {
+                for (int i = 0; i < burst; ++i) {
+                    sender->send(payload, target, port);
+                }
+                sender->flush();
+                received += drain(*receiver, burst);
+            }
+        }
+
+        // Loopback should lose nothing; a big shortfall means the numbers lie
+        QVERIFY(received >= DATAGRAMS * 99 / 100);
+    }
+};
+
+QTEST_MAIN(BenchTransport)
+#include "bench_transport.moc"
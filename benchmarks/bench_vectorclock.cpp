@@ -0,0 +1,112 @@
+#include <QtTest/QtTest>
+#include "../src/vectorclock.h"
+
+// Compares VectorClock against the QVariantMap clock it replaced, at 10, 100
+// and 1000 origins. Run with -median 5 (or -callgrind) for stable numbers.
+class BenchVectorClock : public QObject {
+    Q_OBJECT
+
+private:
+    static void addOriginRows() {
+        QTest::addColumn<int>("origins");
+        QTest::newRow("10 origins") << 10;
+        QTest::newRow("100 origins") << 100;
+        QTest::newRow("1000 origins") << 1000;
+    }
+
+    static VectorClock makeClock(int origins, int offset) {
+        VectorClock clock;
+        for (int i = 0; i < origins; ++i) {
+            clock.set(NodeRegistry::global().intern(QString("Node%1").arg(i)), static_cast<quint32>(i + offset));
+        }
+        return clock;
+    }
+
+    static QVariantMap makeMap(int origins, int offset) {
+        QVariantMap map;
+        for (int i = 0; i < origins; ++i) {
+            map[QString("Node%1").arg(i)] = i + offset;
+        }
+        return map;
+    }
+
+private slots:
+    void mergeVariantMap_data() { addOriginRows(); }
+    void mergeVariantMap() {
+        QFETCH(int, origins);
+        QVariantMap local = makeMap(origins, 0);
+        QVariantMap remote = makeMap(origins, (origins / 2) % 2);
+
+        QBENCHMARK {
+            for (auto it = remote.begin(); it != remote.end(); ++it) {
+                if (it.value().toInt() > local.value(it.key(), 0).toInt()) {
+                    local[it.key()] = it.value();
+                }
+            }
+        }
+    }
+
+    void mergeVectorClock_data() { addOriginRows(); }
+    void mergeVectorClock() {
+        QFETCH(int, origins);
+        VectorClock local = makeClock(origins, 0);
+        VectorClock remote = makeClock(origins, (origins / 2) % 2);
+
+        QBENCHMARK {
+            local.merge(remote);
+        }
+    }
+
+    void dominates_data() { addOriginRows(); }
+    void dominates() {
+        QFETCH(int, origins);
+        VectorClock local = makeClock(origins, 1);
+        VectorClock remote = makeClock(origins, 0);
+        bool result = false;
+
+        QBENCHMARK {
+            result = local.dominates(remote);
+        }
+        QVERIFY(result);
+    }
+
+    void diff_data() { addOriginRows(); }
+    void diff() {
+        QFETCH(int, origins);
+        VectorClock local = makeClock(origins, 1);
+        VectorClock remote = makeClock(origins, 0);
+
+        QBENCHMARK {
+            QVector<VectorClock::Gap> gaps = local.diff(remote);
+            Q_UNUSED(gaps);
+        }
+    }
+
+    void encode_data() { addOriginRows(); }
+    void encode() {
+        QFETCH(int, origins);
+        VectorClock clock = makeClock(origins, 1);
+
+        QBENCHMARK {
+            QByteArray out;
+            clock.appendEntries(out);
+        }
+    }
+
+    void decode_data() { addOriginRows(); }
+    void decode() {
+        QFETCH(int, origins);
+        VectorClock clock = makeClock(origins, 1);
+        QByteArray encoded;
+        clock.appendEntries(encoded);
+        int entries = clock.entryCount();
+
+        QBENCHMARK {
+            VectorClock decoded;
+            decoded.readEntries(encoded.constData(), encoded.size(), entries);
+        }
+    }
+};
+
+QTEST_MAIN(BenchVectorClock)
+#include "bench_vectorclock.moc"
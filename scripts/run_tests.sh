@@ -32,7 +32,7 @@ fi
 # Build tests
 echo ""
 echo "Building tests..."
-make test_basic
+make -j$(nproc 2>/dev/null || sysctl -n hw.ncpu 2>/dev/null || echo 2)
 
 if [ $? -ne 0 ]; then
     echo "ERROR: Test build failed"
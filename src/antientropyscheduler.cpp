@@ -0,0 +1,91 @@
+#include "antientropyscheduler.h"
+#include <climits>
+#include <cmath>
+
+int AntiEntropyScheduler::startRound() {
+    if (divergent) {
+        current = qMax(static_cast<int>(MIN_INTERVAL), current / 2);
+    } else {
+        current = qMin(static_cast<int>(MAX_INTERVAL), current + current / 2);
+    }
+    divergent = false;
+    return current;
+}
+
+void AntiEntropyScheduler::hurry() {
+    current = MIN_INTERVAL;
+    divergent = true;
+}
+
+NodeIndex AntiEntropyScheduler::choosePeer(const QVector<NodeIndex>& candidates, qint64 now, double random) {
+    if (candidates.isEmpty()) {
+        return NodeRegistry::INVALID_NODE;
+    }
+
+    QVector<double> weights;
+    weights.reserve(candidates.size());
+    double total = 0;
+    for (NodeIndex peer : candidates) {
+        weights.append(weight(peer, now));
+        total += weights.last();
+    }
+
+    int chosen = candidates.size() - 1;
+    double point = random * total;
+    for (int i = 0; i < candidates.size(); ++i) {
+        if (point < weights.at(i)) {
+            chosen = i;
+            break;
+        }
+        point -= weights.at(i);
+    }
+
+    // Assumed in sync until the exchange shows otherwise; a matching digest
+    // root gets no answer at all
+    PeerState& state = peers[candidates.at(chosen)];
+    state.lastExchange = now;
+    state.divergence = 0;
+    return candidates.at(chosen);
+}
+
+void AntiEntropyScheduler::exchanged(NodeIndex peer, qint64 now, int divergence) {
+    auto it = peers.find(peer);
+    if (it == peers.end()) {
+        PeerState state = { now, divergence };
+        peers.insert(peer, state);
+    } else {
+        // A digest round takes several datagrams; they count as one exchange
+        const bool sameRound = now - it.value().lastExchange < MIN_INTERVAL;
+        it.value().divergence = sameRound ? qMax(it.value().divergence, divergence) : divergence;
+        it.value().lastExchange = now;
+    }
+
+    if (divergence > 0) {
+        divergent = true;
+    }
+}
+
+double AntiEntropyScheduler::weight(NodeIndex peer, qint64 now) const {
+    qint64 staleness = MAX_STALENESS;
+    int divergence = 0;
+    auto it = peers.constFind(peer);
+    if (it != peers.constEnd()) {
+        staleness = qBound<qint64>(0, now - it.value().lastExchange, MAX_STALENESS);
+        divergence = it.value().divergence;
+    }
+
+    // A peer just synced keeps a small chance; divergence counts
+    // logarithmically so one far-behind peer cannot starve the rest
+    return (staleness + MIN_INTERVAL) * (1.0 + std::log2(1.0 + divergence));
+}
+
+int AntiEntropyScheduler::divergence(const VectorClock& local, const VectorClock& remote) {
+    qint64 missing = 0;
+    for (const VectorClock::Gap& gap : local.diff(remote)) {
+        missing += gap.to - gap.from;
+    }
+    for (const VectorClock::Gap& gap : remote.diff(local)) {
+        missing += gap.to - gap.from;
+    }
+    return static_cast<int>(qMin<qint64>(missing, INT_MAX));
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <QHash>
+#include <QVector>
+#include "noderegistry.h"
+#include "vectorclock.h"
+
+// When to run the next anti-entropy round, and with whom. The interval
+// halves after a round that found replicas diverging and grows by half
+// after one that found nothing, so a node catches up quickly after a
+// partition heals and costs little once everyone agrees. Peers are chosen
+// at random, weighted by how long ago we last exchanged with them and by
+// how much the last exchange found missing.
+class AntiEntropyScheduler {
+public:
+    static const int MIN_INTERVAL = 250;
+    static const int INITIAL_INTERVAL = 2000;
+    static const int MAX_INTERVAL = 8000;
+    static const int MAX_STALENESS = 30000;  // ms; also what a peer we never exchanged with counts as
+
+    AntiEntropyScheduler() : current(INITIAL_INTERVAL), divergent(false) {}
+
+    int interval() const { return current; }
+    int startRound();  // Adapts the interval to what was found since the last round, and returns it
+    void hurry();  // Divergence is likely, e.g. a peer came back: back to the shortest interval
+
+    // Picks among candidates, random in [0, 1); INVALID_NODE if there are none
+    NodeIndex choosePeer(const QVector<NodeIndex>& candidates, qint64 now, double random);
+    void exchanged(NodeIndex peer, qint64 now, int divergence);  // Messages either side turned out to lack
+    double weight(NodeIndex peer, qint64 now) const;
+    void forget(NodeIndex peer) { peers.remove(peer); }
+
+    // Messages one clock has that the other lacks, both ways
+    static int divergence(const VectorClock& local, const VectorClock& remote);
+
+private:
+    struct PeerState {
+        qint64 lastExchange;
+        int divergence;
+    };
+
+    QHash<NodeIndex, PeerState> peers;
+    int current;
+    bool divergent;  // Some exchange since the round started found a difference
+};
@@ -0,0 +1,134 @@
+#include "broadcasttree.h"
+#include <QtEndian>
+
+bool BroadcastTree::addNeighbor(NodeIndex node) {
+    if (node == NodeRegistry::INVALID_NODE || isNeighbor(node)) {
+        return false;
+    }
+    eagerPeers.insert(node);
+    return true;
+}
+
+void BroadcastTree::removeNeighbor(NodeIndex node) {
+    eagerPeers.remove(node);
+    lazyPeers.remove(node);
+    for (auto it = missing.begin(); it != missing.end(); ++it) {
+        it.value().announcers.removeAll(node);
+    }
+}
+
+bool BroadcastTree::receivedPush(NodeIndex sender, MessageKey key, bool duplicate) {
+    if (!duplicate) {
+        delivered(key);
+        graft(sender);
+        return false;
+    }
+    prune(sender);
+    return true;
+}
+
+void BroadcastTree::prune(NodeIndex node) {
+    if (node == NodeRegistry::INVALID_NODE) {
+        return;
+    }
+    eagerPeers.remove(node);
+    lazyPeers.insert(node);
+}
+
+void BroadcastTree::graft(NodeIndex node) {
+    if (node == NodeRegistry::INVALID_NODE) {
+        return;
+    }
+    lazyPeers.remove(node);
+    eagerPeers.insert(node);
+}
+
+void BroadcastTree::announced(NodeIndex sender, MessageKey key, qint64 now) {
+    // Announcers are neighbors, even if they picked us rather than we them
+    if (!isNeighbor(sender)) {
+        lazyPeers.insert(sender);
+    }
+
+    auto it = missing.find(key);
+    if (it == missing.end()) {
+        if (missing.size() >= MAX_MISSING) {
+            return;  // Anti-entropy will find it
+        }
+        Missing entry;
+        entry.deadline = now + GRAFT_TIMEOUT;
+        it = missing.insert(key, entry);
+    }
+    QVector<NodeIndex>& announcers = it.value().announcers;
+    if (announcers.size() < MAX_ANNOUNCERS && !announcers.contains(sender)) {
+        announcers.append(sender);
+    }
+}
+
+void BroadcastTree::delivered(MessageKey key) {
+    missing.remove(key);
+}
+
+void BroadcastTree::poll(qint64 now, QVector<Graft>& grafts) {
+    for (auto it = missing.begin(); it != missing.end();) {
+        Missing& entry = it.value();
+        if (entry.deadline > now) {
+            ++it;
+            continue;
+        }
+        if (entry.announcers.isEmpty()) {
+            it = missing.erase(it);  // Everyone who had it was tried
+            continue;
+        }
+
+        // The announcer's link becomes part of the tree, replacing whichever
+        // eager link lost the message
+        Graft request;
+        request.peer = entry.announcers.takeFirst();
+        request.key = it.key();
+        graft(request.peer);
+        grafts.append(request);
+        entry.deadline = now + GRAFT_RETRY;
+        ++it;
+    }
+}
+
+QByteArray BroadcastTree::encodeKeys(const QVector<MessageKey>& keys) {
+    QByteArray payload;
+    char buf[4];
+    const int count = qMin(keys.size(), 0xFFFF);
+    qToBigEndian(static_cast<quint16>(count), buf);
+    payload.append(buf, 2);
+    for (int i = 0; i < count; ++i) {
+        const QByteArray id = NodeRegistry::global().name(NodeRegistry::keyNode(keys.at(i))).toUtf8().left(255);
+        payload.append(static_cast<char>(id.size()));
+        payload.append(id);
+        qToBigEndian(NodeRegistry::keySequence(keys.at(i)), buf);
+        payload.append(buf, 4);
+    }
+    return payload;
+}
+
+bool BroadcastTree::decodeKeys(const QByteArray& payload, QVector<MessageKey>& keys) {
+    if (payload.size() < 2) {
+        return false;
+    }
+    const char* data = payload.constData();
+    const int size = payload.size();
+    const int count = qFromBigEndian<quint16>(data);
+    int offset = 2;
+
+    for (int i = 0; i < count; ++i) {
+        if (offset + 1 > size) {
+            return false;
+        }
+        const int idSize = static_cast<quint8>(data[offset++]);
+        if (idSize == 0 || offset + idSize + 4 > size) {
+            return false;
+        }
+        NodeIndex origin = NodeRegistry::global().intern(data + offset, idSize);
+        offset += idSize;
+        keys.append(NodeRegistry::messageKey(origin, qFromBigEndian<quint32>(data + offset)));
+        offset += 4;
+    }
+    return offset == size;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include "noderegistry.h"
+
+// Plumtree epidemic broadcast trees (Leitão, Pereira and Rodrigues). Each
+// node keeps a few neighbors, split into eager ones, which get every
+// broadcast pushed to them in full, and lazy ones, which only hear an IHAVE
+// naming it. The first broadcast floods every link; a node receiving a copy
+// it already has PRUNEs that link to lazy, so the eager links settle into a
+// spanning tree and later broadcasts reach each node once.
+//
+// The lazy links repair the tree: when an announced message has not
+// arrived by eager push within GRAFT_TIMEOUT, the node GRAFTs the
+// announcer, which sends it the message and makes the link eager again.
+//
+// This class is the bookkeeping only; NetworkManager sends the datagrams.
+class BroadcastTree {
+public:
+    struct Graft {
+        NodeIndex peer;
+        MessageKey key;
+    };
+
+    static const int GRAFT_TIMEOUT = 150;  // An announced message may take this long to arrive by eager push
+    static const int GRAFT_RETRY = 75;  // Before the next announcer is grafted
+    static const int MAX_ANNOUNCERS = 8;  // Remembered per missing message
+    static const int MAX_MISSING = 4096;  // Announced messages waited for at once
+    static const int MAX_KEYS = 128;  // Message ids per IHAVE or GRAFT
+
+    bool addNeighbor(NodeIndex node);  // Joins eager; false if already a neighbor
+    void removeNeighbor(NodeIndex node);  // Gone, along with its announcements
+    bool isNeighbor(NodeIndex node) const { return eagerPeers.contains(node) || lazyPeers.contains(node); }
+    bool isEager(NodeIndex node) const { return eagerPeers.contains(node); }
+    int neighborCount() const { return eagerPeers.size() + lazyPeers.size(); }
+    const QSet<NodeIndex>& eager() const { return eagerPeers; }
+    const QSet<NodeIndex>& lazy() const { return lazyPeers; }
+
+    // A pushed copy of key arrived from sender. The first copy puts the link
+    // in the tree; a duplicate moves it out and returns true, so the caller
+    // PRUNEs it on the other side too
+    bool receivedPush(NodeIndex sender, MessageKey key, bool duplicate);
+    void prune(NodeIndex node);  // To lazy
+    void graft(NodeIndex node);  // To eager
+
+    void announced(NodeIndex sender, MessageKey key, qint64 now);  // An IHAVE for a message we lack
+    void delivered(MessageKey key);  // However it arrived, stop waiting for it
+    void poll(qint64 now, QVector<Graft>& grafts);  // Overdue announcements: whom to GRAFT for what
+    bool isWaiting() const { return !missing.isEmpty(); }
+    int missingCount() const { return missing.size(); }
+
+    // IHAVE and GRAFT payloads: [u16 count] then [u8 id length][origin id][u32 sequence] each
+    static QByteArray encodeKeys(const QVector<MessageKey>& keys);
+    static bool decodeKeys(const QByteArray& payload, QVector<MessageKey>& keys);
+
+private:
+    struct Missing {
+        QVector<NodeIndex> announcers;  // Not yet grafted, in the order heard from
+        qint64 deadline;
+    };
+
+    QSet<NodeIndex> eagerPeers;
+    QSet<NodeIndex> lazyPeers;
+    QHash<MessageKey, Missing> missing;
+};
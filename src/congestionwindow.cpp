@@ -0,0 +1,19 @@
+#include "congestionwindow.h"
+
+void CongestionWindow::onAck() {
+    if (size < threshold) {
+        size += 1;
+    } else {
+        size += 1 / size;
+    }
+    size = qMin<double>(size, MAX_WINDOW);
+}
+
+void CongestionWindow::onLoss(quint32 sequenceNumber, quint32 highestSent) {
+    if (sequenceNumber <= recoveryPoint) {
+        return;
+    }
+    threshold = qMax<double>(size / 2, MIN_WINDOW);
+    size = threshold;
+    recoveryPoint = highestSent;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <QtGlobal>
+
+// AIMD congestion window for the direct messages in flight to one peer, after
+// TCP Reno without fast retransmit: slow start grows the window by one message
+// per ACK (doubling it every round trip) up to the threshold, congestion
+// avoidance then adds about one message per round trip, and a retransmission
+// timeout halves it. Losses of messages sent before the last cut belong to the
+// same congestion event and cut nothing more.
+class CongestionWindow {
+public:
+    static const int INITIAL_WINDOW = 4;  // Messages
+    static const int MIN_WINDOW = 2;
+    static const int MAX_WINDOW = 256;  // Also bounds what the receiver may have to reorder
+
+    CongestionWindow() : size(INITIAL_WINDOW), threshold(MAX_WINDOW), recoveryPoint(0) {}
+
+    int window() const { return static_cast<int>(size); }
+    bool canSend(int inFlight) const { return inFlight < window(); }
+    bool inSlowStart() const { return size < threshold; }
+
+    void onAck();
+    // sequenceNumber timed out; highestSent is the newest message in flight
+    void onLoss(quint32 sequenceNumber, quint32 highestSent);
+
+private:
+    double size;
+    double threshold;
+    quint32 recoveryPoint;  // Highest sequence number in flight at the last cut
+};
@@ -0,0 +1,53 @@
+#include "datagramtransport.h"
+#include "mmsgtransport.h"
+#include "uringtransport.h"
+#include <QDebug>
+
+DatagramTransport* DatagramTransport::create(Backend backend, QObject* parent) {
+#ifdef Q_OS_LINUX
+    if (backend == IO_URING) {
+        if (UringTransport::isSupported()) {
+            return new UringTransport(parent);
+        }
+        qDebug() << "io_uring transport unavailable on this kernel, using recvmmsg/sendmmsg";
+        return new MmsgTransport(parent);
+    }
+    if (backend == BATCHED_MMSG) {
+        return new MmsgTransport(parent);
+    }
+#else
+    if (backend != QT_SOCKET) {
+        qDebug() << "Batched socket transports are Linux only, using QUdpSocket";
+    }
+#endif
+    return new UdpSocketTransport(parent);
+}
+
+UdpSocketTransport::UdpSocketTransport(QObject* parent) : DatagramTransport(parent) {
+    receiveBuffer.resize(MAX_DATAGRAM_SIZE);
+    socket = new QUdpSocket(this);
+    connect(socket, &QUdpSocket::readyRead, this, &DatagramTransport::readyRead);
+}
+
+bool UdpSocketTransport::bind(const QHostAddress& address, quint16 port) {
+    return socket->bind(address, port);
+}
+
+int UdpSocketTransport::receive(QVector<Datagram>& out) {
+    out.clear();
+    while (socket->hasPendingDatagrams()) {
+        Datagram datagram;
+        qint64 received = socket->readDatagram(receiveBuffer.data(), receiveBuffer.size(), &datagram.host, &datagram.port);
+        if (received > 0) {
+            datagram.data = receiveBuffer.constData();
+            datagram.size = static_cast<int>(received);
+            out.append(datagram);
+            break;  // The buffer is reused, so one at a time
+        }
+    }
+    return out.size();
+}
+
+bool UdpSocketTransport::send(const QByteArray& datagram, const QHostAddress& host, quint16 port) {
+    return socket->writeDatagram(datagram, host, port) != -1;
+}
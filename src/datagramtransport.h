@@ -0,0 +1,73 @@
+#pragma once
+
+#include <QObject>
+#include <QUdpSocket>
+#include <QHostAddress>
+#include <QByteArray>
+#include <QVector>
+
+// UDP socket as NetworkManager sees it, so the syscall strategy can be
+// chosen at startup. Received datagrams are handed out in batches that point
+// into the transport's own buffers; sends may be queued until flush().
+class DatagramTransport : public QObject {
+    Q_OBJECT
+
+public:
+    enum Backend {
+        QT_SOCKET,  // QUdpSocket, one syscall per datagram
+        BATCHED_MMSG,  // Linux recvmmsg/sendmmsg over buffer rings
+        IO_URING  // Linux io_uring: multishot receive into registered buffers
+    };
+
+    struct Datagram {
+        const char* data;  // Valid until the next receive()
+        int size;
+        QHostAddress host;
+        quint16 port;
+    };
+
+    static const int MAX_DATAGRAM_SIZE = 65536;
+
+    // Falls back to QT_SOCKET where the requested backend is unavailable
+    static DatagramTransport* create(Backend backend, QObject* parent = nullptr);
+
+    explicit DatagramTransport(QObject* parent = nullptr) : QObject(parent) {}
+    virtual ~DatagramTransport() {}
+
+    virtual bool bind(const QHostAddress& address, quint16 port) = 0;
+    virtual bool setReusePort(bool enabled) { return !enabled; }  // Before bind(); false if unsupported
+    virtual void close() = 0;
+    virtual quint16 localPort() const = 0;
+    virtual QString errorString() const = 0;
+    virtual Backend backend() const = 0;
+
+    // Reads pending datagrams into out, replacing its contents; 0 when drained
+    virtual int receive(QVector<Datagram>& out) = 0;
+    virtual bool send(const QByteArray& datagram, const QHostAddress& host, quint16 port) = 0;
+    virtual void flush() {}  // Push out anything send() queued
+
+signals:
+    void readyRead();
+};
+
+// Plain QUdpSocket: every send goes out immediately and receive() returns one
+// datagram per call.
+class UdpSocketTransport : public DatagramTransport {
+    Q_OBJECT
+
+public:
+    explicit UdpSocketTransport(QObject* parent = nullptr);
+
+    bool bind(const QHostAddress& address, quint16 port) override;
+    void close() override { socket->close(); }
+    quint16 localPort() const override { return socket->localPort(); }
+    QString errorString() const override { return socket->errorString(); }
+    Backend backend() const override { return QT_SOCKET; }
+
+    int receive(QVector<Datagram>& out) override;
+    bool send(const QByteArray& datagram, const QHostAddress& host, quint16 port) override;
+
+private:
+    QUdpSocket* socket;
+    QByteArray receiveBuffer;  // Reused for every datagram read
+};
@@ -0,0 +1,392 @@
+#include "digesttree.h"
+#include <QtEndian>
+#include <QSet>
+#include <climits>
+
+namespace {
+// Bits per level of the tree: log2(FANOUT)
+const int FANOUT_BITS = 4;
+
+void appendName(QByteArray& out, const QString& name) {
+    QByteArray utf8 = name.toUtf8();
+    char buf[2];
+    qToBigEndian(static_cast<quint16>(utf8.size()), buf);
+    out.append(buf, 2);
+    out.append(utf8);
+}
+
+template <typename T>
+void appendInt(QByteArray& out, T value) {
+    char buf[sizeof(T)];
+    qToBigEndian(value, buf);
+    out.append(buf, sizeof(T));
+}
+
+// Sequential big-endian reader that turns any overrun into a sticky failure
+struct Reader {
+    const char* data;
+    int size;
+    int offset = 0;
+    bool ok = true;
+
+    bool need(int bytes) {
+        ok = ok && size - offset >= bytes;
+        return ok;
+    }
+    template <typename T>
+    T read() {
+        if (!need(sizeof(T))) {
+            return 0;
+        }
+        T value = qFromBigEndian<T>(data + offset);
+        offset += sizeof(T);
+        return value;
+    }
+    QString readName() {
+        int length = read<quint16>();
+        if (!need(length)) {
+            return QString();
+        }
+        QString name = QString::fromUtf8(data + offset, length);
+        offset += length;
+        return name;
+    }
+};
+
+// FNV-1a, 64-bit
+void fnv(quint64& hash, const char* data, int size) {
+    for (int i = 0; i < size; ++i) {
+        hash ^= static_cast<uchar>(data[i]);
+        hash *= 1099511628211ull;
+    }
+}
+}
+
+QByteArray DigestPayload::encode() const {
+    QByteArray out;
+    out.append(static_cast<char>(kind));
+    if (kind == ROOT) {
+        appendInt<quint64>(out, root);
+        out.append(static_cast<char>(height));
+        return out;
+    }
+
+    appendInt<quint16>(out, static_cast<quint16>(nodes.size()));
+    for (const Node& node : nodes) {
+        appendName(out, node.origin);
+        out.append(static_cast<char>(node.level));
+        appendInt<quint32>(out, node.index);
+        appendInt<quint64>(out, node.digest);
+    }
+    appendInt<quint16>(out, static_cast<quint16>(leaves.size()));
+    for (const Leaf& leaf : leaves) {
+        appendName(out, leaf.origin);
+        appendInt<quint32>(out, leaf.index);
+        appendInt<quint64>(out, leaf.bitmap);
+        out.append(static_cast<char>(leaf.final ? 1 : 0));
+    }
+    return out;
+}
+
+bool DigestPayload::decode(const QByteArray& data, DigestPayload& out) {
+    Reader in{data.constData(), data.size()};
+    out = DigestPayload();
+
+    quint8 kind = in.read<quint8>();
+    if (!in.ok || kind > DESCEND) {
+        return false;
+    }
+    out.kind = static_cast<Kind>(kind);
+    if (out.kind == ROOT) {
+        out.root = in.read<quint64>();
+        out.height = in.read<quint8>();
+        return in.ok && out.height <= DigestTree::MAX_HEIGHT;
+    }
+
+    int nodeCount = in.read<quint16>();
+    for (int i = 0; i < nodeCount && in.ok; ++i) {
+        Node node;
+        node.origin = in.readName();
+        node.level = in.read<quint8>();
+        node.index = in.read<quint32>();
+        node.digest = in.read<quint64>();
+        if (node.level > DigestTree::MAX_HEIGHT) {
+            return false;
+        }
+        out.nodes.append(node);
+    }
+    int leafCount = in.read<quint16>();
+    for (int i = 0; i < leafCount && in.ok; ++i) {
+        Leaf leaf;
+        leaf.origin = in.readName();
+        leaf.index = in.read<quint32>();
+        leaf.bitmap = in.read<quint64>();
+        leaf.final = in.read<quint8>() != 0;
+        out.leaves.append(leaf);
+    }
+    return in.ok;
+}
+
+quint64 DigestTree::hashMessage(const Message& message) {
+    // Must agree across processes, so no qHash (it is seeded per process)
+    quint64 hash = 14695981039346656037ull;
+    QByteArray origin = message.getOrigin().toUtf8();
+    fnv(hash, origin.constData(), origin.size());
+    char seq[4];
+    qToBigEndian(static_cast<quint32>(message.getSequenceNumber()), seq);
+    fnv(hash, seq, 4);
+    QByteArray destination = message.getDestination().toUtf8();
+    fnv(hash, destination.constData(), destination.size());
+    QByteArray text = message.getChatText().toUtf8();
+    fnv(hash, text.constData(), text.size());
+
+    // splitmix64 finalizer, so sums of hashes don't cancel along FNV's weak bits
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ull;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebull;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+void DigestTree::add(NodeIndex origin, const Message& message) {
+    const quint32 seq = static_cast<quint32>(message.getSequenceNumber());
+    if (seq == 0) {
+        return;
+    }
+    addToLeaf(origin, (seq - 1) / LEAF_SPAN, hashMessage(message));
+}
+
+void DigestTree::addToLeaf(NodeIndex origin, quint32 leaf, quint64 hash) {
+    OriginTree& tree = trees[origin];
+    if (tree.levels.isEmpty()) {
+        tree.levels.append(QVector<quint64>());
+    }
+
+    // Grow upwards until the top level is a single node covering this leaf
+    while ((leaf >> (FANOUT_BITS * (tree.levels.size() - 1))) > 0) {
+        const QVector<quint64>& top = tree.levels.last();
+        QVector<quint64> parent((top.size() + FANOUT - 1) / FANOUT);
+        for (int i = 0; i < top.size(); ++i) {
+            parent[i / FANOUT] += top.at(i);
+        }
+        if (parent.isEmpty()) {
+            parent.append(0);
+        }
+        tree.levels.append(parent);
+    }
+
+    for (int level = 0; level < tree.levels.size(); ++level) {
+        QVector<quint64>& nodes = tree.levels[level];
+        const int index = static_cast<int>(leaf >> (FANOUT_BITS * level));
+        if (index >= nodes.size()) {
+            nodes.resize(index + 1);
+        }
+        nodes[index] += hash;
+    }
+    tree.total += hash;
+    rootDigest += hash;
+}
+
+void DigestTree::merge(const DigestTree& other) {
+    for (auto it = other.trees.constBegin(); it != other.trees.constEnd(); ++it) {
+        const QVector<quint64>& leaves = it.value().levels.value(0);
+        for (int i = 0; i < leaves.size(); ++i) {
+            if (leaves.at(i) != 0) {
+                addToLeaf(it.key(), static_cast<quint32>(i), leaves.at(i));
+            }
+        }
+    }
+}
+
+QByteArray DigestTree::encodeLeaves() const {
+    QByteArray out;
+    appendInt<quint16>(out, static_cast<quint16>(trees.size()));
+    for (auto it = trees.constBegin(); it != trees.constEnd(); ++it) {
+        const QVector<quint64>& leaves = it.value().levels.value(0);
+        appendName(out, NodeRegistry::global().name(it.key()));
+        appendInt<quint32>(out, static_cast<quint32>(leaves.size()));
+        for (quint64 leaf : leaves) {
+            appendInt<quint64>(out, leaf);
+        }
+    }
+    return out;
+}
+
+bool DigestTree::decodeLeaves(const QByteArray& data, DigestTree& out) {
+    Reader in{data.constData(), data.size()};
+    out.clear();
+    int originCount = in.read<quint16>();
+    for (int i = 0; i < originCount && in.ok; ++i) {
+        const NodeIndex origin = NodeRegistry::global().intern(in.readName());
+        const quint32 leafCount = in.read<quint32>();
+        if (!in.need(static_cast<int>(qMin<quint64>(quint64(leafCount) * 8, INT_MAX)))) {
+            break;
+        }
+        for (quint32 leaf = 0; leaf < leafCount; ++leaf) {
+            const quint64 sum = in.read<quint64>();
+            if (sum != 0) {
+                out.addToLeaf(origin, leaf, sum);
+            }
+        }
+    }
+    if (!in.ok) {
+        out.clear();
+    }
+    return in.ok;
+}
+
+void DigestTree::clear() {
+    trees.clear();
+    rootDigest = 0;
+}
+
+int DigestTree::height() const {
+    int result = 0;
+    for (auto it = trees.constBegin(); it != trees.constEnd(); ++it) {
+        result = qMax(result, it.value().levels.size() - 1);
+    }
+    return result;
+}
+
+int DigestTree::height(NodeIndex origin) const {
+    auto it = trees.constFind(origin);
+    return it != trees.constEnd() ? it.value().levels.size() - 1 : 0;
+}
+
+quint64 DigestTree::digest(NodeIndex origin, int level, quint32 index) const {
+    auto it = trees.constFind(origin);
+    if (it == trees.constEnd()) {
+        return 0;
+    }
+    const OriginTree& tree = it.value();
+    if (level >= tree.levels.size()) {
+        // Above the top: node 0 still covers everything, the rest nothing
+        return index == 0 ? tree.total : 0;
+    }
+    return tree.levels.at(level).value(static_cast<int>(index));
+}
+
+quint32 DigestTree::firstSequence(int level, quint32 index) {
+    const int shift = 6 + FANOUT_BITS * level;  // log2(LEAF_SPAN) + log2(FANOUT) * level
+    if ((quint64(index) << shift) >= 0xFFFFFFFFull) {
+        return 0xFFFFFFFFu;
+    }
+    return static_cast<quint32>((quint64(index) << shift) + 1);
+}
+
+quint32 DigestTree::lastSequence(int level, quint32 index) {
+    const int shift = 6 + FANOUT_BITS * level;
+    return static_cast<quint32>(qMin<quint64>((quint64(index) + 1) << shift, 0xFFFFFFFFull));
+}
+
+quint64 DigestTree::leafBitmap(NodeIndex origin, quint32 index, const VectorClock& clock) {
+    const quint32 first = firstSequence(0, index);
+    if (clock.value(origin) >= lastSequence(0, index)) {
+        return ~quint64(0);
+    }
+    quint64 bitmap = 0;
+    for (int bit = 0; bit < LEAF_SPAN; ++bit) {
+        if (clock.contains(origin, first + bit)) {
+            bitmap |= quint64(1) << bit;
+        }
+    }
+    return bitmap;
+}
+
+void DigestTree::pushBits(NodeIndex origin, quint32 index, quint64 bits, QVector<VectorClock::Gap>& push) {
+    const quint32 first = firstSequence(0, index);
+    int bit = 0;
+    while (bit < LEAF_SPAN) {
+        if (!(bits & (quint64(1) << bit))) {
+            ++bit;
+            continue;
+        }
+        int end = bit;
+        while (end < LEAF_SPAN && (bits & (quint64(1) << end))) {
+            ++end;
+        }
+        push.append({origin, first + bit - 1, first + end - 1});
+        bit = end;
+    }
+}
+
+void DigestTree::answerNode(const DigestPayload::Node& node, const VectorClock& clock,
+                            DigestPayload& reply, QVector<VectorClock::Gap>& push) const {
+    const NodeIndex origin = NodeRegistry::global().intern(node.origin);
+    const quint64 ours = digest(origin, node.level, node.index);
+    if (ours == node.digest) {
+        return;
+    }
+
+    if (node.digest == 0) {
+        // They have nothing under this node: send all of ours
+        const quint32 first = firstSequence(node.level, node.index);
+        const quint32 last = qMin(lastSequence(node.level, node.index), clock.highest(origin));
+        if (last >= first) {
+            push.append({origin, first - 1, last});
+        }
+        return;
+    }
+    if (ours == 0) {
+        // We have nothing: an empty node makes them send all of theirs
+        reply.nodes.append({node.origin, node.level, node.index, 0});
+        return;
+    }
+    if (node.level == 0) {
+        reply.leaves.append({node.origin, node.index, leafBitmap(origin, node.index, clock), false});
+        return;
+    }
+
+    const int childLevel = node.level - 1;
+    for (quint32 child = 0; child < static_cast<quint32>(FANOUT); ++child) {
+        const quint32 index = node.index * FANOUT + child;
+        reply.nodes.append({node.origin, childLevel, index, digest(origin, childLevel, index)});
+    }
+}
+
+void DigestTree::answer(const DigestPayload& incoming, const VectorClock& clock,
+                        DigestPayload& reply, QVector<VectorClock::Gap>& push) const {
+    reply = DigestPayload();
+    reply.root = rootDigest;
+    reply.height = height();
+
+    if (incoming.kind == DigestPayload::ROOT) {
+        if (incoming.root == rootDigest) {
+            return;
+        }
+        // Start at a level that is at or above the top of both trees, so node 0
+        // covers every message of the origin on either side
+        reply.kind = DigestPayload::ORIGINS;
+        for (auto it = trees.constBegin(); it != trees.constEnd(); ++it) {
+            const int level = qMax(incoming.height, it.value().levels.size() - 1);
+            reply.nodes.append({NodeRegistry::global().name(it.key()), level, 0, it.value().total});
+        }
+        return;
+    }
+
+    reply.kind = DigestPayload::DESCEND;
+    QSet<NodeIndex> listed;
+    for (const DigestPayload::Node& node : incoming.nodes) {
+        answerNode(node, clock, reply, push);
+        listed.insert(NodeRegistry::global().intern(node.origin));
+    }
+
+    if (incoming.kind == DigestPayload::ORIGINS) {
+        // ORIGINS lists every origin the peer has; the rest it lacks entirely
+        for (auto it = trees.constBegin(); it != trees.constEnd(); ++it) {
+            if (!listed.contains(it.key()) && clock.highest(it.key()) > 0) {
+                push.append({it.key(), 0, clock.highest(it.key())});
+            }
+        }
+    }
+
+    for (const DigestPayload::Leaf& leaf : incoming.leaves) {
+        const NodeIndex origin = NodeRegistry::global().intern(leaf.origin);
+        const quint64 mine = leafBitmap(origin, leaf.index, clock);
+        pushBits(origin, leaf.index, mine & ~leaf.bitmap, push);
+        if (!leaf.final && (leaf.bitmap & ~mine)) {
+            reply.leaves.append({leaf.origin, leaf.index, mine, true});
+        }
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <QVector>
+#include <QHash>
+#include <QString>
+#include <QByteArray>
+#include "message.h"
+
+// Body of an ANTI_ENTROPY_DIGEST message.
+//
+// ROOT opens a round with the sender's root digest and tree height. A peer
+// whose root differs answers ORIGINS: the top node of every origin it has.
+// From then on both sides answer DESCEND, listing the children of each node
+// whose digest differed, or for leaves a bitmap of the sequence numbers held.
+struct DigestPayload {
+    enum Kind {
+        ROOT,
+        ORIGINS,
+        DESCEND
+    };
+
+    struct Node {
+        QString origin;
+        int level;
+        quint32 index;
+        quint64 digest;
+    };
+
+    struct Leaf {
+        QString origin;
+        quint32 index;
+        quint64 bitmap;  // Bit i set: sequence number first(index) + i is held
+        bool final;  // Answer to a leaf bitmap; push only, don't reply
+    };
+
+    Kind kind = ROOT;
+    quint64 root = 0;
+    int height = 0;
+    QVector<Node> nodes;
+    QVector<Leaf> leaves;
+
+    bool isEmpty() const { return nodes.isEmpty() && leaves.isEmpty(); }
+
+    // [1-byte kind], then for ROOT [8-byte root][1-byte height], otherwise
+    // [2-byte node count] nodes as [2-byte name length][name][1-byte level][4-byte index][8-byte digest],
+    // [2-byte leaf count] leaves as [2-byte name length][name][4-byte index][8-byte bitmap][1-byte final]
+    QByteArray encode() const;
+    static bool decode(const QByteArray& data, DigestPayload& out);
+};
+
+// Hash tree over every message received, per origin, used to find where two
+// replicas differ without exchanging their vector clocks.
+//
+// Leaves cover LEAF_SPAN consecutive sequence numbers and each interior node
+// covers FANOUT children. A node's digest is the sum (mod 2^64) of the hashes
+// of the messages under it, so adding a message touches one node per level
+// and needs no rehashing of siblings. Message hashes depend only on the
+// message's content, so equal sets of messages give equal digests on every
+// node. The tree is independent of the MessageLog: compacted messages stay
+// counted.
+class DigestTree {
+public:
+    static const int LEAF_SPAN = 64;  // Sequence numbers per leaf; one bitmap word
+    static const int FANOUT = 16;
+    static const int MAX_HEIGHT = 7;  // A level-7 node spans more than 2^32 sequence numbers
+
+    void add(NodeIndex origin, const Message& message);
+    void merge(const DigestTree& other);  // Counts other's messages here too
+    void clear();
+
+    // The leaf digests only, enough to rebuild the tree: [2-byte origin count]
+    // origins as [2-byte name length][name][4-byte leaf count][8-byte digest per leaf]
+    QByteArray encodeLeaves() const;
+    static bool decodeLeaves(const QByteArray& data, DigestTree& out);
+
+    quint64 root() const { return rootDigest; }
+    int height() const;  // Tallest origin tree
+    int height(NodeIndex origin) const;  // Level whose node 0 covers everything from origin
+    quint64 digest(NodeIndex origin, int level, quint32 index) const;
+    QList<NodeIndex> origins() const { return trees.keys(); }
+
+    // Sequence numbers covered by a node, inclusive
+    static quint32 firstSequence(int level, quint32 index);
+    static quint32 lastSequence(int level, quint32 index);
+
+    // Answer an incoming digest message. reply is what to send back (may be
+    // empty), push lists the ranges of our messages the peer lacks outright.
+    void answer(const DigestPayload& incoming, const VectorClock& clock,
+                DigestPayload& reply, QVector<VectorClock::Gap>& push) const;
+
+    static quint64 hashMessage(const Message& message);
+
+private:
+    struct OriginTree {
+        QVector<QVector<quint64>> levels;  // levels[0] = leaves
+        quint64 total = 0;
+    };
+
+    void addToLeaf(NodeIndex origin, quint32 leaf, quint64 hash);
+    static quint64 leafBitmap(NodeIndex origin, quint32 index, const VectorClock& clock);
+    static void pushBits(NodeIndex origin, quint32 index, quint64 bits, QVector<VectorClock::Gap>& push);
+    void answerNode(const DigestPayload::Node& node, const VectorClock& clock,
+                    DigestPayload& reply, QVector<VectorClock::Gap>& push) const;
+
+    QHash<NodeIndex, OriginTree> trees;
+    quint64 rootDigest = 0;
+};
@@ -0,0 +1,702 @@
+#include "durablelog.h"
+#include "messageview.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStringList>
+#include <QDebug>
+#include <QtEndian>
+#include <QVector>
+#include <algorithm>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+namespace {
+const char CHECKPOINT_MAGIC[4] = {'S', 'C', 'C', 'P'};
+const quint32 CHECKPOINT_VERSION = 2;  // 1 had no stability frontier
+const char COMPACTION_MAGIC[4] = {'S', 'C', 'C', 'M'};
+const quint32 COMPACTION_VERSION = 1;
+
+void appendUInt16(QByteArray& out, quint16 value) {
+    char buf[2];
+    qToBigEndian(value, buf);
+    out.append(buf, 2);
+}
+
+void appendUInt32(QByteArray& out, quint32 value) {
+    char buf[4];
+    qToBigEndian(value, buf);
+    out.append(buf, 4);
+}
+
+void appendUInt64(QByteArray& out, quint64 value) {
+    char buf[8];
+    qToBigEndian(value, buf);
+    out.append(buf, 8);
+}
+
+void appendClock(QByteArray& out, const VectorClock& clock) {
+    appendUInt16(out, static_cast<quint16>(clock.entryCount()));
+    clock.appendEntries(out);
+}
+
+// Reads a clock written by appendClock; bytes consumed, or -1 if malformed
+int readClock(const char* data, int size, VectorClock& clock) {
+    if (size < 2) {
+        return -1;
+    }
+    const int entries = qFromBigEndian<quint16>(data);
+    const int consumed = clock.readEntries(data + 2, size - 2, entries);
+    return consumed < 0 ? -1 : consumed + 2;
+}
+
+// CRC-32 (IEEE 802.3, reflected), as used by zlib
+quint32 crc32(const char* data, qint64 size) {
+    static const QVector<quint32> table = [] {
+        QVector<quint32> t(256);
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 c = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+            }
+            t[static_cast<int>(i)] = c;
+        }
+        return t;
+    }();
+
+    quint32 crc = 0xFFFFFFFFu;
+    const uchar* bytes = reinterpret_cast<const uchar*>(data);
+    for (qint64 i = 0; i < size; ++i) {
+        crc = table.at((crc ^ bytes[i]) & 0xFF) ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+bool syncToDisk(QFile& file) {
+#ifdef Q_OS_UNIX
+    return ::fsync(file.handle()) == 0;
+#else
+    Q_UNUSED(file);
+    return true;  // QFile::flush() is as far as Qt goes portably
+#endif
+}
+}
+
+DurableLog::DurableLog() : segmentBytes(0), tailScanned(true), segmentLimit(SEGMENT_SIZE) {}
+
+DurableLog::~DurableLog() {
+    close();
+}
+
+bool DurableLog::open(const QString& path) {
+    close();
+
+    if (!QDir().mkpath(path)) {
+        qDebug() << "Durable log: cannot create" << path;
+        return false;
+    }
+    directory = path;
+
+    QDir dir(path);
+    QList<int> numbers;
+    for (const QString& name : dir.entryList(QStringList() << "*.log", QDir::Files)) {
+        bool ok = false;
+        int segment = QFileInfo(name).completeBaseName().toInt(&ok);
+        if (ok) {
+            numbers.append(segment);
+        }
+    }
+    std::sort(numbers.begin(), numbers.end());
+    if (numbers.isEmpty()) {
+        numbers.append(0);
+    }
+
+    for (int number : numbers) {
+        Segment segment;
+        segment.number = number;
+        const qint64 size = QFileInfo(segmentPath(number)).size();
+        loadIndex(segment, size);
+        segment.sealed = indexedEnd(segment) == size;
+        segments.append(segment);
+    }
+
+    // New records go to the last segment, after whatever of it is not indexed yet
+    Segment& last = segments.last();
+    last.sealed = false;
+    current = Chunk();
+    current.start = current.end = indexedEnd(last);
+    tailScanned = current.end == QFileInfo(segmentPath(last.number)).size();
+    return true;
+}
+
+void DurableLog::close() {
+    segmentFile.close();
+    directory.clear();
+    segments.clear();
+    pending.clear();
+    pendingOrigins.clear();
+    current = Chunk();
+    tailScanned = true;
+    segmentBytes = 0;
+    savedCompacted = VectorClock();
+}
+
+QString DurableLog::segmentPath(int segment) const {
+    return QDir(directory).filePath(QString("%1.log").arg(segment, 8, 10, QChar('0')));
+}
+
+QString DurableLog::indexPath(int segment) const {
+    return QDir(directory).filePath(QString("%1.idx").arg(segment, 8, 10, QChar('0')));
+}
+
+QString DurableLog::checkpointPath() const {
+    return QDir(directory).filePath("checkpoint");
+}
+
+QString DurableLog::compactionPath() const {
+    return QDir(directory).filePath("compacted");
+}
+
+qint64 DurableLog::forEachRecord(const uchar* base, qint64 from, qint64 to, bool verify, const RecordVisitor& visit) {
+    qint64 offset = from;
+    while (to - offset >= RECORD_HEADER_SIZE) {
+        const uchar* record = base + offset;
+        const quint32 length = qFromBigEndian<quint32>(record);
+        if (length == 0 || length > to - offset - RECORD_HEADER_SIZE) {
+            break;
+        }
+
+        const char* payload = reinterpret_cast<const char*>(record + RECORD_HEADER_SIZE);
+        if (verify && crc32(payload, length) != qFromBigEndian<quint32>(record + 4)) {
+            break;
+        }
+
+        MessageView view(payload, static_cast<int>(length));
+        if (!view.isValid() || view.getSequenceNumber() <= 0 || view.originSize() == 0) {
+            break;
+        }
+        visit(NodeRegistry::global().intern(view.originData(), view.originSize()),
+              static_cast<quint32>(view.getSequenceNumber()), view);
+        offset += RECORD_HEADER_SIZE + length;
+    }
+    return offset;
+}
+
+void DurableLog::extend(OriginBounds& bounds, NodeIndex origin, quint32 sequence) {
+    auto it = bounds.find(origin);
+    if (it == bounds.end()) {
+        Bounds range = { sequence, sequence };
+        bounds.insert(origin, range);
+    } else {
+        it.value().first = qMin(it.value().first, sequence);
+        it.value().last = qMax(it.value().last, sequence);
+    }
+}
+
+bool DurableLog::covers(const VectorClock& frontier, const OriginBounds& bounds) {
+    for (auto it = bounds.constBegin(); it != bounds.constEnd(); ++it) {
+        if (it.value().last > frontier.value(it.key())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int DurableLog::recover(MessageLog& store, Checkpoint& checkpoint) {
+    if (!isOpen()) {
+        return 0;
+    }
+
+    loadCheckpoint(checkpoint);
+    loadCompaction(checkpoint);
+    dropCompactedSegments(checkpoint.compacted);
+
+    int replayed = 0;
+    for (int i = 0; i < segments.size(); ++i) {
+        replayed += replaySegment(segments[i], store, checkpoint.clock, checkpoint.compacted, i == segments.size() - 1);
+    }
+
+    // Compacted messages still count as held, as they did before the restart
+    for (const VectorClock::Gap& prefix : checkpoint.compacted.diff(VectorClock())) {
+        store.skipThrough(prefix.node, prefix.to);
+    }
+    return replayed;
+}
+
+int DurableLog::replaySegment(Segment& segment, MessageLog& store, VectorClock& clock, const VectorClock& compacted,
+                              bool isLast) {
+    QFile file(segmentPath(segment.number));
+    if (!file.exists()) {
+        return 0;
+    }
+    if (!file.open(QIODevice::ReadWrite)) {
+        qDebug() << "Durable log: cannot open" << file.fileName() << ":" << file.errorString();
+        return 0;
+    }
+
+    const qint64 size = file.size();
+    Chunk tail;
+    tail.start = tail.end = indexedEnd(segment);
+    int replayed = 0;
+
+    if (size > 0) {
+        uchar* base = file.map(0, size);
+        if (!base) {
+            qDebug() << "Durable log: cannot map" << file.fileName() << ":" << file.errorString();
+            return 0;
+        }
+
+        auto replay = [&](NodeIndex origin, quint32 sequence, const MessageView& record) {
+            clock.insert(origin, sequence);
+            if (sequence > compacted.value(origin) && store.insert(origin, record.toMessage())) {
+                ++replayed;
+            }
+        };
+
+        // Indexed stretches were synced before their entry was written, so
+        // they skip the CRC check, and those wholly compacted are not read at all
+        for (const Chunk& chunk : segment.chunks) {
+            if (!covers(compacted, chunk.origins)) {
+                forEachRecord(base, chunk.start, chunk.end, false, replay);
+            }
+        }
+
+        tail.end = forEachRecord(base, tail.start, size, true,
+                                 [&](NodeIndex origin, quint32 sequence, const MessageView& record) {
+                                     extend(tail.origins, origin, sequence);
+                                     replay(origin, sequence, record);
+                                 });
+        file.unmap(base);
+    }
+
+    if (tail.end < size) {
+        qDebug() << "Durable log:" << (size - tail.end) << "unreadable bytes at the end of" << file.fileName();
+        if (isLast) {
+            // A torn final write; cut it off so new records follow the last good one
+            file.resize(tail.end);
+        }
+    }
+
+    if (isLast) {
+        current = tail;
+        tailScanned = true;
+    } else if (tail.end > tail.start) {
+        appendIndexEntry(segment, tail);  // So the next recovery need not verify it again
+        segment.sealed = tail.end == size;
+    }
+    return replayed;
+}
+
+void DurableLog::loadIndex(Segment& segment, qint64 fileSize) {
+    QFile index(indexPath(segment.number));
+    if (!index.exists() || !index.open(QIODevice::ReadWrite)) {
+        return;
+    }
+
+    const QByteArray entries = index.readAll();
+    const char* data = entries.constData();
+    int offset = 0;
+    qint64 expectedStart = 0;
+    while (entries.size() - offset >= 8) {
+        const quint32 length = qFromBigEndian<quint32>(data + offset);
+        if (length < 18 || length > static_cast<quint32>(entries.size() - offset - 8) ||
+            crc32(data + offset + 8, length) != qFromBigEndian<quint32>(data + offset + 4)) {
+            break;  // Torn or damaged; recovery verifies what it covered instead
+        }
+
+        const char* body = data + offset + 8;
+        Chunk chunk;
+        chunk.start = static_cast<qint64>(qFromBigEndian<quint64>(body));
+        chunk.end = static_cast<qint64>(qFromBigEndian<quint64>(body + 8));
+        if (chunk.start != expectedStart || chunk.end <= chunk.start || chunk.end > fileSize) {
+            break;
+        }
+
+        const int origins = qFromBigEndian<quint16>(body + 16);
+        int position = 18;
+        bool ok = true;
+        for (int i = 0; i < origins && ok; ++i) {
+            if (position + 2 > static_cast<int>(length)) {
+                ok = false;
+                break;
+            }
+            const int nameLength = qFromBigEndian<quint16>(body + position);
+            position += 2;
+            if (position + nameLength + 8 > static_cast<int>(length)) {
+                ok = false;
+                break;
+            }
+            NodeIndex origin = NodeRegistry::global().intern(body + position, nameLength);
+            position += nameLength;
+            Bounds bounds = { qFromBigEndian<quint32>(body + position), qFromBigEndian<quint32>(body + position + 4) };
+            position += 8;
+            chunk.origins.insert(origin, bounds);
+        }
+        if (!ok) {
+            break;
+        }
+
+        for (auto it = chunk.origins.constBegin(); it != chunk.origins.constEnd(); ++it) {
+            extend(segment.origins, it.key(), it.value().first);
+            extend(segment.origins, it.key(), it.value().last);
+        }
+        segment.chunks.append(chunk);
+        expectedStart = chunk.end;
+        offset += 8 + static_cast<int>(length);
+    }
+
+    if (offset < entries.size()) {
+        index.resize(offset);  // Later entries must follow on from the last usable one
+    }
+}
+
+qint64 DurableLog::indexedEnd(const Segment& segment) const {
+    return segment.chunks.isEmpty() ? 0 : segment.chunks.last().end;
+}
+
+/*
+ * Sparse index entry layout (big-endian):
+ *   4-byte body length, 4-byte CRC-32 of the body, then the body: 8-byte
+ *   start and end offsets of the stretch, 2-byte origin count, and per origin
+ *   a 2-byte name length, the name, and the 4-byte lowest and highest
+ *   sequence numbers it has in the stretch.
+ */
+bool DurableLog::appendIndexEntry(Segment& segment, const Chunk& chunk) {
+    segment.chunks.append(chunk);
+    for (auto it = chunk.origins.constBegin(); it != chunk.origins.constEnd(); ++it) {
+        extend(segment.origins, it.key(), it.value().first);
+        extend(segment.origins, it.key(), it.value().last);
+    }
+
+    QByteArray body;
+    appendUInt64(body, static_cast<quint64>(chunk.start));
+    appendUInt64(body, static_cast<quint64>(chunk.end));
+    appendUInt16(body, static_cast<quint16>(chunk.origins.size()));
+    NodeRegistry& registry = NodeRegistry::global();
+    for (auto it = chunk.origins.constBegin(); it != chunk.origins.constEnd(); ++it) {
+        const QByteArray name = registry.name(it.key()).toUtf8();
+        appendUInt16(body, static_cast<quint16>(name.size()));
+        body.append(name);
+        appendUInt32(body, it.value().first);
+        appendUInt32(body, it.value().last);
+    }
+
+    QByteArray entry;
+    appendUInt32(entry, static_cast<quint32>(body.size()));
+    appendUInt32(entry, crc32(body.constData(), body.size()));
+    entry.append(body);
+
+    // Not fsynced: losing an entry only means recovery reads and verifies its stretch
+    QFile index(indexPath(segment.number));
+    if (!index.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        return false;
+    }
+    return index.write(entry) == entry.size();
+}
+
+void DurableLog::sealChunk() {
+    if (current.end > current.start) {
+        appendIndexEntry(segments.last(), current);
+    }
+    const qint64 end = current.end;
+    current = Chunk();
+    current.start = current.end = end;
+}
+
+void DurableLog::dropCompactedSegments(const VectorClock& compacted) {
+    if (compacted.isEmpty()) {
+        return;
+    }
+
+    // Never the last segment: it is still being written
+    for (int i = 0; i < segments.size() - 1;) {
+        const Segment& segment = segments.at(i);
+        if (!segment.sealed || !covers(compacted, segment.origins)) {
+            ++i;
+            continue;
+        }
+        qDebug() << "Durable log: deleting compacted segment" << segmentPath(segment.number);
+        QFile::remove(segmentPath(segment.number));
+        QFile::remove(indexPath(segment.number));
+        segments.remove(i);
+    }
+}
+
+QList<Message> DurableLog::range(NodeIndex origin, quint32 after, quint32 upTo, int limit) const {
+    QList<Message> found;
+    if (!isOpen() || upTo <= after || limit <= 0) {
+        return found;
+    }
+
+    auto overlaps = [&](const OriginBounds& bounds) {
+        auto it = bounds.constFind(origin);
+        return it != bounds.constEnd() && it.value().last > after && it.value().first <= upTo;
+    };
+
+    for (int i = 0; i < segments.size() && found.size() < limit; ++i) {
+        const Segment& segment = segments.at(i);
+        QVector<Chunk> chunks;
+        for (const Chunk& chunk : segment.chunks) {
+            if (overlaps(chunk.origins)) {
+                chunks.append(chunk);
+            }
+        }
+        if (i == segments.size() - 1 && overlaps(current.origins)) {
+            chunks.append(current);
+        }
+        if (chunks.isEmpty()) {
+            continue;
+        }
+
+        QFile file(segmentPath(segment.number));
+        const qint64 size = file.size();
+        uchar* base = file.open(QIODevice::ReadOnly) && size > 0 ? file.map(0, size) : nullptr;
+        if (!base) {
+            continue;
+        }
+        for (const Chunk& chunk : chunks) {
+            forEachRecord(base, chunk.start, qMin(chunk.end, size), false,
+                          [&](NodeIndex recordOrigin, quint32 sequence, const MessageView& record) {
+                              if (recordOrigin == origin && sequence > after && sequence <= upTo) {
+                                  found.append(record.toMessage());
+                              }
+                          });
+        }
+        file.unmap(base);
+    }
+
+    std::sort(found.begin(), found.end(), [](const Message& a, const Message& b) {
+        return a.getSequenceNumber() < b.getSequenceNumber();
+    });
+    auto last = std::unique(found.begin(), found.end(), [](const Message& a, const Message& b) {
+        return a.getSequenceNumber() == b.getSequenceNumber();
+    });
+    found.erase(last, found.end());
+    while (found.size() > limit) {
+        found.removeLast();
+    }
+    return found;
+}
+
+void DurableLog::append(const Message& message) {
+    // Only anti-entropy reads a message's vector clock, never a stored chat
+    // message's, so records leave it out; that keeps them small and replay cheap
+    Message record = message;
+    record.setVectorClock(VectorClock());
+    QByteArray encoded = record.toDatagram(Message::BINARY_FORMAT);
+    appendUInt32(pending, static_cast<quint32>(encoded.size()));
+    appendUInt32(pending, crc32(encoded.constData(), encoded.size()));
+    pending.append(encoded);
+    extend(pendingOrigins, NodeRegistry::global().intern(message.getOrigin()),
+           static_cast<quint32>(message.getSequenceNumber()));
+}
+
+bool DurableLog::flush(const Checkpoint& checkpoint) {
+    if (!isOpen()) {
+        return false;
+    }
+
+    if (!pending.isEmpty()) {
+        if (!segmentFile.isOpen() && !openSegmentForAppend()) {
+            return false;
+        }
+
+        if (segmentFile.write(pending) != pending.size() || !segmentFile.flush() || !syncToDisk(segmentFile)) {
+            qDebug() << "Durable log: write to" << segmentFile.fileName() << "failed:" << segmentFile.errorString();
+            segmentFile.resize(segmentBytes);  // Don't leave half a batch for the retry to follow
+            return false;
+        }
+        segmentBytes += pending.size();
+        pending.clear();
+        for (auto it = pendingOrigins.constBegin(); it != pendingOrigins.constEnd(); ++it) {
+            extend(current.origins, it.key(), it.value().first);
+            extend(current.origins, it.key(), it.value().last);
+        }
+        pendingOrigins.clear();
+        current.end = segmentBytes;
+
+        if (current.end - current.start >= INDEX_INTERVAL) {
+            sealChunk();
+        }
+
+        if (segmentBytes >= segmentLimit) {
+            sealChunk();
+            segments.last().sealed = true;
+            segmentFile.close();
+            Segment next;
+            next.number = segments.last().number + 1;
+            segments.append(next);
+            current = Chunk();
+            segmentBytes = 0;
+        }
+    }
+
+    // The frontier is saved before the checkpoint and before anything under
+    // it is deleted, so it never lags the records recovery expects to find
+    if (!(checkpoint.compacted == savedCompacted)) {
+        if (!writeCompaction(checkpoint)) {
+            return false;
+        }
+        savedCompacted = checkpoint.compacted;
+    }
+    if (!writeCheckpoint(checkpoint)) {
+        return false;
+    }
+    dropCompactedSegments(savedCompacted);
+    return true;
+}
+
+bool DurableLog::openSegmentForAppend() {
+    segmentFile.setFileName(segmentPath(segments.last().number));
+    if (!segmentFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qDebug() << "Durable log: cannot open" << segmentFile.fileName() << ":" << segmentFile.errorString();
+        return false;
+    }
+    segmentBytes = segmentFile.size();
+
+    if (!tailScanned) {
+        // Not recovered first: learn what the unindexed tail holds, so the
+        // next index entry describes it too, and drop a torn last record
+        QFile reader(segmentFile.fileName());
+        uchar* base = reader.open(QIODevice::ReadOnly) && segmentBytes > 0 ? reader.map(0, segmentBytes) : nullptr;
+        if (base) {
+            current.end = forEachRecord(base, current.start, segmentBytes, true,
+                                        [&](NodeIndex origin, quint32 sequence, const MessageView&) {
+                                            extend(current.origins, origin, sequence);
+                                        });
+            reader.unmap(base);
+        }
+        if (current.end < segmentBytes) {
+            segmentFile.resize(current.end);
+            segmentBytes = current.end;
+        }
+        tailScanned = true;
+    }
+    return true;
+}
+
+/*
+ * Checkpoint layout (big-endian):
+ *   "SCCP", 4-byte version, 4-byte next sequence number, then the clock and
+ *   the stability frontier, each a 2-byte entry count and entries as in the
+ *   wire format, and a 4-byte CRC-32 of all of it. Version 1 checkpoints end
+ *   after the clock.
+ * Written through QSaveFile, so a crash leaves either the old or the new one.
+ */
+bool DurableLog::loadCheckpoint(Checkpoint& checkpoint) const {
+    QFile file(checkpointPath());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QByteArray data = file.readAll();
+    const int headerSize = 12;
+    if (data.size() < headerSize + 2 + 4 || memcmp(data.constData(), CHECKPOINT_MAGIC, 4) != 0) {
+        qDebug() << "Durable log: ignoring malformed checkpoint";
+        return false;
+    }
+
+    const char* bytes = data.constData();
+    const int body = data.size() - 4;
+    const quint32 version = qFromBigEndian<quint32>(bytes + 4);
+    if (qFromBigEndian<quint32>(bytes + body) != crc32(bytes, body) || version < 1 || version > CHECKPOINT_VERSION) {
+        qDebug() << "Durable log: ignoring corrupt checkpoint";
+        return false;
+    }
+
+    VectorClock clocks[2];
+    const int count = version == 1 ? 1 : 2;
+    int offset = headerSize;
+    for (int i = 0; i < count; ++i) {
+        const int consumed = readClock(bytes + offset, body - offset, clocks[i]);
+        if (consumed < 0) {
+            qDebug() << "Durable log: ignoring corrupt checkpoint";
+            return false;
+        }
+        offset += consumed;
+    }
+    if (offset != body) {
+        qDebug() << "Durable log: ignoring corrupt checkpoint";
+        return false;
+    }
+
+    checkpoint.nextSequenceNumber = qFromBigEndian<qint32>(bytes + 8);
+    checkpoint.clock.merge(clocks[0]);
+    checkpoint.stable.merge(clocks[1]);
+    return true;
+}
+
+bool DurableLog::writeCheckpoint(const Checkpoint& checkpoint) const {
+    QByteArray data;
+    data.append(CHECKPOINT_MAGIC, 4);
+    appendUInt32(data, CHECKPOINT_VERSION);
+    appendUInt32(data, static_cast<quint32>(checkpoint.nextSequenceNumber));
+    appendClock(data, checkpoint.clock);
+    appendClock(data, checkpoint.stable);
+    appendUInt32(data, crc32(data.constData(), data.size()));
+
+    QSaveFile file(checkpointPath());
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        qDebug() << "Durable log: cannot write checkpoint:" << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Compaction file layout (big-endian):
+ *   "SCCM", 4-byte version, the compaction frontier as in the checkpoint,
+ *   4-byte length and the caller's digest of the compacted messages, and a
+ *   4-byte CRC-32 of all of it.
+ * Only rewritten when the frontier moves, which is far rarer than checkpoints.
+ */
+bool DurableLog::loadCompaction(Checkpoint& checkpoint) {
+    QFile file(compactionPath());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QByteArray data = file.readAll();
+    const int headerSize = 8;
+    if (data.size() < headerSize + 2 + 4 + 4 || memcmp(data.constData(), COMPACTION_MAGIC, 4) != 0) {
+        qDebug() << "Durable log: ignoring malformed compaction frontier";
+        return false;
+    }
+
+    const char* bytes = data.constData();
+    const int body = data.size() - 4;
+    VectorClock compacted;
+    const int consumed = readClock(bytes + headerSize, body - headerSize, compacted);
+    const int digestAt = headerSize + consumed + 4;
+    if (qFromBigEndian<quint32>(bytes + body) != crc32(bytes, body)
+        || qFromBigEndian<quint32>(bytes + 4) != COMPACTION_VERSION || consumed < 0 || digestAt > body
+        || qFromBigEndian<quint32>(bytes + digestAt - 4) != static_cast<quint32>(body - digestAt)) {
+        qDebug() << "Durable log: ignoring corrupt compaction frontier";
+        return false;
+    }
+
+    checkpoint.compacted = compacted;
+    checkpoint.compactedDigest = data.mid(digestAt, body - digestAt);
+    savedCompacted = compacted;
+    return true;
+}
+
+bool DurableLog::writeCompaction(const Checkpoint& checkpoint) const {
+    QByteArray data;
+    data.append(COMPACTION_MAGIC, 4);
+    appendUInt32(data, COMPACTION_VERSION);
+    appendClock(data, checkpoint.compacted);
+    appendUInt32(data, static_cast<quint32>(checkpoint.compactedDigest.size()));
+    data.append(checkpoint.compactedDigest);
+    appendUInt32(data, crc32(data.constData(), data.size()));
+
+    QSaveFile file(compactionPath());
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        qDebug() << "Durable log: cannot write compaction frontier:" << file.errorString();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <QFile>
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QVector>
+#include <functional>
+#include "message.h"
+#include "messagelog.h"
+
+class MessageView;
+
+// On-disk, append-only copy of the message store so a restart keeps its
+// history, vector clock and sequence counter.
+//
+// Messages are written to numbered segment files as records of
+// [4-byte length][4-byte CRC-32][binary wire encoding without the vector
+// clock], big-endian. append() only fills a memory buffer; flush() writes the
+// batch, fsyncs it and then rewrites the checkpoint, so callers decide when
+// the disk is touched.
+//
+// Every INDEX_INTERVAL bytes of synced log, and when a segment is sealed, the
+// segment's sparse index (<segment>.idx) gains an entry for the stretch just
+// written: its offsets and, per origin, the lowest and highest sequence
+// number in it. Recovery skips stretches the checkpoint's compaction frontier
+// covers, replays the others without CRC checks (they were synced before
+// their entry was written), verifies only the unindexed tail and truncates a
+// torn final record. Sealed segments entirely below the frontier are deleted.
+// The frontier lives in its own file, rewritten only when it moves.
+// range() reads compacted messages back through the same index.
+class DurableLog {
+public:
+    // State that is not implied by the messages themselves
+    struct Checkpoint {
+        VectorClock clock;
+        VectorClock compacted;  // Per origin, the prefix dropped from memory; not replayed
+        QByteArray compactedDigest;  // Caller's summary of the compacted messages, kept with compacted
+        VectorClock stable;  // Known stable when written; recovery may compact up to it
+        int nextSequenceNumber = 1;  // No sequence number of ours at or above it has been used
+    };
+
+    static const qint64 SEGMENT_SIZE = 64 * 1024 * 1024;  // Start a new segment past this
+    static const qint64 INDEX_INTERVAL = 64 * 1024;  // Synced bytes between sparse index entries
+    static const int RECORD_HEADER_SIZE = 8;
+
+    DurableLog();
+    ~DurableLog();
+
+    bool open(const QString& directory);
+    bool isOpen() const { return !directory.isEmpty(); }
+    void close();
+    void setSegmentSize(qint64 bytes) { segmentLimit = bytes; }
+
+    // Replays the segments into store and loads the checkpoint. Messages
+    // under checkpoint.compacted are left out; the returned clock covers every
+    // replayed message. Returns the number replayed.
+    int recover(MessageLog& store, Checkpoint& checkpoint);
+
+    void append(const Message& message);
+    // Write and fsync buffered records, save checkpoint.compacted if it moved,
+    // checkpoint, and delete the sealed segments the frontier covers entirely
+    bool flush(const Checkpoint& checkpoint);
+
+    // Synced messages of origin with after < sequence <= upTo, in sequence
+    // order; stops after about limit of them
+    QList<Message> range(NodeIndex origin, quint32 after, quint32 upTo, int limit) const;
+
+    qint64 pendingBytes() const { return pending.size(); }
+    int segmentCount() const { return segments.size(); }
+
+private:
+    struct Bounds {
+        quint32 first;
+        quint32 last;
+    };
+    typedef QHash<NodeIndex, Bounds> OriginBounds;
+
+    struct Chunk {  // A stretch of a segment, as one sparse index entry describes it
+        qint64 start = 0;
+        qint64 end = 0;
+        OriginBounds origins;
+    };
+
+    struct Segment {
+        int number = 0;
+        QVector<Chunk> chunks;  // Indexed stretches, contiguous from offset 0
+        OriginBounds origins;  // Over all the chunks
+        bool sealed = false;  // No more records, and all of them indexed
+    };
+
+    // Calls visit for each record of [from, to) and returns where decoding
+    // stopped: at to, or at the first malformed (or, if verify, corrupt) record
+    typedef std::function<void(NodeIndex origin, quint32 sequence, const MessageView& record)> RecordVisitor;
+    static qint64 forEachRecord(const uchar* base, qint64 from, qint64 to, bool verify, const RecordVisitor& visit);
+    static void extend(OriginBounds& bounds, NodeIndex origin, quint32 sequence);
+    static bool covers(const VectorClock& frontier, const OriginBounds& bounds);
+
+    QString segmentPath(int segment) const;
+    QString indexPath(int segment) const;
+    QString checkpointPath() const;
+    QString compactionPath() const;
+
+    void loadIndex(Segment& segment, qint64 fileSize);
+    qint64 indexedEnd(const Segment& segment) const;
+    bool appendIndexEntry(Segment& segment, const Chunk& chunk);
+    int replaySegment(Segment& segment, MessageLog& store, VectorClock& clock, const VectorClock& compacted, bool isLast);
+    void dropCompactedSegments(const VectorClock& compacted);
+    void sealChunk();
+    bool openSegmentForAppend();
+    bool loadCheckpoint(Checkpoint& checkpoint) const;
+    bool writeCheckpoint(const Checkpoint& checkpoint) const;
+    bool loadCompaction(Checkpoint& checkpoint);
+    bool writeCompaction(const Checkpoint& checkpoint) const;
+
+    QString directory;
+    QVector<Segment> segments;  // On disk, ascending; the last is appended to
+    QFile segmentFile;  // Segment currently appended to
+    qint64 segmentBytes;
+    Chunk current;  // Synced but not yet indexed part of the last segment
+    bool tailScanned;  // current covers everything synced to the last segment
+    qint64 segmentLimit;
+    QByteArray pending;  // Encoded records not yet written
+    OriginBounds pendingOrigins;  // Of the records in pending
+    VectorClock savedCompacted;  // Compaction frontier on disk
+};
@@ -0,0 +1,305 @@
+#include "fec.h"
+#include <QtEndian>
+#include <algorithm>
+
+namespace {
+
+// GF(2^8) with the polynomial x^8 + x^4 + x^3 + x^2 + 1, by log tables
+struct GaloisField {
+    quint8 exp[512];
+    quint8 log[256];
+
+    GaloisField() {
+        int x = 1;
+        for (int i = 0; i < 255; ++i) {
+            exp[i] = static_cast<quint8>(x);
+            log[x] = static_cast<quint8>(i);
+            x <<= 1;
+            if (x & 0x100) {
+                x ^= 0x11D;
+            }
+        }
+        for (int i = 255; i < 512; ++i) {
+            exp[i] = exp[i - 255];
+        }
+        log[0] = 0;
+    }
+
+    quint8 mul(quint8 a, quint8 b) const { return a && b ? exp[log[a] + log[b]] : 0; }
+    quint8 div(quint8 a, quint8 b) const { return a ? exp[log[a] + 255 - log[b]] : 0; }  // b != 0
+};
+
+const GaloisField& field() {
+    static const GaloisField gf;
+    return gf;
+}
+
+// out += c * in, over the bytes both have
+void addScaled(QByteArray& out, const QByteArray& in, quint8 c) {
+    if (c == 0) {
+        return;
+    }
+    char* target = out.data();
+    const uchar* source = reinterpret_cast<const uchar*>(in.constData());
+    const int size = qMin(in.size(), out.size());
+    if (c == 1) {
+        for (int i = 0; i < size; ++i) {
+            target[i] ^= static_cast<char>(source[i]);
+        }
+        return;
+    }
+
+    quint8 product[256];
+    for (int x = 0; x < 256; ++x) {
+        product[x] = field().mul(c, static_cast<quint8>(x));
+    }
+    for (int i = 0; i < size; ++i) {
+        target[i] ^= static_cast<char>(product[source[i]]);
+    }
+}
+
+}
+
+quint8 ErasureCode::coefficient(int row, int column) {
+    // Cauchy entry 1 / (x_row + y_column) with x_row = 128 + row and
+    // y_column = column, times (x_0 + y_column) so that row 0 is all ones.
+    // Scaling columns keeps every square submatrix invertible.
+    const quint8 y = static_cast<quint8>(column);
+    return field().div(static_cast<quint8>(128) ^ y, static_cast<quint8>(128 + row) ^ y);
+}
+
+QVector<QByteArray> ErasureCode::encode(const QVector<QByteArray>& data, int parityCount) {
+    int length = 0;
+    for (const QByteArray& symbol : data) {
+        length = qMax(length, symbol.size());
+    }
+
+    QVector<QByteArray> parity;
+    if (data.isEmpty() || data.size() > MAX_DATA) {
+        return parity;
+    }
+    for (int row = 0; row < qMin(parityCount, static_cast<int>(MAX_PARITY)); ++row) {
+        QByteArray symbol(length, '\0');
+        for (int column = 0; column < data.size(); ++column) {
+            addScaled(symbol, data.at(column), coefficient(row, column));
+        }
+        parity.append(symbol);
+    }
+    return parity;
+}
+
+bool ErasureCode::decode(QVector<QByteArray>& data, const QHash<int, QByteArray>& parity) {
+    QVector<int> missing;
+    for (int i = 0; i < data.size(); ++i) {
+        if (data.at(i).isNull()) {
+            missing.append(i);
+        }
+    }
+    if (missing.isEmpty()) {
+        return true;
+    }
+    if (missing.size() > parity.size() || data.size() > MAX_DATA) {
+        return false;
+    }
+
+    QList<int> rows = parity.keys();
+    std::sort(rows.begin(), rows.end());
+    const int count = missing.size();
+    rows = rows.mid(0, count);
+    int length = 0;
+    for (int row : rows) {
+        if (row < 0 || row >= MAX_PARITY) {
+            return false;
+        }
+        length = qMax(length, parity.value(row).size());
+    }
+
+    // What the missing symbols contribute to each parity symbol
+    QVector<QByteArray> residue;
+    for (int row : rows) {
+        QByteArray symbol = parity.value(row);
+        symbol.append(QByteArray(length - symbol.size(), '\0'));
+        for (int column = 0; column < data.size(); ++column) {
+            if (!data.at(column).isNull()) {
+                addScaled(symbol, data.at(column), coefficient(row, column));
+            }
+        }
+        residue.append(symbol);
+    }
+
+    // Invert their coefficients by Gauss-Jordan elimination
+    QVector<QVector<quint8>> matrix(count, QVector<quint8>(2 * count, 0));
+    for (int r = 0; r < count; ++r) {
+        for (int c = 0; c < count; ++c) {
+            matrix[r][c] = coefficient(rows.at(r), missing.at(c));
+        }
+        matrix[r][count + r] = 1;
+    }
+    for (int c = 0; c < count; ++c) {
+        int pivot = c;
+        while (pivot < count && matrix[pivot][c] == 0) {
+            ++pivot;
+        }
+        if (pivot == count) {
+            return false;
+        }
+        std::swap(matrix[c], matrix[pivot]);
+        const quint8 scale = matrix[c][c];
+        for (int k = 0; k < 2 * count; ++k) {
+            matrix[c][k] = field().div(matrix[c][k], scale);
+        }
+        for (int r = 0; r < count; ++r) {
+            const quint8 factor = matrix[r][c];
+            if (r != c && factor != 0) {
+                for (int k = 0; k < 2 * count; ++k) {
+                    matrix[r][k] ^= field().mul(factor, matrix[c][k]);
+                }
+            }
+        }
+    }
+
+    for (int t = 0; t < count; ++t) {
+        QByteArray symbol(length, '\0');
+        for (int r = 0; r < count; ++r) {
+            addScaled(symbol, residue.at(r), matrix[t][count + r]);
+        }
+        data[missing.at(t)] = symbol;
+    }
+    return true;
+}
+
+void FecEncoder::configure(int blockSize, int parityCount) {
+    this->blockSize = qBound(0, blockSize, static_cast<int>(ErasureCode::MAX_DATA));
+    this->parityCount = qBound(0, parityCount, static_cast<int>(ErasureCode::MAX_PARITY));
+    sequences.clear();
+    symbols.clear();
+}
+
+bool FecEncoder::add(quint32 sequence, const QByteArray& datagram) {
+    sequences.append(sequence);
+    symbols.append(FecDecoder::wrap(datagram));
+    return sequences.size() >= blockSize;
+}
+
+FecEncoder::Block FecEncoder::take() {
+    Block block;
+    block.id = nextBlock++;
+    block.sequences = sequences;
+    block.parity = ErasureCode::encode(symbols, parityCount);
+    sequences.clear();
+    symbols.clear();
+    return block;
+}
+
+QByteArray FecDecoder::wrap(const QByteArray& datagram) {
+    QByteArray symbol(4, '\0');
+    qToBigEndian(static_cast<quint32>(datagram.size()), symbol.data());
+    symbol.append(datagram);
+    return symbol;
+}
+
+QByteArray FecDecoder::unwrap(const QByteArray& symbol) {
+    if (symbol.size() < 4) {
+        return QByteArray();
+    }
+    const quint32 size = qFromBigEndian<quint32>(symbol.constData());
+    if (size > static_cast<quint32>(symbol.size() - 4)) {
+        return QByteArray();
+    }
+    return symbol.mid(4, static_cast<int>(size));
+}
+
+QByteArray FecDecoder::encodeParity(const FecEncoder::Block& block, int index) {
+    QByteArray payload;
+    payload.append(static_cast<char>(block.sequences.size()));
+    payload.append(static_cast<char>(block.parity.size()));
+    payload.append(static_cast<char>(index));
+    char buf[4];
+    for (quint32 sequence : block.sequences) {
+        qToBigEndian(sequence, buf);
+        payload.append(buf, 4);
+    }
+    payload.append(block.parity.at(index));
+    return payload;
+}
+
+bool FecDecoder::decodeParity(const QByteArray& payload, Parity& parity) {
+    if (payload.size() < 3) {
+        return false;
+    }
+    const char* data = payload.constData();
+    const int dataCount = static_cast<quint8>(data[0]);
+    parity.parityCount = static_cast<quint8>(data[1]);
+    parity.index = static_cast<quint8>(data[2]);
+    if (dataCount == 0 || dataCount > ErasureCode::MAX_DATA || parity.parityCount > ErasureCode::MAX_PARITY ||
+        parity.index >= parity.parityCount || payload.size() <= 3 + 4 * dataCount) {
+        return false;
+    }
+
+    parity.sequences.clear();
+    for (int i = 0; i < dataCount; ++i) {
+        parity.sequences.append(qFromBigEndian<quint32>(data + 3 + 4 * i));
+    }
+    parity.symbol = payload.mid(3 + 4 * dataCount);
+    return true;
+}
+
+quint64 FecDecoder::add(NodeIndex origin, quint32 block, const Parity& parity, qint64 now) {
+    const quint64 key = NodeRegistry::messageKey(origin, block);
+    auto it = blocks.find(key);
+    if (it == blocks.end()) {
+        if (blocks.size() >= MAX_BLOCKS) {
+            expire(now);
+            if (blocks.size() >= MAX_BLOCKS) {
+                return 0;
+            }
+        }
+        Block entry;
+        entry.origin = origin;
+        entry.sequences = parity.sequences;
+        entry.opened = now;
+        it = blocks.insert(key, entry);
+        for (quint32 sequence : parity.sequences) {
+            covering.insert(NodeRegistry::messageKey(origin, sequence), key);
+        }
+    } else if (it.value().sequences != parity.sequences) {
+        return key;  // Not the block we know by that id
+    }
+    it.value().parity.insert(parity.index, parity.symbol);
+    return key;
+}
+
+const FecDecoder::Block* FecDecoder::find(quint64 key) const {
+    auto it = blocks.constFind(key);
+    return it == blocks.constEnd() ? nullptr : &it.value();
+}
+
+quint64 FecDecoder::blockCovering(MessageKey message) const {
+    return covering.value(message, 0);
+}
+
+void FecDecoder::remove(quint64 key) {
+    auto it = blocks.find(key);
+    if (it == blocks.end()) {
+        return;
+    }
+    for (quint32 sequence : it.value().sequences) {
+        MessageKey message = NodeRegistry::messageKey(it.value().origin, sequence);
+        if (covering.value(message) == key) {
+            covering.remove(message);
+        }
+    }
+    blocks.erase(it);
+}
+
+void FecDecoder::expire(qint64 now) {
+    QVector<quint64> expired;
+    for (auto it = blocks.constBegin(); it != blocks.constEnd(); ++it) {
+        if (now - it.value().opened > BLOCK_TIMEOUT) {
+            expired.append(it.key());
+        }
+    }
+    for (quint64 key : expired) {
+        remove(key);
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
+#include "noderegistry.h"
+
+// Systematic Reed-Solomon erasure code over GF(2^8). Parity symbol j is
+// the sum of the data symbols weighted by row j of a Cauchy matrix, with
+// columns scaled so that row 0 is all ones: one parity symbol is a plain
+// XOR of the data, and any m parity symbols recover any m missing data
+// symbols. Symbols of different lengths are treated as zero padded to the
+// longest, which is also the length of the parity.
+class ErasureCode {
+public:
+    static const int MAX_DATA = 128;
+    static const int MAX_PARITY = 128;
+
+    static QVector<QByteArray> encode(const QVector<QByteArray>& data, int parityCount);
+
+    // Fills in the null entries of data from parity (index -> symbol),
+    // zero padded to the parity length; false if too few parity symbols
+    static bool decode(QVector<QByteArray>& data, const QHash<int, QByteArray>& parity);
+
+    static quint8 coefficient(int row, int column);
+};
+
+// Groups our consecutive broadcasts into blocks and computes their parity.
+// Symbols are [4-byte length][datagram], so the receiver can strip the padding.
+class FecEncoder {
+public:
+    struct Block {
+        quint32 id = 0;
+        QVector<quint32> sequences;  // The broadcasts covered, in block order
+        QVector<QByteArray> parity;
+    };
+
+    FecEncoder() : blockSize(0), parityCount(0), nextBlock(1) {}  // Block ids start at 1
+
+    void configure(int blockSize, int parityCount);  // A block size of 0 disables it
+    bool isEnabled() const { return blockSize > 0 && parityCount > 0; }
+
+    bool add(quint32 sequence, const QByteArray& datagram);  // True once the block is full
+    bool isEmpty() const { return sequences.isEmpty(); }
+    Block take();  // Parity for what was added, full block or not, which starts the next one
+
+private:
+    int blockSize;
+    int parityCount;
+    quint32 nextBlock;
+    QVector<quint32> sequences;
+    QVector<QByteArray> symbols;
+};
+
+// Parity received for other origins' broadcast blocks, held until the block
+// can be reconstructed, turns out complete, or times out. FEC_PARITY
+// payloads are [1-byte data count][1-byte parity count][1-byte parity index]
+// [4-byte sequence number per data symbol][parity symbol]; the message's
+// sequence number is the block id.
+class FecDecoder {
+public:
+    static const int BLOCK_TIMEOUT = 2000;  // ms; then anti-entropy recovers what is still missing
+    static const int MAX_BLOCKS = 256;
+
+    struct Parity {
+        int parityCount = 0;
+        int index = 0;
+        QVector<quint32> sequences;
+        QByteArray symbol;
+    };
+
+    struct Block {
+        NodeIndex origin;
+        QVector<quint32> sequences;
+        QHash<int, QByteArray> parity;  // Parity index -> symbol
+        qint64 opened;
+    };
+
+    static QByteArray wrap(const QByteArray& datagram);  // [4-byte length][datagram]
+    static QByteArray unwrap(const QByteArray& symbol);  // Empty if malformed
+    static QByteArray encodeParity(const FecEncoder::Block& block, int index);
+    static bool decodeParity(const QByteArray& payload, Parity& parity);
+
+    // Returns the key of the block the parity belongs to, or 0 when too many are open
+    quint64 add(NodeIndex origin, quint32 block, const Parity& parity, qint64 now);
+    const Block* find(quint64 key) const;
+    quint64 blockCovering(MessageKey message) const;  // 0 if none
+    void remove(quint64 key);
+    void expire(qint64 now);
+    int size() const { return blocks.size(); }
+
+private:
+    QHash<quint64, Block> blocks;  // (origin, block id) -> parity so far
+    QHash<MessageKey, quint64> covering;  // Broadcast -> block it is in
+};
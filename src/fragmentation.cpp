@@ -0,0 +1,214 @@
+#include "fragmentation.h"
+#include <QtEndian>
+
+namespace {
+void appendUInt16(QByteArray& out, quint16 value) {
+    char buf[2];
+    qToBigEndian(value, buf);
+    out.append(buf, 2);
+}
+}
+
+QList<QByteArray> Reassembler::split(const QByteArray& datagram, int chunkSize) {
+    QList<QByteArray> payloads;
+    if (chunkSize <= 0 || (datagram.size() + chunkSize - 1) / chunkSize > MAX_FRAGMENTS) {
+        return payloads;  // Too big to send at all
+    }
+
+    const int count = (datagram.size() + chunkSize - 1) / chunkSize;
+    for (int index = 0; index < count; ++index) {
+        QByteArray payload;
+        payload.reserve(FRAGMENT_HEADER_SIZE + chunkSize);
+        appendUInt16(payload, static_cast<quint16>(index));
+        appendUInt16(payload, static_cast<quint16>(count));
+        payload.append(datagram.constData() + index * chunkSize, qMin(chunkSize, datagram.size() - index * chunkSize));
+        payloads.append(payload);
+    }
+    return payloads;
+}
+
+QByteArray Reassembler::encodeNack(const QVector<quint16>& missing) {
+    QByteArray payload;
+    const int count = qMin(missing.size(), static_cast<int>(MAX_NACK_INDICES));
+    appendUInt16(payload, static_cast<quint16>(count));
+    for (int i = 0; i < count; ++i) {
+        appendUInt16(payload, missing.at(i));
+    }
+    return payload;
+}
+
+QVector<quint16> Reassembler::decodeNack(const QByteArray& payload) {
+    QVector<quint16> missing;
+    if (payload.size() < 2) {
+        return missing;
+    }
+    const int count = qFromBigEndian<quint16>(payload.constData());
+    if (count > MAX_NACK_INDICES || payload.size() != 2 + 2 * count) {
+        return missing;
+    }
+    for (int i = 0; i < count; ++i) {
+        missing.append(qFromBigEndian<quint16>(payload.constData() + 2 + 2 * i));
+    }
+    return missing;
+}
+
+bool Reassembler::add(NodeIndex sender, quint32 transfer, const QByteArray& payload, qint64 now, QByteArray& datagram) {
+    if (payload.size() <= FRAGMENT_HEADER_SIZE) {
+        return false;
+    }
+    const int index = qFromBigEndian<quint16>(payload.constData());
+    const int count = qFromBigEndian<quint16>(payload.constData() + 2);
+    if (count == 0 || count > MAX_FRAGMENTS || index >= count) {
+        return false;
+    }
+
+    const MessageKey key = NodeRegistry::messageKey(sender, transfer);
+    if (completed.contains(key)) {
+        return false;  // A resend that crossed the last fragment
+    }
+
+    auto it = transfers.find(key);
+    if (it == transfers.end()) {
+        // One sender can't crowd out the rest with transfers it never finishes
+        if (openTransfers.value(sender) >= MAX_TRANSFERS_PER_SENDER) {
+            dropStalest(sender);
+        }
+        it = transfers.insert(key, Transfer());
+        it.value().chunks.resize(count);
+        it.value().lastNack = now;
+        it.value().lastProgress = now;
+        // The empty chunk slots cost memory before any of them is filled
+        it.value().bytes = static_cast<qint64>(count) * sizeof(QByteArray) + TRANSFER_OVERHEAD;
+        bytes += it.value().bytes;
+        openTransfers[sender]++;
+    }
+    Transfer& partial = it.value();
+    if (partial.chunks.size() != count) {
+        return false;  // Disagrees with the fragments before it
+    }
+    if (!partial.chunks.at(index).isEmpty()) {
+        return false;  // Duplicate
+    }
+
+    const int chunkBytes = payload.size() - FRAGMENT_HEADER_SIZE;
+    partial.chunks[index] = payload.mid(FRAGMENT_HEADER_SIZE);
+    partial.bytes += chunkBytes;
+    partial.received++;
+    partial.lastProgress = now;
+    bytes += chunkBytes;
+
+    if (partial.received == count) {
+        datagram.clear();
+        datagram.reserve(static_cast<int>(partial.bytes) - count * static_cast<int>(sizeof(QByteArray)) - TRANSFER_OVERHEAD);
+        for (const QByteArray& chunk : partial.chunks) {
+            datagram.append(chunk);
+        }
+        drop(it);
+        completed.insert(key);
+        completedOrder.enqueue(key);
+        if (completedOrder.size() > RECENT_TRANSFERS) {
+            completed.remove(completedOrder.dequeue());
+        }
+        return true;
+    }
+
+    // Over budget: the transfer that has gone longest without progress goes first
+    while (bytes > MAX_BYTES && transfers.size() > 1) {
+        dropStalest(NodeRegistry::INVALID_NODE);
+    }
+    return false;
+}
+
+void Reassembler::poll(qint64 now, qint64 nackDelay, QVector<Stalled>& stalled) {
+    for (auto it = transfers.begin(); it != transfers.end();) {
+        Transfer& partial = it.value();
+        if (now - partial.lastProgress >= TIMEOUT) {
+            it = drop(it);
+            continue;
+        }
+
+        if (now - qMax(partial.lastProgress, partial.lastNack) >= nackDelay) {
+            Stalled entry;
+            entry.sender = NodeRegistry::keyNode(it.key());
+            entry.transfer = NodeRegistry::keySequence(it.key());
+            for (int index = 0; index < partial.chunks.size() && entry.missing.size() < MAX_NACK_INDICES; ++index) {
+                if (partial.chunks.at(index).isEmpty()) {
+                    entry.missing.append(static_cast<quint16>(index));
+                }
+            }
+            stalled.append(entry);
+            partial.lastNack = now;
+        }
+        ++it;
+    }
+}
+
+QHash<MessageKey, Reassembler::Transfer>::iterator Reassembler::drop(QHash<MessageKey, Transfer>::iterator it) {
+    const NodeIndex sender = NodeRegistry::keyNode(it.key());
+    if (--openTransfers[sender] == 0) {
+        openTransfers.remove(sender);
+    }
+    bytes -= it.value().bytes;
+    return transfers.erase(it);
+}
+
+void Reassembler::dropStalest(NodeIndex sender) {
+    auto oldest = transfers.end();
+    for (auto candidate = transfers.begin(); candidate != transfers.end(); ++candidate) {
+        if (sender != NodeRegistry::INVALID_NODE && NodeRegistry::keyNode(candidate.key()) != sender) {
+            continue;
+        }
+        if (oldest == transfers.end() || candidate.value().lastProgress < oldest.value().lastProgress) {
+            oldest = candidate;
+        }
+    }
+    if (oldest != transfers.end()) {
+        drop(oldest);
+    }
+}
+
+void FragmentCache::insert(quint32 transfer, const QList<QByteArray>& datagrams, qint64 now) {
+    Sent sent;
+    sent.datagrams = datagrams;
+    sent.sentAt = now;
+    sent.bytes = 0;
+    for (const QByteArray& datagram : datagrams) {
+        sent.bytes += datagram.size();
+    }
+
+    transfers.insert(transfer, sent);
+    order.enqueue(transfer);
+    bytes += sent.bytes;
+    expire(now);
+}
+
+QList<QByteArray> FragmentCache::find(quint32 transfer, const QVector<quint16>& indices, qint64 now) {
+    expire(now);
+
+    QList<QByteArray> found;
+    auto it = transfers.constFind(transfer);
+    if (it == transfers.constEnd()) {
+        return found;
+    }
+    for (quint16 index : indices) {
+        if (index < it.value().datagrams.size()) {
+            found.append(it.value().datagrams.at(index));
+        }
+    }
+    return found;
+}
+
+void FragmentCache::expire(qint64 now) {
+    // Transfer ids only grow, so insertion order is age order
+    while (!order.isEmpty()) {
+        auto it = transfers.find(order.head());
+        if (it != transfers.end() && now - it.value().sentAt < RETENTION && bytes <= MAX_BYTES) {
+            break;
+        }
+        if (it != transfers.end()) {
+            bytes -= it.value().bytes;
+            transfers.erase(it);
+        }
+        order.dequeue();
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QQueue>
+#include <QSet>
+#include <QVector>
+#include "noderegistry.h"
+
+// Application-level fragmentation for binary datagrams larger than the path
+// MTU. A FRAGMENT message's sequence number names the transfer, unique per
+// sender, and its payload is [2-byte index][2-byte count][chunk]; the chunks
+// in index order are the original datagram. Where one lost IP fragment loses
+// the whole datagram, here it costs one fragment: the receiver lists what is
+// missing in a FRAGMENT_NACK ([2-byte count][2-byte index]...) and the sender
+// resends those from a short-lived FragmentCache.
+class Reassembler {
+public:
+    static const int FRAGMENT_HEADER_SIZE = 4;
+    static const int MAX_FRAGMENTS = 1024;  // Per transfer
+    static const int MAX_BYTES = 8 * 1024 * 1024;  // Across all partial transfers, bookkeeping included
+    static const int MAX_TRANSFERS_PER_SENDER = 16;  // Partial ones; a sender's stalest goes first
+    static const int TRANSFER_OVERHEAD = 128;  // Bytes charged per open transfer besides its chunk slots
+    static const int TIMEOUT = 5000;  // ms without progress before a transfer is dropped
+    static const int MAX_NACK_INDICES = 256;
+    static const int RECENT_TRANSFERS = 1024;  // Completed transfers remembered against late duplicates
+
+    struct Stalled {
+        NodeIndex sender;
+        quint32 transfer;
+        QVector<quint16> missing;
+    };
+
+    static QList<QByteArray> split(const QByteArray& datagram, int chunkSize);  // Fragment payloads
+    static QByteArray encodeNack(const QVector<quint16>& missing);
+    static QVector<quint16> decodeNack(const QByteArray& payload);  // Empty if malformed
+
+    Reassembler() : bytes(0) {}
+
+    // True once payload completes its transfer, with the original datagram in datagram
+    bool add(NodeIndex sender, quint32 transfer, const QByteArray& payload, qint64 now, QByteArray& datagram);
+
+    // Drops transfers idle for TIMEOUT and lists those idle for nackDelay,
+    // which then wait another nackDelay before being listed again
+    void poll(qint64 now, qint64 nackDelay, QVector<Stalled>& stalled);
+
+    int size() const { return transfers.size(); }
+    bool isEmpty() const { return transfers.isEmpty(); }
+    qint64 byteCount() const { return bytes; }
+
+private:
+    struct Transfer {
+        QVector<QByteArray> chunks;  // Empty until received
+        int received = 0;
+        qint64 bytes = 0;  // Charged against MAX_BYTES
+        qint64 lastProgress = 0;
+        qint64 lastNack = 0;
+    };
+
+    QHash<MessageKey, Transfer>::iterator drop(QHash<MessageKey, Transfer>::iterator it);
+    void dropStalest(NodeIndex sender);  // INVALID_NODE: of any sender
+
+    QHash<MessageKey, Transfer> transfers;  // (sender, transfer) -> partial datagram
+    QSet<MessageKey> completed;
+    QQueue<MessageKey> completedOrder;
+    QHash<NodeIndex, int> openTransfers;  // sender -> partial transfers
+    qint64 bytes;
+};
+
+// Fragments we sent, kept a few seconds for NACKed resends. Bounded by age and bytes.
+class FragmentCache {
+public:
+    static const int RETENTION = 10000;  // ms
+    static const int MAX_BYTES = 8 * 1024 * 1024;
+
+    FragmentCache() : bytes(0) {}
+
+    void insert(quint32 transfer, const QList<QByteArray>& datagrams, qint64 now);
+    QList<QByteArray> find(quint32 transfer, const QVector<quint16>& indices, qint64 now);
+
+    int size() const { return transfers.size(); }
+    qint64 byteCount() const { return bytes; }
+
+private:
+    struct Sent {
+        QList<QByteArray> datagrams;
+        qint64 sentAt;
+        qint64 bytes;
+    };
+
+    void expire(qint64 now);
+
+    QHash<quint32, Sent> transfers;
+    QQueue<quint32> order;  // Oldest first
+    qint64 bytes;
+};
@@ -19,9 +19,58 @@ int main(int argc, char *argv[]) {
     parser.addOption(portOption);
 
     QCommandLineOption peersOption(QStringList() << "peers",
-                                   "Comma-separated list of peer ports (e.g., 9001,9002,9003,9004)", "peers");
+                                   "Comma-separated seed nodes to join through, as ports on this host or host:port (e.g., 9001,9002 or 10.0.0.5:9001)", "peers");
     parser.addOption(peersOption);
 
+    QCommandLineOption bindOption(QStringList() << "bind",
+                                  "Address to listen on; use 0.0.0.0 to reach nodes on other hosts (default 127.0.0.1)", "address");
+    parser.addOption(bindOption);
+
+    QCommandLineOption storeBudgetOption(QStringList() << "store-budget",
+                                         "Message store size in MiB above which stable messages are compacted (default 64)", "mib");
+    parser.addOption(storeBudgetOption);
+
+    QCommandLineOption dataDirOption(QStringList() << "data-dir",
+                                     "Directory for the durable message log; history survives restarts (default: memory only)", "dir");
+    parser.addOption(dataDirOption);
+
+    QCommandLineOption mtuOption(QStringList() << "mtu",
+                                 "Largest datagram anti-entropy batches may fill, in bytes; 0 disables batching (default 1400)", "bytes");
+    parser.addOption(mtuOption);
+
+    QCommandLineOption fragmentMtuOption(QStringList() << "fragment-mtu",
+                                         "Largest datagram sent whole, in bytes; larger ones go out as fragments that are resent individually on loss, 0 leaves them to IP (default 1400)", "bytes");
+    parser.addOption(fragmentMtuOption);
+
+    QCommandLineOption fecBlockOption(QStringList() << "fec-block",
+                                      "Broadcasts per forward error correction block, followed by parity that lets receivers rebuild lost ones; 0 disables it (default 0)", "count");
+    parser.addOption(fecBlockOption);
+
+    QCommandLineOption fecParityOption(QStringList() << "fec-parity",
+                                       "Parity datagrams per block; 1 is a plain XOR, more use a Reed-Solomon code and repair as many losses (default 2)", "count");
+    parser.addOption(fecParityOption);
+
+    QCommandLineOption ioOption(QStringList() << "io",
+                                "Socket backend: 'qt' uses QUdpSocket, 'mmsg' batches syscalls with recvmmsg/sendmmsg, "
+                                "'uring' uses io_uring and falls back to mmsg where unsupported (Linux only, default qt)", "backend");
+    parser.addOption(ioOption);
+
+    QCommandLineOption workersOption(QStringList() << "workers",
+                                     "Receive threads sharing the port through SO_REUSEPORT; above 1 needs --io mmsg or uring, and picks mmsg over qt (Linux only, default 1)", "count");
+    parser.addOption(workersOption);
+
+    QCommandLineOption antiEntropyOption(QStringList() << "anti-entropy",
+                                         "Anti-entropy mode: 'clock' sends vector clocks, 'digest' compares hash trees (default clock)", "mode");
+    parser.addOption(antiEntropyOption);
+
+    QCommandLineOption broadcastOption(QStringList() << "broadcast",
+                                       "Broadcast mode: 'direct' sends our broadcasts to every peer, 'tree' pushes them down a spanning tree that other nodes relay (default direct)", "mode");
+    parser.addOption(broadcastOption);
+
+    QCommandLineOption phiThresholdOption(QStringList() << "phi-threshold",
+                                          "Failure detector suspicion level at which a silent peer is marked inactive; lower detects faster, higher tolerates more jitter (default 8)", "phi");
+    parser.addOption(phiThresholdOption);
+
     parser.process(app);
 
     bool ok;
@@ -32,20 +81,127 @@ int main(int argc, char *argv[]) {
         port = 9001;
     }
 
-    // Parse peer ports if provided
-    QList<int> peerPorts;
+    // Parse seeds if provided: bare ports are on this host
+    QList<SimpleChat::Seed> seeds;
     if (parser.isSet(peersOption)) {
         QString peersStr = parser.value(peersOption);
         QStringList peersList = peersStr.split(',');
         for (const QString& peerStr : peersList) {
-            int peerPort = peerStr.trimmed().toInt(&ok);
+            QString entry = peerStr.trimmed();
+            int colon = entry.lastIndexOf(':');
+            QString host = colon > 0 ? entry.left(colon) : QString("127.0.0.1");
+            int peerPort = entry.mid(colon + 1).toInt(&ok);
             if (ok && peerPort >= 1024 && peerPort <= 65535) {
-                peerPorts.append(peerPort);
+                seeds.append(SimpleChat::Seed(host, peerPort));
             }
         }
     }
 
-    SimpleChat chat(port, peerPorts);
+    NetworkOptions options;
+    if (parser.isSet(storeBudgetOption)) {
+        int budget = parser.value(storeBudgetOption).toInt(&ok);
+        if (ok && budget >= 0) {
+            options.storeBudgetBytes = static_cast<qint64>(budget) * 1024 * 1024;
+        } else {
+            qDebug() << "Invalid store budget. Using default of 64 MiB.";
+        }
+    }
+
+    options.dataDirectory = parser.value(dataDirOption);
+
+    if (parser.isSet(bindOption)) {
+        QHostAddress address(parser.value(bindOption));
+        if (!address.isNull()) {
+            options.bindAddress = address;
+        } else {
+            qDebug() << "Invalid bind address. Using 127.0.0.1.";
+        }
+    }
+
+    if (parser.isSet(mtuOption)) {
+        int mtu = parser.value(mtuOption).toInt(&ok);
+        if (ok && (mtu == 0 || (mtu >= 576 && mtu <= 65507))) {
+            options.batchMtu = mtu;
+        } else {
+            qDebug() << "Invalid MTU (0 or 576-65507). Using default of 1400 bytes.";
+        }
+    }
+
+    if (parser.isSet(fragmentMtuOption)) {
+        int mtu = parser.value(fragmentMtuOption).toInt(&ok);
+        if (ok && (mtu == 0 || (mtu >= 576 && mtu <= 65507))) {
+            options.fragmentMtu = mtu;
+        } else {
+            qDebug() << "Invalid fragment MTU (0 or 576-65507). Using default of 1400 bytes.";
+        }
+    }
+
+    if (parser.isSet(fecBlockOption)) {
+        int count = parser.value(fecBlockOption).toInt(&ok);
+        if (ok && count >= 0 && count <= 64) {
+            options.fecBlockSize = count;
+        } else {
+            qDebug() << "Invalid FEC block size (0-64). Parity disabled.";
+        }
+    }
+
+    if (parser.isSet(fecParityOption)) {
+        int count = parser.value(fecParityOption).toInt(&ok);
+        if (ok && count >= 1 && count <= 16) {
+            options.fecParity = count;
+        } else {
+            qDebug() << "Invalid FEC parity count (1-16). Using 2.";
+        }
+    }
+
+    if (parser.isSet(ioOption)) {
+        QString backend = parser.value(ioOption);
+        if (backend == "mmsg") {
+            options.transport = DatagramTransport::BATCHED_MMSG;
+        } else if (backend == "uring") {
+            options.transport = DatagramTransport::IO_URING;
+        } else if (backend != "qt") {
+            qDebug() << "Unknown I/O backend" << backend << ". Using qt.";
+        }
+    }
+
+    if (parser.isSet(workersOption)) {
+        int workers = parser.value(workersOption).toInt(&ok);
+        if (ok && workers >= 1 && workers <= 64) {
+            options.receiveWorkers = workers;
+        } else {
+            qDebug() << "Invalid worker count (1-64). Using 1.";
+        }
+    }
+
+    if (parser.isSet(antiEntropyOption)) {
+        QString mode = parser.value(antiEntropyOption);
+        if (mode == "digest") {
+            options.antiEntropyMode = NetworkOptions::DIGEST_EXCHANGE;
+        } else if (mode != "clock") {
+            qDebug() << "Unknown anti-entropy mode" << mode << ". Using clock.";
+        }
+    }
+
+    if (parser.isSet(broadcastOption)) {
+        QString mode = parser.value(broadcastOption);
+        if (mode == "tree") {
+            options.broadcastMode = NetworkOptions::TREE_BROADCAST;
+        } else if (mode != "direct") {
+            qDebug() << "Unknown broadcast mode" << mode << ". Using direct.";
+        }
+    }
+
+    if (parser.isSet(phiThresholdOption)) {
+        double threshold = parser.value(phiThresholdOption).toDouble(&ok);
+        if (ok && threshold >= 1.0 && threshold <= 100.0) {
+            options.phiThreshold = threshold;
+        } else {
+            qDebug() << "Invalid phi threshold (1-100). Using 8.";
+        }
+    }
+
+    SimpleChat chat(port, seeds, options);
     chat.show();
 
     return app.exec();
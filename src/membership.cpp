@@ -0,0 +1,411 @@
+#include "membership.h"
+#include <QRandomGenerator>
+#include <QtEndian>
+#include <algorithm>
+
+namespace {
+
+// Address families in an encoded update; SENDER is a null address
+const quint8 ADDRESS_SENDER = 0;
+const quint8 ADDRESS_IPV4 = 4;
+const quint8 ADDRESS_IPV6 = 6;
+
+// ceil(log2(n)), at least 1
+int logSize(int n) {
+    int bits = 1;
+    while ((1 << bits) < n && bits < 30) {
+        ++bits;
+    }
+    return bits;
+}
+
+void appendUpdate(QByteArray& out, const Membership::Update& update) {
+    const QByteArray id = update.id.toUtf8().left(Membership::MAX_ID_BYTES);
+    out.append(static_cast<char>(id.size()));
+    out.append(id);
+    out.append(static_cast<char>(update.state));
+
+    char buf[4];
+    qToBigEndian(update.incarnation, buf);
+    out.append(buf, 4);
+
+    bool ok = false;
+    const quint32 ipv4 = update.address.toIPv4Address(&ok);
+    if (update.address.isNull()) {
+        out.append(static_cast<char>(ADDRESS_SENDER));
+    } else if (ok) {
+        out.append(static_cast<char>(ADDRESS_IPV4));
+        qToBigEndian(ipv4, buf);
+        out.append(buf, 4);
+    } else {
+        const Q_IPV6ADDR ipv6 = update.address.toIPv6Address();
+        out.append(static_cast<char>(ADDRESS_IPV6));
+        out.append(reinterpret_cast<const char*>(ipv6.c), 16);
+    }
+    qToBigEndian(update.port, buf);
+    out.append(buf, 2);
+}
+
+}
+
+Membership::Membership()
+    : self(NodeRegistry::INVALID_NODE), selfIncarnation(0), leaving(false), alive(0), probeIndex(0) {}
+
+void Membership::setSelf(const QString& id) {
+    selfId = id;
+    self = NodeRegistry::global().intern(id);
+    announceSelf();
+}
+
+void Membership::apply(const QByteArray& payload, const QHostAddress& senderHost, quint16 senderPort, qint64 now,
+                       QVector<Change>& changes) {
+    QVector<Update> updates;
+    if (!decodeUpdates(payload, updates)) {
+        return;
+    }
+    for (Update& update : updates) {
+        if (update.address.isNull()) {
+            update.address = senderHost;
+            update.port = senderPort;
+        }
+        apply(update, now, changes);
+    }
+}
+
+bool Membership::apply(const Update& update, qint64 now, QVector<Change>& changes) {
+    const NodeIndex node = NodeRegistry::global().intern(update.id);
+    if (node == self) {
+        // Whoever doubts us learns otherwise from a higher incarnation
+        if (update.state != ALIVE && update.incarnation >= selfIncarnation && !leaving) {
+            selfIncarnation = update.incarnation + 1;
+            announceSelf();
+        }
+        return false;
+    }
+
+    auto it = members.find(node);
+    if (it == members.end()) {
+        // Deaths of nodes we never knew need no spreading; nor do nodes we cannot reach
+        if (update.state == DEAD || update.state == LEFT || update.address.isNull()) {
+            return false;
+        }
+        Member member;
+        member.id = update.id;
+        member.address = update.address;
+        member.port = update.port;
+        member.incarnation = update.incarnation;
+        member.state = DEAD;  // Counted in by setState()
+        it = members.insert(node, member);
+
+        // New members are probed at a random point in the current round
+        const int position = probeIndex + QRandomGenerator::global()->bounded(probeOrder.size() - probeIndex + 1);
+        probeOrder.insert(position, node);
+    } else {
+        // A higher incarnation always wins; at the same one, the gloomier state does
+        const Member& known = it.value();
+        if (update.incarnation < known.incarnation ||
+            (update.incarnation == known.incarnation && update.state <= known.state)) {
+            return false;
+        }
+    }
+
+    Member& member = it.value();
+    const bool joined = update.state == ALIVE && (member.state == DEAD || member.state == LEFT);
+    member.incarnation = update.incarnation;
+    if (update.state == ALIVE && !update.address.isNull()) {
+        member.address = update.address;  // Rejoined, perhaps from elsewhere
+        member.port = update.port;
+    }
+    setState(node, member, update.state, now);
+    enqueue(updateFor(member));
+
+    Change change;
+    change.node = node;
+    change.state = update.state;
+    change.joined = joined;
+    changes.append(change);
+    return true;
+}
+
+bool Membership::suspect(NodeIndex node, qint64 now) {
+    auto it = members.find(node);
+    if (it == members.end() || it.value().state != ALIVE) {
+        return false;
+    }
+    setState(node, it.value(), SUSPECT, now);
+    enqueue(updateFor(it.value()));
+    return true;
+}
+
+void Membership::expireSuspects(qint64 now, qint64 period, QVector<Change>& changes) {
+    const qint64 timeout = suspicionTimeout(period);
+    QVector<NodeIndex> expired;
+    for (auto it = suspects.constBegin(); it != suspects.constEnd(); ++it) {
+        if (now - it.value() >= timeout) {
+            expired.append(it.key());
+        }
+    }
+    for (NodeIndex node : expired) {
+        Member& member = members[node];
+        setState(node, member, DEAD, now);
+        enqueue(updateFor(member));
+
+        Change change;
+        change.node = node;
+        change.state = DEAD;
+        change.joined = false;
+        changes.append(change);
+    }
+}
+
+void Membership::leave() {
+    leaving = true;
+    Update update;
+    update.id = selfId;
+    update.incarnation = selfIncarnation;
+    update.state = LEFT;
+    enqueue(update);
+}
+
+QByteArray Membership::takeGossip(NodeIndex destination) {
+    QByteArray payload(2, '\0');  // Count, filled in last
+    int count = 0;
+    auto add = [&](const Update& update) {
+        QByteArray entry;
+        appendUpdate(entry, update);
+        if (payload.size() + entry.size() > MAX_GOSSIP_BYTES || count == 0xFFFF) {
+            return false;
+        }
+        payload.append(entry);
+        ++count;
+        return true;
+    };
+
+    const Member* doubted = find(destination);
+    if (doubted && doubted->state != ALIVE) {
+        add(updateFor(*doubted));
+    } else {
+        doubted = nullptr;
+    }
+
+    std::stable_sort(gossip.begin(), gossip.end(), [](const Gossip& a, const Gossip& b) {
+        return a.transmissions < b.transmissions;
+    });
+    const int limit = retransmitLimit();
+    for (Gossip& entry : gossip) {
+        if (doubted && entry.update.id == doubted->id) {
+            continue;  // Already first
+        }
+        if (!add(entry.update)) {
+            break;
+        }
+        ++entry.transmissions;
+    }
+    gossip.erase(std::remove_if(gossip.begin(), gossip.end(), [limit](const Gossip& entry) {
+        return entry.transmissions >= limit;
+    }), gossip.end());
+
+    if (count == 0) {
+        return QByteArray();
+    }
+    qToBigEndian(static_cast<quint16>(count), payload.data());
+    return payload;
+}
+
+QByteArray Membership::encodeAll() const {
+    QVector<Update> updates;
+    Update selfUpdate;
+    selfUpdate.id = selfId;
+    selfUpdate.incarnation = selfIncarnation;
+    selfUpdate.state = leaving ? LEFT : ALIVE;
+    updates.append(selfUpdate);
+
+    for (auto it = members.constBegin(); it != members.constEnd(); ++it) {
+        if (it.value().state == ALIVE || it.value().state == SUSPECT) {
+            updates.append(updateFor(it.value()));
+        }
+    }
+    return encodeUpdates(updates);
+}
+
+NodeIndex Membership::nextProbeTarget() {
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        while (probeIndex < probeOrder.size()) {
+            const NodeIndex node = probeOrder.at(probeIndex++);
+            const Member* member = find(node);
+            if (member && (member->state == ALIVE || member->state == SUSPECT)) {
+                return node;
+            }
+        }
+
+        // Round over: reshuffle whoever is still worth probing
+        probeOrder.clear();
+        probeIndex = 0;
+        for (auto it = members.constBegin(); it != members.constEnd(); ++it) {
+            if (it.value().state == ALIVE || it.value().state == SUSPECT) {
+                probeOrder.append(it.key());
+            }
+        }
+        for (int i = probeOrder.size() - 1; i > 0; --i) {
+            std::swap(probeOrder[i], probeOrder[QRandomGenerator::global()->bounded(i + 1)]);
+        }
+    }
+    return NodeRegistry::INVALID_NODE;
+}
+
+QVector<NodeIndex> Membership::randomMembers(int count, NodeIndex exclude) const {
+    QVector<NodeIndex> candidates;
+    candidates.reserve(alive);
+    for (auto it = members.constBegin(); it != members.constEnd(); ++it) {
+        if (it.value().state == ALIVE && it.key() != exclude) {
+            candidates.append(it.key());
+        }
+    }
+
+    // Partial Fisher-Yates: the first count entries end up a random sample
+    const int picked = qMin(count, candidates.size());
+    for (int i = 0; i < picked; ++i) {
+        std::swap(candidates[i], candidates[i + QRandomGenerator::global()->bounded(candidates.size() - i)]);
+    }
+    candidates.resize(picked);
+    return candidates;
+}
+
+NodeIndex Membership::randomDeadMember() const {
+    QVector<NodeIndex> dead;
+    for (auto it = members.constBegin(); it != members.constEnd(); ++it) {
+        if (it.value().state == DEAD) {
+            dead.append(it.key());
+        }
+    }
+    if (dead.isEmpty()) {
+        return NodeRegistry::INVALID_NODE;
+    }
+    return dead.at(QRandomGenerator::global()->bounded(dead.size()));
+}
+
+const Membership::Member* Membership::find(NodeIndex node) const {
+    auto it = members.constFind(node);
+    return it == members.constEnd() ? nullptr : &it.value();
+}
+
+bool Membership::isAlive(NodeIndex node) const {
+    const Member* member = find(node);
+    return member && member->state == ALIVE;
+}
+
+QByteArray Membership::encodeUpdates(const QVector<Update>& updates) {
+    QByteArray payload;
+    char buf[2];
+    const int count = qMin(updates.size(), 0xFFFF);
+    qToBigEndian(static_cast<quint16>(count), buf);
+    payload.append(buf, 2);
+    for (int i = 0; i < count; ++i) {
+        appendUpdate(payload, updates.at(i));
+    }
+    return payload;
+}
+
+bool Membership::decodeUpdates(const QByteArray& payload, QVector<Update>& updates) {
+    if (payload.size() < 2) {
+        return payload.isEmpty();
+    }
+    const char* data = payload.constData();
+    const int size = payload.size();
+    const int count = qFromBigEndian<quint16>(data);
+    int offset = 2;
+
+    for (int i = 0; i < count; ++i) {
+        if (offset + 1 > size) {
+            return false;
+        }
+        const int idSize = static_cast<quint8>(data[offset++]);
+        if (idSize == 0 || offset + idSize + 1 + 4 + 1 > size) {
+            return false;
+        }
+        Update update;
+        update.id = QString::fromUtf8(data + offset, idSize);
+        offset += idSize;
+
+        const quint8 state = static_cast<quint8>(data[offset++]);
+        if (state > LEFT) {
+            return false;
+        }
+        update.state = static_cast<State>(state);
+        update.incarnation = qFromBigEndian<quint32>(data + offset);
+        offset += 4;
+
+        const quint8 family = static_cast<quint8>(data[offset++]);
+        const int addressSize = family == ADDRESS_IPV4 ? 4 : family == ADDRESS_IPV6 ? 16 : 0;
+        if ((family != ADDRESS_SENDER && addressSize == 0) || offset + addressSize + 2 > size) {
+            return false;
+        }
+        if (family == ADDRESS_IPV4) {
+            update.address = QHostAddress(qFromBigEndian<quint32>(data + offset));
+        } else if (family == ADDRESS_IPV6) {
+            update.address = QHostAddress(reinterpret_cast<const quint8*>(data + offset));
+        }
+        offset += addressSize;
+        update.port = qFromBigEndian<quint16>(data + offset);
+        offset += 2;
+
+        updates.append(update);
+    }
+    return offset == size;
+}
+
+void Membership::setState(NodeIndex node, Member& member, State state, qint64 now) {
+    if (member.state == ALIVE) {
+        --alive;
+    }
+    if (state == ALIVE) {
+        ++alive;
+    }
+    if (state == SUSPECT) {
+        suspects.insert(node, now);
+    } else {
+        suspects.remove(node);
+    }
+    member.state = state;
+    member.since = now;
+}
+
+void Membership::enqueue(const Update& update) {
+    // A newer fact about a node replaces the one still spreading
+    for (Gossip& entry : gossip) {
+        if (entry.update.id == update.id) {
+            entry.update = update;
+            entry.transmissions = 0;
+            return;
+        }
+    }
+    Gossip entry;
+    entry.update = update;
+    gossip.append(entry);
+}
+
+void Membership::announceSelf() {
+    Update update;
+    update.id = selfId;  // Null address: receivers fill in where it came from
+    update.incarnation = selfIncarnation;
+    update.state = ALIVE;
+    enqueue(update);
+}
+
+Membership::Update Membership::updateFor(const Member& member) const {
+    Update update;
+    update.id = member.id;
+    update.address = member.address;
+    update.port = member.port;
+    update.incarnation = member.incarnation;
+    update.state = member.state;
+    return update;
+}
+
+int Membership::retransmitLimit() const {
+    return RETRANSMIT_MULTIPLIER * logSize(members.size() + 2);
+}
+
+qint64 Membership::suspicionTimeout(qint64 period) const {
+    return SUSPICION_MULTIPLIER * logSize(members.size() + 2) * period;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QHostAddress>
+#include <QString>
+#include <QVector>
+#include "noderegistry.h"
+
+// SWIM membership (Das, Gupta and Motivala): who is in the cluster, and
+// which of them are alive. Every protocol period a node probes one member,
+// taken round-robin from a shuffled list, with a PING; if no PING_ACK comes
+// back it asks a few others to probe it for us (PING_REQ), and if that fails
+// too the member is suspected. Suspicion becomes death after a timeout unless
+// the member refutes it by announcing a higher incarnation number.
+//
+// Joins, suspicions, deaths and leaves spread epidemically: each change is
+// piggybacked on the next few probes, acks and ping requests, so the whole
+// cluster hears of it in O(log N) periods while every node sends a constant
+// number of datagrams per period, however large the cluster.
+//
+// This class is the bookkeeping only; NetworkManager sends the datagrams.
+class Membership {
+public:
+    enum State : quint8 {
+        ALIVE,
+        SUSPECT,
+        DEAD,
+        LEFT
+    };
+
+    struct Member {
+        QString id;
+        QHostAddress address;
+        quint16 port = 0;
+        quint32 incarnation = 0;
+        State state = ALIVE;
+        qint64 since = 0;  // When it entered this state
+    };
+
+    // One membership fact as gossiped. A null address stands for whoever
+    // sent the datagram, which is how a node announces itself without
+    // knowing the address others see it at.
+    struct Update {
+        QString id;
+        QHostAddress address;
+        quint16 port = 0;
+        quint32 incarnation = 0;
+        State state = ALIVE;
+    };
+
+    struct Change {
+        NodeIndex node;
+        State state;
+        bool joined;  // Was unknown, dead or gone, and is now alive
+    };
+
+    static const int RETRANSMIT_MULTIPLIER = 3;  // An update rides on this many times log2(N) datagrams
+    static const int SUSPICION_MULTIPLIER = 4;  // Suspicion lasts this many times log2(N) periods
+    static const int MAX_GOSSIP_BYTES = 512;  // Piggybacked on one datagram
+    static const int MAX_ID_BYTES = 255;
+
+    Membership();
+
+    void setSelf(const QString& id);
+    quint32 incarnation() const { return selfIncarnation; }
+
+    // Merges gossip from the datagram's sender, reporting what changed
+    void apply(const QByteArray& payload, const QHostAddress& senderHost, quint16 senderPort, qint64 now, QVector<Change>& changes);
+    bool apply(const Update& update, qint64 now, QVector<Change>& changes);
+
+    bool suspect(NodeIndex node, qint64 now);  // After a failed probe; false if not alive
+    void expireSuspects(qint64 now, qint64 period, QVector<Change>& changes);  // Suspects past their timeout die
+    void leave();  // Announces that we are leaving
+
+    // Updates to piggyback on a datagram to destination, fewest-sent first.
+    // A destination we suspect or think dead hears that first, so it can refute.
+    QByteArray takeGossip(NodeIndex destination);
+    QByteArray encodeAll() const;  // Every live member and ourselves, for a node that just joined
+
+    NodeIndex nextProbeTarget();  // INVALID_NODE when there is nobody to probe
+    QVector<NodeIndex> randomMembers(int count, NodeIndex exclude) const;  // Alive ones
+    NodeIndex randomDeadMember() const;  // INVALID_NODE if none
+
+    const Member* find(NodeIndex node) const;
+    bool contains(NodeIndex node) const { return members.contains(node); }
+    bool isAlive(NodeIndex node) const;
+    int size() const { return members.size(); }
+    int aliveCount() const { return alive; }
+    int pendingGossip() const { return gossip.size(); }
+
+    static QByteArray encodeUpdates(const QVector<Update>& updates);
+    static bool decodeUpdates(const QByteArray& payload, QVector<Update>& updates);
+
+private:
+    struct Gossip {
+        Update update;
+        int transmissions = 0;
+    };
+
+    void setState(NodeIndex node, Member& member, State state, qint64 now);
+    void enqueue(const Update& update);
+    void announceSelf();
+    Update updateFor(const Member& member) const;
+    int retransmitLimit() const;
+    qint64 suspicionTimeout(qint64 period) const;
+
+    QString selfId;
+    NodeIndex self;
+    quint32 selfIncarnation;
+    bool leaving;
+
+    QHash<NodeIndex, Member> members;  // Everyone but ourselves, dead ones included
+    int alive;
+    QHash<NodeIndex, qint64> suspects;  // node -> suspected at
+    QVector<Gossip> gossip;  // At most one update per node
+    QVector<NodeIndex> probeOrder;  // Shuffled; refilled once used up
+    int probeIndex;
+};
@@ -1,11 +1,55 @@
 #include "message.h"
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QtEndian>
+#include "messageview.h"
 
-Message::Message() : sequenceNumber(0), type(CHAT_MESSAGE) {}
+/*
+ * Binary wire format (all integers big-endian):
+ *
+ *   offset  size  field
+ *   0       1     magic (WIRE_MAGIC)
+ *   1       1     wire version
+ *   2       1     message type
+ *   3       1     flags (WIRE_FLAG_IMPLICIT_ID, WIRE_FLAG_CLOCK_RANGES, WIRE_FLAG_PAYLOAD,
+ *                 WIRE_FLAG_PREVIOUS)
+ *   4       4     total encoded length, header included
+ *   8       4     sequence number
+ *   12      2     origin length
+ *   14      2     destination length
+ *   16      2     messageId length
+ *   18      2     vector clock entry count
+ *   20      4     chat text length
+ *   24      ...   origin, destination, messageId, chat text (UTF-8)
+ *           ...   vector clock entries: 2-byte name length, name, 4-byte watermark
+ *           ...   if WIRE_FLAG_CLOCK_RANGES: received ranges above the watermarks
+ *                 (VectorClock::appendRanges). Older decoders ignore the trailing
+ *                 bytes and see only the watermarks, which is conservative.
+ *           ...   if WIRE_FLAG_PAYLOAD: 4-byte payload length, payload bytes
+ *           ...   if WIRE_FLAG_PREVIOUS: 4-byte sequence number of the origin's previous
+ *                 direct message to the same destination, for in-order delivery
+ *
+ * Decoding lives in MessageView so the receive path can read headers in place.
+ */
+namespace {
+void appendUInt16(QByteArray& out, quint16 value) {
+    char buf[2];
+    qToBigEndian(value, buf);
+    out.append(buf, 2);
+}
+
+void appendUInt32(QByteArray& out, quint32 value) {
+    char buf[4];
+    qToBigEndian(value, buf);
+    out.append(buf, 4);
+}
+}
+
+Message::Message() : sequenceNumber(0), type(CHAT_MESSAGE), wireVersion(0), previousSequence(0) {}
 
 Message::Message(const QString& chatText, const QString& origin, const QString& destination, int sequenceNumber, MessageType type)
-    : chatText(chatText), origin(origin), destination(destination), sequenceNumber(sequenceNumber), type(type) {
+    : chatText(chatText), origin(origin), destination(destination), sequenceNumber(sequenceNumber), type(type), wireVersion(0),
+      previousSequence(0) {
     messageId = generateMessageId();
 }
 
@@ -16,8 +60,12 @@ Message Message::fromVariantMap(const QVariantMap& map) {
     msg.destination = map.value("Destination").toString();
     msg.sequenceNumber = map.value("SequenceNumber").toInt();
     msg.type = static_cast<MessageType>(map.value("Type", CHAT_MESSAGE).toInt());
-    msg.vectorClock = map.value("VectorClock").toMap();
+    msg.vectorClock = VectorClock::fromVariantMap(map.value("VectorClock").toMap());
+    msg.vectorClock.addRangesFromVariantMap(map.value("VectorClockRanges").toMap());
     msg.messageId = map.value("MessageId").toString();
+    msg.wireVersion = map.value("WireVersion", 0).toInt();
+    msg.payload = QByteArray::fromBase64(map.value("Payload").toString().toLatin1());
+    msg.previousSequence = map.value("PreviousSequence", 0).toInt();
 
     // Generate message ID if not present
     if (msg.messageId.isEmpty()) {
@@ -28,6 +76,10 @@ Message Message::fromVariantMap(const QVariantMap& map) {
 }
 
 Message Message::fromDatagram(const QByteArray& datagram) {
+    if (detectFormat(datagram) == BINARY_FORMAT) {
+        return MessageView(datagram.constData(), datagram.size()).toMessage();
+    }
+
     QJsonDocument doc = QJsonDocument::fromJson(datagram);
     if (doc.isNull() || !doc.isObject()) {
         return Message();
@@ -44,17 +96,120 @@ QVariantMap Message::toVariantMap() const {
     map["Destination"] = destination;
     map["SequenceNumber"] = sequenceNumber;
     map["Type"] = static_cast<int>(type);
-    map["VectorClock"] = vectorClock;
+    map["VectorClock"] = vectorClock.toVariantMap();
+    if (vectorClock.hasRanges()) {
+        map["VectorClockRanges"] = vectorClock.rangesToVariantMap();
+    }
+    if (!payload.isEmpty()) {
+        map["Payload"] = QString::fromLatin1(payload.toBase64());
+    }
+    if (previousSequence > 0) {
+        map["PreviousSequence"] = previousSequence;
+    }
     map["MessageId"] = messageId;
     return map;
 }
 
-QByteArray Message::toDatagram() const {
+Message::WireFormat Message::detectFormat(const QByteArray& datagram) {
+    if (!datagram.isEmpty() && static_cast<quint8>(datagram.at(0)) == WIRE_MAGIC) {
+        return BINARY_FORMAT;
+    }
+    return JSON_FORMAT;
+}
+
+QByteArray Message::toDatagram(WireFormat format) const {
+    if (format == BINARY_FORMAT) {
+        return toBinaryDatagram();
+    }
+    return toJsonDatagram();
+}
+
+QByteArray Message::toJsonDatagram() const {
     QVariantMap map = toVariantMap();
+    // Advertise binary support so peers can switch formats for us
+    map["WireVersion"] = WIRE_VERSION;
     QJsonDocument doc = QJsonDocument::fromVariant(map);
     return doc.toJson(QJsonDocument::Compact);
 }
 
+QByteArray Message::toBinaryDatagram() const {
+    QByteArray originUtf8 = origin.toUtf8();
+    QByteArray destinationUtf8 = destination.toUtf8();
+    QByteArray textUtf8 = chatText.toUtf8();
+    bool implicitId = messageId == generateMessageId();
+    QByteArray idUtf8 = implicitId ? QByteArray() : messageId.toUtf8();
+    int clockEntries = vectorClock.entryCount();
+
+    QByteArray out;
+    out.reserve(WIRE_HEADER_SIZE + originUtf8.size() + destinationUtf8.size() + idUtf8.size()
+                + textUtf8.size() + clockEntries * 16 + payload.size() + 8);
+
+    out.append(static_cast<char>(WIRE_MAGIC));
+    out.append(static_cast<char>(WIRE_VERSION));
+    out.append(static_cast<char>(type));
+    quint8 flags = implicitId ? WIRE_FLAG_IMPLICIT_ID : 0;
+    if (vectorClock.hasRanges()) {
+        flags |= WIRE_FLAG_CLOCK_RANGES;
+    }
+    if (!payload.isEmpty()) {
+        flags |= WIRE_FLAG_PAYLOAD;
+    }
+    if (previousSequence > 0) {
+        flags |= WIRE_FLAG_PREVIOUS;
+    }
+    out.append(static_cast<char>(flags));
+    appendUInt32(out, 0);  // Total length, patched below
+    appendUInt32(out, static_cast<quint32>(sequenceNumber));
+    appendUInt16(out, static_cast<quint16>(originUtf8.size()));
+    appendUInt16(out, static_cast<quint16>(destinationUtf8.size()));
+    appendUInt16(out, static_cast<quint16>(idUtf8.size()));
+    appendUInt16(out, static_cast<quint16>(clockEntries));
+    appendUInt32(out, static_cast<quint32>(textUtf8.size()));
+
+    out.append(originUtf8);
+    out.append(destinationUtf8);
+    out.append(idUtf8);
+    out.append(textUtf8);
+    vectorClock.appendEntries(out);
+    if (vectorClock.hasRanges()) {
+        vectorClock.appendRanges(out);
+    }
+    if (!payload.isEmpty()) {
+        appendUInt32(out, static_cast<quint32>(payload.size()));
+        out.append(payload);
+    }
+    if (previousSequence > 0) {
+        appendUInt32(out, static_cast<quint32>(previousSequence));
+    }
+
+    qToBigEndian(static_cast<quint32>(out.size()), out.data() + 4);
+    return out;
+}
+
+void Message::appendToBatch(QByteArray& payload, const QByteArray& datagram) {
+    appendUInt16(payload, static_cast<quint16>(datagram.size()));
+    payload.append(datagram);
+}
+
+QList<QByteArray> Message::unpackBatch(const QByteArray& payload) {
+    QList<QByteArray> datagrams;
+    const char* data = payload.constData();
+    int offset = 0;
+    while (offset < payload.size()) {
+        if (payload.size() - offset < BATCH_ENTRY_HEADER_SIZE) {
+            return QList<QByteArray>();
+        }
+        int length = qFromBigEndian<quint16>(data + offset);
+        offset += BATCH_ENTRY_HEADER_SIZE;
+        if (length == 0 || payload.size() - offset < length) {
+            return QList<QByteArray>();
+        }
+        datagrams.append(payload.mid(offset, length));
+        offset += length;
+    }
+    return datagrams;
+}
+
 bool Message::isValid() const {
     return !origin.isEmpty() && !destination.isEmpty() && sequenceNumber >= 1;
 }
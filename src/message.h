@@ -3,6 +3,7 @@
 #include <QVariantMap>
 #include <QString>
 #include <QDataStream>
+#include "vectorclock.h"
 
 class Message {
 public:
@@ -10,32 +11,71 @@ public:
         CHAT_MESSAGE,
         ANTI_ENTROPY_REQUEST,
         ANTI_ENTROPY_RESPONSE,
-        ACK
+        ACK,
+        ANTI_ENTROPY_DIGEST,  // Hash tree digests; see DigestTree
+        BATCH,  // Payload packs several binary datagrams; see appendToBatch()
+        FRAGMENT,  // One piece of a datagram too large to send whole; see Reassembler
+        FRAGMENT_NACK,  // Asks the sender to resend the fragments listed in the payload
+        HEARTBEAT,  // Liveness beacon for the receiver's failure detector; no body
+        PING,  // Membership probe; these three carry piggybacked membership updates, see Membership
+        PING_REQ,  // Asks the receiver to probe the destination for us
+        PING_ACK,  // Answers a PING, for its sender or whoever asked it to probe
+        GOSSIP,  // A broadcast chat datagram pushed along a broadcast tree, in the payload; see BroadcastTree
+        IHAVE,  // Names broadcasts the sender has, for a lazy tree link
+        GRAFT,  // Asks the receiver to push to us again, and for the broadcasts listed, if any
+        PRUNE,  // Asks the receiver to stop pushing to us; no body
+        FEC_PARITY  // One parity symbol over a block of the sender's broadcasts; see FecDecoder
     };
 
+    enum WireFormat {
+        JSON_FORMAT,    // Compact JSON object, understood by every node
+        BINARY_FORMAT   // Length-prefixed binary encoding (WIRE_VERSION >= 1)
+    };
+
+    // Binary datagrams start with WIRE_MAGIC, which can never begin a JSON document
+    static const quint8 WIRE_MAGIC = 0xC5;
+    static const quint8 WIRE_VERSION = 5;  // 2: ACKs may carry a clock (cumulative and selective); 3: fragments; 4: broadcast trees; 5: broadcast parity
+    static const int WIRE_HEADER_SIZE = 24;
+    static const quint8 WIRE_FLAG_IMPLICIT_ID = 0x01;  // messageId == origin_sequence, not sent
+    static const quint8 WIRE_FLAG_CLOCK_RANGES = 0x02;  // Clock ranges above the watermarks follow the entries
+    static const quint8 WIRE_FLAG_PAYLOAD = 0x04;  // A length-prefixed protocol payload ends the datagram
+    static const quint8 WIRE_FLAG_PREVIOUS = 0x08;  // The previous sequence number in the sender's stream follows
+    static const int BATCH_ENTRY_HEADER_SIZE = 2;
+
     Message();
     Message(const QString& chatText, const QString& origin, const QString& destination, int sequenceNumber, MessageType type = CHAT_MESSAGE);
 
     static Message fromVariantMap(const QVariantMap& map);
     static Message fromDatagram(const QByteArray& datagram);
     QVariantMap toVariantMap() const;
-    QByteArray toDatagram() const;
+    QByteArray toDatagram(WireFormat format = JSON_FORMAT) const;
+    static WireFormat detectFormat(const QByteArray& datagram);
+
+    // BATCH payloads are a run of [2-byte length][datagram] entries
+    static void appendToBatch(QByteArray& payload, const QByteArray& datagram);
+    static QList<QByteArray> unpackBatch(const QByteArray& payload);  // Empty if malformed
 
     QString getChatText() const { return chatText; }
     QString getOrigin() const { return origin; }
     QString getDestination() const { return destination; }
     int getSequenceNumber() const { return sequenceNumber; }
     MessageType getType() const { return type; }
-    QVariantMap getVectorClock() const { return vectorClock; }
+    VectorClock getVectorClock() const { return vectorClock; }
     QString getMessageId() const { return messageId; }
+    int getWireVersion() const { return wireVersion; }
+    QByteArray getPayload() const { return payload; }
+    int getPreviousSequence() const { return previousSequence; }
 
     void setChatText(const QString& text) { chatText = text; }
     void setOrigin(const QString& org) { origin = org; }
     void setDestination(const QString& dest) { destination = dest; }
     void setSequenceNumber(int seq) { sequenceNumber = seq; }
     void setType(MessageType t) { type = t; }
-    void setVectorClock(const QVariantMap& vc) { vectorClock = vc; }
+    void setVectorClock(const VectorClock& vc) { vectorClock = vc; }
     void setMessageId(const QString& id) { messageId = id; }
+    void setWireVersion(int version) { wireVersion = version; }
+    void setPayload(const QByteArray& data) { payload = data; }
+    void setPreviousSequence(int seq) { previousSequence = seq; }
 
     bool isValid() const;
     bool isBroadcast() const { return destination == "-1" || destination == "broadcast"; }
@@ -43,13 +83,19 @@ public:
     QString generateMessageId() const;
 
 private:
+    QByteArray toBinaryDatagram() const;
+    QByteArray toJsonDatagram() const;
+
     QString chatText;
     QString origin;
     QString destination;  // "-1" or "broadcast" indicates broadcast message
     int sequenceNumber;
     MessageType type;
-    QVariantMap vectorClock;  // For anti-entropy: origin -> max sequence number
+    VectorClock vectorClock;  // For anti-entropy: what the sender has received from each origin
     QString messageId;  // Unique identifier: origin_sequence
+    int wireVersion;  // Highest wire version the sender advertised (0 = JSON only)
+    QByteArray payload;  // Opaque body for protocol messages (digests, ...)
+    int previousSequence;  // Origin's previous direct message to the same destination (0 = none)
 };
 
 QDataStream& operator<<(QDataStream& stream, const Message& message);
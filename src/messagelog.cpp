@@ -0,0 +1,189 @@
+#include "messagelog.h"
+
+const Message* MessageLog::find(NodeIndex origin, quint32 sequenceNumber) const {
+    if (origin >= static_cast<NodeIndex>(origins.size())) {
+        return nullptr;
+    }
+
+    const OriginLog& log = origins.at(origin);
+    if (sequenceNumber < log.firstSequence) {
+        return nullptr;
+    }
+
+    quint32 slot = sequenceNumber - log.firstSequence;
+    if (slot >= static_cast<quint32>(log.entries.size())) {
+        return nullptr;
+    }
+
+    const Message& entry = log.entries.at(static_cast<int>(slot));
+    return entry.getSequenceNumber() != 0 ? &entry : nullptr;
+}
+
+bool MessageLog::contains(NodeIndex origin, quint32 sequenceNumber) const {
+    if (origin < static_cast<NodeIndex>(origins.size()) &&
+        sequenceNumber >= 1 && sequenceNumber < origins.at(origin).firstSequence) {
+        return true;  // Compacted away
+    }
+    return find(origin, sequenceNumber) != nullptr;
+}
+
+bool MessageLog::insert(NodeIndex origin, const Message& message) {
+    if (message.getSequenceNumber() < 1) {
+        return false;
+    }
+    quint32 sequenceNumber = static_cast<quint32>(message.getSequenceNumber());
+
+    if (origin >= static_cast<NodeIndex>(origins.size())) {
+        origins.resize(origin + 1);
+    }
+
+    OriginLog& log = origins[origin];
+    if (sequenceNumber < log.firstSequence) {
+        return false;
+    }
+
+    quint32 slot = sequenceNumber - log.firstSequence;
+    if (slot >= static_cast<quint32>(log.entries.size())) {
+        if (slot - static_cast<quint32>(log.entries.size()) > static_cast<quint32>(MAX_SEQUENCE_GAP)) {
+            return false;
+        }
+        // Empty slots opened for a gap cost a whole Message each until filled
+        bytes += static_cast<qint64>(slot + 1 - static_cast<quint32>(log.entries.size())) * sizeof(Message);
+        log.entries.resize(static_cast<int>(slot) + 1);
+    }
+
+    Message& entry = log.entries[static_cast<int>(slot)];
+    if (entry.getSequenceNumber() != 0) {
+        return false;
+    }
+
+    // A received message carries the sender's whole clock, which nothing
+    // reads once it is stored; keeping it would cost a private copy per message
+    entry = message;
+    entry.setVectorClock(VectorClock());
+    ++messageCount;
+    bytes += estimateBytes(entry) - static_cast<qint64>(sizeof(Message));
+    return true;
+}
+
+int MessageLog::compact(NodeIndex origin, quint32 upTo, qint64* reclaimedBytes) {
+    if (origin >= static_cast<NodeIndex>(origins.size())) {
+        return 0;
+    }
+
+    OriginLog& log = origins[origin];
+    int removed = 0;
+    qint64 freed = 0;
+    while (removed < log.entries.size() &&
+           log.firstSequence + static_cast<quint32>(removed) <= upTo &&
+           log.entries.at(removed).getSequenceNumber() != 0) {
+        freed += estimateBytes(log.entries.at(removed));
+        ++removed;
+    }
+
+    if (removed == 0) {
+        return 0;
+    }
+
+    log.entries.remove(0, removed);
+    log.entries.squeeze();
+    log.firstSequence += static_cast<quint32>(removed);
+    messageCount -= removed;
+    bytes -= freed;
+    if (reclaimedBytes) {
+        *reclaimedBytes += freed;
+    }
+    return removed;
+}
+
+void MessageLog::skipThrough(NodeIndex origin, quint32 upTo) {
+    if (upTo == 0) {
+        return;
+    }
+    if (origin >= static_cast<NodeIndex>(origins.size())) {
+        origins.resize(origin + 1);
+    }
+
+    OriginLog& log = origins[origin];
+    if (upTo < log.firstSequence) {
+        return;
+    }
+
+    const int dropped = static_cast<int>(qMin<quint64>(quint64(upTo) - log.firstSequence + 1, quint64(log.entries.size())));
+    for (int i = 0; i < dropped; ++i) {
+        const Message& entry = log.entries.at(i);
+        if (entry.getSequenceNumber() != 0) {
+            bytes -= estimateBytes(entry);
+            --messageCount;
+        } else {
+            bytes -= static_cast<qint64>(sizeof(Message));
+        }
+    }
+    log.entries.remove(0, dropped);
+    log.entries.squeeze();
+    log.firstSequence = upTo + 1;
+}
+
+quint32 MessageLog::compactedThrough(NodeIndex origin) const {
+    return origin < static_cast<NodeIndex>(origins.size()) ? origins.at(origin).firstSequence - 1 : 0;
+}
+
+QList<NodeIndex> MessageLog::originsWithMessages() const {
+    QList<NodeIndex> result;
+    for (int i = 0; i < origins.size(); ++i) {
+        if (!origins.at(i).entries.isEmpty()) {
+            result.append(static_cast<NodeIndex>(i));
+        }
+    }
+    return result;
+}
+
+qint64 MessageLog::estimateBytes(const Message& message) {
+    // Stored messages have no vector clock, so only the strings are charged
+    // beyond the object itself
+    qint64 characters = message.getChatText().size() + message.getOrigin().size()
+                        + message.getDestination().size() + message.getMessageId().size();
+    return static_cast<qint64>(sizeof(Message)) + characters * static_cast<qint64>(sizeof(QChar));
+}
+
+QList<Message> MessageLog::range(NodeIndex origin, quint32 after, quint32 upTo) const {
+    QList<Message> messages;
+    if (origin >= static_cast<NodeIndex>(origins.size()) || upTo <= after) {
+        return messages;
+    }
+
+    const OriginLog& log = origins.at(origin);
+    if (upTo < log.firstSequence) {
+        return messages;
+    }
+
+    quint64 first = qMax<quint64>(quint64(after) + 1, log.firstSequence) - log.firstSequence;
+    quint64 last = qMin<quint64>(quint64(upTo) - log.firstSequence + 1, quint64(log.entries.size()));
+    if (first >= last) {
+        return messages;
+    }
+
+    messages.reserve(static_cast<int>(last - first));
+    for (quint64 slot = first; slot < last; ++slot) {
+        const Message& entry = log.entries.at(static_cast<int>(slot));
+        if (entry.getSequenceNumber() != 0) {
+            messages.append(entry);
+        }
+    }
+    return messages;
+}
+
+QList<Message> MessageLog::missingFor(const VectorClock& local, const VectorClock& remote) const {
+    QList<Message> missing;
+    const QVector<VectorClock::Gap> gaps = local.diff(remote);
+    for (const VectorClock::Gap& gap : gaps) {
+        missing.append(range(gap.node, gap.from, gap.to));
+    }
+    return missing;
+}
+
+void MessageLog::clear() {
+    origins.clear();
+    messageCount = 0;
+    bytes = 0;
+}
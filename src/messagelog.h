@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QVector>
+#include <QList>
+#include "message.h"
+#include "noderegistry.h"
+#include "vectorclock.h"
+
+// Message store organized as one sequence-indexed log per origin. Each log is
+// a flat array where slot i holds sequence firstSequence + i, so membership is
+// a bounds check and "everything from origin X after N" is a direct slice.
+// Messages that arrive out of order leave empty slots (default Message,
+// sequence number 0) which are filled in place when the message shows up.
+// Messages are stored without their vector clock, and byteCount() charges
+// empty slots as well as stored messages.
+//
+// compact() drops a contiguous prefix of a log once it is known to be stable.
+// Compacted sequence numbers still count as held, so late duplicates of them
+// are recognized and dropped.
+class MessageLog {
+public:
+    // Largest hole we will open past the end of an origin's log; anything
+    // further ahead is treated as bogus rather than allocated
+    static const int MAX_SEQUENCE_GAP = 65536;
+
+    bool contains(NodeIndex origin, quint32 sequenceNumber) const;  // Stored or compacted
+    const Message* find(NodeIndex origin, quint32 sequenceNumber) const;
+    bool insert(NodeIndex origin, const Message& message);  // false if duplicate or out of range
+
+    // Stored messages of origin with after < sequence <= upTo, in sequence order
+    QList<Message> range(NodeIndex origin, quint32 after, quint32 upTo) const;
+    // Every stored message the remote clock does not cover
+    QList<Message> missingFor(const VectorClock& local, const VectorClock& remote) const;
+
+    // Drop the stored prefix of origin's log up to and including upTo, stopping at
+    // the first hole. Returns the number of messages removed; bytes are added to
+    // reclaimedBytes if given.
+    int compact(NodeIndex origin, quint32 upTo, qint64* reclaimedBytes = nullptr);
+    // Treat everything of origin up to and including upTo as compacted, holes
+    // included, e.g. what was compacted before a restart
+    void skipThrough(NodeIndex origin, quint32 upTo);
+    quint32 compactedThrough(NodeIndex origin) const;  // Highest compacted sequence number, 0 if none
+    QList<NodeIndex> originsWithMessages() const;
+
+    int size() const { return messageCount; }
+    qint64 byteCount() const { return bytes; }  // Estimated heap footprint of stored messages
+    void clear();
+
+    static qint64 estimateBytes(const Message& message);  // Of a stored message, slot included
+
+private:
+    struct OriginLog {
+        quint32 firstSequence = 1;  // Sequence number held by entries[0]
+        QVector<Message> entries;
+    };
+
+    QVector<OriginLog> origins;  // NodeIndex -> log
+    int messageCount = 0;
+    qint64 bytes = 0;
+};
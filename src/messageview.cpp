@@ -0,0 +1,136 @@
+#include "messageview.h"
+#include <QtEndian>
+#include <cstring>
+
+MessageView::MessageView(const char* data, int size)
+    : data(data), size(size), valid(false), flags(0),
+      originOffset(0), originLength(0), destinationOffset(0), destinationLength(0),
+      idOffset(0), idLength(0), textOffset(0), textLength(0), clockOffset(0), clockEntries(0) {
+
+    if (size < Message::WIRE_HEADER_SIZE || static_cast<quint8>(data[0]) != Message::WIRE_MAGIC) {
+        return;
+    }
+
+    const uchar* bytes = reinterpret_cast<const uchar*>(data);
+    quint32 totalLength = qFromBigEndian<quint32>(bytes + 4);
+    if (bytes[1] < 1 || totalLength < quint32(Message::WIRE_HEADER_SIZE) || totalLength > quint32(size)) {
+        return;
+    }
+
+    flags = bytes[3];
+    originLength = qFromBigEndian<quint16>(bytes + 12);
+    destinationLength = qFromBigEndian<quint16>(bytes + 14);
+    idLength = qFromBigEndian<quint16>(bytes + 16);
+    clockEntries = qFromBigEndian<quint16>(bytes + 18);
+    quint32 text = qFromBigEndian<quint32>(bytes + 20);
+
+    quint64 end = quint64(Message::WIRE_HEADER_SIZE) + originLength + destinationLength + idLength + text;
+    if (end > totalLength) {
+        return;
+    }
+
+    originOffset = Message::WIRE_HEADER_SIZE;
+    destinationOffset = originOffset + originLength;
+    idOffset = destinationOffset + destinationLength;
+    textOffset = idOffset + idLength;
+    textLength = static_cast<int>(text);
+    clockOffset = textOffset + textLength;
+    this->size = static_cast<int>(totalLength);
+    valid = true;
+}
+
+int MessageView::getSequenceNumber() const {
+    return static_cast<qint32>(qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(data) + 8));
+}
+
+bool MessageView::fieldEquals(int offset, int length, const QByteArray& utf8) const {
+    return length == utf8.size() && std::memcmp(data + offset, utf8.constData(), length) == 0;
+}
+
+bool MessageView::originEquals(const QByteArray& utf8) const {
+    return fieldEquals(originOffset, originLength, utf8);
+}
+
+bool MessageView::destinationEquals(const QByteArray& utf8) const {
+    return fieldEquals(destinationOffset, destinationLength, utf8);
+}
+
+bool MessageView::isBroadcast() const {
+    static const QByteArray minusOne("-1");
+    static const QByteArray broadcast("broadcast");
+    return destinationEquals(minusOne) || destinationEquals(broadcast);
+}
+
+int MessageView::getMessageIdSequence() const {
+    if (flags & Message::WIRE_FLAG_IMPLICIT_ID) {
+        return getSequenceNumber();
+    }
+
+    // Parse the digits after the last '_' of "origin_sequence"
+    const char* id = data + idOffset;
+    int start = idLength;
+    while (start > 0 && id[start - 1] >= '0' && id[start - 1] <= '9') {
+        --start;
+    }
+    if (start == idLength || start == 0 || id[start - 1] != '_' || idLength - start > 9) {
+        return -1;
+    }
+
+    int sequence = 0;
+    for (int i = start; i < idLength; ++i) {
+        sequence = sequence * 10 + (id[i] - '0');
+    }
+    return sequence;
+}
+
+Message MessageView::toMessage() const {
+    if (!valid) {
+        return Message();
+    }
+
+    Message msg(QString::fromUtf8(data + textOffset, textLength),
+                QString::fromUtf8(data + originOffset, originLength),
+                QString::fromUtf8(data + destinationOffset, destinationLength),
+                getSequenceNumber(), getType());
+    msg.setWireVersion(getWireVersion());
+    if (!(flags & Message::WIRE_FLAG_IMPLICIT_ID)) {
+        msg.setMessageId(QString::fromUtf8(data + idOffset, idLength));
+    }
+
+    VectorClock vectorClock;
+    int consumed = vectorClock.readEntries(data + clockOffset, size - clockOffset, clockEntries);
+    if (consumed < 0) {
+        return Message();
+    }
+    int offset = clockOffset + consumed;
+    if (flags & Message::WIRE_FLAG_CLOCK_RANGES) {
+        consumed = vectorClock.readRanges(data + offset, size - offset);
+        if (consumed < 0) {
+            return Message();
+        }
+        offset += consumed;
+    }
+    msg.setVectorClock(vectorClock);
+
+    if (flags & Message::WIRE_FLAG_PAYLOAD) {
+        if (size - offset < 4) {
+            return Message();
+        }
+        quint32 length = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(data) + offset);
+        offset += 4;
+        if (length > quint32(size - offset)) {
+            return Message();
+        }
+        msg.setPayload(QByteArray(data + offset, static_cast<int>(length)));
+        offset += static_cast<int>(length);
+    }
+
+    if (flags & Message::WIRE_FLAG_PREVIOUS) {
+        if (size - offset < 4) {
+            return Message();
+        }
+        msg.setPreviousSequence(static_cast<qint32>(qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(data) + offset)));
+    }
+
+    return msg;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QByteArray>
+#include "message.h"
+
+// Read-only view over a binary datagram (see the layout in message.cpp).
+// Header fields are decoded in place, so the receive path can route ACKs and
+// drop duplicates without building a Message. The view does not own the
+// bytes: the buffer must outlive it. JSON datagrams are not viewable.
+class MessageView {
+public:
+    MessageView(const char* data, int size);
+
+    bool isValid() const { return valid; }
+    int getWireVersion() const { return static_cast<quint8>(data[1]); }
+    Message::MessageType getType() const { return static_cast<Message::MessageType>(static_cast<quint8>(data[2])); }
+    int getSequenceNumber() const;
+
+    const char* originData() const { return data + originOffset; }
+    int originSize() const { return originLength; }
+    bool originEquals(const QByteArray& utf8) const;
+    bool destinationEquals(const QByteArray& utf8) const;
+    bool isBroadcast() const;
+    bool hasVectorClock() const { return clockEntries > 0 || (flags & Message::WIRE_FLAG_CLOCK_RANGES); }
+
+    // Sequence number named by the message ID: the ID's "_<seq>" suffix when it is
+    // carried explicitly (ACKs), otherwise the message's own sequence number.
+    // Returns -1 if an explicit ID has no numeric suffix.
+    int getMessageIdSequence() const;
+
+    Message toMessage() const;
+
+private:
+    bool fieldEquals(int offset, int length, const QByteArray& utf8) const;
+
+    const char* data;
+    int size;
+    bool valid;
+    quint8 flags;
+    int originOffset;
+    int originLength;
+    int destinationOffset;
+    int destinationLength;
+    int idOffset;
+    int idLength;
+    int textOffset;
+    int textLength;
+    int clockOffset;
+    int clockEntries;
+};
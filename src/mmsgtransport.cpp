@@ -0,0 +1,205 @@
+#include "mmsgtransport.h"
+
+#ifdef Q_OS_LINUX
+
+#include <QTimer>
+#include <QDebug>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+MmsgTransport::MmsgTransport(QObject* parent)
+    : DatagramTransport(parent), fd(-1), boundPort(0), reusePort(false), notifier(nullptr), flushScheduled(false) {
+
+    receiveRing.resize(RECEIVE_SLOTS * MAX_DATAGRAM_SIZE);
+    receiveHeaders.resize(RECEIVE_SLOTS);
+    receiveVectors.resize(RECEIVE_SLOTS);
+    receiveAddresses.resize(RECEIVE_SLOTS);
+    for (int i = 0; i < RECEIVE_SLOTS; ++i) {
+        receiveVectors[i].iov_base = receiveRing.data() + i * MAX_DATAGRAM_SIZE;
+        receiveVectors[i].iov_len = MAX_DATAGRAM_SIZE;
+        std::memset(&receiveHeaders[i], 0, sizeof(mmsghdr));
+        receiveHeaders[i].msg_hdr.msg_iov = &receiveVectors[i];
+        receiveHeaders[i].msg_hdr.msg_iovlen = 1;
+        receiveHeaders[i].msg_hdr.msg_name = &receiveAddresses[i];
+    }
+
+    sendQueue.reserve(SEND_SLOTS);
+    sendHeaders.resize(SEND_SLOTS);
+    sendVectors.resize(SEND_SLOTS);
+    sendAddresses.resize(SEND_SLOTS);
+}
+
+MmsgTransport::~MmsgTransport() {
+    close();
+}
+
+void MmsgTransport::setError(const char* operation) {
+    lastError = QString("%1: %2").arg(operation).arg(QString::fromLocal8Bit(std::strerror(errno)));
+}
+
+bool MmsgTransport::bind(const QHostAddress& address, quint16 port) {
+    close();
+
+    bool isIPv4 = false;
+    quint32 ip = address.toIPv4Address(&isIPv4);
+    if (!isIPv4) {
+        lastError = "recvmmsg transport only supports IPv4";
+        return false;
+    }
+
+    fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        setError("socket");
+        return false;
+    }
+
+    int enable = 1;
+    if (reusePort && ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0) {
+        setError("SO_REUSEPORT");
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    sockaddr_in local;
+    std::memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(ip);
+    local.sin_port = htons(port);
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0) {
+        setError("bind");
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    socklen_t length = sizeof(local);
+    ::getsockname(fd, reinterpret_cast<sockaddr*>(&local), &length);
+    boundPort = ntohs(local.sin_port);
+
+    notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+    connect(notifier, &QSocketNotifier::activated, this, &DatagramTransport::readyRead);
+    return true;
+}
+
+void MmsgTransport::close() {
+    if (fd < 0) {
+        return;
+    }
+    flush();
+    delete notifier;
+    notifier = nullptr;
+    ::close(fd);
+    fd = -1;
+    boundPort = 0;
+}
+
+int MmsgTransport::receive(QVector<Datagram>& out) {
+    out.clear();
+    if (fd < 0) {
+        return 0;
+    }
+
+    // The kernel overwrites the lengths, so reset them for every call
+    for (int i = 0; i < RECEIVE_SLOTS; ++i) {
+        receiveHeaders[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        receiveHeaders[i].msg_hdr.msg_flags = 0;
+    }
+
+    int received;
+    do {
+        received = ::recvmmsg(fd, receiveHeaders.data(), RECEIVE_SLOTS, MSG_DONTWAIT, nullptr);
+    } while (received < 0 && errno == EINTR);
+
+    if (received < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            setError("recvmmsg");
+        }
+        return 0;
+    }
+
+    for (int i = 0; i < received; ++i) {
+        const mmsghdr& header = receiveHeaders.at(i);
+        if (header.msg_hdr.msg_flags & MSG_TRUNC) {
+            continue;  // Larger than a slot; a partial datagram is useless
+        }
+        const sockaddr_in& from = receiveAddresses.at(i);
+        Datagram datagram;
+        datagram.data = static_cast<const char*>(receiveVectors.at(i).iov_base);
+        datagram.size = static_cast<int>(header.msg_len);
+        datagram.host = QHostAddress(ntohl(from.sin_addr.s_addr));
+        datagram.port = ntohs(from.sin_port);
+        out.append(datagram);
+    }
+    return received;
+}
+
+bool MmsgTransport::send(const QByteArray& datagram, const QHostAddress& host, quint16 port) {
+    bool isIPv4 = false;
+    quint32 ip = host.toIPv4Address(&isIPv4);
+    if (fd < 0 || !isIPv4) {
+        lastError = fd < 0 ? "socket not bound" : "recvmmsg transport only supports IPv4";
+        return false;
+    }
+
+    const int slot = sendQueue.size();
+    sendQueue.append(datagram);
+    sockaddr_in& to = sendAddresses[slot];
+    std::memset(&to, 0, sizeof(to));
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = htonl(ip);
+    to.sin_port = htons(port);
+
+    if (sendQueue.size() == SEND_SLOTS) {
+        flush();
+    } else if (!flushScheduled) {
+        flushScheduled = true;
+        QTimer::singleShot(0, this, [this]() { flush(); });
+    }
+    return true;
+}
+
+void MmsgTransport::flush() {
+    flushScheduled = false;
+    const int count = sendQueue.size();
+    if (count == 0 || fd < 0) {
+        sendQueue.clear();
+        return;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        sendVectors[i].iov_base = const_cast<char*>(sendQueue.at(i).constData());
+        sendVectors[i].iov_len = static_cast<size_t>(sendQueue.at(i).size());
+        std::memset(&sendHeaders[i], 0, sizeof(mmsghdr));
+        sendHeaders[i].msg_hdr.msg_iov = &sendVectors[i];
+        sendHeaders[i].msg_hdr.msg_iovlen = 1;
+        sendHeaders[i].msg_hdr.msg_name = &sendAddresses[i];
+        sendHeaders[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    }
+
+    int offset = 0;
+    while (offset < count) {
+        int sent = ::sendmmsg(fd, sendHeaders.data() + offset, static_cast<unsigned int>(count - offset), 0);
+        if (sent < 0) {
+            const int error = errno;
+            if (error == EINTR) {
+                continue;
+            }
+            setError("sendmmsg");
+            if (error == EAGAIN || error == EWOULDBLOCK) {
+                // A full socket buffer drops the rest, as failed writeDatagrams would
+                qDebug() << "Failed to send" << (count - offset) << "datagrams:" << lastError;
+                break;
+            }
+            qDebug() << "Failed to send datagram:" << lastError;
+            ++offset;  // sendmmsg stops at the first bad message; skip it
+            continue;
+        }
+        offset += sent;
+    }
+    sendQueue.clear();
+}
+
+#endif
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "datagramtransport.h"
+
+#ifdef Q_OS_LINUX
+
+#include <QSocketNotifier>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+// IPv4 UDP socket driven with recvmmsg/sendmmsg, so a burst of datagrams
+// costs one syscall per RECEIVE_SLOTS received or SEND_SLOTS sent.
+//
+// Received datagrams land in a preallocated ring of RECEIVE_SLOTS buffers;
+// receive() hands them out in place. send() only queues: the queue is pushed
+// with sendmmsg when it fills, when flush() is called, or at the latest when
+// control returns to the event loop, so one broadcast or anti-entropy round
+// leaves in a single syscall.
+class MmsgTransport : public DatagramTransport {
+    Q_OBJECT
+
+public:
+    static const int RECEIVE_SLOTS = 32;  // 2 MiB of receive buffers
+    static const int SEND_SLOTS = 64;
+
+    explicit MmsgTransport(QObject* parent = nullptr);
+    ~MmsgTransport() override;
+
+    bool bind(const QHostAddress& address, quint16 port) override;
+    bool setReusePort(bool enabled) override { reusePort = enabled; return true; }
+    void close() override;
+    quint16 localPort() const override { return boundPort; }
+    QString errorString() const override { return lastError; }
+    Backend backend() const override { return BATCHED_MMSG; }
+
+    int receive(QVector<Datagram>& out) override;
+    bool send(const QByteArray& datagram, const QHostAddress& host, quint16 port) override;
+    void flush() override;
+
+private:
+    void setError(const char* operation);
+
+    int fd;
+    quint16 boundPort;
+    bool reusePort;  // SO_REUSEPORT: share the port with other sockets, kernel balances between them
+    QString lastError;
+    QSocketNotifier* notifier;
+
+    // Receive ring: slot i is receiveRing[i * MAX_DATAGRAM_SIZE]
+    QByteArray receiveRing;
+    QVector<mmsghdr> receiveHeaders;
+    QVector<iovec> receiveVectors;
+    QVector<sockaddr_in> receiveAddresses;
+
+    // Send queue; the QByteArrays keep the queued payloads alive
+    QVector<QByteArray> sendQueue;
+    QVector<mmsghdr> sendHeaders;
+    QVector<iovec> sendVectors;
+    QVector<sockaddr_in> sendAddresses;
+    bool flushScheduled;
+};
+
+#endif
@@ -1,49 +1,145 @@
 #include "networkmanager.h"
+#include "messageview.h"
+#include "receiveworker.h"
 #include <QHostAddress>
+#include <QHostInfo>
 #include <QDebug>
 #include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QRandomGenerator>
+#include <algorithm>
 
 NetworkManager::NetworkManager(QObject* parent)
-    : QObject(parent), socket(nullptr), serverPort(0) {
+    : QObject(parent), transport(nullptr), selfIndex(NodeRegistry::INVALID_NODE), serverPort(0), reclaimedBytes(0), nextSequenceNumber(1), sequenceLease(1),
+      nextTransferId(1 + QRandomGenerator::global()->bounded(1u << 30)), nextProbeId(1), probeRounds(0) {
 
-    socket = new QUdpSocket(this);
-    connect(socket, &QUdpSocket::readyRead, this, &NetworkManager::onDataReceived);
-
-    // Anti-entropy timer for periodic synchronization
+    // Anti-entropy timer, re-armed each round with the scheduler's interval
     antiEntropyTimer = new QTimer(this);
+    antiEntropyTimer->setSingleShot(true);
     connect(antiEntropyTimer, &QTimer::timeout, this, &NetworkManager::onAntiEntropyTimeout);
 
-    // ACK check timer for reliable delivery
-    ackCheckTimer = new QTimer(this);
-    connect(ackCheckTimer, &QTimer::timeout, this, &NetworkManager::checkPendingAcks);
-
-    // Peer health check timer
-    peerHealthTimer = new QTimer(this);
-    connect(peerHealthTimer, &QTimer::timeout, this, &NetworkManager::checkPeerHealth);
+    // Fires retransmissions exactly when the earliest one falls due
+    monotonicClock.start();
+    retransmitTimer = new QTimer(this);
+    retransmitTimer->setSingleShot(true);
+    retransmitTimer->setTimerType(Qt::PreciseTimer);
+    connect(retransmitTimer, &QTimer::timeout, this, &NetworkManager::onRetransmitTimeout);
+
+    // Holds ACKs back briefly so one covers several messages
+    ackTimer = new QTimer(this);
+    ackTimer->setSingleShot(true);
+    connect(ackTimer, &QTimer::timeout, this, &NetworkManager::flushAcks);
+
+    // Gives up waiting for a direct message's lost predecessor
+    reorderTimer = new QTimer(this);
+    reorderTimer->setSingleShot(true);
+    connect(reorderTimer, &QTimer::timeout, this, &NetworkManager::onReorderTimeout);
+
+    // Asks for fragments that stopped arriving
+    fragmentTimer = new QTimer(this);
+    connect(fragmentTimer, &QTimer::timeout, this, &NetworkManager::onFragmentTimeout);
+
+    // Heartbeats out, failure detection in
+    heartbeatTimer = new QTimer(this);
+    connect(heartbeatTimer, &QTimer::timeout, this, &NetworkManager::onHeartbeatTimeout);
+
+    // Membership protocol periods, and the direct probe's deadline within one
+    probeTimer = new QTimer(this);
+    connect(probeTimer, &QTimer::timeout, this, &NetworkManager::onProbeTimeout);
+    indirectProbeTimer = new QTimer(this);
+    indirectProbeTimer->setSingleShot(true);
+    connect(indirectProbeTimer, &QTimer::timeout, this, &NetworkManager::onIndirectProbeTimeout);
+
+    // Batches IHAVEs to lazy broadcast tree links, and grafts one when a
+    // broadcast it announced does not arrive
+    announceTimer = new QTimer(this);
+    announceTimer->setSingleShot(true);
+    connect(announceTimer, &QTimer::timeout, this, &NetworkManager::flushAnnouncements);
+    graftTimer = new QTimer(this);
+    connect(graftTimer, &QTimer::timeout, this, &NetworkManager::onGraftTimeout);
+
+    // Closes a broadcast parity block early when no more broadcasts come to fill it
+    fecFlushTimer = new QTimer(this);
+    fecFlushTimer->setSingleShot(true);
+    connect(fecFlushTimer, &QTimer::timeout, this, &NetworkManager::sendParity);
+
+    // Batches durable log writes so one fsync covers many received messages
+    logFlushTimer = new QTimer(this);
+    logFlushTimer->setSingleShot(true);
+    connect(logFlushTimer, &QTimer::timeout, this, &NetworkManager::flushDurableLog);
 }
 
 NetworkManager::~NetworkManager() {
-    if (socket) {
-        socket->close();
+    // Workers write into messageStore, so they must stop before it goes away
+    qDeleteAll(receiveWorkers);
+    receiveWorkers.clear();
+
+    // Hand back the rest of the lease, so a clean restart leaves no gap in our sequence
+    sequenceLease = nextSequenceNumber;
+    flushDurableLog();
+
+    if (transport) {
+        // Say goodbye, so nobody has to suspect us first
+        membership.leave();
+        for (NodeIndex member : membership.randomMembers(INDIRECT_PROBES, NodeRegistry::INVALID_NODE)) {
+            sendPing(member, 0);
+        }
+        transport->flush();
+        transport->close();
     }
 }
 
+void NetworkManager::setNodeId(const QString& nodeId) {
+    this->nodeId = nodeId;
+    nodeIdUtf8 = nodeId.toUtf8();
+    selfIndex = NodeRegistry::global().intern(nodeId);
+    membership.setSelf(nodeId);
+}
+
 bool NetworkManager::startServer(int port) {
-    if (!socket->bind(QHostAddress::LocalHost, port)) {
-        qDebug() << "Failed to bind UDP socket on port" << port << ":" << socket->errorString();
+    // Extra workers join our socket's SO_REUSEPORT group, which QUdpSocket
+    // cannot; where no backend can we receive on one socket
+    int workers = qMax(1, options.receiveWorkers);
+    DatagramTransport::Backend backend = options.transport;
+    if (workers > 1 && backend == DatagramTransport::QT_SOCKET) {
+        backend = DatagramTransport::BATCHED_MMSG;
+    }
+    transport = DatagramTransport::create(backend, this);
+    connect(transport, &DatagramTransport::readyRead, this, &NetworkManager::onDataReceived);
+    if (workers > 1 && !transport->setReusePort(true)) {
+        qDebug() << "Receive workers need SO_REUSEPORT, using a single socket";
+        delete transport;
+        transport = DatagramTransport::create(options.transport, this);
+        connect(transport, &DatagramTransport::readyRead, this, &NetworkManager::onDataReceived);
+        workers = 1;
+    }
+
+    if (!transport->bind(options.bindAddress, port)) {
+        qDebug() << "Failed to bind UDP socket on port" << port << ":" << transport->errorString();
         return false;
     }
 
     serverPort = port;
-    qDebug() << "UDP server started on port" << port;
+    static const char* const backendNames[] = { "(QUdpSocket)", "(recvmmsg/sendmmsg)", "(io_uring)" };
+    qDebug() << "UDP server started on port" << port << backendNames[transport->backend()];
+
+    fecEncoder.configure(options.fecBlockSize, options.fecParity);
+
+    // One store shard per receiving thread, set before anything is stored
+    messageStore.setShardCount(workers);
+    startReceiveWorkers(workers - 1);
+
+    if (!options.dataDirectory.isEmpty()) {
+        restoreFromDisk();
+    }
 
     // Start timers
-    antiEntropyTimer->start(ANTI_ENTROPY_INTERVAL);
-    ackCheckTimer->start(ACK_CHECK_INTERVAL);
-    peerHealthTimer->start(PEER_HEALTH_CHECK_INTERVAL);
+    antiEntropyTimer->start(antiEntropyScheduler.interval());
+    heartbeatTimer->start(HEARTBEAT_INTERVAL);
+    probeTimer->start(PROTOCOL_PERIOD);
 
     return true;
 }
@@ -53,26 +149,55 @@ void NetworkManager::addPeer(const QString& peerId, const QString& host, int por
         return;  // Don't add self as peer
     }
 
-    PeerInfo peerInfo(peerId, host, port);
-    peers[peerId] = peerInfo;
+    resolveHost(host, [this, peerId, host, port](const QHostAddress& address) {
+        if (address.isNull()) {
+            qDebug() << "Cannot resolve peer address" << host << "for" << peerId;
+            return;
+        }
+        addPeer(peerId, address, static_cast<quint16>(port));
+    });
+}
+
+void NetworkManager::addPeer(const QString& peerId, const QHostAddress& address, quint16 port) {
+    if (peerId == nodeId) {
+        return;
+    }
+
+    NodeIndex node = NodeRegistry::global().intern(peerId);
+    auto it = peers.insert(PeerInfo(peerId, node, address, static_cast<quint16>(port)));
+    it.value().heartbeats = PhiAccrualDetector(HEARTBEAT_INTERVAL, HEARTBEAT_PAUSE);
+    antiEntropyScheduler.forget(node);
+    hurryAntiEntropy();
 
-    qDebug() << "Added peer:" << peerId << "at" << host << ":" << port;
-    emit peerDiscovered(peerId, host, port);
+    qDebug() << "Added peer:" << peerId << "at" << address.toString() << ":" << port;
+    emit peerDiscovered(peerId, address.toString(), port);
 }
 
-void NetworkManager::discoverLocalPeers(const QList<int>& portRange) {
-    qDebug() << "Discovering peers on local ports:" << portRange;
+void NetworkManager::addSeed(const QString& host, int port) {
+    resolveHost(host, [this, host, port](const QHostAddress& address) {
+        if (address.isNull()) {
+            qDebug() << "Cannot resolve seed address" << host;
+            return;
+        }
+        if (port == serverPort && (address.isLoopback() || address == options.bindAddress)) {
+            return;  // Ourselves
+        }
 
-    // Send discovery message to each port
-    for (int port : portRange) {
-        if (port == serverPort) {
-            continue;  // Skip own port
+        QPair<QHostAddress, quint16> seed(address, static_cast<quint16>(port));
+        if (!seeds.contains(seed)) {
+            seeds.append(seed);
         }
+        pingSeed(seed.first, seed.second);
+    });
+}
 
-        Message discoveryMsg("", nodeId, "discovery", 0, Message::ANTI_ENTROPY_REQUEST);
-        QByteArray datagram = discoveryMsg.toDatagram();
-        sendDatagram(datagram, QHostAddress::LocalHost, port);
-    }
+void NetworkManager::pingSeed(const QHostAddress& host, quint16 port) {
+    // Seeds are unknown nodes, so they get JSON, which every version reads,
+    // and our whole view: the seed needs to hear of us, and whoever it
+    // tells needs our address
+    Message ping("", nodeId, "seed", 0, Message::PING);
+    ping.setPayload(membership.encodeAll());
+    sendDatagram(ping.toDatagram(Message::JSON_FORMAT), host, port);
 }
 
 void NetworkManager::sendMessage(const Message& message) {
@@ -84,23 +209,31 @@ void NetworkManager::sendMessage(const Message& message) {
     Message msgToSend = message;
     msgToSend.setOrigin(nodeId);
 
-    // Assign sequence number for chat messages
+    // Assign sequence number for chat messages. Numbers are per origin, not per
+    // destination, so (origin, sequence) identifies a message cluster-wide
     if (msgToSend.getType() == Message::CHAT_MESSAGE) {
-        const QString& destination = msgToSend.getDestination();
-        QString seqKey = destination;
-
-        if (!nextSequenceNumbers.contains(seqKey)) {
-            nextSequenceNumbers[seqKey] = 1;
+        if (durableLog.isOpen() && nextSequenceNumber >= sequenceLease) {
+            // Reserve the next block on disk before using any of it, so a
+            // crash can never make us hand out a sequence number twice
+            sequenceLease = nextSequenceNumber + SEQUENCE_LEASE;
+            flushDurableLog();
         }
-
-        msgToSend.setSequenceNumber(nextSequenceNumbers[seqKey]++);
+        msgToSend.setSequenceNumber(nextSequenceNumber++);
         msgToSend.setMessageId(msgToSend.generateMessageId());
 
+        // Chain direct messages to our previous one to the same destination,
+        // so the receiver can put them back in order
+        if (!msgToSend.isBroadcast()) {
+            SendStream& stream = sendStreams[NodeRegistry::global().intern(msgToSend.getDestination())];
+            msgToSend.setPreviousSequence(static_cast<int>(stream.lastSequence));
+            stream.lastSequence = static_cast<quint32>(msgToSend.getSequenceNumber());
+        }
+
         // Update own vector clock
-        updateVectorClock(nodeId, msgToSend.getSequenceNumber());
+        updateVectorClock(selfIndex, msgToSend.getSequenceNumber());
 
         // Store the message
-        storeMessage(msgToSend);
+        storeMessage(selfIndex, msgToSend);
     }
 
     // Set vector clock
@@ -114,19 +247,61 @@ void NetworkManager::sendMessage(const Message& message) {
     if (msgToSend.isBroadcast()) {
         sendBroadcastMessage(msgToSend);
     } else {
-        sendDirectMessage(msgToSend, msgToSend.getDestination());
+        enqueueDirectMessage(msgToSend, NodeRegistry::global().intern(msgToSend.getDestination()));
+    }
+}
+
+void NetworkManager::enqueueDirectMessage(const Message& message, NodeIndex peerNode) {
+    if (message.getType() != Message::CHAT_MESSAGE || !peers.contains(peerNode)) {
+        sendDirectMessage(message, peerNode);
+        return;
+    }
+
+    sendStreams[peerNode].backlog.enqueue(message);
+    pumpStream(peerNode);
+}
+
+void NetworkManager::pumpStream(NodeIndex peerNode) {
+    auto peer = peers.constFind(peerNode);
+    auto stream = sendStreams.find(peerNode);
+    if (peer == peers.constEnd() || stream == sendStreams.end()) {
+        return;
+    }
+
+    // Only as many unacknowledged messages as the congestion window allows
+    while (!stream.value().backlog.isEmpty() && stream.value().window.canSend(peer.value().awaitingAck.size())) {
+        Message message = stream.value().backlog.dequeue();
+        stream.value().highestSent = static_cast<quint32>(message.getSequenceNumber());
+        sendDirectMessage(message, peerNode);
     }
 }
 
-void NetworkManager::sendDirectMessage(const Message& message, const QString& peerId, bool requireAck) {
-    if (!peers.contains(peerId)) {
-        qDebug() << "Unknown peer:" << peerId;
+void NetworkManager::sendDirectMessage(const Message& message, NodeIndex peerNode, bool requireAck) {
+    auto it = peers.find(peerNode);
+    if (it == peers.end()) {
+        qDebug() << "Unknown peer:" << NodeRegistry::global().name(peerNode);
         return;
     }
 
-    PeerInfo& peer = peers[peerId];
-    QByteArray datagram = message.toDatagram();
-    sendDatagram(datagram, QHostAddress(peer.host), peer.port);
+    PeerInfo& peer = it.value();
+    QByteArray datagram = message.toDatagram(wireFormatFor(peerNode));
+
+    // An ACK we owe this peer rides along in a batch rather than on its own
+    if (peer.unacked > 0 && message.getType() != Message::ACK && options.batchMtu > 0) {
+        QByteArray ack = takeAck(peer);
+        QByteArray payload;
+        Message::appendToBatch(payload, ack);
+        Message::appendToBatch(payload, datagram);
+        Message batch("", nodeId, peer.peerId, 0, Message::BATCH);
+        batch.setPayload(payload);
+        QByteArray packed = batch.toDatagram(Message::BINARY_FORMAT);
+        if (packed.size() <= options.batchMtu) {
+            datagram = packed;
+        } else {
+            sendDatagram(ack, peer.address, peer.port);
+        }
+    }
+    sendDatagram(datagram, peer.address, peer.port);
 
     // For chat messages, track for ACK (only for direct messages, not broadcasts)
     // Only add if not already tracking to avoid overwriting during retries
@@ -134,71 +309,313 @@ void NetworkManager::sendDirectMessage(const Message& message, const QString& pe
     if (requireAck &&
         message.getType() == Message::CHAT_MESSAGE &&
         !message.isBroadcast() &&
-        !pendingAcks.contains(message.getMessageId())) {
+        !pendingAcks.contains(message.getSequenceNumber())) {
         PendingMessage pending;
         pending.message = message;
-        pending.targetPeerId = peerId;
-        pending.sentTime = QDateTime::currentMSecsSinceEpoch();
+        pending.targetPeer = peerNode;
+        pending.sentTime = monotonicClock.elapsed();
         pending.retryCount = 0;
+        pending.timer = TimerWheel::INVALID_TIMER;
 
-        pendingAcks[message.getMessageId()] = pending;
+        pendingAcks[message.getSequenceNumber()] = pending;
+        peer.awaitingAck.insert(message.getSequenceNumber());
+        scheduleRetransmit(message.getSequenceNumber());
     }
 }
 
 void NetworkManager::sendBroadcastMessage(const Message& message) {
     qDebug() << "Broadcasting message to all peers";
 
+    // Tree members relay it to each other; without neighbors yet there is no tree
+    const bool tree = options.broadcastMode == NetworkOptions::TREE_BROADCAST && broadcastTree.neighborCount() > 0;
+    if (tree) {
+        pushBroadcast(message.toDatagram(Message::BINARY_FORMAT),
+                      NodeRegistry::messageKey(selfIndex, static_cast<quint32>(message.getSequenceNumber())),
+                      NodeRegistry::INVALID_NODE);
+    }
+
+    // Encode at most once per wire format and fan the same buffer out to
+    // every peer that speaks it, or in tree mode, every peer the tree misses
+    QByteArray encoded[2];
     for (auto it = peers.begin(); it != peers.end(); ++it) {
         const PeerInfo& peer = it.value();
-        if (peer.isActive) {
-            QByteArray datagram = message.toDatagram();
-            sendDatagram(datagram, QHostAddress(peer.host), peer.port);
+        if (peer.isActive && !(tree && canJoinTree(it.key()))) {
+            Message::WireFormat format = wireFormatFor(it.key());
+            QByteArray& datagram = encoded[format];
+            if (datagram.isEmpty()) {
+                datagram = message.toDatagram(format);
+            }
+            sendDatagram(datagram, peer.address, peer.port);
+        }
+    }
+
+    // For broadcast chat messages, we don't track ACKs (gossip-style). On
+    // lossy links parity lets receivers rebuild lost ones straight away;
+    // broadcast trees repair themselves by grafting instead
+    if (!tree && fecEncoder.isEnabled()) {
+        if (fecEncoder.add(static_cast<quint32>(message.getSequenceNumber()), fecDatagram(message))) {
+            sendParity();
+        } else if (!fecFlushTimer->isActive()) {
+            fecFlushTimer->start(FEC_FLUSH_DELAY);
+        }
+    }
+}
+
+void NetworkManager::sendParity() {
+    fecFlushTimer->stop();
+    if (fecEncoder.isEmpty()) {
+        return;
+    }
+
+    const FecEncoder::Block block = fecEncoder.take();
+    Message parity("", nodeId, "broadcast", static_cast<int>(block.id), Message::FEC_PARITY);
+    for (int index = 0; index < block.parity.size(); ++index) {
+        parity.setPayload(FecDecoder::encodeParity(block, index));
+        const QByteArray datagram = parity.toDatagram(Message::BINARY_FORMAT);
+        for (auto it = peers.begin(); it != peers.end(); ++it) {
+            const PeerInfo& peer = it.value();
+            if (peer.isActive && peer.wireVersion >= FEC_WIRE_VERSION) {
+                sendDatagram(datagram, peer.address, peer.port);
+            }
         }
     }
+    if (transport) {
+        transport->flush();
+    }
+}
 
-    // For broadcast chat messages, we don't track ACKs (gossip-style)
+QByteArray NetworkManager::fecDatagram(const Message& message) {
+    // Parity must be computed over the same bytes on both sides, and the
+    // order of vector clock entries is local to each process, so the clock
+    // is left out (broadcasts are stored and delivered without it anyway)
+    // and the version byte pinned
+    Message bare = message;
+    bare.setVectorClock(VectorClock());
+    QByteArray datagram = bare.toDatagram(Message::BINARY_FORMAT);
+    datagram[1] = static_cast<char>(FEC_WIRE_VERSION);
+    return datagram;
 }
 
 void NetworkManager::sendDatagram(const QByteArray& datagram, const QHostAddress& host, quint16 port) {
-    qint64 sent = socket->writeDatagram(datagram, host, port);
-    if (sent == -1) {
-        qDebug() << "Failed to send datagram:" << socket->errorString();
+    if (!transport) {
+        return;
+    }
+    if (options.fragmentMtu > 0 && datagram.size() > options.fragmentMtu &&
+        Message::detectFormat(datagram) == Message::BINARY_FORMAT && sendFragmented(datagram, host, port)) {
+        return;
+    }
+    if (!transport->send(datagram, host, port)) {
+        qDebug() << "Failed to send datagram:" << transport->errorString();
+    }
+}
+
+bool NetworkManager::sendFragmented(const QByteArray& datagram, const QHostAddress& host, quint16 port) {
+    // Peers that cannot reassemble are left to IP fragmentation
+    auto peer = peers.constFind(findPeerByAddress(host, port));
+    if (peer == peers.constEnd() || peer.value().wireVersion < FRAGMENT_WIRE_VERSION) {
+        return false;
+    }
+
+    // Every fragment but the last fills the MTU
+    Message fragment("", nodeId, peer.value().peerId, static_cast<int>(nextTransferId), Message::FRAGMENT);
+    const int overhead = fragment.toDatagram(Message::BINARY_FORMAT).size() + 4 + Reassembler::FRAGMENT_HEADER_SIZE;
+    const QList<QByteArray> payloads = Reassembler::split(datagram, options.fragmentMtu - overhead);
+    if (payloads.isEmpty()) {
+        qDebug() << "Datagram of" << datagram.size() << "bytes is too large to fragment";
+        return false;
+    }
+
+    QList<QByteArray> fragments;
+    for (const QByteArray& payload : payloads) {
+        fragment.setPayload(payload);
+        fragments.append(fragment.toDatagram(Message::BINARY_FORMAT));
+    }
+    sentFragments.insert(nextTransferId++, fragments, monotonicClock.elapsed());
+
+    for (const QByteArray& piece : fragments) {
+        sendDatagram(piece, host, port);
+    }
+    return true;
+}
+
+int NetworkManager::sendMessages(const QList<Message>& messages, NodeIndex peer, const QHostAddress& host, quint16 port) {
+    Message::WireFormat format = wireFormatFor(peer);
+    if (format != Message::BINARY_FORMAT || options.batchMtu <= 0) {
+        // JSON-only peers predate batches
+        for (const Message& msg : messages) {
+            sendDatagram(msg.toDatagram(format), host, port);
+        }
+        return messages.size();
+    }
+
+    // Pack as many messages as fit under the MTU into each BATCH datagram
+    Message batch("", nodeId, NodeRegistry::global().name(peer), 0, Message::BATCH);
+    const int envelope = batch.toDatagram(Message::BINARY_FORMAT).size() + 4;  // + payload length
+    QByteArray payload;
+    QByteArray last;
+    int packed = 0;
+    int datagrams = 0;
+
+    auto flush = [&]() {
+        if (packed == 1) {
+            sendDatagram(last, host, port);  // No point wrapping a lone message
+        } else if (packed > 1) {
+            batch.setPayload(payload);
+            sendDatagram(batch.toDatagram(Message::BINARY_FORMAT), host, port);
+        }
+        datagrams += packed > 0 ? 1 : 0;
+        payload.clear();
+        packed = 0;
+    };
+
+    for (const Message& msg : messages) {
+        QByteArray datagram = msg.toDatagram(Message::BINARY_FORMAT);
+        const int entry = Message::BATCH_ENTRY_HEADER_SIZE + datagram.size();
+        if (envelope + payload.size() + entry > options.batchMtu) {
+            flush();
+        }
+        if (envelope + entry > options.batchMtu) {
+            sendDatagram(datagram, host, port);  // Too big to share a datagram
+            ++datagrams;
+            continue;
+        }
+        Message::appendToBatch(payload, datagram);
+        last = datagram;
+        ++packed;
+    }
+    flush();
+    return datagrams;
+}
+
+Message::WireFormat NetworkManager::wireFormatFor(NodeIndex peer) const {
+    // Stay on JSON until the peer has advertised that it understands the binary format
+    auto it = peers.find(peer);
+    if (it != peers.end() && it.value().wireVersion >= 1) {
+        return Message::BINARY_FORMAT;
     }
+    return Message::JSON_FORMAT;
 }
 
 void NetworkManager::onDataReceived() {
-    while (socket->hasPendingDatagrams()) {
-        QByteArray datagram;
-        datagram.resize(socket->pendingDatagramSize());
-        QHostAddress senderHost;
-        quint16 senderPort;
+    while (transport->receive(receivedBatch) > 0) {
+        for (const DatagramTransport::Datagram& datagram : receivedBatch) {
+            processDatagram(datagram.data, datagram.size, datagram.host, datagram.port);
+        }
+    }
+
+    // Replies to the whole burst leave together
+    transport->flush();
+}
 
-        qint64 received = socket->readDatagram(datagram.data(), datagram.size(), &senderHost, &senderPort);
+void NetworkManager::startReceiveWorkers(int count) {
+    for (int i = 1; i <= count; ++i) {
+        ReceiveWorker* worker = new ReceiveWorker(i, transport->backend(), nodeIdUtf8, messageStore, this);
+        if (!worker->start(options.bindAddress, static_cast<quint16>(serverPort))) {
+            delete worker;
+            break;
+        }
+        connect(worker, &ReceiveWorker::handoffReady, this, &NetworkManager::drainReceiveWorkers);
+        receiveWorkers.append(worker);
+    }
 
-        if (received > 0) {
-            Message message = Message::fromDatagram(datagram);
+    if (!receiveWorkers.isEmpty()) {
+        qDebug() << "Receiving on" << receiveWorkers.size() + 1 << "SO_REUSEPORT sockets";
+    }
+}
 
-            if (message.getOrigin() == nodeId) {
-                // Ignore messages from self
-                continue;
-            }
+void NetworkManager::drainReceiveWorkers() {
+    QVector<ReceiveWorker::Handoff> handoffs;
+    for (ReceiveWorker* worker : receiveWorkers) {
+        worker->takeHandoffs(handoffs);
+    }
+
+    for (const ReceiveWorker::Handoff& handoff : handoffs) {
+        switch (handoff.kind) {
+            case ReceiveWorker::Handoff::STORED:
+                updateRelay(handoff.wireVersion, handoff.host, handoff.port);
+                handleChatMessage(handoff.message, true);
+                break;
+            case ReceiveWorker::Handoff::SEEN:
+                updateRelay(handoff.wireVersion, handoff.host, handoff.port);
+                if (handoff.direct) {
+                    queueAck(handoff.sender, handoff.sequenceNumber, true);
+                }
+                break;
+            case ReceiveWorker::Handoff::RAW:
+                processDatagram(handoff.datagram.constData(), handoff.datagram.size(), handoff.host, handoff.port);
+                break;
+        }
+    }
 
-            processReceivedMessage(message, senderHost, senderPort);
+    transport->flush();
+}
+
+void NetworkManager::processDatagram(const char* data, int size, const QHostAddress& senderHost, quint16 senderPort) {
+    // Binary datagrams: ACKs and duplicates are handled straight from the header
+    MessageView view(data, size);
+    if (view.isValid()) {
+        if (view.originEquals(nodeIdUtf8)) {
+            return;  // Ignore messages from self
         }
+        if (processReceivedView(view, senderHost, senderPort)) {
+            return;
+        }
+    }
+
+    Message message = Message::fromDatagram(QByteArray::fromRawData(data, size));
+
+    if (message.getOrigin() == nodeId) {
+        // Ignore messages from self
+        return;
+    }
+
+    processReceivedMessage(message, senderHost, senderPort);
+}
+
+bool NetworkManager::processReceivedView(const MessageView& view, const QHostAddress& senderHost, quint16 senderPort) {
+    Message::MessageType type = view.getType();
+    if (type == Message::HEARTBEAT) {
+        NodeIndex sender = NodeRegistry::global().intern(view.originData(), view.originSize());
+        updatePeer(sender, QString(), view.getWireVersion(), senderHost, senderPort);
+        handleHeartbeat(sender);
+        return true;
+    }
+    if (type != Message::ACK && type != Message::CHAT_MESSAGE) {
+        return false;
+    }
+    if (type == Message::ACK && view.hasVectorClock()) {
+        return false;  // Cumulative ACKs need their clock decoded
+    }
+
+    NodeIndex sender = NodeRegistry::global().intern(view.originData(), view.originSize());
+
+    // New chat messages need the full Message to be stored and delivered
+    if (type == Message::CHAT_MESSAGE &&
+        !hasMessage(NodeRegistry::messageKey(sender, static_cast<quint32>(view.getSequenceNumber())))) {
+        return false;
+    }
+
+    if (type == Message::ACK) {
+        updatePeer(sender, QString(), view.getWireVersion(), senderHost, senderPort);
+    } else {
+        updateRelay(view.getWireVersion(), senderHost, senderPort);
+    }
+
+    if (type == Message::ACK) {
+        acknowledge(view.getMessageIdSequence());
+    } else if (view.destinationEquals(nodeIdUtf8)) {
+        queueAck(sender, view.getSequenceNumber(), true);  // Our ACK was lost: the sender retransmitted
     }
+
+    return true;
 }
 
 void NetworkManager::processReceivedMessage(const Message& message, const QHostAddress& senderHost, quint16 senderPort) {
-    // Update peer info
-    QString senderId = message.getOrigin();
-    if (!peers.contains(senderId)) {
-        addPeer(senderId, senderHost.toString(), senderPort);
+    if (message.getType() == Message::CHAT_MESSAGE) {
+        updateRelay(message.getWireVersion(), senderHost, senderPort);
     } else {
-        peers[senderId].lastSeen = QDateTime::currentMSecsSinceEpoch();
-        if (!peers[senderId].isActive) {
-            peers[senderId].isActive = true;
-            emit peerStatusChanged(senderId, true);
-        }
+        updatePeer(NodeRegistry::global().intern(message.getOrigin()), message.getOrigin(),
+                   message.getWireVersion(), senderHost, senderPort);
     }
 
     switch (message.getType()) {
@@ -211,219 +628,1331 @@ void NetworkManager::processReceivedMessage(const Message& message, const QHostA
         case Message::ANTI_ENTROPY_RESPONSE:
             handleAntiEntropyResponse(message);
             break;
+        case Message::ANTI_ENTROPY_DIGEST:
+            handleAntiEntropyDigest(message, senderHost, senderPort);
+            break;
+        case Message::BATCH:
+            handleBatch(message, senderHost, senderPort);
+            break;
         case Message::ACK:
             handleAck(message);
             break;
+        case Message::FRAGMENT:
+            handleFragment(message, senderHost, senderPort);
+            break;
+        case Message::FRAGMENT_NACK:
+            handleFragmentNack(message, senderHost, senderPort);
+            break;
+        case Message::HEARTBEAT:
+            handleHeartbeat(NodeRegistry::global().intern(message.getOrigin()));
+            break;
+        case Message::PING:
+            handlePing(message, senderHost, senderPort);
+            break;
+        case Message::PING_REQ:
+            handlePingRequest(message, senderHost, senderPort);
+            break;
+        case Message::PING_ACK:
+            handlePingAck(message, senderHost, senderPort);
+            break;
+        case Message::GOSSIP:
+            handleGossip(message);
+            break;
+        case Message::IHAVE:
+            handleAnnouncement(message);
+            break;
+        case Message::GRAFT:
+            handleGraft(message);
+            break;
+        case Message::PRUNE:
+            broadcastTree.prune(NodeRegistry::global().intern(message.getOrigin()));
+            break;
+        case Message::FEC_PARITY:
+            handleParity(message);
+            break;
+    }
+}
+
+void NetworkManager::updatePeer(NodeIndex sender, const QString& senderId, int wireVersion,
+                                const QHostAddress& senderHost, quint16 senderPort) {
+    // Only for datagrams the origin sent itself: those are never relayed
+    auto it = peers.find(sender);
+    if (it == peers.end()) {
+        addPeer(senderId.isEmpty() ? NodeRegistry::global().name(sender) : senderId, senderHost, senderPort);
+        it = peers.find(sender);
+        if (it == peers.end()) {
+            return;
+        }
+    } else {
+        if (it.value().port == senderPort && it.value().address == senderHost &&
+            findPeerByAddress(senderHost, senderPort) != sender) {
+            it = peers.relocate(sender, senderHost, senderPort);  // Claims the endpoint if its holder has gone
+        }
+        it.value().lastSeen = QDateTime::currentMSecsSinceEpoch();
+        // Members come back by refuting their death, not by being heard from
+        if (!it.value().isActive && !membership.contains(sender)) {
+            it.value().isActive = true;
+            hurryAntiEntropy();
+            emit peerStatusChanged(it.value().peerId, true);
+        }
+    }
+
+    it.value().wireVersion = qMin(static_cast<int>(Message::WIRE_VERSION), wireVersion);
+}
+
+void NetworkManager::updateRelay(int wireVersion, const QHostAddress& senderHost, quint16 senderPort) {
+    // Chat messages arrive from their origin or from anyone relaying them
+    // (anti-entropy, batches, tree pushes), so they only vouch for whoever is
+    // at the sending endpoint, and never introduce a peer
+    NodeIndex relay = findPeerByAddress(senderHost, senderPort);
+    if (relay != NodeRegistry::INVALID_NODE) {
+        updatePeer(relay, QString(), wireVersion, senderHost, senderPort);
+    }
+}
+
+void NetworkManager::handleBatch(const Message& batch, const QHostAddress& senderHost, quint16 senderPort) {
+    const QList<QByteArray> datagrams = Message::unpackBatch(batch.getPayload());
+    if (datagrams.isEmpty()) {
+        qDebug() << "Dropping malformed batch from" << batch.getOrigin();
+        return;
+    }
+
+    // Batches only ever carry binary datagrams, and never other batches
+    for (const QByteArray& datagram : datagrams) {
+        MessageView view(datagram.constData(), datagram.size());
+        if (view.isValid() && view.getType() != Message::BATCH) {
+            processDatagram(datagram.constData(), datagram.size(), senderHost, senderPort);
+        }
+    }
+}
+
+void NetworkManager::handleFragment(const Message& message, const QHostAddress& senderHost, quint16 senderPort) {
+    QByteArray datagram;
+    NodeIndex sender = NodeRegistry::global().intern(message.getOrigin());
+    if (reassembler.add(sender, static_cast<quint32>(message.getSequenceNumber()), message.getPayload(),
+                        monotonicClock.elapsed(), datagram)) {
+        // Whole again: handled as if it had arrived in one piece. Fragments never nest.
+        MessageView view(datagram.constData(), datagram.size());
+        if (view.isValid() && view.getType() != Message::FRAGMENT) {
+            processDatagram(datagram.constData(), datagram.size(), senderHost, senderPort);
+        }
+    }
+
+    if (!reassembler.isEmpty() && !fragmentTimer->isActive()) {
+        fragmentTimer->start(FRAGMENT_NACK_INTERVAL);
+    }
+}
+
+void NetworkManager::handleFragmentNack(const Message& message, const QHostAddress& senderHost, quint16 senderPort) {
+    const QVector<quint16> missing = Reassembler::decodeNack(message.getPayload());
+    const QList<QByteArray> fragments = sentFragments.find(static_cast<quint32>(message.getSequenceNumber()), missing,
+                                                           monotonicClock.elapsed());
+    for (const QByteArray& fragment : fragments) {
+        sendDatagram(fragment, senderHost, senderPort);
+    }
+
+    if (!fragments.isEmpty()) {
+        qDebug() << "Resent" << fragments.size() << "fragments of transfer" << message.getSequenceNumber()
+                 << "to" << message.getOrigin();
+    }
+}
+
+void NetworkManager::onFragmentTimeout() {
+    QVector<Reassembler::Stalled> stalled;
+    reassembler.poll(monotonicClock.elapsed(), FRAGMENT_NACK_INTERVAL, stalled);
+
+    for (const Reassembler::Stalled& transfer : stalled) {
+        auto peer = peers.constFind(transfer.sender);
+        if (peer == peers.constEnd()) {
+            continue;
+        }
+        Message nack("", nodeId, peer.value().peerId, static_cast<int>(transfer.transfer), Message::FRAGMENT_NACK);
+        nack.setPayload(Reassembler::encodeNack(transfer.missing));
+        sendDatagram(nack.toDatagram(Message::BINARY_FORMAT), peer.value().address, peer.value().port);
+    }
+
+    if (reassembler.isEmpty()) {
+        fragmentTimer->stop();
+    }
+    if (transport) {
+        transport->flush();
     }
 }
 
-void NetworkManager::handleChatMessage(const Message& message) {
+void NetworkManager::handleChatMessage(const Message& message, bool stored) {
     // Check if this is for us or broadcast
     bool isForUs = message.getDestination() == nodeId || message.isBroadcast();
-    bool alreadyHave = hasMessage(message.getMessageId());
+    NodeIndex origin = NodeRegistry::global().intern(message.getOrigin());
+    MessageKey key = NodeRegistry::messageKey(origin, static_cast<quint32>(message.getSequenceNumber()));
+    bool alreadyHave = !stored && hasMessage(key);
 
-    // Store message if we haven't seen it
+    // Store message if we haven't seen it; a receive worker may already have
     if (!alreadyHave) {
-        storeMessage(message);
-        updateVectorClock(message.getOrigin(), message.getSequenceNumber());
+        if (!stored && !messageStore.insert(origin, message)) {
+            if (!hasMessage(key)) {
+                qDebug() << "Dropping message" << message.getMessageId() << "outside the storable sequence range";
+            }
+            return;  // Otherwise a worker stored it first and hands it over itself
+        }
+        recordStored(origin, message);
+        updateVectorClock(origin, message.getSequenceNumber());
     }
 
-    // Deliver if it's for us (even if we've seen it before via anti-entropy)
+    // Deliver if it's for us and new, whether it arrived directly or via anti-entropy
     // But NOT if we're the sender (origin == our nodeId)
-    if (isForUs && message.getOrigin() != nodeId) {
-        // For broadcasts: always deliver even if seen before (might come via anti-entropy first)
-        // For direct messages: only deliver if new
-        if (message.isBroadcast() || !alreadyHave) {
-            emit messageReceived(message);
+    if (isForUs && !alreadyHave && message.getOrigin() != nodeId) {
+        deliverInOrder(origin, message);
+    }
+
+    // ACK anything sent directly to us (not broadcast); a duplicate means our
+    // earlier ACK was lost, so it is acknowledged again
+    if (message.getDestination() == nodeId && message.getOrigin() != nodeId) {
+        queueAck(origin, message.getSequenceNumber(), alreadyHave);
+    }
+}
+
+void NetworkManager::deliverInOrder(NodeIndex origin, const Message& message) {
+    // A direct message waits until its predecessor in the sender's stream has
+    // been delivered. Having it stored is not enough: a receive worker may
+    // have stored it without our having delivered it yet
+    const int previous = message.getPreviousSequence();
+    if (previous > 0 && !message.isBroadcast()) {
+        if (static_cast<quint32>(previous) > lastDelivered.value(origin) &&
+            reorderBuffer.hold(origin, message, monotonicClock.elapsed())) {
+            QList<Message> released;
+            reorderBuffer.takeExpired(monotonicClock.elapsed(), released);  // Only if over the limit
+            for (const Message& msg : released) {
+                deliverWithSuccessors(NodeRegistry::global().intern(msg.getOrigin()), msg);
+            }
+            if (!reorderTimer->isActive()) {
+                armReorderTimer();
+            }
+            return;
         }
     }
 
-    // Send ACK if it's directly to us (not broadcast) and is new
-    if (!alreadyHave && message.getDestination() == nodeId) {
-        Message ack("", nodeId, message.getOrigin(), 0, Message::ACK);
-        ack.setMessageId(message.getMessageId());
-        sendDirectMessage(ack, message.getOrigin());
+    deliverWithSuccessors(origin, message);
+}
+
+void NetworkManager::deliverWithSuccessors(NodeIndex origin, const Message& message) {
+    deliver(origin, message);
+
+    // Each delivery may unblock the next message of the stream
+    Message next;
+    MessageKey delivered = NodeRegistry::messageKey(origin, static_cast<quint32>(message.getSequenceNumber()));
+    while (reorderBuffer.takeSuccessor(delivered, next)) {
+        deliver(origin, next);
+        delivered = NodeRegistry::messageKey(origin, static_cast<quint32>(next.getSequenceNumber()));
+    }
+}
+
+void NetworkManager::deliver(NodeIndex origin, const Message& message) {
+    if (!message.isBroadcast()) {
+        // Never moves back: a late message released past a hole is older
+        quint32& last = lastDelivered[origin];
+        last = qMax(last, static_cast<quint32>(message.getSequenceNumber()));
+    }
+    emit messageReceived(message);
+}
+
+void NetworkManager::onReorderTimeout() {
+    QList<Message> released;
+    reorderBuffer.takeExpired(monotonicClock.elapsed(), released);
+    for (const Message& msg : released) {
+        qDebug() << "Delivering" << msg.getMessageId() << "without its predecessor" << msg.getPreviousSequence();
+        deliverWithSuccessors(NodeRegistry::global().intern(msg.getOrigin()), msg);
+    }
+    armReorderTimer();
+}
+
+void NetworkManager::armReorderTimer() {
+    const qint64 expiry = reorderBuffer.nextExpiry();
+    if (expiry < 0) {
+        reorderTimer->stop();
+        return;
     }
+    reorderTimer->start(static_cast<int>(qMax<qint64>(0, expiry - monotonicClock.elapsed())));
 }
 
 void NetworkManager::handleAntiEntropyRequest(const Message& message, const QHostAddress& senderHost, quint16 senderPort) {
     QString senderId = message.getOrigin();
 
     // Compare vector clocks
-    QVariantMap remoteVectorClock = message.getVectorClock();
+    NodeIndex sender = NodeRegistry::global().intern(senderId);
+    VectorClock remoteVectorClock = message.getVectorClock();
+    recordPeerClock(sender, remoteVectorClock);
+    antiEntropyScheduler.exchanged(sender, monotonicClock.elapsed(),
+                                   AntiEntropyScheduler::divergence(vectorClock, remoteVectorClock));
     QList<Message> missingMessages = getMissingMessages(remoteVectorClock);
 
-    // Only log if there are missing messages
-    if (!missingMessages.isEmpty()) {
-        qDebug() << "Anti-entropy: Sending" << missingMessages.size() << "missing messages to" << senderId;
-    }
-
     // Send response with our vector clock
     Message response("", nodeId, senderId, 0, Message::ANTI_ENTROPY_RESPONSE);
     response.setVectorClock(vectorClock);
+    sendDatagram(response.toDatagram(wireFormatFor(sender)), senderHost, senderPort);
 
-    // Include missing messages in the response
-    // For simplicity, we send them as separate messages
-    sendDatagram(response.toDatagram(), senderHost, senderPort);
-
-    for (const Message& msg : missingMessages) {
-        sendDatagram(msg.toDatagram(), senderHost, senderPort);
+    // Followed by the missing messages, batched under the MTU
+    if (!missingMessages.isEmpty()) {
+        int datagrams = sendMessages(missingMessages, sender, senderHost, senderPort);
+        qDebug() << "Anti-entropy: Sent" << missingMessages.size() << "missing messages to" << senderId
+                 << "in" << datagrams << "datagrams";
     }
 }
 
 void NetworkManager::handleAntiEntropyResponse(const Message& message) {
     // Update our knowledge of what the peer has
-    QVariantMap remoteVectorClock = message.getVectorClock();
+    VectorClock remoteVectorClock = message.getVectorClock();
+    NodeIndex peer = NodeRegistry::global().intern(message.getOrigin());
+    recordPeerClock(peer, remoteVectorClock);
+    antiEntropyScheduler.exchanged(peer, monotonicClock.elapsed(),
+                                   AntiEntropyScheduler::divergence(vectorClock, remoteVectorClock));
 
-    // Send missing messages to the peer
+    // Send missing messages to the peer; anti-entropy sync needs no ACKs
     QList<Message> missingMessages = getMissingMessages(remoteVectorClock);
+    auto it = peers.find(peer);
+    if (missingMessages.isEmpty() || it == peers.end()) {
+        return;
+    }
 
-    // Only log if there are missing messages
-    if (!missingMessages.isEmpty()) {
-        qDebug() << "Anti-entropy: Sending" << missingMessages.size() << "missing messages to" << message.getOrigin();
+    int datagrams = sendMessages(missingMessages, peer, it.value().address, it.value().port);
+    qDebug() << "Anti-entropy: Sent" << missingMessages.size() << "missing messages to" << message.getOrigin()
+             << "in" << datagrams << "datagrams";
+}
+
+void NetworkManager::handleAntiEntropyDigest(const Message& message, const QHostAddress& senderHost, quint16 senderPort) {
+    // Answered whatever our own mode is, so mixed clusters still converge
+    DigestPayload incoming;
+    if (!DigestPayload::decode(message.getPayload(), incoming)) {
+        qDebug() << "Anti-entropy: malformed digest from" << message.getOrigin();
+        return;
     }
 
-    for (const Message& msg : missingMessages) {
-        sendDirectMessage(msg, message.getOrigin(), false);  // Don't require ACK for anti-entropy sync
+    NodeIndex peer = NodeRegistry::global().intern(message.getOrigin());
+    if (incoming.kind == DigestPayload::ROOT && incoming.root == digestTree.root()) {
+        // Same root, same set of messages: the peer has seen everything we have
+        recordPeerClock(peer, vectorClock);
+        antiEntropyScheduler.exchanged(peer, monotonicClock.elapsed(), 0);
+        return;
     }
-}
 
-void NetworkManager::handleAck(const Message& message) {
-    QString messageId = message.getMessageId();
+    DigestPayload reply;
+    QVector<VectorClock::Gap> push;
+    digestTree.answer(incoming, vectorClock, reply, push);
 
-    if (pendingAcks.contains(messageId)) {
-        qDebug() << "Received ACK for message" << messageId;
-        pendingAcks.remove(messageId);
+    QList<Message> missing;
+    for (const VectorClock::Gap& gap : push) {
+        missing.append(storedRange(gap.node, gap.from, gap.to));
+    }
+    // Digests only show that something differs; what we push is a lower bound
+    antiEntropyScheduler.exchanged(peer, monotonicClock.elapsed(), qMax(1, missing.size()));
+    if (!missing.isEmpty()) {
+        int datagrams = sendMessages(missing, peer, senderHost, senderPort);
+        qDebug() << "Anti-entropy: Sent" << missing.size() << "missing messages to" << message.getOrigin()
+                 << "in" << datagrams << "datagrams";
     }
-}
 
-void NetworkManager::onAntiEntropyTimeout() {
-    performAntiEntropy();
+    // An empty ORIGINS still matters: it tells the peer we have nothing at all
+    if (reply.kind == DigestPayload::ORIGINS || !reply.isEmpty()) {
+        sendDigest(reply, message.getOrigin(), senderHost, senderPort);
+    }
 }
 
-void NetworkManager::performAntiEntropy() {
-    if (peers.isEmpty()) {
+void NetworkManager::sendDigest(const DigestPayload& payload, const QString& peerId, const QHostAddress& host, quint16 port) {
+    Message::WireFormat format = wireFormatFor(NodeRegistry::global().intern(peerId));
+    auto send = [&](const DigestPayload& part) {
+        Message digest("", nodeId, peerId, 0, Message::ANTI_ENTROPY_DIGEST);
+        digest.setPayload(part.encode());
+        sendDatagram(digest.toDatagram(format), host, port);
+    };
+
+    // ORIGINS must arrive whole, since the peer pushes every origin it doesn't
+    // list; it holds one node per origin, so it stays far below a datagram
+    if (payload.kind != DigestPayload::DESCEND) {
+        send(payload);
         return;
     }
 
-    // Send anti-entropy request to a random active peer
-    QList<QString> activePeerIds;
-    for (auto it = peers.begin(); it != peers.end(); ++it) {
-        if (it.value().isActive) {
-            activePeerIds.append(it.key());
+    DigestPayload part;
+    part.kind = DigestPayload::DESCEND;
+    for (const DigestPayload::Node& node : payload.nodes) {
+        part.nodes.append(node);
+        if (part.nodes.size() == MAX_DIGEST_ENTRIES) {
+            send(part);
+            part.nodes.clear();
         }
     }
+    for (const DigestPayload::Leaf& leaf : payload.leaves) {
+        part.leaves.append(leaf);
+        if (part.nodes.size() + part.leaves.size() >= MAX_DIGEST_ENTRIES) {
+            send(part);
+            part.nodes.clear();
+            part.leaves.clear();
+        }
+    }
+    if (!part.isEmpty()) {
+        send(part);
+    }
+}
 
-    if (activePeerIds.isEmpty()) {
+void NetworkManager::recordPeerClock(NodeIndex peer, const VectorClock& clock) {
+    auto it = peers.find(peer);
+    if (it == peers.end()) {
         return;
     }
 
-    int randomIndex = QRandomGenerator::global()->bounded(activePeerIds.size());
-    QString randomPeerId = activePeerIds[randomIndex];
+    // Clocks only move forward, so merging tolerates reordered exchanges
+    it.value().knownClock.merge(clock);
+    collectGarbage();
+}
 
-    Message request("", nodeId, randomPeerId, 0, Message::ANTI_ENTROPY_REQUEST);
-    request.setVectorClock(vectorClock);
+void NetworkManager::handleAck(const Message& message) {
+    // Cumulative ACKs carry what the peer has received from us
+    const VectorClock clock = message.getVectorClock();
+    if (!clock.isEmpty()) {
+        acknowledgeClock(NodeRegistry::global().intern(message.getOrigin()), clock);
+        return;
+    }
 
-    // Silent - don't log routine anti-entropy
-    sendDirectMessage(request, randomPeerId);
+    // Older peers name our message as "origin_sequence"
+    QString messageId = message.getMessageId();
+    int separator = messageId.lastIndexOf('_');
+    bool ok = false;
+    int sequenceNumber = messageId.mid(separator + 1).toInt(&ok);
+
+    if (separator > 0 && ok) {
+        acknowledge(sequenceNumber);
+    }
 }
 
-void NetworkManager::checkPendingAcks() {
-    qint64 now = QDateTime::currentMSecsSinceEpoch();
-    QList<QString> toRetry;
+void NetworkManager::acknowledge(int sequenceNumber, bool sampleRtt) {
+    auto it = pendingAcks.find(sequenceNumber);
+    if (it == pendingAcks.end()) {
+        return;
+    }
 
-    for (auto it = pendingAcks.begin(); it != pendingAcks.end(); ) {
-        PendingMessage& pending = it.value();
+    const PendingMessage& pending = it.value();
+    const NodeIndex target = pending.targetPeer;
+    retransmitWheel.cancel(pending.timer);
 
-        if (now - pending.sentTime > ACK_TIMEOUT) {
-            if (pending.retryCount < MAX_RETRIES) {
-                qDebug() << "Retry sending message" << pending.message.getMessageId()
-                         << "attempt" << (pending.retryCount + 1);
-                toRetry.append(it.key());
-                ++it;
-            } else {
-                qDebug() << "Message" << pending.message.getMessageId() << "failed after" << MAX_RETRIES << "retries";
-                it = pendingAcks.erase(it);
-            }
-        } else {
-            ++it;
+    // Karn: after a retransmission the ACK could answer either copy
+    auto peer = peers.find(target);
+    if (peer != peers.end()) {
+        if (sampleRtt && pending.retryCount == 0) {
+            peer.value().rtt.sample(monotonicClock.elapsed() - pending.sentTime);
         }
+        peer.value().awaitingAck.remove(sequenceNumber);
     }
 
-    // Retry messages (check if still pending - ACK may have arrived)
-    for (const QString& messageId : toRetry) {
-        if (pendingAcks.contains(messageId)) {
-            PendingMessage& pending = pendingAcks[messageId];
-            pending.retryCount++;
-            pending.sentTime = now;
-            sendDirectMessage(pending.message, pending.targetPeerId);
-        }
+    qDebug() << "Received ACK for message" << sequenceNumber;
+    pendingAcks.erase(it);
+
+    // The window grows and has a free slot
+    auto stream = sendStreams.find(target);
+    if (stream != sendStreams.end()) {
+        stream.value().window.onAck();
+        pumpStream(target);
     }
 }
 
-void NetworkManager::checkPeerHealth() {
-    qint64 now = QDateTime::currentMSecsSinceEpoch();
-
-    for (auto it = peers.begin(); it != peers.end(); ++it) {
-        PeerInfo& peer = it.value();
+void NetworkManager::acknowledgeClock(NodeIndex peerNode, const VectorClock& clock) {
+    auto peer = peers.find(peerNode);
+    if (peer == peers.end()) {
+        return;
+    }
 
-        if (peer.isActive && (now - peer.lastSeen > PEER_TIMEOUT)) {
-            qDebug() << "Peer" << peer.peerId << "timed out";
-            peer.isActive = false;
-            emit peerStatusChanged(peer.peerId, false);
+    QVector<int> covered;
+    int newest = 0;
+    for (int sequenceNumber : peer.value().awaitingAck) {
+        if (clock.contains(selfIndex, static_cast<quint32>(sequenceNumber))) {
+            covered.append(sequenceNumber);
+            newest = qMax(newest, sequenceNumber);
         }
     }
-}
 
-void NetworkManager::updateVectorClock(const QString& origin, int sequenceNumber) {
-    int currentMax = vectorClock.value(origin, 0).toInt();
-    if (sequenceNumber > currentMax) {
-        vectorClock[origin] = sequenceNumber;
+    // Older messages waited out the ACK delay, so only the newest gives a fair RTT sample
+    for (int sequenceNumber : covered) {
+        acknowledge(sequenceNumber, sequenceNumber == newest);
     }
 }
 
-bool NetworkManager::hasMessage(const QString& messageId) const {
-    return messageStore.contains(messageId);
+void NetworkManager::queueAck(NodeIndex origin, int sequenceNumber, bool duplicate) {
+    auto it = peers.find(origin);
+    if (it == peers.end()) {
+        return;
+    }
+
+    PeerInfo& peer = it.value();
+    if (peer.wireVersion < SACK_WIRE_VERSION) {
+        // Older peers expect one ACK per message, naming it
+        Message ack("", nodeId, peer.peerId, 0, Message::ACK);
+        ack.setMessageId(QString("%1_%2").arg(peer.peerId).arg(sequenceNumber));
+        sendDirectMessage(ack, origin);
+        return;
+    }
+
+    if (++peer.unacked == 1) {
+        delayedAcks.append(origin);
+    }
+    if (duplicate || peer.unacked >= ACK_COALESCE_LIMIT) {
+        sendDatagram(takeAck(peer), peer.address, peer.port);  // The sender is already waiting
+    } else if (!ackTimer->isActive()) {
+        ackTimer->start(ACK_DELAY);
+    }
 }
 
-void NetworkManager::storeMessage(const Message& message) {
-    messageStore[message.getMessageId()] = message;
+QByteArray NetworkManager::takeAck(PeerInfo& peer) {
+    // The watermark acknowledges everything up to it, the ranges what arrived above it
+    Message ack("", nodeId, peer.peerId, 0, Message::ACK);
+    ack.setVectorClock(vectorClock.slice(peer.node, MAX_SACK_RANGES));
+    peer.unacked = 0;
+    return ack.toDatagram(Message::BINARY_FORMAT);
 }
 
-QList<Message> NetworkManager::getMissingMessages(const QVariantMap& remoteVectorClock) const {
-    QList<Message> missing;
+void NetworkManager::flushAcks() {
+    for (NodeIndex node : delayedAcks) {
+        auto it = peers.find(node);
+        if (it != peers.end() && it.value().unacked > 0) {
+            sendDatagram(takeAck(it.value()), it.value().address, it.value().port);
+        }
+    }
+    delayedAcks.clear();
+
+    if (transport) {
+        transport->flush();
+    }
+}
+
+void NetworkManager::onAntiEntropyTimeout() {
+    antiEntropyTimer->start(antiEntropyScheduler.startRound());
+    performAntiEntropy();
+}
+
+void NetworkManager::hurryAntiEntropy() {
+    antiEntropyScheduler.hurry();
+    if (antiEntropyTimer->isActive() && antiEntropyTimer->remainingTime() > AntiEntropyScheduler::MIN_INTERVAL) {
+        antiEntropyTimer->start(AntiEntropyScheduler::MIN_INTERVAL);
+    }
+}
+
+void NetworkManager::performAntiEntropy() {
+    if (peers.isEmpty()) {
+        return;
+    }
+
+    // Favor peers we have not synced with lately, or that were far behind
+    QVector<NodeIndex> activePeers;
+    for (auto it = peers.begin(); it != peers.end(); ++it) {
+        if (it.value().isActive) {
+            activePeers.append(it.key());
+        }
+    }
+
+    if (activePeers.isEmpty()) {
+        return;
+    }
+
+    NodeIndex chosen = antiEntropyScheduler.choosePeer(activePeers, monotonicClock.elapsed(),
+                                                       QRandomGenerator::global()->generateDouble());
+    const PeerInfo& target = peers.find(chosen).value();
+
+    if (options.antiEntropyMode == NetworkOptions::DIGEST_EXCHANGE) {
+        // Only the root goes out; matching replicas end the round right there
+        DigestPayload root;
+        root.kind = DigestPayload::ROOT;
+        root.root = digestTree.root();
+        root.height = digestTree.height();
+
+        Message request("", nodeId, target.peerId, 0, Message::ANTI_ENTROPY_DIGEST);
+        request.setPayload(root.encode());
+        sendDirectMessage(request, target.node);
+        return;
+    }
+
+    Message request("", nodeId, target.peerId, 0, Message::ANTI_ENTROPY_REQUEST);
+    request.setVectorClock(vectorClock);
+
+    // Silent - don't log routine anti-entropy
+    sendDirectMessage(request, target.node);
+}
+
+void NetworkManager::onRetransmitTimeout() {
+    QVector<quint64> expired;
+    retransmitWheel.advance(monotonicClock.elapsed(), expired);
+
+    for (quint64 key : expired) {
+        const int sequenceNumber = static_cast<int>(key);
+        auto it = pendingAcks.find(sequenceNumber);
+        if (it == pendingAcks.end()) {
+            continue;
+        }
+
+        PendingMessage& pending = it.value();
+        const NodeIndex target = pending.targetPeer;
+        pending.timer = TimerWheel::INVALID_TIMER;
+
+        // A timeout is taken as congestion
+        auto stream = sendStreams.find(target);
+        if (stream != sendStreams.end()) {
+            stream.value().window.onLoss(static_cast<quint32>(sequenceNumber), stream.value().highestSent);
+        }
+
+        if (pending.retryCount >= MAX_RETRIES) {
+            qDebug() << "Message" << pending.message.getMessageId() << "failed after" << MAX_RETRIES << "retries";
+            auto peer = peers.find(target);
+            if (peer != peers.end()) {
+                peer.value().awaitingAck.remove(sequenceNumber);
+            }
+            pendingAcks.erase(it);
+            pumpStream(target);  // Anti-entropy repairs it; the window slot is free
+            continue;
+        }
+
+        pending.retryCount++;
+        pending.sentTime = monotonicClock.elapsed();
+        qDebug() << "Retry sending message" << pending.message.getMessageId() << "attempt" << pending.retryCount;
+        sendDirectMessage(pending.message, pending.targetPeer);
+        scheduleRetransmit(sequenceNumber);
+    }
+
+    armRetransmitTimer();
+}
+
+void NetworkManager::scheduleRetransmit(int sequenceNumber) {
+    PendingMessage& pending = pendingAcks[sequenceNumber];
+    auto peer = peers.constFind(pending.targetPeer);
+    const qint64 timeout = peer != peers.constEnd() ? peer.value().rtt.backoff(pending.retryCount)
+                                                    : RttEstimator().backoff(pending.retryCount);
+
+    retransmitWheel.cancel(pending.timer);
+    pending.timer = retransmitWheel.schedule(pending.sentTime + timeout, static_cast<quint32>(sequenceNumber));
+    if (!retransmitTimer->isActive() || retransmitTimer->remainingTime() > timeout) {
+        armRetransmitTimer();
+    }
+}
+
+void NetworkManager::armRetransmitTimer() {
+    const qint64 deadline = retransmitWheel.nextDeadline();
+    if (deadline < 0) {
+        retransmitTimer->stop();
+        return;
+    }
+    retransmitTimer->start(static_cast<int>(qMax<qint64>(0, deadline - monotonicClock.elapsed())));
+}
+
+void NetworkManager::onHeartbeatTimeout() {
+    sendHeartbeats();
+    checkPeerHealth();
+}
+
+void NetworkManager::handleHeartbeat(NodeIndex sender) {
+    auto it = peers.find(sender);
+    if (it != peers.end()) {
+        it.value().heartbeats.heartbeat(monotonicClock.elapsed());
+    }
+}
+
+void NetworkManager::sendHeartbeats() {
+    // Suspected peers get them too, so a healed partition is noticed from
+    // both sides without waiting for other traffic
+    Message heartbeat("", nodeId, "broadcast", 0, Message::HEARTBEAT);
+    QByteArray encoded[2];
+    for (auto it = peers.begin(); it != peers.end(); ++it) {
+        if (membership.contains(it.key())) {
+            continue;  // Probed instead
+        }
+        Message::WireFormat format = wireFormatFor(it.key());
+        QByteArray& datagram = encoded[format];
+        if (datagram.isEmpty()) {
+            datagram = heartbeat.toDatagram(format);
+        }
+        sendDatagram(datagram, it.value().address, it.value().port);
+    }
+}
+
+void NetworkManager::onProbeTimeout() {
+    qint64 now = monotonicClock.elapsed();
+    QVector<Membership::Change> changes;
+
+    // The last period's probe went unanswered, directly and through others
+    if (currentProbe.target != NodeRegistry::INVALID_NODE && !currentProbe.acked &&
+        membership.suspect(currentProbe.target, now)) {
+        Membership::Change change;
+        change.node = currentProbe.target;
+        change.state = Membership::SUSPECT;
+        change.joined = false;
+        changes.append(change);
+    }
+    membership.expireSuspects(now, PROTOCOL_PERIOD, changes);
+    applyMembershipChanges(changes);
+    refillBroadcastTree();
+
+    for (auto it = relayedProbes.begin(); it != relayedProbes.end();) {
+        if (now - it.value().sentAt > PROTOCOL_PERIOD) {
+            it = relayedProbes.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // Alone: keep knocking on the seeds until one answers
+    if (membership.aliveCount() == 0) {
+        for (const auto& seed : seeds) {
+            pingSeed(seed.first, seed.second);
+        }
+    }
+
+    // Now and then a dead member is pinged, so the two sides of a healed
+    // partition find each other and refute the deaths
+    if (++probeRounds % DEAD_RECHECK_PERIODS == 0) {
+        NodeIndex dead = membership.randomDeadMember();
+        if (dead != NodeRegistry::INVALID_NODE) {
+            sendPing(dead, 0);
+        }
+    }
+
+    currentProbe = Probe();
+    currentProbe.target = membership.nextProbeTarget();
+    if (currentProbe.target == NodeRegistry::INVALID_NODE) {
+        return;
+    }
+    currentProbe.id = nextProbeId++;
+    sendPing(currentProbe.target, currentProbe.id);
+    indirectProbeTimer->start(PROBE_TIMEOUT);
+}
+
+void NetworkManager::onIndirectProbeTimeout() {
+    if (currentProbe.acked || currentProbe.target == NodeRegistry::INVALID_NODE) {
+        return;
+    }
+
+    const Membership::Member* target = membership.find(currentProbe.target);
+    if (!target) {
+        return;
+    }
+    for (NodeIndex helper : membership.randomMembers(INDIRECT_PROBES, currentProbe.target)) {
+        const Membership::Member* member = membership.find(helper);
+        sendMembershipMessage(Message::PING_REQ, currentProbe.id, target->id, helper,
+                              membership.takeGossip(helper), member->address, member->port);
+    }
+}
+
+void NetworkManager::handlePing(const Message& message, const QHostAddress& senderHost, quint16 senderPort) {
+    NodeIndex sender = NodeRegistry::global().intern(message.getOrigin());
+
+    // A newcomer gets our whole view in the ACK; everyone else, the gossip
+    bool joined = applyGossip(message, sender, senderHost, senderPort);
+    QByteArray payload = joined ? membership.encodeAll() : membership.takeGossip(sender);
+    sendMembershipMessage(Message::PING_ACK, static_cast<quint32>(message.getSequenceNumber()), message.getOrigin(),
+                          sender, payload, senderHost, senderPort);
+}
+
+void NetworkManager::handlePingRequest(const Message& message, const QHostAddress& senderHost, quint16 senderPort) {
+    NodeIndex sender = NodeRegistry::global().intern(message.getOrigin());
+    applyGossip(message, sender, senderHost, senderPort);
+
+    NodeIndex target = NodeRegistry::global().intern(message.getDestination());
+    if (!membership.contains(target)) {
+        return;
+    }
+
+    RelayedProbe relayed;
+    relayed.requester = sender;
+    relayed.probe = static_cast<quint32>(message.getSequenceNumber());
+    relayed.sentAt = monotonicClock.elapsed();
+    quint32 id = nextProbeId++;
+    relayedProbes.insert(id, relayed);
+    sendPing(target, id);
+}
+
+void NetworkManager::handlePingAck(const Message& message, const QHostAddress& senderHost, quint16 senderPort) {
+    applyGossip(message, NodeRegistry::global().intern(message.getOrigin()), senderHost, senderPort);
+
+    quint32 probe = static_cast<quint32>(message.getSequenceNumber());
+    if (probe == 0) {
+        return;  // Answers a seed or farewell ping
+    }
+    if (probe == currentProbe.id) {
+        currentProbe.acked = true;  // Directly or through a helper
+        return;
+    }
+
+    // A probe we made for someone else: pass the good news on
+    auto it = relayedProbes.find(probe);
+    if (it == relayedProbes.end()) {
+        return;
+    }
+    const Membership::Member* requester = membership.find(it.value().requester);
+    if (requester) {
+        sendMembershipMessage(Message::PING_ACK, it.value().probe, requester->id, it.value().requester,
+                              membership.takeGossip(it.value().requester), requester->address, requester->port);
+    }
+    relayedProbes.erase(it);
+}
+
+bool NetworkManager::applyGossip(const Message& message, NodeIndex sender, const QHostAddress& senderHost, quint16 senderPort) {
+    qint64 now = monotonicClock.elapsed();
+    QVector<Membership::Change> changes;
+    membership.apply(message.getPayload(), senderHost, senderPort, now, changes);
+
+    // Whoever speaks the protocol to us is a member, even with nothing to gossip
+    if (!membership.contains(sender)) {
+        Membership::Update update;
+        update.id = message.getOrigin();
+        update.address = senderHost;
+        update.port = senderPort;
+        membership.apply(update, now, changes);
+    }
+    applyMembershipChanges(changes);
+
+    for (const Membership::Change& change : changes) {
+        if (change.node == sender && change.joined) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void NetworkManager::applyMembershipChanges(const QVector<Membership::Change>& changes) {
+    for (const Membership::Change& change : changes) {
+        const Membership::Member* member = membership.find(change.node);
+        auto it = peers.find(change.node);
+
+        if (change.state == Membership::ALIVE) {
+            if (it == peers.end()) {
+                addPeer(member->id, member->address, member->port);
+                continue;
+            }
+            if (it.value().port != member->port || it.value().address != member->address) {
+                // Rejoined from elsewhere: the old endpoint would swallow every send
+                qDebug() << "Member" << member->id << "moved to" << member->address.toString() << ":" << member->port;
+                it = peers.relocate(change.node, member->address, member->port);
+                it.value().rtt = RttEstimator();  // Measured on the old path
+            }
+            if (!it.value().isActive) {
+                it.value().isActive = true;
+                hurryAntiEntropy();
+                emit peerStatusChanged(it.value().peerId, true);
+            }
+            continue;
+        }
+
+        // Suspects are left out of broadcasts and anti-entropy until they refute
+        static const char* const stateNames[] = { "alive", "suspected", "dead", "gone" };
+        qDebug() << "Member" << member->id << "is" << stateNames[change.state];
+        broadcastTree.removeNeighbor(change.node);  // Replaced next period
+        pendingAnnouncements.remove(change.node);
+        if (it != peers.end() && it.value().isActive) {
+            it.value().isActive = false;
+            emit peerStatusChanged(it.value().peerId, false);
+        }
+    }
+}
+
+void NetworkManager::sendMembershipMessage(Message::MessageType type, quint32 probe, const QString& destination, NodeIndex to,
+                                           const QByteArray& payload, const QHostAddress& host, quint16 port) {
+    Message message("", nodeId, destination, static_cast<int>(probe), type);
+    message.setPayload(payload);
+    sendDatagram(message.toDatagram(wireFormatFor(to)), host, port);
+}
+
+void NetworkManager::sendPing(NodeIndex member, quint32 probe) {
+    const Membership::Member* target = membership.find(member);
+    if (target) {
+        sendMembershipMessage(Message::PING, probe, target->id, member, membership.takeGossip(member),
+                              target->address, target->port);
+    }
+}
+
+void NetworkManager::handleGossip(const Message& message) {
+    NodeIndex sender = NodeRegistry::global().intern(message.getOrigin());
+    const QByteArray datagram = message.getPayload();
+    Message chat = Message::fromDatagram(datagram);
+    if (!chat.isValid() || chat.getType() != Message::CHAT_MESSAGE || !chat.isBroadcast()) {
+        qDebug() << "Dropping malformed gossip from" << message.getOrigin();
+        return;
+    }
+
+    // A copy we already have, our own included, means this link is not in the tree
+    NodeIndex origin = NodeRegistry::global().intern(chat.getOrigin());
+    MessageKey key = NodeRegistry::messageKey(origin, static_cast<quint32>(chat.getSequenceNumber()));
+    if (broadcastTree.receivedPush(sender, key, hasMessage(key))) {
+        sendTreeMessage(Message::PRUNE, sender);
+        return;
+    }
+
+    handleChatMessage(chat);
+    if (hasMessage(key)) {
+        pushBroadcast(datagram, key, sender);  // Relayed as received, never re-encoded
+    }
+}
+
+void NetworkManager::handleAnnouncement(const Message& message) {
+    QVector<MessageKey> keys;
+    if (!BroadcastTree::decodeKeys(message.getPayload(), keys)) {
+        qDebug() << "Dropping malformed IHAVE from" << message.getOrigin();
+        return;
+    }
+
+    NodeIndex sender = NodeRegistry::global().intern(message.getOrigin());
+    qint64 now = monotonicClock.elapsed();
+    for (MessageKey key : keys) {
+        if (!hasMessage(key)) {
+            broadcastTree.announced(sender, key, now);
+        }
+    }
+    if (broadcastTree.isWaiting() && !graftTimer->isActive()) {
+        graftTimer->start(GRAFT_CHECK_INTERVAL);
+    }
+}
+
+void NetworkManager::handleGraft(const Message& message) {
+    NodeIndex sender = NodeRegistry::global().intern(message.getOrigin());
+    broadcastTree.graft(sender);
+    if (message.getPayload().isEmpty()) {
+        return;  // A new neighbor, not a repair
+    }
+
+    QVector<MessageKey> keys;
+    auto peer = peers.constFind(sender);
+    if (!BroadcastTree::decodeKeys(message.getPayload(), keys) || peer == peers.constEnd()) {
+        qDebug() << "Dropping GRAFT from" << message.getOrigin();
+        return;
+    }
+    Message gossip("", nodeId, "broadcast", 0, Message::GOSSIP);
+    for (MessageKey key : keys) {
+        quint32 sequence = NodeRegistry::keySequence(key);
+        const QList<Message> found = messageStore.range(NodeRegistry::keyNode(key), sequence - 1, sequence);
+        if (!found.isEmpty()) {
+            gossip.setPayload(found.first().toDatagram(Message::BINARY_FORMAT));
+            sendDatagram(gossip.toDatagram(Message::BINARY_FORMAT), peer.value().address, peer.value().port);
+        }
+    }
+}
+
+void NetworkManager::pushBroadcast(const QByteArray& datagram, MessageKey key, NodeIndex from) {
+    // Eager neighbors get the message itself, lazy ones only hear of it
+    Message gossip("", nodeId, "broadcast", 0, Message::GOSSIP);
+    gossip.setPayload(datagram);
+    const QByteArray envelope = gossip.toDatagram(Message::BINARY_FORMAT);
+    for (NodeIndex neighbor : broadcastTree.eager()) {
+        auto peer = peers.constFind(neighbor);
+        if (neighbor != from && peer != peers.constEnd()) {
+            sendDatagram(envelope, peer.value().address, peer.value().port);
+        }
+    }
+
+    for (NodeIndex neighbor : broadcastTree.lazy()) {
+        if (neighbor != from) {
+            pendingAnnouncements[neighbor].append(key);
+        }
+    }
+    if (!pendingAnnouncements.isEmpty() && !announceTimer->isActive()) {
+        announceTimer->start(ANNOUNCE_DELAY);
+    }
+}
+
+void NetworkManager::flushAnnouncements() {
+    for (auto it = pendingAnnouncements.constBegin(); it != pendingAnnouncements.constEnd(); ++it) {
+        const QVector<MessageKey>& keys = it.value();
+        for (int i = 0; i < keys.size(); i += BroadcastTree::MAX_KEYS) {
+            sendTreeMessage(Message::IHAVE, it.key(), BroadcastTree::encodeKeys(keys.mid(i, BroadcastTree::MAX_KEYS)));
+        }
+    }
+    pendingAnnouncements.clear();
+    if (transport) {
+        transport->flush();
+    }
+}
+
+void NetworkManager::onGraftTimeout() {
+    QVector<BroadcastTree::Graft> grafts;
+    broadcastTree.poll(monotonicClock.elapsed(), grafts);
+
+    // One GRAFT per announcer, listing everything we want from it
+    QHash<NodeIndex, QVector<MessageKey>> requests;
+    for (const BroadcastTree::Graft& graft : grafts) {
+        requests[graft.peer].append(graft.key);
+    }
+    for (auto it = requests.constBegin(); it != requests.constEnd(); ++it) {
+        const QVector<MessageKey>& keys = it.value();
+        for (int i = 0; i < keys.size(); i += BroadcastTree::MAX_KEYS) {
+            sendTreeMessage(Message::GRAFT, it.key(), BroadcastTree::encodeKeys(keys.mid(i, BroadcastTree::MAX_KEYS)));
+        }
+    }
+
+    if (!broadcastTree.isWaiting()) {
+        graftTimer->stop();
+    }
+    if (transport) {
+        transport->flush();
+    }
+}
+
+void NetworkManager::handleParity(const Message& message) {
+    FecDecoder::Parity parity;
+    if (!FecDecoder::decodeParity(message.getPayload(), parity)) {
+        qDebug() << "Dropping malformed parity from" << message.getOrigin();
+        return;
+    }
+
+    qint64 now = monotonicClock.elapsed();
+    fecDecoder.expire(now);
+    quint64 block = fecDecoder.add(NodeRegistry::global().intern(message.getOrigin()),
+                                   static_cast<quint32>(message.getSequenceNumber()), parity, now);
+    if (block != 0) {
+        recoverBroadcasts(block);
+    }
+}
+
+void NetworkManager::recoverBroadcasts(quint64 key) {
+    const FecDecoder::Block* block = fecDecoder.find(key);
+    if (!block) {
+        return;
+    }
+    const NodeIndex origin = block->origin;
+    const QVector<quint32> sequences = block->sequences;
 
-    // Find messages that the remote peer doesn't have
-    for (auto it = messageStore.begin(); it != messageStore.end(); ++it) {
-        const Message& msg = it.value();
-        QString origin = msg.getOrigin();
-        int localSeq = msg.getSequenceNumber();
-        int remoteSeq = remoteVectorClock.value(origin, 0).toInt();
+    QVector<int> missing;
+    for (int i = 0; i < sequences.size(); ++i) {
+        if (!hasMessage(NodeRegistry::messageKey(origin, sequences.at(i)))) {
+            missing.append(i);
+        }
+    }
+    if (missing.size() > block->parity.size()) {
+        return;  // Wait for more parity or more of the block
+    }
+    const QHash<int, QByteArray> parity = block->parity;
+    fecDecoder.remove(key);  // Before delivering, which comes back through recordStored()
+    if (missing.isEmpty()) {
+        return;
+    }
+
+    // Everything we have goes in as the sender encoded it, the rest comes out
+    QVector<QByteArray> symbols(sequences.size());
+    for (int i = 0; i < sequences.size(); ++i) {
+        if (!missing.contains(i)) {
+            const QList<Message> stored = messageStore.range(origin, sequences.at(i) - 1, sequences.at(i));
+            if (stored.isEmpty()) {
+                return;  // Compacted meanwhile; anti-entropy still has the rest
+            }
+            symbols[i] = FecDecoder::wrap(fecDatagram(stored.first()));
+        }
+    }
+    if (!ErasureCode::decode(symbols, parity)) {
+        return;
+    }
+
+    for (int i : missing) {
+        Message chat = Message::fromDatagram(FecDecoder::unwrap(symbols.at(i)));
+        if (chat.getType() != Message::CHAT_MESSAGE || !chat.isBroadcast() ||
+            NodeRegistry::global().intern(chat.getOrigin()) != origin ||
+            static_cast<quint32>(chat.getSequenceNumber()) != sequences.at(i)) {
+            qDebug() << "Parity block from" << NodeRegistry::global().name(origin) << "did not decode";
+            return;
+        }
+        qDebug() << "Recovered broadcast" << chat.getMessageId() << "from parity";
+        handleChatMessage(chat);
+    }
+}
 
-        if (localSeq > remoteSeq) {
-            missing.append(msg);
+void NetworkManager::sendTreeMessage(Message::MessageType type, NodeIndex to, const QByteArray& payload) {
+    auto peer = peers.constFind(to);
+    if (peer == peers.constEnd()) {
+        return;
+    }
+    Message message("", nodeId, peer.value().peerId, 0, type);
+    message.setPayload(payload);
+    sendDatagram(message.toDatagram(Message::BINARY_FORMAT), peer.value().address, peer.value().port);
+}
+
+void NetworkManager::refillBroadcastTree() {
+    // Neighbors that failed or left were dropped as membership noticed
+    int wanted = TREE_FANOUT - broadcastTree.neighborCount();
+    if (wanted <= 0) {
+        return;
+    }
+    for (NodeIndex member : membership.randomMembers(TREE_FANOUT * 2, NodeRegistry::INVALID_NODE)) {
+        if (wanted > 0 && canJoinTree(member) && broadcastTree.addNeighbor(member)) {
+            sendTreeMessage(Message::GRAFT, member);  // Links are two-way: the other side adds us too
+            --wanted;
         }
     }
+}
+
+bool NetworkManager::canJoinTree(NodeIndex node) const {
+    auto peer = peers.constFind(node);
+    return membership.isAlive(node) && peer != peers.constEnd() && peer.value().wireVersion >= TREE_WIRE_VERSION;
+}
+
+void NetworkManager::checkPeerHealth() {
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    qint64 monotonicNow = monotonicClock.elapsed();
+
+    for (auto it = peers.begin(); it != peers.end(); ++it) {
+        PeerInfo& peer = it.value();
+        if (!peer.isActive || membership.contains(it.key())) {
+            continue;
+        }
+
+        // Peers that heartbeat are judged by suspicion level; older ones,
+        // which never do, by a fixed silence timeout
+        bool failed;
+        if (peer.heartbeats.hasHistory()) {
+            double phi = peer.heartbeats.phi(monotonicNow);
+            failed = phi >= options.phiThreshold;
+            if (failed) {
+                qDebug() << "Peer" << peer.peerId << "suspected, phi" << phi;
+            }
+        } else {
+            failed = now - peer.lastSeen > PEER_TIMEOUT;
+            if (failed) {
+                qDebug() << "Peer" << peer.peerId << "timed out";
+            }
+        }
 
+        if (failed) {
+            peer.isActive = false;
+            peer.heartbeats.reset();  // The outage would skew its interval history
+            emit peerStatusChanged(peer.peerId, false);
+        }
+    }
+}
+
+void NetworkManager::updateVectorClock(NodeIndex origin, int sequenceNumber) {
+    if (sequenceNumber > 0) {
+        vectorClock.insert(origin, static_cast<quint32>(sequenceNumber));
+    }
+}
+
+bool NetworkManager::hasMessage(MessageKey key) const {
+    return messageStore.contains(NodeRegistry::keyNode(key), NodeRegistry::keySequence(key));
+}
+
+bool NetworkManager::storeMessage(NodeIndex origin, const Message& message) {
+    if (!messageStore.insert(origin, message)) {
+        return false;
+    }
+    recordStored(origin, message);
+    return true;
+}
+
+void NetworkManager::recordStored(NodeIndex origin, const Message& message) {
+    digestTree.add(origin, message);
+    MessageKey key = NodeRegistry::messageKey(origin, static_cast<quint32>(message.getSequenceNumber()));
+    broadcastTree.delivered(key);
+    if (fecDecoder.size() > 0) {
+        quint64 block = fecDecoder.blockCovering(key);
+        if (block != 0) {
+            recoverBroadcasts(block);  // Parity came first; this may be the piece it lacked
+        }
+    }
+
+    if (durableLog.isOpen()) {
+        // Our own messages too: their sequence numbers are covered by the lease
+        durableLog.append(message);
+        if (!logFlushTimer->isActive()) {
+            logFlushTimer->start(LOG_FLUSH_INTERVAL);
+        }
+    }
+}
+
+void NetworkManager::flushDurableLog() {
+    if (!durableLog.isOpen()) {
+        return;
+    }
+
+    logFlushTimer->stop();
+
+    DurableLog::Checkpoint checkpoint;
+    checkpoint.clock = vectorClock;
+    checkpoint.compacted = compactedFrontier;
+    checkpoint.compactedDigest = compactedTreeLeaves;
+    checkpoint.stable = stableFrontier;
+    checkpoint.nextSequenceNumber = sequenceLease;
+    durableLog.flush(checkpoint);
+}
+
+void NetworkManager::restoreFromDisk() {
+    QElapsedTimer timer;
+    timer.start();
+
+    QString directory = QDir(options.dataDirectory).filePath(nodeId);
+    if (!durableLog.open(directory)) {
+        qDebug() << "Durable log disabled: cannot open" << directory;
+        return;
+    }
+
+    DurableLog::Checkpoint checkpoint;
+    MessageLog recoveredLog;
+    int recovered = durableLog.recover(recoveredLog, checkpoint);
+    messageStore.absorb(recoveredLog);
+    vectorClock.merge(checkpoint.clock);
+    // After a crash the rest of the last lease is skipped, never reused
+    nextSequenceNumber = qMax(checkpoint.nextSequenceNumber, static_cast<int>(vectorClock.highest(selfIndex)) + 1);
+    sequenceLease = nextSequenceNumber;
+
+    // Compacted messages were not replayed, but still count as held
+    for (const VectorClock::Gap& prefix : checkpoint.compacted.diff(VectorClock())) {
+        messageStore.skipThrough(prefix.node, prefix.to);
+        lastDelivered[prefix.node] = prefix.to;  // Stable, so delivered long ago
+    }
+    compactedFrontier = checkpoint.compacted;
+    stableFrontier = checkpoint.stable;
+    if (!DigestTree::decodeLeaves(checkpoint.compactedDigest, compactedTree) && !compactedFrontier.isEmpty()) {
+        qDebug() << "Durable log: compacted messages missing from the digest tree; digest rounds will push them";
+    }
+    compactedTreeLeaves = compactedTree.encodeLeaves();
+
+    // Recovery fills the store directly, so the digest tree is built from it here
+    digestTree.merge(compactedTree);
+    for (NodeIndex origin : messageStore.originsWithMessages()) {
+        for (const Message& msg : messageStore.range(origin, 0, vectorClock.highest(origin))) {
+            digestTree.add(origin, msg);
+            if (origin == selfIndex && !msg.isBroadcast()) {
+                // Our streams continue where they left off
+                sendStreams[NodeRegistry::global().intern(msg.getDestination())].lastSequence =
+                    static_cast<quint32>(msg.getSequenceNumber());
+            } else if (msg.getDestination() == nodeId) {
+                lastDelivered[origin] = static_cast<quint32>(msg.getSequenceNumber());  // Delivered before the restart
+            }
+        }
+    }
+
+    // The budget may have shrunk since, or the last compaction not reached the disk
+    if (messageStore.byteCount() > options.storeBudgetBytes) {
+        compactStable(stableFrontier);
+    }
+
+    qDebug() << "Recovered" << recovered << "messages from" << directory << "in" << timer.elapsed()
+             << "ms, next sequence number" << nextSequenceNumber;
+}
+
+QList<Message> NetworkManager::getMissingMessages(const VectorClock& remoteVectorClock) const {
+    // Nothing to send if the remote peer has seen everything we have
+    if (remoteVectorClock.dominates(vectorClock)) {
+        return QList<Message>();
+    }
+
+    // Slice each origin's log at the remote's holes and above the highest
+    // sequence number it has, so only what it actually lacks is sent
+    QList<Message> missing;
+    for (const VectorClock::Gap& gap : vectorClock.diff(remoteVectorClock)) {
+        missing.append(storedRange(gap.node, gap.from, gap.to));
+    }
     return missing;
 }
 
+QList<Message> NetworkManager::storedRange(NodeIndex origin, quint32 after, quint32 upTo) const {
+    // Compacted messages are only on disk; a peer that far behind gets a
+    // bounded batch of them per round
+    const quint32 compacted = messageStore.compactedThrough(origin);
+    QList<Message> found;
+    if (after < compacted && durableLog.isOpen()) {
+        found = durableLog.range(origin, after, qMin(upTo, compacted), MAX_DISK_READ);
+    }
+    if (upTo > compacted) {
+        found.append(messageStore.range(origin, qMax(after, compacted), upTo));
+    }
+    return found;
+}
+
+VectorClock NetworkManager::stabilityFrontier(bool* ok) const {
+    // A message is stable once we and every active peer have seen it
+    VectorClock frontier = vectorClock;
+    *ok = false;
+    for (auto it = peers.begin(); it != peers.end(); ++it) {
+        if (it.value().isActive) {
+            frontier.meet(it.value().knownClock);
+            *ok = true;
+        }
+    }
+    return frontier;
+}
+
+void NetworkManager::collectGarbage() {
+    // With no active peers nobody can vouch for anything new, but what they
+    // all had stays stable; it is remembered, and checkpointed for recovery
+    bool ok = false;
+    VectorClock frontier = stabilityFrontier(&ok);
+    if (ok) {
+        stableFrontier.merge(frontier);
+    }
+
+    if (messageStore.byteCount() > options.storeBudgetBytes && !stableFrontier.isEmpty()) {
+        compactStable(stableFrontier);
+    }
+}
+
+int NetworkManager::compactStable(const VectorClock& frontier) {
+    qint64 freed = 0;
+    int removed = 0;
+    for (NodeIndex origin : messageStore.originsWithMessages()) {
+        // Compaction stops at the first hole; the run read here is exactly
+        // what goes, so its hashes move into compactedTree
+        const quint32 from = messageStore.compactedThrough(origin);
+        quint32 upTo = from;
+        for (const Message& msg : messageStore.range(origin, from, frontier.value(origin))) {
+            if (static_cast<quint32>(msg.getSequenceNumber()) != upTo + 1) {
+                break;
+            }
+            compactedTree.add(origin, msg);
+            ++upTo;
+        }
+        if (upTo == from) {
+            continue;
+        }
+        removed += messageStore.compact(origin, upTo, &freed);
+        compactedFrontier.set(origin, upTo);
+        if (messageStore.byteCount() <= options.storeBudgetBytes) {
+            break;
+        }
+    }
+
+    if (removed > 0) {
+        reclaimedBytes += freed;
+        if (durableLog.isOpen()) {
+            compactedTreeLeaves = compactedTree.encodeLeaves();
+            if (!logFlushTimer->isActive()) {
+                logFlushTimer->start(LOG_FLUSH_INTERVAL);  // Segments under the new frontier can go
+            }
+        }
+        qDebug() << "Garbage collection: compacted" << removed << "stable messages, reclaimed"
+                 << freed << "bytes," << messageStore.byteCount() << "bytes still stored";
+    }
+    return removed;
+}
+
 QList<QString> NetworkManager::getActivePeers() const {
     QList<QString> activePeers;
     for (auto it = peers.begin(); it != peers.end(); ++it) {
         // Return all peers, not just active ones
         // This prevents manually added peers from disappearing
-        activePeers.append(it.key());
+        activePeers.append(it.value().peerId);
     }
+    std::sort(activePeers.begin(), activePeers.end());
     return activePeers;
 }
 
-QString NetworkManager::findPeerIdByAddress(const QHostAddress& host, quint16 port) const {
-    for (auto it = peers.begin(); it != peers.end(); ++it) {
-        const PeerInfo& peer = it.value();
-        if (peer.host == host.toString() && peer.port == port) {
-            return peer.peerId;
-        }
+void NetworkManager::resolveHost(const QString& host, const std::function<void(const QHostAddress&)>& done) {
+    QHostAddress address(host);
+    if (!address.isNull()) {
+        done(address);
+        return;
     }
-    return QString();
+
+    // Host names are looked up once here rather than on every send, and off
+    // this thread: a slow resolver must not stall the network loop. The
+    // answer comes back through our event loop, and not at all once we are gone
+    QHostInfo::lookupHost(host, this, [done](const QHostInfo& info) {
+        for (const QHostAddress& candidate : info.addresses()) {
+            if (candidate.protocol() == QAbstractSocket::IPv4Protocol) {
+                done(candidate);  // The socket is bound to an IPv4 address
+                return;
+            }
+        }
+        done(QHostAddress());
+    });
+}
+
+NodeIndex NetworkManager::findPeerByAddress(const QHostAddress& host, quint16 port) const {
+    return peers.findByAddress(host, port);
 }
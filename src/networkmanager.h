@@ -1,25 +1,60 @@
 #pragma once
 
 #include <QObject>
-#include <QUdpSocket>
+#include <QHostAddress>
 #include <QTimer>
 #include <QMap>
+#include <QHash>
 #include <QSet>
 #include <QQueue>
 #include <QPair>
 #include <QDateTime>
+#include <QElapsedTimer>
+#include <functional>
 #include "message.h"
+#include "noderegistry.h"
+#include "shardedstore.h"
+#include "durablelog.h"
+#include "digesttree.h"
+#include "peertable.h"
+#include "membership.h"
+#include "broadcasttree.h"
+#include "fec.h"
+#include "antientropyscheduler.h"
+#include "congestionwindow.h"
+#include "reorderbuffer.h"
+#include "fragmentation.h"
+#include "timerwheel.h"
+#include "datagramtransport.h"
 
-struct PeerInfo {
-    QString peerId;
-    QString host;
-    int port;
-    bool isActive;
-    qint64 lastSeen;
+class ReceiveWorker;
 
-    PeerInfo() : port(0), isActive(false), lastSeen(0) {}
-    PeerInfo(const QString& id, const QString& h, int p)
-        : peerId(id), host(h), port(p), isActive(true), lastSeen(QDateTime::currentMSecsSinceEpoch()) {}
+class MessageView;
+
+// Startup tunables, filled in from the command line by main.cpp
+struct NetworkOptions {
+    enum AntiEntropyMode {
+        CLOCK_EXCHANGE,  // Send the whole vector clock every round
+        DIGEST_EXCHANGE  // Compare hash-tree digests, descending only where they differ
+    };
+
+    enum BroadcastMode {
+        DIRECT_BROADCAST,  // Send our broadcasts to every active peer ourselves
+        TREE_BROADCAST  // Push them down a broadcast tree, which every node relays
+    };
+
+    AntiEntropyMode antiEntropyMode = CLOCK_EXCHANGE;
+    BroadcastMode broadcastMode = DIRECT_BROADCAST;
+    qint64 storeBudgetBytes = 64 * 1024 * 1024;  // Stable messages are compacted above this
+    DatagramTransport::Backend transport = DatagramTransport::QT_SOCKET;
+    int batchMtu = 1400;  // Largest batched anti-entropy datagram; 0 sends one message per datagram
+    int fragmentMtu = 1400;  // Larger binary datagrams are sent in fragments; 0 leaves them to IP
+    int fecBlockSize = 0;  // Broadcasts per parity block; 0 sends no parity
+    int fecParity = 2;  // Parity datagrams per block; that many losses in a block can be rebuilt
+    double phiThreshold = 8.0;  // Suspicion level at which a heartbeating peer counts as failed
+    int receiveWorkers = 1;  // Sockets in the SO_REUSEPORT group, each read on its own thread
+    QString dataDirectory;  // Where the durable log lives; empty keeps everything in memory
+    QHostAddress bindAddress = QHostAddress::LocalHost;  // Any address reaches nodes on other hosts
 };
 
 class NetworkManager : public QObject {
@@ -32,13 +67,17 @@ public:
     bool startServer(int port);
     void sendMessage(const Message& message);
     void addPeer(const QString& peerId, const QString& host, int port);
-    void discoverLocalPeers(const QList<int>& portRange);
+    void addSeed(const QString& host, int port);  // Joins the cluster through this node
 
-    void setNodeId(const QString& nodeId) { this->nodeId = nodeId; }
+    void setNodeId(const QString& nodeId);
     QString getNodeId() const { return nodeId; }
+    void setOptions(const NetworkOptions& options) { this->options = options; }
+
+    qint64 getStoreBytes() const { return messageStore.byteCount(); }
+    qint64 getReclaimedBytes() const { return reclaimedBytes; }
 
     QList<QString> getActivePeers() const;
-    QVariantMap getVectorClock() const { return vectorClock; }
+    VectorClock getVectorClock() const { return vectorClock; }
 
 signals:
     void messageReceived(const Message& message);
@@ -48,60 +87,218 @@ signals:
 private slots:
     void onDataReceived();
     void onAntiEntropyTimeout();
-    void checkPendingAcks();
-    void checkPeerHealth();
+    void onRetransmitTimeout();
+    void flushAcks();
+    void onReorderTimeout();
+    void onFragmentTimeout();
+    void onHeartbeatTimeout();
+    void onProbeTimeout();
+    void onIndirectProbeTimeout();
+    void flushAnnouncements();
+    void onGraftTimeout();
+    void sendParity();
+    void flushDurableLog();
+    void drainReceiveWorkers();
 
 private:
+    void processDatagram(const char* data, int size, const QHostAddress& senderHost, quint16 senderPort);
+    bool processReceivedView(const MessageView& view, const QHostAddress& senderHost, quint16 senderPort);
     void processReceivedMessage(const Message& message, const QHostAddress& senderHost, quint16 senderPort);
-    void handleChatMessage(const Message& message);
+    void updatePeer(NodeIndex sender, const QString& senderId, int wireVersion, const QHostAddress& senderHost, quint16 senderPort);
+    void updateRelay(int wireVersion, const QHostAddress& senderHost, quint16 senderPort);
+    void handleChatMessage(const Message& message, bool stored = false);
+    void deliverInOrder(NodeIndex origin, const Message& message);
+    void deliverWithSuccessors(NodeIndex origin, const Message& message);
+    void deliver(NodeIndex origin, const Message& message);
+    void armReorderTimer();
     void handleAntiEntropyRequest(const Message& message, const QHostAddress& senderHost, quint16 senderPort);
     void handleAntiEntropyResponse(const Message& message);
+    void handleBatch(const Message& batch, const QHostAddress& senderHost, quint16 senderPort);
+    void handleAntiEntropyDigest(const Message& message, const QHostAddress& senderHost, quint16 senderPort);
+    void handleFragment(const Message& message, const QHostAddress& senderHost, quint16 senderPort);
+    void handleFragmentNack(const Message& message, const QHostAddress& senderHost, quint16 senderPort);
+    void handleHeartbeat(NodeIndex sender);
+    void handlePing(const Message& message, const QHostAddress& senderHost, quint16 senderPort);
+    void handlePingRequest(const Message& message, const QHostAddress& senderHost, quint16 senderPort);
+    void handlePingAck(const Message& message, const QHostAddress& senderHost, quint16 senderPort);
+    bool applyGossip(const Message& message, NodeIndex sender, const QHostAddress& senderHost, quint16 senderPort);
+    void applyMembershipChanges(const QVector<Membership::Change>& changes);
+    void sendMembershipMessage(Message::MessageType type, quint32 probe, const QString& destination, NodeIndex to,
+                               const QByteArray& payload, const QHostAddress& host, quint16 port);
+    void sendPing(NodeIndex member, quint32 probe);
+    void pingSeed(const QHostAddress& host, quint16 port);
+    void handleGossip(const Message& message);
+    void handleAnnouncement(const Message& message);
+    void handleGraft(const Message& message);
+    void pushBroadcast(const QByteArray& datagram, MessageKey key, NodeIndex from);
+    void sendTreeMessage(Message::MessageType type, NodeIndex to, const QByteArray& payload = QByteArray());
+    void refillBroadcastTree();
+    bool canJoinTree(NodeIndex node) const;
+    void handleParity(const Message& message);
+    void recoverBroadcasts(quint64 block);
+    static QByteArray fecDatagram(const Message& message);
+    void sendHeartbeats();
+    void checkPeerHealth();
+    void sendDigest(const DigestPayload& payload, const QString& peerId, const QHostAddress& host, quint16 port);
+    void recordPeerClock(NodeIndex peer, const VectorClock& clock);
     void handleAck(const Message& message);
+    void acknowledge(int sequenceNumber, bool sampleRtt = true);
+    void acknowledgeClock(NodeIndex peer, const VectorClock& clock);
+    void queueAck(NodeIndex origin, int sequenceNumber, bool duplicate);
+    QByteArray takeAck(PeerInfo& peer);
+    void scheduleRetransmit(int sequenceNumber);
+    void armRetransmitTimer();
 
-    void sendDirectMessage(const Message& message, const QString& peerId, bool requireAck = true);
+    void sendDirectMessage(const Message& message, NodeIndex peer, bool requireAck = true);
+    void enqueueDirectMessage(const Message& message, NodeIndex peer);
+    void pumpStream(NodeIndex peer);
     void sendBroadcastMessage(const Message& message);
-    void sendWithRetry(const Message& message, const QString& peerId);
     void sendDatagram(const QByteArray& datagram, const QHostAddress& host, quint16 port);
+    bool sendFragmented(const QByteArray& datagram, const QHostAddress& host, quint16 port);
+    int sendMessages(const QList<Message>& messages, NodeIndex peer, const QHostAddress& host, quint16 port);
+    Message::WireFormat wireFormatFor(NodeIndex peer) const;
 
-    void updateVectorClock(const QString& origin, int sequenceNumber);
+    void updateVectorClock(NodeIndex origin, int sequenceNumber);
     void performAntiEntropy();
-    void syncMissingMessages(const QString& peerId);
+    void hurryAntiEntropy();  // A peer came (back) online
+    void restoreFromDisk();
 
-    bool hasMessage(const QString& messageId) const;
-    void storeMessage(const Message& message);
-    QList<Message> getMissingMessages(const QVariantMap& remoteVectorClock) const;
+    bool hasMessage(MessageKey key) const;
+    bool storeMessage(NodeIndex origin, const Message& message);
+    void recordStored(NodeIndex origin, const Message& message);
+    void startReceiveWorkers(int count);
+    QList<Message> getMissingMessages(const VectorClock& remoteVectorClock) const;
+    VectorClock stabilityFrontier(bool* ok) const;
+    void collectGarbage();
+    int compactStable(const VectorClock& frontier);  // Until within budget; returns messages dropped
+    QList<Message> storedRange(NodeIndex origin, quint32 after, quint32 upTo) const;  // Compacted ones from disk
 
-    QString findPeerIdByAddress(const QHostAddress& host, quint16 port) const;
+    void addPeer(const QString& peerId, const QHostAddress& address, quint16 port);
+    // Calls done with host's IPv4 address, or a null one; at once for literal
+    // addresses, later for names
+    void resolveHost(const QString& host, const std::function<void(const QHostAddress&)>& done);
+    NodeIndex findPeerByAddress(const QHostAddress& host, quint16 port) const;
 
-    QUdpSocket* socket;
+    DatagramTransport* transport;  // Created in startServer() from options.transport
     QString nodeId;
+    QByteArray nodeIdUtf8;
+    NodeIndex selfIndex;
     int serverPort;
+    NetworkOptions options;
+    QVector<DatagramTransport::Datagram> receivedBatch;  // Reused for every receive
+    QList<ReceiveWorker*> receiveWorkers;  // Empty unless options.receiveWorkers > 1
 
     // Peer management
-    QMap<QString, PeerInfo> peers;  // peerId -> PeerInfo
-    QTimer* antiEntropyTimer;
-    QTimer* ackCheckTimer;
-    QTimer* peerHealthTimer;
+    PeerTable peers;  // Indexed by node and by address
+    QTimer* antiEntropyTimer;  // Single shot, re-armed each round
+    QTimer* retransmitTimer;  // Single shot, armed for the wheel's next deadline
+    QTimer* ackTimer;  // Single shot, sends the ACKs held back for coalescing
+    QTimer* reorderTimer;  // Single shot, armed for the reorder buffer's oldest message
+    QTimer* fragmentTimer;  // Runs while transfers are partly reassembled, to NACK stalled ones
+    QTimer* heartbeatTimer;  // Heartbeats to, and failure detection of, peers outside the membership protocol
+    QTimer* probeTimer;  // One membership protocol period per tick
+    QTimer* indirectProbeTimer;  // Single shot; the direct probe's deadline
+    QTimer* announceTimer;  // Single shot, sends the IHAVEs held back for batching
+    QTimer* graftTimer;  // Runs while announced broadcasts are awaited
+    QTimer* fecFlushTimer;  // Single shot, sends parity for a block that stopped filling
+    QTimer* logFlushTimer;
 
     // Message management
-    QMap<QString, Message> messageStore;  // messageId -> Message
-    QVariantMap vectorClock;  // origin -> max sequence number seen
+    ShardedStore messageStore;  // Per-origin, sequence-indexed message logs, shared with receive workers
+    VectorClock vectorClock;  // origin -> max sequence number seen
+    qint64 reclaimedBytes;  // Total freed by garbage collection
+    DurableLog durableLog;  // Only open when options.dataDirectory is set
+    DigestTree digestTree;  // Hashes of every message stored, for digest anti-entropy
+    DigestTree compactedTree;  // The part of digestTree for compacted messages, persisted with them
+    QByteArray compactedTreeLeaves;  // compactedTree, encoded after each compaction
+    VectorClock compactedFrontier;  // Per origin, what compaction dropped from messageStore
+    VectorClock stableFrontier;  // Everything ever known stable; compaction may go up to it
+    AntiEntropyScheduler antiEntropyScheduler;  // Round interval and peer choice
 
     // Reliable delivery
     struct PendingMessage {
         Message message;
-        QString targetPeerId;
-        qint64 sentTime;
+        NodeIndex targetPeer;
+        qint64 sentTime;  // On monotonicClock
         int retryCount;
+        TimerId timer;
     };
-    QMap<QString, PendingMessage> pendingAcks;  // messageId -> PendingMessage
-    QMap<QString, int> nextSequenceNumbers;  // destination -> next sequence number
+    QHash<int, PendingMessage> pendingAcks;  // our sequence number -> PendingMessage
+    TimerWheel retransmitWheel;  // Retransmission deadlines, keyed by sequence number
+    QElapsedTimer monotonicClock;  // Time base for RTT samples and the wheel
+    int nextSequenceNumber;  // Next sequence number for messages we originate
+    int sequenceLease;  // Sequence numbers of ours from here on are not reserved on disk yet
+    QVector<NodeIndex> delayedAcks;  // Peers owed an ACK when ackTimer fires
+
+    // Our direct messages to one destination form a stream: each names its
+    // predecessor so the receiver can deliver them in order, and at most a
+    // congestion window of them await ACKs at once
+    struct SendStream {
+        quint32 lastSequence = 0;  // Newest message chained into the stream
+        quint32 highestSent = 0;  // Newest message actually sent
+        CongestionWindow window;
+        QQueue<Message> backlog;  // Chained, stored, waiting for room in the window
+    };
+    QHash<NodeIndex, SendStream> sendStreams;  // destination -> stream
+    ReorderBuffer reorderBuffer;  // Direct messages to us waiting for their predecessor
+    QHash<NodeIndex, quint32> lastDelivered;  // origin -> newest of its direct messages to us delivered
+
+    // Fragmentation of datagrams above options.fragmentMtu
+    Reassembler reassembler;  // Partial datagrams from peers
+    FragmentCache sentFragments;  // Ours, for NACKed resends
+    quint32 nextTransferId;  // Starts at random, so transfers after a restart don't look like completed ones
+
+    // SWIM membership: everyone who speaks it is found, probed and judged
+    // through it; older peers fall back to heartbeats
+    struct Probe {
+        quint32 id = 0;
+        NodeIndex target = NodeRegistry::INVALID_NODE;
+        bool acked = false;
+    };
+    struct RelayedProbe {  // A PING we send on behalf of a PING_REQ
+        NodeIndex requester;
+        quint32 probe;  // The requester's id for it
+        qint64 sentAt;
+    };
+    Membership membership;
+    Probe currentProbe;
+    QHash<quint32, RelayedProbe> relayedProbes;  // our probe id -> requester
+    quint32 nextProbeId;
+    int probeRounds;
+    QList<QPair<QHostAddress, quint16>> seeds;
+
+    // Broadcasts travel down a tree over a few members each node picked as
+    // neighbors; older peers are sent them directly by the origin
+    BroadcastTree broadcastTree;
+    QHash<NodeIndex, QVector<MessageKey>> pendingAnnouncements;  // Lazy neighbor -> IHAVEs owed
+
+    // Forward error correction for our direct broadcasts, and parity from others
+    FecEncoder fecEncoder;  // Configured from options.fecBlockSize in startServer()
+    FecDecoder fecDecoder;
 
     // Configuration
-    static const int ANTI_ENTROPY_INTERVAL = 2000;  // 2 seconds
-    static const int ACK_CHECK_INTERVAL = 1000;  // 1 second
-    static const int ACK_TIMEOUT = 2000;  // 2 seconds
     static const int MAX_RETRIES = 3;
-    static const int PEER_HEALTH_CHECK_INTERVAL = 5000;  // 5 seconds
-    static const int PEER_TIMEOUT = 15000;  // 15 seconds
+    static const int ACK_DELAY = 10;  // How long an ACK may wait for more messages or a reply to ride on
+    static const int ACK_COALESCE_LIMIT = 16;  // Messages one ACK may cover before it goes out at once
+    static const int MAX_SACK_RANGES = 32;  // Highest received ranges an ACK lists above its watermark
+    static const int SACK_WIRE_VERSION = 2;  // Peers from this version on get cumulative, coalesced ACKs
+    static const int FRAGMENT_WIRE_VERSION = 3;  // Peers from this version on reassemble fragments
+    static const int TREE_WIRE_VERSION = 4;  // Peers from this version on relay broadcast trees
+    static const int TREE_FANOUT = 4;  // Neighbors each node picks; others pick it too
+    static const int ANNOUNCE_DELAY = 20;  // How long an IHAVE may wait for more to share its datagram
+    static const int GRAFT_CHECK_INTERVAL = 25;  // Resolution of the deadlines for announced broadcasts
+    static const int FEC_WIRE_VERSION = 5;  // Peers from this version on rebuild broadcasts from parity
+    static const int FEC_FLUSH_DELAY = 50;  // A partial block gets its parity once broadcasts pause this long
+    static const int FRAGMENT_NACK_INTERVAL = 50;  // Silence after which missing fragments are asked for again
+    static const int HEARTBEAT_INTERVAL = 500;
+    static const int HEARTBEAT_PAUSE = 1000;  // Silence beyond the usual interval before suspicion rises
+    static const int PEER_TIMEOUT = 15000;  // For peers that send no heartbeats (older versions)
+    static const int PROTOCOL_PERIOD = 500;  // One membership probe per period
+    static const int PROBE_TIMEOUT = 200;  // Wait for a direct PING_ACK before asking others
+    static const int INDIRECT_PROBES = 3;  // Members asked to probe an unresponsive one
+    static const int DEAD_RECHECK_PERIODS = 20;  // How often a dead member is pinged, in case a partition healed
+    static const int LOG_FLUSH_INTERVAL = 100;  // Group commit window for stored messages
+    static const int SEQUENCE_LEASE = 1024;  // Sequence numbers of ours one checkpoint reserves
+    static const int MAX_DISK_READ = 512;  // Compacted messages read back per gap and round
+    static const int MAX_DIGEST_ENTRIES = 48;  // Digest nodes or leaves per datagram
 };
@@ -0,0 +1,127 @@
+#include "networkthread.h"
+#include <QDebug>
+#include <algorithm>
+
+NetworkThread::NetworkThread(const QString& nodeId, const NetworkOptions& options, QObject* parent)
+    : QObject(parent), commandWakePending(false), eventWakePending(false) {
+
+    thread.setObjectName("network");
+
+    manager = new NetworkManager();
+    manager->setNodeId(nodeId);
+    manager->setOptions(options);
+    manager->moveToThread(&thread);
+    connect(&thread, &QThread::finished, manager, &QObject::deleteLater);
+
+    // Emitted on the network thread; only queue them there
+    connect(manager, &NetworkManager::messageReceived, manager, [this](const Message& message) {
+        Event event;
+        event.kind = Event::MESSAGE_RECEIVED;
+        event.message = message;
+        postEvent(std::move(event));
+    }, Qt::DirectConnection);
+    connect(manager, &NetworkManager::peerDiscovered, manager, [this](const QString& peerId, const QString& host, int port) {
+        Event event;
+        event.kind = Event::PEER_DISCOVERED;
+        event.peerId = peerId;
+        event.host = host;
+        event.port = port;
+        postEvent(std::move(event));
+    }, Qt::DirectConnection);
+    connect(manager, &NetworkManager::peerStatusChanged, manager, [this](const QString& peerId, bool active) {
+        Event event;
+        event.kind = Event::PEER_STATUS_CHANGED;
+        event.peerId = peerId;
+        event.active = active;
+        postEvent(std::move(event));
+    }, Qt::DirectConnection);
+}
+
+NetworkThread::~NetworkThread() {
+    // The manager is deleted on its own thread as the event loop winds down,
+    // so its destructor can still flush the durable log
+    thread.quit();
+    thread.wait();
+}
+
+bool NetworkThread::start(int port) {
+    thread.start();
+
+    bool started = false;
+    QMetaObject::invokeMethod(manager, [this, port, &started]() {
+        started = manager->startServer(port);
+    }, Qt::BlockingQueuedConnection);
+    return started;
+}
+
+void NetworkThread::sendMessage(const Message& message) {
+    Command command;
+    command.kind = Command::SEND_MESSAGE;
+    command.message = message;
+    postCommand(std::move(command));
+}
+
+void NetworkThread::addSeed(const QString& host, int port) {
+    Command command;
+    command.kind = Command::ADD_SEED;
+    command.host = host;
+    command.port = port;
+    postCommand(std::move(command));
+}
+
+QList<QString> NetworkThread::getActivePeers() const {
+    QList<QString> peers = knownPeers.values();
+    std::sort(peers.begin(), peers.end());
+    return peers;
+}
+
+void NetworkThread::postCommand(Command command) {
+    commands.push(std::move(command));
+    if (!commandWakePending.exchange(true)) {
+        QMetaObject::invokeMethod(manager, [this]() { drainCommands(); }, Qt::QueuedConnection);
+    }
+}
+
+void NetworkThread::postEvent(Event event) {
+    events.push(std::move(event));
+    if (!eventWakePending.exchange(true)) {
+        QMetaObject::invokeMethod(this, [this]() { drainEvents(); }, Qt::QueuedConnection);
+    }
+}
+
+void NetworkThread::drainCommands() {
+    // Clear the flag first: anything pushed after this posts a new wake-up
+    commandWakePending.store(false);
+
+    Command command;
+    while (commands.pop(command)) {
+        switch (command.kind) {
+            case Command::SEND_MESSAGE:
+                manager->sendMessage(command.message);
+                break;
+            case Command::ADD_SEED:
+                manager->addSeed(command.host, command.port);
+                break;
+        }
+    }
+}
+
+void NetworkThread::drainEvents() {
+    eventWakePending.store(false);
+
+    Event event;
+    while (events.pop(event)) {
+        switch (event.kind) {
+            case Event::MESSAGE_RECEIVED:
+                emit messageReceived(event.message);
+                break;
+            case Event::PEER_DISCOVERED:
+                knownPeers.insert(event.peerId);
+                emit peerDiscovered(event.peerId, event.host, event.port);
+                break;
+            case Event::PEER_STATUS_CHANGED:
+                emit peerStatusChanged(event.peerId, event.active);
+                break;
+        }
+    }
+}
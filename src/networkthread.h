@@ -0,0 +1,70 @@
+#pragma once
+
+#include <QObject>
+#include <QThread>
+#include <QSet>
+#include <atomic>
+#include "networkmanager.h"
+#include "spscqueue.h"
+
+// Runs a NetworkManager, with its socket, timers and message store, on a
+// dedicated I/O thread, and gives the GUI thread the same calls and signals.
+//
+// The two threads only talk through a pair of SPSC queues: commands from
+// the GUI, events from the network. Pushing never blocks, so a GUI busy
+// rendering can delay when received messages are shown but never when
+// datagrams are read, ACKed or retried. Each side wakes the other with a
+// queued call only when the queue goes from idle to non-empty.
+class NetworkThread : public QObject {
+    Q_OBJECT
+
+public:
+    NetworkThread(const QString& nodeId, const NetworkOptions& options, QObject* parent = nullptr);
+    ~NetworkThread();
+
+    bool start(int port);  // Starts the thread and binds there; blocks until bound
+
+    // GUI thread
+    void sendMessage(const Message& message);
+    void addSeed(const QString& host, int port);
+    QList<QString> getActivePeers() const;  // Every peer the network has reported, sorted
+
+signals:
+    void messageReceived(const Message& message);
+    void peerDiscovered(const QString& peerId, const QString& host, int port);
+    void peerStatusChanged(const QString& peerId, bool active);
+
+private:
+    struct Command {
+        enum Kind { SEND_MESSAGE, ADD_SEED };
+        Kind kind = SEND_MESSAGE;
+        Message message;
+        QString host;
+        int port = 0;
+    };
+
+    struct Event {
+        enum Kind { MESSAGE_RECEIVED, PEER_DISCOVERED, PEER_STATUS_CHANGED };
+        Kind kind = MESSAGE_RECEIVED;
+        Message message;
+        QString peerId;
+        QString host;
+        int port = 0;
+        bool active = false;
+    };
+
+    void postCommand(Command command);
+    void postEvent(Event event);
+    void drainCommands();  // Network thread
+    void drainEvents();  // GUI thread
+
+    QThread thread;
+    NetworkManager* manager;  // Lives on thread
+
+    SpscQueue<Command> commands;
+    SpscQueue<Event> events;
+    std::atomic<bool> commandWakePending;
+    std::atomic<bool> eventWakePending;
+
+    QSet<QString> knownPeers;  // GUI thread mirror for getActivePeers()
+};
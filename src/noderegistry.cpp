@@ -0,0 +1,59 @@
+#include "noderegistry.h"
+
+NodeRegistry& NodeRegistry::global() {
+    static NodeRegistry registry;
+    return registry;
+}
+
+NodeIndex NodeRegistry::intern(const QString& nodeId) {
+    QByteArray utf8 = nodeId.toUtf8();
+    {
+        QReadLocker locker(&lock);
+        auto it = indexByName.constFind(utf8);
+        if (it != indexByName.constEnd()) {
+            return it.value();
+        }
+    }
+    return insert(utf8, nodeId);
+}
+
+NodeIndex NodeRegistry::intern(const char* utf8, int size) {
+    {
+        QReadLocker locker(&lock);
+        auto it = indexByName.constFind(QByteArray::fromRawData(utf8, size));
+        if (it != indexByName.constEnd()) {
+            return it.value();
+        }
+    }
+    return insert(QByteArray(utf8, size), QString::fromUtf8(utf8, size));
+}
+
+NodeIndex NodeRegistry::insert(const QByteArray& utf8, const QString& nodeId) {
+    QWriteLocker locker(&lock);
+
+    // Another thread may have interned the same ID since the read lock was dropped
+    auto it = indexByName.constFind(utf8);
+    if (it != indexByName.constEnd()) {
+        return it.value();
+    }
+
+    NodeIndex node = static_cast<NodeIndex>(names.size());
+    names.append(nodeId);
+    indexByName.insert(utf8, node);
+    return node;
+}
+
+NodeIndex NodeRegistry::find(const QString& nodeId) const {
+    QReadLocker locker(&lock);
+    return indexByName.value(nodeId.toUtf8(), INVALID_NODE);
+}
+
+QString NodeRegistry::name(NodeIndex node) const {
+    QReadLocker locker(&lock);
+    return node < static_cast<NodeIndex>(names.size()) ? names.at(node) : QString();
+}
+
+int NodeRegistry::size() const {
+    QReadLocker locker(&lock);
+    return names.size();
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
+#include <QReadWriteLock>
+
+typedef quint32 NodeIndex;   // Dense per-process index of a node ID
+typedef quint64 MessageKey;  // Packed (origin index, sequence number)
+
+// Interns node ID strings into small dense integers so the protocol state in
+// NetworkManager can be keyed by integers instead of hashing QStrings. Indices
+// are process-local and never go on the wire; datagrams keep the string IDs.
+// The registry is shared by every component of the process and is thread-safe.
+class NodeRegistry {
+public:
+    static constexpr NodeIndex INVALID_NODE = 0xFFFFFFFFu;
+
+    static NodeRegistry& global();
+
+    NodeIndex intern(const QString& nodeId);
+    NodeIndex intern(const char* utf8, int size);  // Allocation-free for known IDs
+    NodeIndex find(const QString& nodeId) const;
+
+    QString name(NodeIndex node) const;
+    int size() const;
+
+    static MessageKey messageKey(NodeIndex node, quint32 sequenceNumber) {
+        return (static_cast<quint64>(node) << 32) | sequenceNumber;
+    }
+    static NodeIndex keyNode(MessageKey key) { return static_cast<NodeIndex>(key >> 32); }
+    static quint32 keySequence(MessageKey key) { return static_cast<quint32>(key); }
+
+private:
+    NodeIndex insert(const QByteArray& utf8, const QString& nodeId);
+
+    mutable QReadWriteLock lock;
+    QHash<QByteArray, NodeIndex> indexByName;  // UTF-8 node ID -> index
+    QVector<QString> names;  // index -> node ID
+};
@@ -0,0 +1,75 @@
+#include "peertable.h"
+
+PeerTable::iterator PeerTable::insert(const PeerInfo& peer) {
+    auto previous = byNode.constFind(peer.node);
+    if (previous != byNode.constEnd()) {
+        unindex(previous.value());
+    }
+    auto it = byNode.insert(peer.node, peer);
+    index(it.value());
+    return it;
+}
+
+PeerTable::iterator PeerTable::relocate(NodeIndex node, const QHostAddress& address, quint16 port) {
+    auto it = byNode.find(node);
+    if (it == byNode.end()) {
+        return it;
+    }
+    unindex(it.value());
+    it.value().address = address;
+    it.value().port = port;
+    index(it.value());
+    return it;
+}
+
+void PeerTable::unindex(const PeerInfo& peer) {
+    const quint64 key = endpointKey(peer.address, peer.port);
+    if (key == 0) {
+        --unindexed;
+    } else if (byEndpoint.value(key, NodeRegistry::INVALID_NODE) == peer.node) {
+        byEndpoint.remove(key);
+    }
+}
+
+void PeerTable::index(const PeerInfo& peer) {
+    const quint64 key = endpointKey(peer.address, peer.port);
+    if (key == 0) {
+        ++unindexed;
+        return;
+    }
+
+    // A newer peer at the same endpoint (say, a restart under a new id) takes
+    // it over once the old one is no longer active, never before: until then
+    // the endpoint's datagrams are still the old peer's
+    auto owner = byNode.constFind(byEndpoint.value(key, NodeRegistry::INVALID_NODE));
+    if (owner == byNode.constEnd() || owner.key() == peer.node || !owner.value().isActive) {
+        byEndpoint.insert(key, peer.node);
+    }
+}
+
+NodeIndex PeerTable::findByAddress(const QHostAddress& host, quint16 port) const {
+    const quint64 key = endpointKey(host, port);
+    if (key != 0) {
+        return byEndpoint.value(key, NodeRegistry::INVALID_NODE);
+    }
+    if (unindexed == 0) {
+        return NodeRegistry::INVALID_NODE;
+    }
+
+    for (auto it = byNode.constBegin(); it != byNode.constEnd(); ++it) {
+        if (it.value().port == port && it.value().address == host) {
+            return it.key();
+        }
+    }
+    return NodeRegistry::INVALID_NODE;
+}
+
+quint64 PeerTable::endpointKey(const QHostAddress& host, quint16 port) {
+    bool ok = false;
+    const quint32 ipv4 = host.toIPv4Address(&ok);
+    if (!ok) {
+        return 0;
+    }
+    // Bit 48 marks the key as valid, so 0.0.0.0:0 does not read as "no key"
+    return (quint64(1) << 48) | (quint64(ipv4) << 16) | port;
+}
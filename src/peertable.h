@@ -0,0 +1,76 @@
+#pragma once
+
+#include <QHash>
+#include <QSet>
+#include <QHostAddress>
+#include <QDateTime>
+#include "noderegistry.h"
+#include "vectorclock.h"
+#include "rttestimator.h"
+#include "phiaccrualdetector.h"
+
+struct PeerInfo {
+    QString peerId;
+    NodeIndex node;
+    QHostAddress address;  // Resolved when the peer is added; changed only through PeerTable::relocate
+    quint16 port;
+    bool isActive;
+    qint64 lastSeen;
+    int wireVersion;  // Highest wire version the peer advertised (0 = JSON only)
+    VectorClock knownClock;  // Latest clock the peer sent us in anti-entropy
+    RttEstimator rtt;  // From ACKs of our direct messages; sets their retransmission timeout
+    QSet<int> awaitingAck;  // Our direct messages to the peer that are still unacknowledged
+    int unacked;  // The peer's direct messages to us not yet covered by an ACK
+    PhiAccrualDetector heartbeats;  // Arrivals of the peer's HEARTBEATs; judges it failed or alive
+
+    PeerInfo() : node(NodeRegistry::INVALID_NODE), port(0), isActive(false), lastSeen(0), wireVersion(0), unacked(0) {}
+    PeerInfo(const QString& id, NodeIndex n, const QHostAddress& a, quint16 p)
+        : peerId(id), node(n), address(a), port(p), isActive(true), lastSeen(QDateTime::currentMSecsSinceEpoch()), wireVersion(0), unacked(0) {}
+};
+
+// Peers indexed two ways: by interned node id, which every protocol path
+// uses, and by binary (IPv4 address, port), which is all a datagram says
+// about its sender. Either lookup is one hash probe, so per-packet peer
+// bookkeeping stays constant time at thousands of peers. A peer's address
+// only changes through insert() or relocate(), which keep the two indexes in
+// step. An endpoint still held by another active peer is not taken from it;
+// the newcomer is indexed once it tries again after the holder went inactive.
+// Non-IPv4 addresses are not indexed and are found by a scan.
+class PeerTable {
+public:
+    typedef QHash<NodeIndex, PeerInfo>::iterator iterator;
+    typedef QHash<NodeIndex, PeerInfo>::const_iterator const_iterator;
+
+    iterator find(NodeIndex node) { return byNode.find(node); }
+    const_iterator find(NodeIndex node) const { return byNode.constFind(node); }
+    const_iterator constFind(NodeIndex node) const { return byNode.constFind(node); }
+    iterator begin() { return byNode.begin(); }
+    iterator end() { return byNode.end(); }
+    const_iterator begin() const { return byNode.constBegin(); }
+    const_iterator end() const { return byNode.constEnd(); }
+    const_iterator constBegin() const { return byNode.constBegin(); }
+    const_iterator constEnd() const { return byNode.constEnd(); }
+
+    bool contains(NodeIndex node) const { return byNode.contains(node); }
+    bool isEmpty() const { return byNode.isEmpty(); }
+    int size() const { return byNode.size(); }
+
+    // Adds the peer, replacing (and forgetting everything about) any with the same node
+    iterator insert(const PeerInfo& peer);
+    // Moves the peer to another endpoint, or claims the one it has if that
+    // was held by a peer since gone inactive. end() if unknown.
+    iterator relocate(NodeIndex node, const QHostAddress& address, quint16 port);
+
+    NodeIndex findByAddress(const QHostAddress& host, quint16 port) const;  // INVALID_NODE if none
+
+    // (IPv4 address, port) packed into one integer, or 0 for other protocols
+    static quint64 endpointKey(const QHostAddress& host, quint16 port);
+
+private:
+    void unindex(const PeerInfo& peer);
+    void index(const PeerInfo& peer);
+
+    QHash<NodeIndex, PeerInfo> byNode;
+    QHash<quint64, NodeIndex> byEndpoint;  // endpointKey -> node, IPv4 peers only
+    int unindexed = 0;  // Peers without an endpoint key
+};
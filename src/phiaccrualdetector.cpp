@@ -0,0 +1,66 @@
+#include "phiaccrualdetector.h"
+#include <cmath>
+
+PhiAccrualDetector::PhiAccrualDetector(qint64 expectedInterval, qint64 acceptablePause)
+    : expected(qMax<qint64>(1, expectedInterval)), pause(qMax<qint64>(0, acceptablePause)) {
+    reset();
+}
+
+void PhiAccrualDetector::reset() {
+    intervals.clear();
+    next = 0;
+    sum = 0;
+    sumOfSquares = 0;
+    lastArrival = -1;
+}
+
+void PhiAccrualDetector::heartbeat(qint64 now) {
+    // The first heartbeat has nothing to measure against; a guess at the
+    // interval stands in until real ones replace it
+    const qint64 interval = lastArrival < 0 ? expected : qMax<qint64>(0, now - lastArrival);
+    lastArrival = now;
+
+    if (intervals.size() < WINDOW) {
+        intervals.append(interval);
+    } else {
+        const qint64 oldest = intervals.at(next);
+        sum -= oldest;
+        sumOfSquares -= oldest * oldest;
+        intervals[next] = interval;
+        next = (next + 1) % WINDOW;
+    }
+    sum += interval;
+    sumOfSquares += interval * interval;
+}
+
+double PhiAccrualDetector::meanInterval() const {
+    return intervals.isEmpty() ? static_cast<double>(expected) : static_cast<double>(sum) / intervals.size();
+}
+
+double PhiAccrualDetector::standardDeviation() const {
+    double deviation = 0.0;
+    if (!intervals.isEmpty()) {
+        const double mean = meanInterval();
+        const double variance = static_cast<double>(sumOfSquares) / intervals.size() - mean * mean;
+        deviation = variance > 0.0 ? std::sqrt(variance) : 0.0;
+    }
+    return qMax(deviation, static_cast<double>(MIN_STD_DEV));
+}
+
+double PhiAccrualDetector::phi(qint64 now) const {
+    if (lastArrival < 0) {
+        return 0.0;
+    }
+
+    // Logistic approximation of the normal CDF (error below 1e-4), worked in
+    // log space so phi stays finite however far the tail goes
+    const double y = (static_cast<double>(now - lastArrival) - meanInterval() - pause) / standardDeviation();
+    const double exponent = -y * (1.5976 + 0.070566 * y * y);
+    if (exponent < -30.0) {
+        // P(later) = e / (1 + e) ~ e
+        return -exponent / std::log(10.0);
+    }
+    const double e = std::exp(exponent);
+    const double later = y > 0.0 ? e / (1.0 + e) : 1.0 - 1.0 / (1.0 + e);
+    return -std::log10(later);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QVector>
+#include <QtGlobal>
+
+// Phi-accrual failure detector for one peer (Hayashibara et al.): instead of
+// a yes/no timeout it keeps the recent heartbeat inter-arrival times and
+// reports phi = -log10(P(a heartbeat arrives later than now)), assuming the
+// intervals are normally distributed. Phi grows without bound the longer a
+// peer stays silent, and grows faster for a peer whose heartbeats have been
+// regular, so one threshold suits both a quiet LAN and a jittery link.
+class PhiAccrualDetector {
+public:
+    static const int WINDOW = 100;  // Inter-arrival times remembered
+    static const int MIN_STD_DEV = 100;  // ms; keeps a very regular peer from being judged on jitter alone
+
+    // expectedInterval seeds the history at the first heartbeat;
+    // acceptablePause is silence tolerated on top of the mean (GC, a busy
+    // event loop) before phi starts to climb
+    explicit PhiAccrualDetector(qint64 expectedInterval = 1000, qint64 acceptablePause = 0);
+
+    void heartbeat(qint64 now);
+    double phi(qint64 now) const;  // 0 until the first heartbeat
+    bool hasHistory() const { return lastArrival >= 0; }
+    void reset();  // Forgets everything, e.g. once the peer is judged failed
+
+    double meanInterval() const;
+    double standardDeviation() const;
+
+private:
+    qint64 expected;
+    qint64 pause;
+    QVector<qint64> intervals;  // Ring of the last WINDOW inter-arrival times
+    int next;
+    qint64 sum;
+    qint64 sumOfSquares;
+    qint64 lastArrival;  // -1 before the first heartbeat
+};
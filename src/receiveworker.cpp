@@ -0,0 +1,104 @@
+#include "receiveworker.h"
+#include "messageview.h"
+#include <QDebug>
+#include <utility>
+
+ReceiveWorker::ReceiveWorker(int id, DatagramTransport::Backend backend, const QByteArray& selfId, ShardedStore& store,
+                             QObject* parent)
+    : QObject(parent), selfId(selfId), store(store), wakePending(false) {
+
+    thread.setObjectName(QString("receive-%1").arg(id));
+
+    transport = DatagramTransport::create(backend);
+    transport->moveToThread(&thread);
+    connect(&thread, &QThread::finished, transport, &QObject::deleteLater);
+    connect(transport, &DatagramTransport::readyRead, transport, [this]() { onDataReceived(); });
+}
+
+ReceiveWorker::~ReceiveWorker() {
+    thread.quit();
+    thread.wait();
+}
+
+bool ReceiveWorker::start(const QHostAddress& address, quint16 port) {
+    thread.start();
+
+    bool bound = false;
+    QMetaObject::invokeMethod(transport, [this, &address, port, &bound]() {
+        bound = transport->setReusePort(true) && transport->bind(address, port);
+        if (!bound) {
+            qDebug() << "Receive worker failed to bind port" << port << ":" << transport->errorString();
+        }
+    }, Qt::BlockingQueuedConnection);
+    return bound;
+}
+
+void ReceiveWorker::takeHandoffs(QVector<Handoff>& out) {
+    // Clear the flag first: anything pushed after this signals again
+    wakePending.store(false);
+
+    Handoff handoff;
+    while (handoffs.pop(handoff)) {
+        out.append(std::move(handoff));
+    }
+}
+
+void ReceiveWorker::onDataReceived() {
+    while (transport->receive(receivedBatch) > 0) {
+        for (const DatagramTransport::Datagram& datagram : receivedBatch) {
+            process(datagram);
+        }
+    }
+}
+
+void ReceiveWorker::process(const DatagramTransport::Datagram& datagram) {
+    Handoff handoff;
+    handoff.host = datagram.host;
+    handoff.port = datagram.port;
+
+    MessageView view(datagram.data, datagram.size);
+    if (view.isValid() && view.getType() == Message::CHAT_MESSAGE) {
+        if (view.originEquals(selfId)) {
+            return;  // Ignore messages from self
+        }
+
+        NodeIndex origin = NodeRegistry::global().intern(view.originData(), view.originSize());
+        quint32 sequenceNumber = static_cast<quint32>(view.getSequenceNumber());
+        handoff.sender = origin;
+        handoff.wireVersion = view.getWireVersion();
+
+        handoff.sequenceNumber = static_cast<int>(sequenceNumber);
+        handoff.direct = view.destinationEquals(selfId);
+
+        if (store.contains(origin, sequenceNumber)) {
+            handoff.kind = Handoff::SEEN;
+            post(std::move(handoff));
+            return;
+        }
+
+        Message message = view.toMessage();
+        if (store.insert(origin, message)) {
+            handoff.kind = Handoff::STORED;
+            handoff.message = std::move(message);
+            post(std::move(handoff));
+            return;
+        }
+        if (store.contains(origin, sequenceNumber)) {
+            handoff.kind = Handoff::SEEN;  // Another thread stored it first
+            post(std::move(handoff));
+            return;
+        }
+        // Not storable at all: the manager logs and drops it
+    }
+
+    handoff.kind = Handoff::RAW;
+    handoff.datagram = QByteArray(datagram.data, datagram.size);  // The receive ring is reused
+    post(std::move(handoff));
+}
+
+void ReceiveWorker::post(Handoff handoff) {
+    handoffs.push(std::move(handoff));
+    if (!wakePending.exchange(true)) {
+        emit handoffReady();
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <QObject>
+#include <QThread>
+#include <QHostAddress>
+#include <atomic>
+#include "message.h"
+#include "noderegistry.h"
+#include "datagramtransport.h"
+#include "shardedstore.h"
+#include "spscqueue.h"
+
+// One extra socket in NetworkManager's SO_REUSEPORT group, read on its own
+// thread. The kernel spreads incoming datagrams across the group by flow, so
+// each worker sees a share of the traffic.
+//
+// Chat messages, the bulk of the traffic, are deduplicated and stored right
+// here in the shared ShardedStore; only the first thread to store a message
+// hands it on. Everything else is handed to the manager as raw bytes. The
+// manager still owns the clock, digest tree, durable log and every reply.
+class ReceiveWorker : public QObject {
+    Q_OBJECT
+
+public:
+    struct Handoff {
+        enum Kind {
+            STORED,  // New chat message, already in the store
+            SEEN,  // Duplicate chat message: only the sender's liveness matters
+            RAW  // Anything else, for the manager to process
+        };
+        Kind kind = RAW;
+        Message message;
+        QByteArray datagram;
+        NodeIndex sender = NodeRegistry::INVALID_NODE;
+        int sequenceNumber = 0;  // SEEN: which message was duplicated
+        bool direct = false;  // SEEN: it was addressed to us, so the sender wants another ACK
+        int wireVersion = 0;
+        QHostAddress host;
+        quint16 port = 0;
+    };
+
+    // backend must be one that supports SO_REUSEPORT
+    ReceiveWorker(int id, DatagramTransport::Backend backend, const QByteArray& selfId, ShardedStore& store,
+                  QObject* parent = nullptr);
+    ~ReceiveWorker();
+
+    // Starts the thread and binds there with SO_REUSEPORT; blocks until bound
+    bool start(const QHostAddress& address, quint16 port);
+
+    // Manager thread: moves every pending handoff into out
+    void takeHandoffs(QVector<Handoff>& out);
+
+signals:
+    void handoffReady();  // Emitted on the worker thread when handoffs go from none to some
+
+private:
+    void onDataReceived();  // Worker thread
+    void process(const DatagramTransport::Datagram& datagram);
+    void post(Handoff handoff);
+
+    QThread thread;
+    DatagramTransport* transport;  // Lives on thread
+    QByteArray selfId;
+    ShardedStore& store;
+    QVector<DatagramTransport::Datagram> receivedBatch;
+
+    SpscQueue<Handoff> handoffs;
+    std::atomic<bool> wakePending;
+};
@@ -0,0 +1,55 @@
+#include "reorderbuffer.h"
+
+bool ReorderBuffer::hold(NodeIndex origin, const Message& message, qint64 now) {
+    const MessageKey predecessor = NodeRegistry::messageKey(origin, static_cast<quint32>(message.getPreviousSequence()));
+    if (waiting.contains(predecessor)) {
+        return false;
+    }
+
+    Entry entry;
+    entry.message = message;
+    entry.key = NodeRegistry::messageKey(origin, static_cast<quint32>(message.getSequenceNumber()));
+    entry.heldSince = now;
+    waiting.insert(predecessor, entry);
+    held.insert(entry.key);
+    arrivals.enqueue(predecessor);
+    return true;
+}
+
+bool ReorderBuffer::takeSuccessor(MessageKey delivered, Message& out) {
+    auto it = waiting.find(delivered);
+    if (it == waiting.end()) {
+        return false;
+    }
+    out = it.value().message;
+    held.remove(it.value().key);
+    waiting.erase(it);
+    return true;
+}
+
+void ReorderBuffer::takeExpired(qint64 now, QList<Message>& out) {
+    while (!arrivals.isEmpty()) {
+        auto it = waiting.find(arrivals.head());
+        if (it == waiting.end()) {
+            arrivals.dequeue();  // Already delivered in order
+            continue;
+        }
+        if (now - it.value().heldSince < TIMEOUT && waiting.size() <= LIMIT) {
+            break;
+        }
+        arrivals.dequeue();
+        out.append(it.value().message);
+        held.remove(it.value().key);
+        waiting.erase(it);
+    }
+}
+
+qint64 ReorderBuffer::nextExpiry() const {
+    for (MessageKey predecessor : arrivals) {
+        auto it = waiting.constFind(predecessor);
+        if (it != waiting.constEnd()) {
+            return it.value().heldSince + TIMEOUT;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <QHash>
+#include <QSet>
+#include <QQueue>
+#include "message.h"
+#include "noderegistry.h"
+
+// Direct messages that arrived before their predecessor in the sender's
+// stream to us (Message::getPreviousSequence()), held so they are delivered
+// in the order they were sent. Entries are keyed by the predecessor, so the
+// successor of a just-delivered message is found in O(1).
+//
+// A predecessor may never come (the sender gave up on it, or it was compacted
+// away), so waiting is bounded: past TIMEOUT, or beyond LIMIT held messages,
+// the oldest is released anyway and delivery skips the hole.
+class ReorderBuffer {
+public:
+    static const int LIMIT = 1024;
+    static const int TIMEOUT = 5000;  // ms
+
+    // Holds message until (origin, message.getPreviousSequence()) is delivered.
+    // False if another message already waits on that predecessor.
+    bool hold(NodeIndex origin, const Message& message, qint64 now);
+    bool holds(MessageKey key) const { return held.contains(key); }  // key of the held message itself
+
+    // The message waiting on delivered, if any
+    bool takeSuccessor(MessageKey delivered, Message& out);
+
+    // Moves the messages that waited too long, or overflow LIMIT, into out, oldest first
+    void takeExpired(qint64 now, QList<Message>& out);
+    qint64 nextExpiry() const;  // -1 when empty
+
+    int size() const { return waiting.size(); }
+    bool isEmpty() const { return waiting.isEmpty(); }
+
+private:
+    struct Entry {
+        Message message;
+        MessageKey key;
+        qint64 heldSince;
+    };
+
+    QHash<MessageKey, Entry> waiting;  // predecessor -> the message waiting on it
+    QSet<MessageKey> held;  // Keys of the waiting messages themselves
+    QQueue<MessageKey> arrivals;  // Predecessor keys, oldest first; entries taken early are skipped
+};
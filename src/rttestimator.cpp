@@ -0,0 +1,27 @@
+#include "rttestimator.h"
+#include <QRandomGenerator>
+
+void RttEstimator::sample(qint64 rttMs) {
+    const qint64 rtt = qMax<qint64>(1, rttMs);
+    if (samples == 0) {
+        srtt = rtt;
+        rttvar = rtt / 2;
+    } else {
+        // beta = 1/4, alpha = 1/8
+        rttvar = (3 * rttvar + qAbs(srtt - rtt)) / 4;
+        srtt = (7 * srtt + rtt) / 8;
+    }
+    ++samples;
+
+    // Clock granularity is 1 ms, so 4 * RTTVAR is never rounded below it
+    timeout = qBound<qint64>(MIN_RTO, srtt + qMax<qint64>(1, 4 * rttvar), MAX_RTO);
+}
+
+qint64 RttEstimator::backoff(int retry) const {
+    qint64 delay = timeout;
+    for (int i = 0; i < retry && delay < MAX_RTO; ++i) {
+        delay *= 2;
+    }
+    delay = qMin<qint64>(delay, MAX_RTO);
+    return delay + QRandomGenerator::global()->bounded(delay / 4 + 1);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <QtGlobal>
+
+// Smoothed round-trip time and retransmission timeout for one peer, after
+// RFC 6298: SRTT and RTTVAR are exponentially weighted from ACK timings, and
+// RTO = SRTT + 4 * RTTVAR, clamped. Callers feed it only samples from
+// messages that were never retransmitted (Karn's algorithm), since an ACK for
+// a retransmitted message cannot say which copy it answers.
+class RttEstimator {
+public:
+    static const int INITIAL_RTO = 1000;  // ms, before the first sample
+    static const int MIN_RTO = 20;  // ms; the LAN floor, well under the old fixed 2 s
+    static const int MAX_RTO = 60000;  // ms
+
+    RttEstimator() : srtt(0), rttvar(0), timeout(INITIAL_RTO), samples(0) {}
+
+    void sample(qint64 rttMs);
+    qint64 rto() const { return timeout; }
+    qint64 smoothedRtt() const { return srtt; }
+    bool hasSample() const { return samples > 0; }
+
+    // Timeout for retry n (0 = first transmission): RTO doubled n times, capped
+    // at MAX_RTO, plus up to a quarter more at random so retransmissions from
+    // many senders don't synchronize
+    qint64 backoff(int retry) const;
+
+private:
+    qint64 srtt;
+    qint64 rttvar;
+    qint64 timeout;
+    int samples;
+};
@@ -0,0 +1,101 @@
+#include "shardedstore.h"
+#include <QMutexLocker>
+#include <utility>
+
+ShardedStore::ShardedStore(int shards) {
+    setShardCount(shards);
+}
+
+void ShardedStore::setShardCount(int count) {
+    shards.clear();
+    for (int i = 0; i < qMax(1, count); ++i) {
+        shards.emplace_back(new Shard);
+    }
+}
+
+bool ShardedStore::contains(NodeIndex origin, quint32 sequenceNumber) const {
+    const Shard& shard = shardFor(origin);
+    QMutexLocker locker(&shard.lock);
+    return shard.log.contains(origin, sequenceNumber);
+}
+
+bool ShardedStore::insert(NodeIndex origin, const Message& message) {
+    Shard& shard = shardFor(origin);
+    QMutexLocker locker(&shard.lock);
+    return shard.log.insert(origin, message);
+}
+
+QList<Message> ShardedStore::range(NodeIndex origin, quint32 after, quint32 upTo) const {
+    const Shard& shard = shardFor(origin);
+    QMutexLocker locker(&shard.lock);
+    return shard.log.range(origin, after, upTo);
+}
+
+QList<Message> ShardedStore::missingFor(const VectorClock& local, const VectorClock& remote) const {
+    QList<Message> missing;
+    const QVector<VectorClock::Gap> gaps = local.diff(remote);
+    for (const VectorClock::Gap& gap : gaps) {
+        missing.append(range(gap.node, gap.from, gap.to));
+    }
+    return missing;
+}
+
+int ShardedStore::compact(NodeIndex origin, quint32 upTo, qint64* reclaimedBytes) {
+    Shard& shard = shardFor(origin);
+    QMutexLocker locker(&shard.lock);
+    return shard.log.compact(origin, upTo, reclaimedBytes);
+}
+
+void ShardedStore::skipThrough(NodeIndex origin, quint32 upTo) {
+    Shard& shard = shardFor(origin);
+    QMutexLocker locker(&shard.lock);
+    shard.log.skipThrough(origin, upTo);
+}
+
+quint32 ShardedStore::compactedThrough(NodeIndex origin) const {
+    const Shard& shard = shardFor(origin);
+    QMutexLocker locker(&shard.lock);
+    return shard.log.compactedThrough(origin);
+}
+
+QList<NodeIndex> ShardedStore::originsWithMessages() const {
+    QList<NodeIndex> origins;
+    for (const auto& shard : shards) {
+        QMutexLocker locker(&shard->lock);
+        origins.append(shard->log.originsWithMessages());
+    }
+    return origins;
+}
+
+void ShardedStore::absorb(MessageLog& log) {
+    if (shards.size() == 1 && size() == 0) {
+        QMutexLocker locker(&shards.front()->lock);
+        std::swap(shards.front()->log, log);
+        return;
+    }
+
+    for (NodeIndex origin : log.originsWithMessages()) {
+        for (const Message& message : log.range(origin, 0, 0xFFFFFFFFu)) {
+            insert(origin, message);
+        }
+    }
+    log.clear();
+}
+
+int ShardedStore::size() const {
+    int total = 0;
+    for (const auto& shard : shards) {
+        QMutexLocker locker(&shard->lock);
+        total += shard->log.size();
+    }
+    return total;
+}
+
+qint64 ShardedStore::byteCount() const {
+    qint64 total = 0;
+    for (const auto& shard : shards) {
+        QMutexLocker locker(&shard->lock);
+        total += shard->log.byteCount();
+    }
+    return total;
+}
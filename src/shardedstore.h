@@ -0,0 +1,48 @@
+#pragma once
+
+#include <QMutex>
+#include <QVector>
+#include <QList>
+#include <memory>
+#include <vector>
+#include "messagelog.h"
+
+// MessageLog split into shards by origin, each behind its own lock, so
+// receive workers on different threads can dedupe and store messages of
+// different origins in parallel. An origin always maps to the same shard, so
+// every per-origin operation takes exactly one lock.
+//
+// With a single shard this is a MessageLog plus an uncontended mutex.
+class ShardedStore {
+public:
+    explicit ShardedStore(int shards = 1);
+
+    void setShardCount(int shards);  // Drops everything stored
+    int shardCount() const { return static_cast<int>(shards.size()); }
+
+    bool contains(NodeIndex origin, quint32 sequenceNumber) const;
+    bool insert(NodeIndex origin, const Message& message);  // false if duplicate or out of range
+    QList<Message> range(NodeIndex origin, quint32 after, quint32 upTo) const;
+    QList<Message> missingFor(const VectorClock& local, const VectorClock& remote) const;
+    int compact(NodeIndex origin, quint32 upTo, qint64* reclaimedBytes = nullptr);
+    void skipThrough(NodeIndex origin, quint32 upTo);
+    quint32 compactedThrough(NodeIndex origin) const;
+    QList<NodeIndex> originsWithMessages() const;
+
+    // Take over every message of log (e.g. one just recovered from disk)
+    void absorb(MessageLog& log);
+
+    int size() const;
+    qint64 byteCount() const;
+
+private:
+    struct Shard {
+        mutable QMutex lock;
+        MessageLog log;
+    };
+
+    Shard& shardFor(NodeIndex origin) { return *shards[origin % shards.size()]; }
+    const Shard& shardFor(NodeIndex origin) const { return *shards[origin % shards.size()]; }
+
+    std::vector<std::unique_ptr<Shard>> shards;
+};
@@ -5,7 +5,7 @@
 
 const QList<int> SimpleChat::DEFAULT_PORTS = {9001, 9002, 9003, 9004};
 
-SimpleChat::SimpleChat(int port, const QList<int>& peerPorts, QObject* parent)
+SimpleChat::SimpleChat(int port, const QList<Seed>& seeds, const NetworkOptions& options, QObject* parent)
     : QObject(parent), serverPort(port) {
 
     nodeId = generateNodeId(port);
@@ -13,23 +13,27 @@ SimpleChat::SimpleChat(int port, const QList<int>& peerPorts, QObject* parent)
     window = new ChatWindow();
     window->setNodeId(nodeId);
 
-    networkManager = new NetworkManager(this);
-    networkManager->setNodeId(nodeId);
+    network = new NetworkThread(nodeId, options, this);
 
     connect(window, &ChatWindow::messageEntered, this, &SimpleChat::onMessageEntered);
     connect(window, &ChatWindow::addPeerRequested, this, &SimpleChat::onAddPeerRequested);
-    connect(networkManager, &NetworkManager::messageReceived, this, &SimpleChat::onMessageReceived);
-    connect(networkManager, &NetworkManager::peerDiscovered, this, &SimpleChat::onPeerDiscovered);
-    connect(networkManager, &NetworkManager::peerStatusChanged, this, &SimpleChat::onPeerStatusChanged);
+    connect(network, &NetworkThread::messageReceived, this, &SimpleChat::onMessageReceived);
+    connect(network, &NetworkThread::peerDiscovered, this, &SimpleChat::onPeerDiscovered);
+    connect(network, &NetworkThread::peerStatusChanged, this, &SimpleChat::onPeerStatusChanged);
 
-    if (!networkManager->startServer(port)) {
+    if (!network->start(port)) {
         QMessageBox::critical(nullptr, "Error", QString("Failed to start server on port %1").arg(port));
         QApplication::exit(1);
         return;
     }
 
-    // Use provided peer ports or defaults
-    discoveryPorts = peerPorts.isEmpty() ? DEFAULT_PORTS : peerPorts;
+    // Use provided seeds or the default local ports
+    this->seeds = seeds;
+    if (this->seeds.isEmpty()) {
+        for (int seedPort : DEFAULT_PORTS) {
+            this->seeds.append(Seed("127.0.0.1", seedPort));
+        }
+    }
 
     window->appendMessage(QString("SimpleChat P2P Node %1 started on port %2").arg(nodeId).arg(port));
     window->appendMessage("Features: Peer-to-Peer messaging, Broadcast, Anti-Entropy sync");
@@ -56,19 +60,14 @@ QString SimpleChat::generateNodeId(int port) {
 }
 
 void SimpleChat::setupPeerDiscovery() {
-    // Discover peers on specified ports
-    networkManager->discoverLocalPeers(discoveryPorts);
-
-    // Also manually add known peers (for deterministic setup)
-    for (int port : discoveryPorts) {
-        if (port != serverPort) {
-            QString peerId = generateNodeId(port);
-            networkManager->addPeer(peerId, "127.0.0.1", port);
-        }
+    // Any one reachable seed is enough: membership gossip introduces the rest
+    QStringList addresses;
+    for (const Seed& seed : seeds) {
+        network->addSeed(seed.first, seed.second);
+        addresses.append(QString("%1:%2").arg(seed.first).arg(seed.second));
     }
 
-    window->appendMessage(QString("Attempting to discover peers on ports: %1")
-        .arg(QString::number(discoveryPorts[0]) + "-" + QString::number(discoveryPorts.last())));
+    window->appendMessage(QString("Joining the cluster through: %1").arg(addresses.join(", ")));
 }
 
 void SimpleChat::onMessageEntered(const QString& text, const QString& destination) {
@@ -86,7 +85,7 @@ void SimpleChat::onMessageEntered(const QString& text, const QString& destinatio
     // Create message
     Message message(trimmedText, nodeId, destination, 1);
     qDebug() << "Sending message from" << nodeId << "to" << destination << ":" << trimmedText;
-    networkManager->sendMessage(message);
+    network->sendMessage(message);
 
     // Add to conversation
     if (destination == "broadcast" || destination == "-1") {
@@ -116,7 +115,7 @@ void SimpleChat::onPeerDiscovered(const QString& peerId, const QString& host, in
     window->appendMessage(QString("Discovered peer: %1 at %2:%3").arg(peerId).arg(host).arg(port));
 
     // Update peer list in UI
-    QList<QString> activePeers = networkManager->getActivePeers();
+    QList<QString> activePeers = network->getActivePeers();
     window->updatePeerList(activePeers);
 }
 
@@ -128,20 +127,13 @@ void SimpleChat::onPeerStatusChanged(const QString& peerId, bool active) {
     window->updatePeerStatus(peerId, active);
 
     // Update peer list
-    QList<QString> activePeers = networkManager->getActivePeers();
+    QList<QString> activePeers = network->getActivePeers();
     window->updatePeerList(activePeers);
 }
 
 void SimpleChat::onAddPeerRequested(const QString& host, int port) {
-    // Generate peer ID from port
-    QString peerId = generateNodeId(port);
-
-    window->appendMessage(QString("Manually adding peer %1 at %2:%3").arg(peerId).arg(host).arg(port));
+    window->appendMessage(QString("Contacting %1:%2").arg(host).arg(port));
 
-    // Add peer to network manager
-    networkManager->addPeer(peerId, host, port);
-
-    // Update peer list in UI
-    QList<QString> activePeers = networkManager->getActivePeers();
-    window->updatePeerList(activePeers);
+    // The node and whoever it knows show up once it answers
+    network->addSeed(host, port);
 }
@@ -2,15 +2,19 @@
 
 #include <QObject>
 #include <QTimer>
+#include <QPair>
 #include "chatwindow.h"
-#include "networkmanager.h"
+#include "networkthread.h"
 #include "message.h"
 
 class SimpleChat : public QObject {
     Q_OBJECT
 
 public:
-    explicit SimpleChat(int port, const QList<int>& peerPorts = QList<int>(), QObject* parent = nullptr);
+    typedef QPair<QString, int> Seed;  // Host and port of a node to join through
+
+    explicit SimpleChat(int port, const QList<Seed>& seeds = QList<Seed>(),
+                        const NetworkOptions& options = NetworkOptions(), QObject* parent = nullptr);
     ~SimpleChat();
 
     void show();
@@ -27,10 +31,10 @@ private:
     void setupPeerDiscovery();
 
     ChatWindow* window;
-    NetworkManager* networkManager;
+    NetworkThread* network;  // NetworkManager running on its own thread
     int serverPort;
     QString nodeId;
-    QList<int> discoveryPorts;
+    QList<Seed> seeds;
 
     static const QList<int> DEFAULT_PORTS;
 };
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+// Unbounded lock-free queue for exactly one producer thread and one consumer
+// thread (D. Vyukov's node-recycling SPSC queue).
+//
+// push() never blocks and never fails, so a stalled consumer can't hold up
+// the producer; the price is that the queue grows while the consumer is
+// away. Nodes the consumer has finished with are reused by the producer, so
+// a queue in steady state does not allocate.
+template <typename T>
+class SpscQueue {
+public:
+    SpscQueue() {
+        Node* dummy = new Node;
+        tail.store(dummy, std::memory_order_relaxed);
+        head = first = tailCopy = dummy;
+    }
+
+    ~SpscQueue() {
+        Node* node = first;
+        while (node) {
+            Node* next = node->next.load(std::memory_order_relaxed);
+            delete node;
+            node = next;
+        }
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer thread only
+    void push(T value) {
+        Node* node = allocate();
+        node->value = std::move(value);
+        node->next.store(nullptr, std::memory_order_relaxed);
+        head->next.store(node, std::memory_order_release);
+        head = node;
+    }
+
+    // Consumer thread only; false when empty
+    bool pop(T& out) {
+        Node* current = tail.load(std::memory_order_relaxed);
+        Node* next = current->next.load(std::memory_order_acquire);
+        if (!next) {
+            return false;
+        }
+        out = std::move(next->value);
+        next->value = T();  // Don't keep payloads alive in recycled nodes
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+private:
+    struct Node {
+        std::atomic<Node*> next{nullptr};
+        T value;
+    };
+
+    // Reuse nodes in [first, tail) the consumer has moved past
+    Node* allocate() {
+        if (first != tailCopy) {
+            Node* node = first;
+            first = first->next.load(std::memory_order_relaxed);
+            return node;
+        }
+        tailCopy = tail.load(std::memory_order_acquire);
+        if (first != tailCopy) {
+            Node* node = first;
+            first = first->next.load(std::memory_order_relaxed);
+            return node;
+        }
+        return new Node;
+    }
+
+    // Consumer side
+    alignas(64) std::atomic<Node*> tail;  // Last consumed node; its successor is the front
+
+    // Producer side
+    alignas(64) Node* head;  // Last pushed node
+    Node* first;  // Oldest recyclable node
+    Node* tailCopy;  // Producer's cached view of tail
+};
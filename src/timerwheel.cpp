@@ -0,0 +1,179 @@
+#include "timerwheel.h"
+#include <QtAlgorithms>
+
+namespace {
+
+const qint64 SLOT_MASK = TimerWheel::SLOTS - 1;
+
+// Distance from slot 'from' to the next occupied slot, wrapping around; -1 if none
+int nextOccupied(quint64 bits, int from) {
+    quint64 rotated = from == 0 ? bits : (bits >> from) | (bits << (TimerWheel::SLOTS - from));
+    return rotated ? static_cast<int>(qCountTrailingZeroBits(rotated)) : -1;
+}
+
+}
+
+TimerWheel::TimerWheel(qint64 now) : freeList(-1), current(now), count(0) {
+    for (int level = 0; level < LEVELS; ++level) {
+        for (int slot = 0; slot < SLOTS; ++slot) {
+            heads[level][slot] = -1;
+        }
+        occupied[level] = 0;
+    }
+}
+
+TimerId TimerWheel::schedule(qint64 deadline, quint64 key) {
+    int index;
+    if (freeList >= 0) {
+        index = freeList;
+        freeList = nodes[index].next;
+    } else {
+        index = nodes.size();
+        Node node;
+        node.generation = 1;
+        nodes.append(node);
+    }
+
+    Node& node = nodes[index];
+    node.deadline = qMax(deadline, current);
+    node.key = key;
+    place(index);
+    ++count;
+    return (static_cast<TimerId>(node.generation) << 32) | static_cast<quint32>(index);
+}
+
+bool TimerWheel::cancel(TimerId timer) {
+    const int index = static_cast<int>(static_cast<quint32>(timer));
+    const quint32 generation = static_cast<quint32>(timer >> 32);
+    if (index >= nodes.size() || nodes.at(index).generation != generation || nodes.at(index).level < 0) {
+        return false;
+    }
+    unlink(index);
+    release(index);
+    return true;
+}
+
+void TimerWheel::advance(qint64 now, QVector<quint64>& expired) {
+    while (current <= now) {
+        // Level 0 slots hold exactly one tick's timers
+        const int slot = static_cast<int>(current & SLOT_MASK);
+        const quint64 bit = quint64(1) << slot;
+        if (occupied[0] & bit) {
+            int index = heads[0][slot];
+            heads[0][slot] = -1;
+            occupied[0] &= ~bit;
+            while (index >= 0) {
+                const int next = nodes.at(index).next;
+                expired.append(nodes.at(index).key);
+                release(index);
+                index = next;
+            }
+        }
+
+        if (count == 0) {
+            current = now + 1;  // Nothing left to fire or cascade
+            return;
+        }
+
+        // Step straight to the next occupied slot of this rotation, or else to
+        // whatever comes first: a later rotation's slot or a coarse slot's
+        // cascade. Empty stretches cost nothing.
+        const quint64 ahead = slot == SLOTS - 1 ? 0 : occupied[0] & (~quint64(0) << (slot + 1));
+        const qint64 next = ahead ? current - slot + qCountTrailingZeroBits(ahead) : nextDeadline();
+        current = qMin(next, now + 1);
+        if ((current & SLOT_MASK) == 0) {
+            cascade(1);
+        }
+    }
+}
+
+qint64 TimerWheel::nextDeadline() const {
+    if (count == 0) {
+        return -1;
+    }
+
+    qint64 earliest = -1;
+    const int distance = nextOccupied(occupied[0], static_cast<int>(current & SLOT_MASK));
+    if (distance >= 0) {
+        earliest = current + distance;
+    }
+
+    // A coarser slot can fire nothing before it cascades at its start
+    for (int level = 1; level < LEVELS; ++level) {
+        const int shift = SLOT_BITS * level;
+        const qint64 index = current >> shift;
+        const int ahead = nextOccupied(occupied[level], static_cast<int>((index + 1) & SLOT_MASK));
+        if (ahead >= 0) {
+            const qint64 start = (index + 1 + ahead) << shift;
+            earliest = earliest < 0 ? start : qMin(earliest, start);
+        }
+    }
+    return earliest;
+}
+
+void TimerWheel::place(int index) {
+    Node& node = nodes[index];
+    const qint64 delta = node.deadline - current;
+
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (qint64(1) << (SLOT_BITS * (level + 1)))) {
+        ++level;
+    }
+    // Beyond the wheel's reach: park in the last top-level slot and place
+    // again when it cascades
+    const qint64 reach = qint64(1) << (SLOT_BITS * LEVELS);
+    const qint64 tick = delta < reach ? node.deadline : current + reach - 1;
+    const int slot = static_cast<int>((tick >> (SLOT_BITS * level)) & SLOT_MASK);
+
+    node.level = static_cast<qint8>(level);
+    node.slot = static_cast<quint8>(slot);
+    node.prev = -1;
+    node.next = heads[level][slot];
+    if (node.next >= 0) {
+        nodes[node.next].prev = index;
+    }
+    heads[level][slot] = index;
+    occupied[level] |= quint64(1) << slot;
+}
+
+void TimerWheel::unlink(int index) {
+    Node& node = nodes[index];
+    if (node.prev >= 0) {
+        nodes[node.prev].next = node.next;
+    } else {
+        heads[node.level][node.slot] = node.next;
+        if (node.next < 0) {
+            occupied[node.level] &= ~(quint64(1) << node.slot);
+        }
+    }
+    if (node.next >= 0) {
+        nodes[node.next].prev = node.prev;
+    }
+}
+
+void TimerWheel::release(int index) {
+    Node& node = nodes[index];
+    if (++node.generation == 0) {
+        node.generation = 1;  // Keeps TimerId 0 invalid
+    }
+    node.level = -1;
+    node.next = freeList;
+    freeList = index;
+    --count;
+}
+
+void TimerWheel::cascade(int level) {
+    const int slot = static_cast<int>((current >> (SLOT_BITS * level)) & SLOT_MASK);
+    if (slot == 0 && level + 1 < LEVELS) {
+        cascade(level + 1);  // Refills this level first
+    }
+
+    int index = heads[level][slot];
+    heads[level][slot] = -1;
+    occupied[level] &= ~(quint64(1) << slot);
+    while (index >= 0) {
+        const int next = nodes.at(index).next;
+        place(index);  // Now within reach of a finer level
+        index = next;
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <QVector>
+#include <QtGlobal>
+
+typedef quint64 TimerId;  // Generation and node slot; 0 is never handed out
+
+// Hierarchical timer wheel with millisecond ticks: LEVELS wheels of SLOTS
+// slots each, level l slots spanning SLOTS^l ticks, so the wheel reaches about
+// 4.6 hours ahead. Timers due within SLOTS ticks sit in level 0 and fire from
+// their exact slot; later ones wait in a coarser level and are moved down
+// (cascaded) as time reaches their slot. Scheduling and cancelling are O(1),
+// and advancing jumps over empty slots, so it costs one step per slot that
+// fires or cascades however many timers are outstanding.
+//
+// Timers live in a pooled array of intrusive list nodes, so steady-state use
+// allocates nothing. A TimerId stays safe to cancel after its timer fired.
+class TimerWheel {
+public:
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+    static const int LEVELS = 4;
+    static constexpr TimerId INVALID_TIMER = 0;
+
+    explicit TimerWheel(qint64 now = 0);
+
+    // key comes back from advance() once now reaches deadline; a deadline
+    // already past is due on the next tick not yet advanced over
+    TimerId schedule(qint64 deadline, quint64 key);
+    bool cancel(TimerId timer);  // false if it already fired or was cancelled
+
+    // Fires everything due at or before now, in deadline order, appending the keys
+    void advance(qint64 now, QVector<quint64>& expired);
+
+    // Earliest time advance() could have anything to fire, or -1 when empty.
+    // Exact for level 0; for coarser levels, when the next one cascades.
+    qint64 nextDeadline() const;
+
+    int size() const { return count; }
+    bool isEmpty() const { return count == 0; }
+
+private:
+    struct Node {
+        qint64 deadline;
+        quint64 key;
+        int prev;
+        int next;  // Also links the free list
+        quint32 generation;  // Bumped whenever the node is released
+        qint8 level;  // -1 when free
+        quint8 slot;
+    };
+
+    void place(int index);
+    void unlink(int index);
+    void release(int index);
+    void cascade(int level);
+
+    QVector<Node> nodes;
+    int freeList;
+    int heads[LEVELS][SLOTS];
+    quint64 occupied[LEVELS];  // Bit s set when slot s has timers
+    qint64 current;  // Next tick to process
+    int count;
+};
@@ -0,0 +1,515 @@
+#include "uringtransport.h"
+
+#ifdef Q_OS_LINUX
+
+#include <QTimer>
+#include <QDebug>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+bool UringTransport::Ring::setup(unsigned entries, unsigned completions, QString& error) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = completions;
+
+    fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+        error = QString("io_uring_setup: %1").arg(QString::fromLocal8Bit(std::strerror(errno)));
+        return false;
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        error = "io_uring: kernel too old";
+        teardown();
+        return false;
+    }
+
+    ringsSize = qMax(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                     params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    rings = ::mmap(nullptr, ringsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqeMapping = ::mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (rings == MAP_FAILED || sqeMapping == MAP_FAILED) {
+        error = QString("io_uring mmap: %1").arg(QString::fromLocal8Bit(std::strerror(errno)));
+        if (rings == MAP_FAILED) {
+            rings = nullptr;
+        }
+        if (sqeMapping != MAP_FAILED) {
+            ::munmap(sqeMapping, sqesSize);
+        }
+        teardown();
+        return false;
+    }
+    sqes = static_cast<io_uring_sqe*>(sqeMapping);
+
+    char* base = static_cast<char*>(rings);
+    sqHead = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+    sqMask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+    cqHead = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+    queued = 0;
+    return true;
+}
+
+void UringTransport::Ring::teardown() {
+    if (sqes) {
+        ::munmap(sqes, sqesSize);
+        sqes = nullptr;
+    }
+    if (rings) {
+        ::munmap(rings, ringsSize);
+        rings = nullptr;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+io_uring_sqe* UringTransport::Ring::nextSqe() {
+    // Only this thread writes the SQ tail, so a plain read is current
+    const unsigned index = (*sqTail + queued) & sqMask;
+    sqArray[index] = index;
+    ++queued;
+    io_uring_sqe* sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int UringTransport::Ring::enter(unsigned waitFor) {
+    const unsigned base = *sqTail;
+    const unsigned submit = queued;
+    if (submit > 0) {
+        __atomic_store_n(sqTail, base + submit, __ATOMIC_RELEASE);
+    }
+
+    int result;
+    do {
+        result = static_cast<int>(::syscall(__NR_io_uring_enter, fd, submit, waitFor,
+                                            waitFor > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+    } while (result < 0 && errno == EINTR);
+
+    // Without SQPOLL the kernel only reads the SQ inside io_uring_enter, so
+    // what it did not take can be withdrawn; left published, it would be
+    // consumed by some later enter, long after the caller gave up on it
+    const unsigned taken = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) - base;
+    if (taken != submit) {
+        __atomic_store_n(sqTail, base + taken, __ATOMIC_RELEASE);
+    }
+    queued = 0;
+    if (result < 0 && taken == 0) {
+        return -1;
+    }
+    return static_cast<int>(taken);
+}
+
+UringTransport::UringTransport(QObject* parent)
+    : DatagramTransport(parent), fd(-1), eventFd(-1), boundPort(0), reusePort(false), receiveArmed(false),
+      notifier(nullptr), sendsInFlight(0), flushScheduled(false) {
+
+    bufferPool.resize(BUFFER_COUNT * BUFFER_SIZE);
+
+    bufferRingSize = BUFFER_COUNT * sizeof(io_uring_buf);
+    void* mapping = ::mmap(nullptr, bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    bufferRing = mapping == MAP_FAILED ? nullptr : static_cast<io_uring_buf_ring*>(mapping);
+
+    std::memset(&receiveHeader, 0, sizeof(receiveHeader));
+    receiveHeader.msg_namelen = sizeof(sockaddr_in);
+
+    sendPayloads.resize(SEND_SLOTS);
+    sendHeaders.resize(SEND_SLOTS);
+    sendVectors.resize(SEND_SLOTS);
+    sendAddresses.resize(SEND_SLOTS);
+    for (int slot = SEND_SLOTS - 1; slot >= 0; --slot) {
+        freeSlots.append(slot);
+    }
+}
+
+UringTransport::~UringTransport() {
+    close();
+    if (bufferRing) {
+        ::munmap(bufferRing, bufferRingSize);
+    }
+}
+
+bool UringTransport::isSupported() {
+    // Setting up a real socket is the only reliable test: seccomp filters and
+    // older kernels fail at different steps
+    static const bool supported = []() {
+        UringTransport probe;
+        if (!probe.bind(QHostAddress::LocalHost, 0)) {
+            qDebug() << "io_uring unavailable:" << probe.errorString();
+            return false;
+        }
+        return true;
+    }();
+    return supported;
+}
+
+void UringTransport::setError(const char* operation, int error) {
+    lastError = QString("%1: %2").arg(operation).arg(QString::fromLocal8Bit(std::strerror(error)));
+}
+
+bool UringTransport::bind(const QHostAddress& address, quint16 port) {
+    close();
+
+    bool isIPv4 = false;
+    quint32 ip = address.toIPv4Address(&isIPv4);
+    if (!isIPv4) {
+        lastError = "io_uring transport only supports IPv4";
+        return false;
+    }
+    if (!bufferRing) {
+        lastError = "io_uring: cannot map the buffer ring";
+        return false;
+    }
+
+    fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        setError("socket", errno);
+        return false;
+    }
+
+    int enable = 1;
+    if (reusePort && ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0) {
+        setError("SO_REUSEPORT", errno);
+        close();
+        return false;
+    }
+
+    sockaddr_in local;
+    std::memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(ip);
+    local.sin_port = htons(port);
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0) {
+        setError("bind", errno);
+        close();
+        return false;
+    }
+
+    socklen_t length = sizeof(local);
+    ::getsockname(fd, reinterpret_cast<sockaddr*>(&local), &length);
+    boundPort = ntohs(local.sin_port);
+
+    // Room for a completion per buffer several times over, so the CQ never
+    // overflows while the buffers are out
+    if (!receiveRing.setup(BUFFER_COUNT, BUFFER_COUNT * 4, lastError) ||
+        !sendRing.setup(SEND_SLOTS, SEND_SLOTS * 2, lastError)) {
+        close();
+        return false;
+    }
+
+    // Register the buffer pool, then hand every buffer to the kernel
+    io_uring_buf_reg registration;
+    std::memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = reinterpret_cast<quint64>(bufferRing);
+    registration.ring_entries = BUFFER_COUNT;
+    registration.bgid = BUFFER_GROUP;
+    bufferRing->tail = 0;
+    if (::syscall(__NR_io_uring_register, receiveRing.fd, IORING_REGISTER_PBUF_RING, &registration, 1) != 0) {
+        setError("io_uring provided buffers", errno);
+        close();
+        return false;
+    }
+    handedOut.clear();
+    for (int i = 0; i < BUFFER_COUNT; ++i) {
+        handedOut.append(static_cast<quint16>(i));
+    }
+    recycleBuffers();
+
+    eventFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (eventFd < 0 || ::syscall(__NR_io_uring_register, receiveRing.fd, IORING_REGISTER_EVENTFD, &eventFd, 1) != 0) {
+        setError("io_uring eventfd", errno);
+        close();
+        return false;
+    }
+
+    if (!armReceive()) {
+        close();
+        return false;
+    }
+
+    // A kernel without multishot recvmsg rejects it on the spot instead of
+    // leaving it armed
+    const unsigned head = *receiveRing.cqHead;
+    if (head != __atomic_load_n(receiveRing.cqTail, __ATOMIC_ACQUIRE)) {
+        const io_uring_cqe& cqe = receiveRing.cqes[head & receiveRing.cqMask];
+        if (cqe.res < 0 && !(cqe.flags & IORING_CQE_F_MORE) && cqe.res != -ENOBUFS) {
+            setError("multishot recvmsg", -cqe.res);
+            close();
+            return false;
+        }
+    }
+
+    notifier = new QSocketNotifier(eventFd, QSocketNotifier::Read, this);
+    connect(notifier, &QSocketNotifier::activated, this, &DatagramTransport::readyRead);
+    return true;
+}
+
+void UringTransport::close() {
+    if (fd >= 0) {
+        flush();
+    }
+    delete notifier;
+    notifier = nullptr;
+
+    // Closing the ring cancels the armed receive; the kernel is done with the
+    // buffers before the ring's memory goes. flush() above waited for the sends.
+    receiveRing.teardown();
+    sendRing.teardown();
+    if (sendsInFlight > 0) {
+        qDebug() << "io_uring: closed with" << sendsInFlight << "sends unconfirmed";
+    }
+    sendsInFlight = 0;
+    queuedSlots.clear();
+    freeSlots.clear();
+    for (int slot = SEND_SLOTS - 1; slot >= 0; --slot) {
+        sendPayloads[slot].clear();
+        freeSlots.append(slot);
+    }
+    if (eventFd >= 0) {
+        ::close(eventFd);
+        eventFd = -1;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    boundPort = 0;
+    receiveArmed = false;
+    handedOut.clear();
+}
+
+bool UringTransport::armReceive() {
+    io_uring_sqe* sqe = receiveRing.nextSqe();
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<quint64>(&receiveHeader);
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = RECEIVE_TAG;
+
+    if (receiveRing.enter(0) < 1) {
+        setError("io_uring_enter", errno);
+        return false;
+    }
+    receiveArmed = true;
+    return true;
+}
+
+void UringTransport::recycleBuffers() {
+    if (handedOut.isEmpty()) {
+        return;
+    }
+
+    // Entries start at offset 0, with the tail overlaying entry 0's resv
+    // field. Not bufferRing->bufs: the header's flexible array member gets
+    // an offset of 8 when compiled as C++.
+    io_uring_buf* entries = reinterpret_cast<io_uring_buf*>(bufferRing);
+    unsigned short tail = bufferRing->tail;
+    const unsigned short mask = BUFFER_COUNT - 1;
+    for (quint16 id : handedOut) {
+        io_uring_buf& buffer = entries[tail & mask];
+        buffer.addr = reinterpret_cast<quint64>(bufferPool.data() + id * BUFFER_SIZE);
+        buffer.len = BUFFER_SIZE;
+        buffer.bid = id;
+        ++tail;
+    }
+    __atomic_store_n(&bufferRing->tail, tail, __ATOMIC_RELEASE);
+    handedOut.clear();
+}
+
+int UringTransport::receive(QVector<Datagram>& out) {
+    out.clear();
+    if (fd < 0) {
+        return 0;
+    }
+
+    // Reset the notifier first; completions posted after this signal again
+    eventfd_t signalled;
+    ::eventfd_read(eventFd, &signalled);
+
+    // The previous batch is done with; its buffers go back to the kernel,
+    // and a receive that ended (out of buffers, say) is armed again
+    recycleBuffers();
+    if (!receiveArmed && !armReceive()) {
+        qDebug() << "Failed to re-arm io_uring receive:" << lastError;
+        return 0;
+    }
+
+    const char* pool = bufferPool.constData();
+    unsigned head = *receiveRing.cqHead;
+    const unsigned tail = __atomic_load_n(receiveRing.cqTail, __ATOMIC_ACQUIRE);
+    int reaped = 0;
+    while (head != tail && handedOut.size() < RECEIVE_BATCH) {
+        const io_uring_cqe& cqe = receiveRing.cqes[head & receiveRing.cqMask];
+        ++head;
+        ++reaped;
+
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            receiveArmed = false;  // Armed again on the next call
+        }
+        if (cqe.res < 0) {
+            if (cqe.res != -ENOBUFS) {
+                setError("recvmsg", -cqe.res);
+            }
+            continue;
+        }
+        if (!(cqe.flags & IORING_CQE_F_BUFFER)) {
+            continue;
+        }
+
+        const quint16 id = static_cast<quint16>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        handedOut.append(id);
+
+        // [recvmsg_out][source address][payload], as laid out by the kernel
+        const char* buffer = pool + id * BUFFER_SIZE;
+        io_uring_recvmsg_out header;
+        std::memcpy(&header, buffer, sizeof(header));
+        if ((header.flags & MSG_TRUNC) || header.namelen < sizeof(sockaddr_in)) {
+            continue;  // Larger than a buffer; a partial datagram is useless
+        }
+        sockaddr_in from;
+        std::memcpy(&from, buffer + sizeof(header), sizeof(from));
+
+        Datagram datagram;
+        datagram.data = buffer + sizeof(header) + receiveHeader.msg_namelen + header.controllen;
+        datagram.size = static_cast<int>(header.payloadlen);
+        datagram.host = QHostAddress(ntohl(from.sin_addr.s_addr));
+        datagram.port = ntohs(from.sin_port);
+        out.append(datagram);
+    }
+    __atomic_store_n(receiveRing.cqHead, head, __ATOMIC_RELEASE);
+    return reaped;
+}
+
+bool UringTransport::send(const QByteArray& datagram, const QHostAddress& host, quint16 port) {
+    bool isIPv4 = false;
+    quint32 ip = host.toIPv4Address(&isIPv4);
+    if (fd < 0 || !isIPv4) {
+        lastError = fd < 0 ? "socket not bound" : "io_uring transport only supports IPv4";
+        return false;
+    }
+
+    if (freeSlots.isEmpty()) {
+        flush();  // Submits the queue and reaps what completed
+    }
+    if (freeSlots.isEmpty()) {
+        lastError = "io_uring: every send slot is awaiting its completion";
+        return false;
+    }
+
+    const int slot = freeSlots.takeLast();
+    sendPayloads[slot] = datagram;
+    sockaddr_in& to = sendAddresses[slot];
+    std::memset(&to, 0, sizeof(to));
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = htonl(ip);
+    to.sin_port = htons(port);
+    queuedSlots.append(slot);
+
+    if (freeSlots.isEmpty()) {
+        flush();
+    } else if (!flushScheduled) {
+        flushScheduled = true;
+        QTimer::singleShot(0, this, [this]() { flush(); });
+    }
+    return true;
+}
+
+void UringTransport::flush() {
+    flushScheduled = false;
+    if (fd < 0) {
+        return;
+    }
+    reapSends();  // Left over from a flush whose wait failed
+    const int count = queuedSlots.size();
+    if (count == 0) {
+        return;
+    }
+
+    for (int slot : queuedSlots) {
+        sendVectors[slot].iov_base = const_cast<char*>(sendPayloads.at(slot).constData());
+        sendVectors[slot].iov_len = static_cast<size_t>(sendPayloads.at(slot).size());
+        std::memset(&sendHeaders[slot], 0, sizeof(msghdr));
+        sendHeaders[slot].msg_iov = &sendVectors[slot];
+        sendHeaders[slot].msg_iovlen = 1;
+        sendHeaders[slot].msg_name = &sendAddresses[slot];
+        sendHeaders[slot].msg_namelen = sizeof(sockaddr_in);
+
+        io_uring_sqe* sqe = sendRing.nextSqe();
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<quint64>(&sendHeaders[slot]);
+        sqe->len = 1;
+        sqe->user_data = static_cast<quint64>(slot);
+    }
+
+    // One syscall submits the lot and waits for it: UDP sends complete inline
+    int submitted = sendRing.enter(static_cast<unsigned>(count));
+    if (submitted < count) {
+        // The kernel took the first submitted SQEs; the rest were withdrawn
+        // and their datagrams are dropped, as a full socket buffer would
+        setError("io_uring_enter", errno);
+        qDebug() << "Failed to send" << count - qMax(0, submitted) << "datagrams:" << lastError;
+        for (int i = qMax(0, submitted); i < count; ++i) {
+            const int slot = queuedSlots.at(i);
+            sendPayloads[slot].clear();
+            freeSlots.append(slot);
+        }
+    }
+    sendsInFlight += qMax(0, submitted);
+    queuedSlots.clear();
+
+    // Until a slot's completion is reaped the kernel may still read it, so a
+    // failed wait leaves it busy for the next flush to reap
+    while (sendsInFlight > 0) {
+        const int before = sendsInFlight;
+        reapSends();
+        if (sendsInFlight == before && sendRing.enter(static_cast<unsigned>(sendsInFlight)) < 0) {
+            setError("io_uring_enter", errno);
+            qDebug() << sendsInFlight << "sends still in flight:" << lastError;
+            break;
+        }
+    }
+}
+
+void UringTransport::reapSends() {
+    unsigned head = *sendRing.cqHead;
+    const unsigned tail = __atomic_load_n(sendRing.cqTail, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        return;
+    }
+
+    int failed = 0;
+    for (; head != tail; ++head) {
+        const io_uring_cqe& cqe = sendRing.cqes[head & sendRing.cqMask];
+        const int slot = static_cast<int>(cqe.user_data);
+        if (cqe.res < 0) {
+            setError("sendmsg", -cqe.res);
+            ++failed;
+        }
+        sendPayloads[slot].clear();
+        freeSlots.append(slot);
+        --sendsInFlight;
+    }
+    __atomic_store_n(sendRing.cqHead, head, __ATOMIC_RELEASE);
+
+    if (failed > 0) {
+        qDebug() << "Failed to send" << failed << "datagrams:" << lastError;
+    }
+}
+
+#endif
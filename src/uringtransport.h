@@ -0,0 +1,118 @@
+#pragma once
+
+#include "datagramtransport.h"
+
+#ifdef Q_OS_LINUX
+
+#include <QSocketNotifier>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <linux/io_uring.h>
+
+// IPv4 UDP socket driven through io_uring, using the raw syscalls so there is
+// no liburing dependency. Needs Linux 6.0 or later; isSupported() says whether
+// this kernel (and its seccomp policy) has what it takes.
+//
+// Receiving: a pool of BUFFER_COUNT buffers is registered with the kernel as a
+// provided-buffer ring, and a single multishot recvmsg stays armed on the
+// socket. The kernel copies each datagram, with its source address, straight
+// into a free buffer and posts a completion; no syscall per datagram, and none
+// at all while completions keep arriving. receive() reaps completions and hands
+// the datagrams out in place, giving their buffers back on the next call.
+//
+// Sending: send() queues like MmsgTransport, and flush() submits the queue as
+// one sendmsg per datagram on a second ring, in a single io_uring_enter. Each
+// datagram owns a slot (payload, header, address) until its completion is
+// reaped, so a failed or partial submit never leaves the kernel pointing at
+// memory that has been reused.
+class UringTransport : public DatagramTransport {
+    Q_OBJECT
+
+public:
+    static const int BUFFER_COUNT = 64;  // Power of two; about 4 MiB in all
+    static const int RECEIVE_BATCH = 32;  // Most handed out per receive(), so the kernel keeps the rest
+    static const int SEND_SLOTS = 64;
+
+    explicit UringTransport(QObject* parent = nullptr);
+    ~UringTransport() override;
+
+    static bool isSupported();  // Probed once per process
+
+    bool bind(const QHostAddress& address, quint16 port) override;
+    bool setReusePort(bool enabled) override { reusePort = enabled; return true; }
+    void close() override;
+    quint16 localPort() const override { return boundPort; }
+    QString errorString() const override { return lastError; }
+    Backend backend() const override { return IO_URING; }
+
+    int receive(QVector<Datagram>& out) override;
+    bool send(const QByteArray& datagram, const QHostAddress& host, quint16 port) override;
+    void flush() override;
+
+private:
+    // One io_uring instance: the shared submission and completion rings
+    struct Ring {
+        int fd = -1;
+        void* rings = nullptr;  // SQ and CQ share one mapping (IORING_FEAT_SINGLE_MMAP)
+        size_t ringsSize = 0;
+        io_uring_sqe* sqes = nullptr;
+        size_t sqesSize = 0;
+        unsigned* sqHead = nullptr;
+        unsigned* sqTail = nullptr;
+        unsigned sqMask = 0;
+        unsigned* sqArray = nullptr;
+        unsigned* cqHead = nullptr;
+        unsigned* cqTail = nullptr;
+        unsigned cqMask = 0;
+        io_uring_cqe* cqes = nullptr;
+        unsigned queued = 0;  // SQEs filled in but not yet published
+
+        bool setup(unsigned entries, unsigned completions, QString& error);
+        void teardown();
+        io_uring_sqe* nextSqe();  // Cleared SQE for the caller to fill in; at most entries per enter()
+        // Submits everything queued and waits for waitFor completions. Returns
+        // how many SQEs the kernel took, or -1; the rest are withdrawn.
+        int enter(unsigned waitFor);
+    };
+
+    // Room for the recvmsg header and source address ahead of the payload
+    static const int BUFFER_SIZE = sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_in) + MAX_DATAGRAM_SIZE;
+    static const quint64 RECEIVE_TAG = 1;
+    static const quint16 BUFFER_GROUP = 0;
+
+    void setError(const char* operation, int error);
+    bool armReceive();
+    void recycleBuffers();
+    void reapSends();  // Frees the slots of completed sends
+
+    int fd;
+    int eventFd;  // Signalled by the receive ring for every completion
+    quint16 boundPort;
+    bool reusePort;
+    bool receiveArmed;
+    QString lastError;
+    QSocketNotifier* notifier;
+
+    Ring receiveRing;
+    Ring sendRing;
+
+    // Provided buffers: buffer i is bufferPool[i * BUFFER_SIZE]
+    QByteArray bufferPool;
+    io_uring_buf_ring* bufferRing;  // Page aligned, as the kernel requires
+    size_t bufferRingSize;
+    QVector<quint16> handedOut;  // Buffers backing the last receive()'s datagrams
+    msghdr receiveHeader;  // Template for the multishot recvmsg
+
+    // Send slots; slot i's payload, header, vector and address belong together
+    QVector<QByteArray> sendPayloads;  // Keeps queued and in-flight payloads alive
+    QVector<msghdr> sendHeaders;
+    QVector<iovec> sendVectors;
+    QVector<sockaddr_in> sendAddresses;
+    QVector<int> freeSlots;
+    QVector<int> queuedSlots;  // Waiting for flush(), in send order
+    int sendsInFlight;  // Submitted, completion not reaped yet
+    bool flushScheduled;
+};
+
+#endif
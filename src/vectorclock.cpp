@@ -0,0 +1,464 @@
+#include "vectorclock.h"
+#include <QtEndian>
+
+void VectorClock::set(NodeIndex node, quint32 sequenceNumber) {
+    if (node >= static_cast<NodeIndex>(sequences.size())) {
+        if (sequenceNumber == 0) {
+            return;
+        }
+        sequences.resize(node + 1);
+    }
+    sequences[node] = sequenceNumber;
+
+    auto it = above.find(node);
+    if (it != above.end()) {
+        // Drop ranges the new watermark covers, then let it swallow any that now touch it
+        QVector<Range>& ranges = it.value();
+        while (!ranges.isEmpty() && ranges.first().last <= sequenceNumber) {
+            ranges.removeFirst();
+        }
+        if (!ranges.isEmpty() && ranges.first().first <= sequenceNumber) {
+            ranges.first().first = sequenceNumber + 1;
+        }
+        absorbRanges(node);
+    }
+}
+
+bool VectorClock::advance(NodeIndex node, quint32 sequenceNumber) {
+    if (sequenceNumber <= value(node)) {
+        return false;
+    }
+    set(node, sequenceNumber);
+    return true;
+}
+
+bool VectorClock::insert(NodeIndex node, quint32 sequenceNumber) {
+    if (sequenceNumber == 0 || contains(node, sequenceNumber)) {
+        return false;
+    }
+    addRange(node, sequenceNumber, sequenceNumber);
+    return true;
+}
+
+quint32 VectorClock::highest(NodeIndex node) const {
+    auto it = above.find(node);
+    return it != above.end() ? it.value().last().last : value(node);
+}
+
+bool VectorClock::contains(NodeIndex node, quint32 sequenceNumber) const {
+    return sequenceNumber != 0 && covers(node, sequenceNumber, sequenceNumber);
+}
+
+VectorClock VectorClock::slice(NodeIndex node, int maxRanges) const {
+    VectorClock result;
+    result.set(node, value(node));
+    const QVector<Range> ranges = above.value(node);
+    for (int i = qMax(0, ranges.size() - maxRanges); i < ranges.size(); ++i) {
+        result.addRange(node, ranges.at(i).first, ranges.at(i).last);
+    }
+    return result;
+}
+
+bool VectorClock::addRange(NodeIndex node, quint32 first, quint32 last) {
+    const quint32 watermark = value(node);
+    if (last <= watermark) {
+        return false;
+    }
+    first = qMax(first, watermark + 1);
+
+    if (first == watermark + 1) {
+        set(node, last);  // Also absorbs ranges the new watermark reaches
+        return true;
+    }
+
+    // Splice [first, last] into the sorted set, coalescing overlapping or adjacent ranges
+    QVector<Range>& ranges = above[node];
+    QVector<Range> merged;
+    merged.reserve(ranges.size() + 1);
+    Range added = {first, last};
+    bool placed = false;
+    for (const Range& range : ranges) {
+        if (range.last + 1 < added.first) {
+            merged.append(range);
+        } else if (added.last + 1 < range.first) {
+            if (!placed) {
+                merged.append(added);
+                placed = true;
+            }
+            merged.append(range);
+        } else {
+            added.first = qMin(added.first, range.first);
+            added.last = qMax(added.last, range.last);
+        }
+    }
+    if (!placed) {
+        merged.append(added);
+    }
+    ranges = merged;
+    return true;
+}
+
+void VectorClock::absorbRanges(NodeIndex node) {
+    auto it = above.find(node);
+    if (it == above.end()) {
+        return;
+    }
+
+    QVector<Range>& ranges = it.value();
+    quint32 watermark = value(node);
+    int absorbed = 0;
+    while (absorbed < ranges.size() && ranges.at(absorbed).first <= watermark + 1) {
+        watermark = qMax(watermark, ranges.at(absorbed).last);
+        ++absorbed;
+    }
+    ranges.remove(0, absorbed);
+
+    if (ranges.isEmpty()) {
+        above.erase(it);
+    }
+    if (watermark != value(node)) {
+        sequences[node] = watermark;
+    }
+}
+
+bool VectorClock::covers(NodeIndex node, quint32 first, quint32 last) const {
+    const quint32 watermark = value(node);
+    if (last <= watermark) {
+        return true;
+    }
+    first = qMax(first, watermark + 1);
+
+    auto it = above.find(node);
+    if (it == above.end()) {
+        return false;
+    }
+    for (const Range& range : it.value()) {
+        if (range.first <= first && last <= range.last) {
+            return true;
+        }
+    }
+    return false;
+}
+
+QVector<VectorClock::Range> VectorClock::received(NodeIndex node) const {
+    QVector<Range> result;
+    if (value(node) > 0) {
+        result.append({1, value(node)});
+    }
+    result += above.value(node);
+    return result;
+}
+
+void VectorClock::merge(const VectorClock& other) {
+    const int otherSize = other.sequences.size();
+    if (otherSize > sequences.size()) {
+        sequences.resize(otherSize);
+    }
+
+    quint32* mine = sequences.data();
+    const quint32* theirs = other.sequences.constData();
+    for (int i = 0; i < otherSize; ++i) {
+        if (theirs[i] > mine[i]) {
+            mine[i] = theirs[i];
+        }
+    }
+
+    // Raised watermarks may have reached our own ranges
+    const QList<NodeIndex> withRanges = above.keys();
+    for (NodeIndex node : withRanges) {
+        set(node, value(node));
+    }
+    for (auto it = other.above.begin(); it != other.above.end(); ++it) {
+        for (const Range& range : it.value()) {
+            addRange(it.key(), range.first, range.last);
+        }
+    }
+}
+
+void VectorClock::meet(const VectorClock& other) {
+    const int shared = qMin(sequences.size(), other.sequences.size());
+    sequences.resize(shared);
+    above.clear();
+
+    quint32* mine = sequences.data();
+    const quint32* theirs = other.sequences.constData();
+    for (int i = 0; i < shared; ++i) {
+        if (theirs[i] < mine[i]) {
+            mine[i] = theirs[i];
+        }
+    }
+}
+
+VectorClock::Ordering VectorClock::compare(const VectorClock& other) const {
+    if (!above.isEmpty() || !other.above.isEmpty()) {
+        bool ahead = !other.dominates(*this);
+        bool behind = !dominates(other);
+        if (ahead && behind) {
+            return CONCURRENT;
+        }
+        return ahead ? AFTER : (behind ? BEFORE : EQUAL);
+    }
+
+    bool ahead = false;
+    bool behind = false;
+
+    const int count = qMax(sequences.size(), other.sequences.size());
+    for (int i = 0; i < count && !(ahead && behind); ++i) {
+        quint32 mine = value(static_cast<NodeIndex>(i));
+        quint32 theirs = other.value(static_cast<NodeIndex>(i));
+        if (mine > theirs) {
+            ahead = true;
+        } else if (mine < theirs) {
+            behind = true;
+        }
+    }
+
+    if (ahead && behind) {
+        return CONCURRENT;
+    }
+    if (ahead) {
+        return AFTER;
+    }
+    return behind ? BEFORE : EQUAL;
+}
+
+bool VectorClock::dominates(const VectorClock& other) const {
+    if (!above.isEmpty() || !other.above.isEmpty()) {
+        for (int i = 0; i < other.sequences.size(); ++i) {
+            if (!covers(static_cast<NodeIndex>(i), 1, other.sequences.at(i))) {
+                return false;
+            }
+        }
+        for (auto it = other.above.begin(); it != other.above.end(); ++it) {
+            for (const Range& range : it.value()) {
+                if (!covers(it.key(), range.first, range.last)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    const quint32* mine = sequences.constData();
+    const quint32* theirs = other.sequences.constData();
+    const int shared = qMin(sequences.size(), other.sequences.size());
+
+    for (int i = 0; i < shared; ++i) {
+        if (mine[i] < theirs[i]) {
+            return false;
+        }
+    }
+    for (int i = shared; i < other.sequences.size(); ++i) {
+        if (theirs[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+QVector<VectorClock::Gap> VectorClock::diff(const VectorClock& remote) const {
+    QVector<Gap> gaps;
+    QVector<NodeIndex> nodes;
+    for (int i = 0; i < sequences.size(); ++i) {
+        nodes.append(static_cast<NodeIndex>(i));
+    }
+    for (auto it = above.begin(); it != above.end(); ++it) {
+        if (it.key() >= static_cast<NodeIndex>(sequences.size())) {
+            nodes.append(it.key());
+        }
+    }
+
+    for (NodeIndex node : nodes) {
+        // In-order fast path: one slice above the remote's watermark
+        if (!above.contains(node) && !remote.above.contains(node)) {
+            quint32 theirs = remote.value(node);
+            if (value(node) > theirs) {
+                gaps.append({node, theirs, value(node)});
+            }
+            continue;
+        }
+
+        // Subtract the remote's received ranges from ours
+        const QVector<Range> theirs = remote.received(node);
+        int j = 0;
+        for (Range range : received(node)) {
+            while (j < theirs.size() && theirs.at(j).last < range.first) {
+                ++j;
+            }
+            for (int k = j; k < theirs.size() && theirs.at(k).first <= range.last; ++k) {
+                if (theirs.at(k).first > range.first) {
+                    gaps.append({node, range.first - 1, theirs.at(k).first - 1});
+                }
+                range.first = theirs.at(k).last + 1;
+                if (range.first > range.last || range.first == 0) {
+                    break;
+                }
+            }
+            if (range.first <= range.last && range.first != 0) {
+                gaps.append({node, range.first - 1, range.last});
+            }
+        }
+    }
+    return gaps;
+}
+
+int VectorClock::entryCount() const {
+    int count = 0;
+    for (quint32 sequenceNumber : sequences) {
+        if (sequenceNumber != 0) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+QVariantMap VectorClock::toVariantMap() const {
+    NodeRegistry& registry = NodeRegistry::global();
+    QVariantMap map;
+    for (int i = 0; i < sequences.size(); ++i) {
+        if (sequences.at(i) != 0) {
+            map[registry.name(static_cast<NodeIndex>(i))] = static_cast<int>(sequences.at(i));
+        }
+    }
+    return map;
+}
+
+VectorClock VectorClock::fromVariantMap(const QVariantMap& map) {
+    NodeRegistry& registry = NodeRegistry::global();
+    VectorClock clock;
+    for (auto it = map.begin(); it != map.end(); ++it) {
+        int sequenceNumber = it.value().toInt();
+        if (sequenceNumber > 0) {
+            clock.advance(registry.intern(it.key()), static_cast<quint32>(sequenceNumber));
+        }
+    }
+    return clock;
+}
+
+void VectorClock::appendEntries(QByteArray& out) const {
+    NodeRegistry& registry = NodeRegistry::global();
+    for (int i = 0; i < sequences.size(); ++i) {
+        if (sequences.at(i) == 0) {
+            continue;
+        }
+
+        QByteArray name = registry.name(static_cast<NodeIndex>(i)).toUtf8();
+        char buf[4];
+        qToBigEndian(static_cast<quint16>(name.size()), buf);
+        out.append(buf, 2);
+        out.append(name);
+        qToBigEndian(sequences.at(i), buf);
+        out.append(buf, 4);
+    }
+}
+
+int VectorClock::readEntries(const char* data, int size, int entries) {
+    NodeRegistry& registry = NodeRegistry::global();
+    const uchar* bytes = reinterpret_cast<const uchar*>(data);
+    int offset = 0;
+
+    for (int i = 0; i < entries; ++i) {
+        if (offset + 2 > size) {
+            return -1;
+        }
+        int nameLength = qFromBigEndian<quint16>(bytes + offset);
+        offset += 2;
+        if (offset + nameLength + 4 > size) {
+            return -1;
+        }
+        NodeIndex node = registry.intern(data + offset, nameLength);
+        offset += nameLength;
+        advance(node, qFromBigEndian<quint32>(bytes + offset));
+        offset += 4;
+    }
+
+    return offset;
+}
+
+QVariantMap VectorClock::rangesToVariantMap() const {
+    NodeRegistry& registry = NodeRegistry::global();
+    QVariantMap map;
+    for (auto it = above.begin(); it != above.end(); ++it) {
+        QVariantList bounds;
+        for (const Range& range : it.value()) {
+            bounds << static_cast<qint64>(range.first) << static_cast<qint64>(range.last);
+        }
+        map[registry.name(it.key())] = bounds;
+    }
+    return map;
+}
+
+void VectorClock::addRangesFromVariantMap(const QVariantMap& map) {
+    NodeRegistry& registry = NodeRegistry::global();
+    for (auto it = map.begin(); it != map.end(); ++it) {
+        const QVariantList bounds = it.value().toList();
+        NodeIndex node = registry.intern(it.key());
+        for (int i = 0; i + 1 < bounds.size(); i += 2) {
+            qint64 first = bounds.at(i).toLongLong();
+            qint64 last = bounds.at(i + 1).toLongLong();
+            if (first >= 1 && first <= last && last <= 0xFFFFFFFFLL) {
+                addRange(node, static_cast<quint32>(first), static_cast<quint32>(last));
+            }
+        }
+    }
+}
+
+void VectorClock::appendRanges(QByteArray& out) const {
+    NodeRegistry& registry = NodeRegistry::global();
+    char buf[4];
+    qToBigEndian(static_cast<quint16>(above.size()), buf);
+    out.append(buf, 2);
+
+    for (auto it = above.begin(); it != above.end(); ++it) {
+        QByteArray name = registry.name(it.key()).toUtf8();
+        qToBigEndian(static_cast<quint16>(name.size()), buf);
+        out.append(buf, 2);
+        out.append(name);
+        qToBigEndian(static_cast<quint16>(it.value().size()), buf);
+        out.append(buf, 2);
+        for (const Range& range : it.value()) {
+            qToBigEndian(range.first, buf);
+            out.append(buf, 4);
+            qToBigEndian(range.last, buf);
+            out.append(buf, 4);
+        }
+    }
+}
+
+int VectorClock::readRanges(const char* data, int size) {
+    NodeRegistry& registry = NodeRegistry::global();
+    const uchar* bytes = reinterpret_cast<const uchar*>(data);
+    if (size < 2) {
+        return -1;
+    }
+    const int origins = qFromBigEndian<quint16>(bytes);
+    int offset = 2;
+
+    for (int i = 0; i < origins; ++i) {
+        if (offset + 2 > size) {
+            return -1;
+        }
+        int nameLength = qFromBigEndian<quint16>(bytes + offset);
+        offset += 2;
+        if (offset + nameLength + 2 > size) {
+            return -1;
+        }
+        NodeIndex node = registry.intern(data + offset, nameLength);
+        offset += nameLength;
+        int count = qFromBigEndian<quint16>(bytes + offset);
+        offset += 2;
+        if (offset + count * 8 > size) {
+            return -1;
+        }
+        for (int r = 0; r < count; ++r) {
+            quint32 first = qFromBigEndian<quint32>(bytes + offset);
+            quint32 last = qFromBigEndian<quint32>(bytes + offset + 4);
+            offset += 8;
+            if (first >= 1 && first <= last) {
+                addRange(node, first, last);
+            }
+        }
+    }
+
+    return offset;
+}
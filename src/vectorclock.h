@@ -0,0 +1,94 @@
+#pragma once
+
+#include <QVector>
+#include <QHash>
+#include <QVariantMap>
+#include <QByteArray>
+#include "noderegistry.h"
+
+// Vector clock over interned node indices, tracking exactly which sequence
+// numbers have been received from each origin.
+//
+// Each origin has a contiguous watermark (every sequence number up to it has
+// been received) plus, when messages arrived out of order or were lost, a
+// sorted set of received ranges above it. Watermarks are a flat array indexed
+// by NodeIndex (absent origins read as 0), so lookups are a bounds check plus
+// a load and merges are a linear pass; the range sets live in a side table
+// that is empty in the common, in-order case. Both are implicitly shared, so
+// copying a clock into a Message is O(1).
+class VectorClock {
+public:
+    enum Ordering {
+        EQUAL,
+        BEFORE,      // this < other
+        AFTER,       // this > other
+        CONCURRENT
+    };
+
+    // Sequence range (from, to] of one origin that the other side lacks
+    struct Gap {
+        NodeIndex node;
+        quint32 from;
+        quint32 to;
+    };
+
+    // Received sequence numbers first..last, inclusive
+    struct Range {
+        quint32 first;
+        quint32 last;
+    };
+
+    VectorClock() {}
+
+    // Contiguous watermark: everything up to it has been received
+    quint32 value(NodeIndex node) const {
+        return node < static_cast<NodeIndex>(sequences.size()) ? sequences.at(node) : 0;
+    }
+    quint32 highest(NodeIndex node) const;  // Highest sequence number received, holes or not
+    bool contains(NodeIndex node, quint32 sequenceNumber) const;
+    QVector<Range> ranges(NodeIndex node) const { return above.value(node); }  // Received above the watermark
+    bool hasRanges() const { return !above.isEmpty(); }
+    VectorClock slice(NodeIndex node, int maxRanges) const;  // node's entry alone, keeping its highest ranges
+
+    void set(NodeIndex node, quint32 sequenceNumber);  // Set the watermark
+    bool advance(NodeIndex node, quint32 sequenceNumber);  // Raise the watermark; true if it changed
+    bool insert(NodeIndex node, quint32 sequenceNumber);  // Record one sequence number; true if new
+
+    void merge(const VectorClock& other);  // Union
+    void meet(const VectorClock& other);  // Minimum of the watermarks; ranges are dropped
+    Ordering compare(const VectorClock& other) const;
+    bool dominates(const VectorClock& other) const;  // Has received everything other has
+    QVector<Gap> diff(const VectorClock& remote) const;  // What this has that remote lacks, holes included
+
+    int entryCount() const;  // Origins with a non-zero watermark
+    bool isEmpty() const { return entryCount() == 0 && above.isEmpty(); }
+    void clear() { sequences.clear(); above.clear(); }
+    bool operator==(const VectorClock& other) const { return compare(other) == EQUAL; }
+    bool operator!=(const VectorClock& other) const { return compare(other) != EQUAL; }
+
+    // JSON representation: origin name -> watermark, and separately
+    // origin name -> [first, last, first, last, ...] for the ranges above it
+    QVariantMap toVariantMap() const;
+    static VectorClock fromVariantMap(const QVariantMap& map);
+    QVariantMap rangesToVariantMap() const;
+    void addRangesFromVariantMap(const QVariantMap& map);
+
+    // Binary representation: entryCount() entries of
+    // [2-byte name length][UTF-8 name][4-byte watermark], big-endian, zeros omitted
+    void appendEntries(QByteArray& out) const;
+    int readEntries(const char* data, int size, int entries);  // Bytes consumed, or -1 if malformed
+
+    // Binary range section: [2-byte origin count], then per origin
+    // [2-byte name length][UTF-8 name][2-byte range count][4-byte first, 4-byte last]...
+    void appendRanges(QByteArray& out) const;
+    int readRanges(const char* data, int size);  // Bytes consumed, or -1 if malformed
+
+private:
+    bool addRange(NodeIndex node, quint32 first, quint32 last);
+    void absorbRanges(NodeIndex node);
+    bool covers(NodeIndex node, quint32 first, quint32 last) const;
+    QVector<Range> received(NodeIndex node) const;  // Watermark and ranges as one range list
+
+    QVector<quint32> sequences;  // NodeIndex -> contiguous watermark
+    QHash<NodeIndex, QVector<Range>> above;  // Sorted, disjoint, non-adjacent ranges above the watermark
+};
@@ -0,0 +1,122 @@
+#include <QtTest/QtTest>
+#include <cmath>
+#include "../src/antientropyscheduler.h"
+
+class TestAntiEntropyScheduler : public QObject {
+    Q_OBJECT
+
+private:
+    static NodeIndex node(const QString& id) { return NodeRegistry::global().intern(id); }
+
+    // How often each candidate is picked over evenly spread random draws
+    static QHash<NodeIndex, int> tally(AntiEntropyScheduler scheduler, const QVector<NodeIndex>& candidates, qint64 now) {
+        QHash<NodeIndex, int> picks;
+        for (int i = 0; i < 1000; ++i) {
+            AntiEntropyScheduler copy = scheduler;  // Picking marks the peer as synced
+            picks[copy.choosePeer(candidates, now, i / 1000.0)]++;
+        }
+        return picks;
+    }
+
+private slots:
+    void testIntervalAdaptsToDivergence() {
+        AntiEntropyScheduler scheduler;
+        QCOMPARE(scheduler.interval(), static_cast<int>(AntiEntropyScheduler::INITIAL_INTERVAL));
+
+        // Rounds in sync back off, up to the maximum
+        QCOMPARE(scheduler.startRound(), 3000);
+        scheduler.exchanged(node("ae-a"), 0, 0);
+        QCOMPARE(scheduler.startRound(), 4500);
+        for (int i = 0; i < 5; ++i) {
+            scheduler.startRound();
+        }
+        QCOMPARE(scheduler.interval(), static_cast<int>(AntiEntropyScheduler::MAX_INTERVAL));
+
+        // Each round that finds a difference halves it, down to the minimum
+        scheduler.exchanged(node("ae-a"), 10000, 3);
+        QCOMPARE(scheduler.startRound(), 4000);
+        for (int i = 0; i < 8; ++i) {
+            scheduler.exchanged(node("ae-a"), 20000 + 1000 * i, 1);
+            scheduler.startRound();
+        }
+        QCOMPARE(scheduler.interval(), static_cast<int>(AntiEntropyScheduler::MIN_INTERVAL));
+
+        // A returning peer skips the ramp down, and the next round stays short
+        scheduler.startRound();
+        scheduler.startRound();
+        QVERIFY(scheduler.interval() > AntiEntropyScheduler::MIN_INTERVAL);
+        scheduler.hurry();
+        QCOMPARE(scheduler.interval(), static_cast<int>(AntiEntropyScheduler::MIN_INTERVAL));
+        QCOMPARE(scheduler.startRound(), static_cast<int>(AntiEntropyScheduler::MIN_INTERVAL));
+    }
+
+    void testStalePeersArePickedMoreOften() {
+        const NodeIndex fresh = node("ae-fresh");
+        const NodeIndex stale = node("ae-stale");
+        const NodeIndex unknown = node("ae-unknown");
+        AntiEntropyScheduler scheduler;
+        QCOMPARE(scheduler.choosePeer(QVector<NodeIndex>(), 0, 0.5), NodeRegistry::INVALID_NODE);
+
+        scheduler.exchanged(stale, 0, 0);
+        scheduler.exchanged(fresh, 9750, 0);
+        const qint64 now = 10000;
+        QVERIFY(scheduler.weight(fresh, now) < scheduler.weight(stale, now));
+        QVERIFY(scheduler.weight(stale, now) < scheduler.weight(unknown, now));
+        QVERIFY(scheduler.weight(fresh, now) > 0);
+
+        QVector<NodeIndex> candidates;
+        candidates << fresh << stale << unknown;
+        QHash<NodeIndex, int> picks = tally(scheduler, candidates, now);
+        QVERIFY(picks.value(fresh) > 0);
+        QVERIFY(picks.value(fresh) < picks.value(stale));
+        QVERIFY(picks.value(stale) < picks.value(unknown));
+
+        // Staleness is capped, so long-silent peers don't drown out the rest
+        QCOMPARE(scheduler.weight(stale, 10 * AntiEntropyScheduler::MAX_STALENESS),
+                 scheduler.weight(unknown, 10 * AntiEntropyScheduler::MAX_STALENESS));
+    }
+
+    void testDivergentPeersArePickedMoreOften() {
+        const NodeIndex behind = node("ae-behind");
+        const NodeIndex synced = node("ae-synced");
+        AntiEntropyScheduler scheduler;
+        scheduler.exchanged(behind, 1000, 500);
+        scheduler.exchanged(synced, 1000, 0);
+        QVERIFY(scheduler.weight(behind, 2000) > 5 * scheduler.weight(synced, 2000));
+
+        QVector<NodeIndex> candidates;
+        candidates << synced << behind;
+        QHash<NodeIndex, int> picks = tally(scheduler, candidates, 2000);
+        QVERIFY(picks.value(behind) > 5 * picks.value(synced));
+
+        // Picking starts a fresh exchange, assumed in sync until it reports
+        QCOMPARE(scheduler.choosePeer(candidates, 2000, 0.99), behind);
+        QCOMPARE(scheduler.weight(behind, 2500), scheduler.weight(synced, 1500));
+
+        // The datagrams of one digest round count together
+        scheduler.exchanged(behind, 2010, 40);
+        scheduler.exchanged(behind, 2020, 2);
+        QCOMPARE(scheduler.weight(behind, 3020), (1000.0 + AntiEntropyScheduler::MIN_INTERVAL) * (1 + std::log2(41.0)));
+        scheduler.exchanged(behind, 3020, 2);
+        QCOMPARE(scheduler.weight(behind, 3020), AntiEntropyScheduler::MIN_INTERVAL * (1 + std::log2(3.0)));
+    }
+
+    void testDivergenceCountsBothDirections() {
+        const NodeIndex x = node("ae-x");
+        const NodeIndex y = node("ae-y");
+        VectorClock local;
+        local.set(x, 10);
+        local.set(y, 2);
+        local.insert(x, 12);  // 11 is a hole
+        VectorClock remote;
+        remote.set(x, 4);
+        remote.set(y, 5);
+
+        QCOMPARE(AntiEntropyScheduler::divergence(local, remote), 7 + 3);
+        QCOMPARE(AntiEntropyScheduler::divergence(remote, local), 7 + 3);
+        QCOMPARE(AntiEntropyScheduler::divergence(local, local), 0);
+    }
+};
+
+QTEST_MAIN(TestAntiEntropyScheduler)
+#include "test_antientropyscheduler.moc"
@@ -44,9 +44,9 @@ private slots:
         QVariantMap vc;
         vc["Node1"] = 5;
         vc["Node2"] = 3;
-        msg.setVectorClock(vc);
+        msg.setVectorClock(VectorClock::fromVariantMap(vc));
 
-        QVariantMap retrieved = msg.getVectorClock();
+        QVariantMap retrieved = msg.getVectorClock().toVariantMap();
         QCOMPARE(retrieved.value("Node1").toInt(), 5);
         QCOMPARE(retrieved.value("Node2").toInt(), 3);
     }
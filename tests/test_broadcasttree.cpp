@@ -0,0 +1,278 @@
+#include <QtTest/QtTest>
+#include <map>
+#include "../src/broadcasttree.h"
+
+class TestBroadcastTree : public QObject {
+    Q_OBJECT
+
+private:
+    static NodeIndex node(const QString& id) { return NodeRegistry::global().intern(id); }
+    static MessageKey key(const QString& origin, quint32 sequence) { return NodeRegistry::messageKey(node(origin), sequence); }
+
+    // A cluster relaying broadcasts over its trees, one datagram taking
+    // LATENCY ms; pushes to the victim are lost unless they answer a GRAFT
+    struct Cluster {
+        enum Kind { PUSH, REPAIR, IHAVE, PRUNE, GRAFT };
+        struct Event {
+            Kind kind;
+            int from;
+            int to;
+            MessageKey key;
+        };
+        static const int LATENCY = 10;
+        static const int POLL_INTERVAL = 25;
+
+        QVector<BroadcastTree> trees;
+        QVector<QSet<MessageKey>> have;
+        QVector<int> hops;
+        QVector<qint64> deliveredAt;
+        QVector<NodeIndex> ids;
+        QHash<NodeIndex, int> indexOf;
+        std::multimap<qint64, Event> events;
+        int victim = -1;
+        int pushes = 0;
+        int duplicates = 0;
+
+        explicit Cluster(int size) : trees(size), have(size), hops(size), deliveredAt(size) {
+            for (int i = 0; i < size; ++i) {
+                ids.append(node(QString("bt-n%1").arg(i)));
+                indexOf.insert(ids[i], i);
+            }
+            // Each node picks a few neighbors, and they add it back
+            QRandomGenerator random(23);
+            for (int i = 0; i < size; ++i) {
+                int picked = 0;
+                while (picked < 4) {
+                    int j = random.bounded(size);
+                    if (j != i && trees[i].addNeighbor(ids[j])) {
+                        trees[j].addNeighbor(ids[i]);
+                        ++picked;
+                    }
+                }
+            }
+        }
+
+        void send(qint64 now, Kind kind, int from, int to, MessageKey message) {
+            Event event = { kind, from, to, message };
+            events.insert(std::make_pair(now + LATENCY, event));
+        }
+
+        void relay(qint64 now, int from, int exclude, MessageKey message) {
+            for (NodeIndex peer : trees[from].eager()) {
+                if (indexOf.value(peer) != exclude) {
+                    send(now, PUSH, from, indexOf.value(peer), message);
+                }
+            }
+            for (NodeIndex peer : trees[from].lazy()) {
+                if (indexOf.value(peer) != exclude) {
+                    send(now, IHAVE, from, indexOf.value(peer), message);
+                }
+            }
+        }
+
+        // Returns when the last node got it, or -1 if some never did
+        qint64 broadcast(int origin, MessageKey message) {
+            pushes = duplicates = 0;
+            have[origin].insert(message);
+            hops[origin] = 0;
+            deliveredAt[origin] = 0;
+            relay(0, origin, -1, message);
+
+            qint64 lastDelivery = 0;
+            qint64 nextPoll = POLL_INTERVAL;
+            while (!events.empty() || waiting()) {
+                qint64 now = events.empty() ? nextPoll : events.begin()->first;
+                if (nextPoll <= now) {
+                    for (int i = 0; i < trees.size(); ++i) {
+                        QVector<BroadcastTree::Graft> grafts;
+                        trees[i].poll(nextPoll, grafts);
+                        for (const BroadcastTree::Graft& graft : grafts) {
+                            send(nextPoll, GRAFT, i, indexOf.value(graft.peer), graft.key);
+                        }
+                    }
+                    nextPoll += POLL_INTERVAL;
+                    continue;
+                }
+                Event event = events.begin()->second;
+                events.erase(events.begin());
+
+                switch (event.kind) {
+                    case PUSH:
+                    case REPAIR: {
+                        if (event.kind == PUSH && event.to == victim) {
+                            break;
+                        }
+                        ++pushes;
+                        bool duplicate = have[event.to].contains(event.key);
+                        if (trees[event.to].receivedPush(ids[event.from], event.key, duplicate)) {
+                            ++duplicates;
+                            send(now, PRUNE, event.to, event.from, event.key);
+                            break;
+                        }
+                        have[event.to].insert(event.key);
+                        hops[event.to] = hops[event.from] + 1;
+                        deliveredAt[event.to] = now;
+                        lastDelivery = now;
+                        relay(now, event.to, event.from, event.key);
+                        break;
+                    }
+                    case IHAVE:
+                        if (!have[event.to].contains(event.key)) {
+                            trees[event.to].announced(ids[event.from], event.key, now);
+                        }
+                        break;
+                    case PRUNE:
+                        trees[event.to].prune(ids[event.from]);
+                        break;
+                    case GRAFT:
+                        trees[event.to].graft(ids[event.from]);
+                        if (have[event.to].contains(event.key)) {
+                            send(now, REPAIR, event.to, event.from, event.key);
+                        }
+                        break;
+                }
+            }
+
+            for (const QSet<MessageKey>& received : have) {
+                if (!received.contains(message)) {
+                    return -1;
+                }
+            }
+            return lastDelivery;
+        }
+
+        bool waiting() const {
+            for (const BroadcastTree& tree : trees) {
+                if (tree.isWaiting()) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        int maxHops() const { return *std::max_element(hops.begin(), hops.end()); }
+    };
+
+private slots:
+    void testDuplicatePushesPruneTheLink() {
+        BroadcastTree tree;
+        QVERIFY(tree.addNeighbor(node("bt-a")));
+        QVERIFY(tree.addNeighbor(node("bt-b")));
+        QVERIFY(!tree.addNeighbor(node("bt-a")));
+        QCOMPARE(tree.eager().size(), 2);
+
+        QVERIFY(!tree.receivedPush(node("bt-a"), key("bt-o", 1), false));
+        QVERIFY(tree.receivedPush(node("bt-b"), key("bt-o", 1), true));
+        QVERIFY(tree.isEager(node("bt-a")));
+        QVERIFY(!tree.isEager(node("bt-b")));
+        QVERIFY(tree.isNeighbor(node("bt-b")));
+        QCOMPARE(tree.neighborCount(), 2);
+
+        // The first copy through a lazy link puts it back in the tree
+        QVERIFY(!tree.receivedPush(node("bt-b"), key("bt-o", 2), false));
+        QVERIFY(tree.isEager(node("bt-b")));
+    }
+
+    void testGraftsAnnouncersInTurn() {
+        BroadcastTree tree;
+        tree.addNeighbor(node("bt-c"));
+        tree.addNeighbor(node("bt-d"));
+        tree.prune(node("bt-c"));
+        tree.prune(node("bt-d"));
+
+        const MessageKey missing = key("bt-o", 7);
+        tree.announced(node("bt-c"), missing, 0);
+        tree.announced(node("bt-d"), missing, 10);
+        tree.announced(node("bt-d"), missing, 20);
+        QCOMPARE(tree.missingCount(), 1);
+
+        QVector<BroadcastTree::Graft> grafts;
+        tree.poll(BroadcastTree::GRAFT_TIMEOUT - 1, grafts);
+        QVERIFY(grafts.isEmpty());
+
+        tree.poll(BroadcastTree::GRAFT_TIMEOUT, grafts);
+        QCOMPARE(grafts.size(), 1);
+        QCOMPARE(grafts.first().peer, node("bt-c"));
+        QCOMPARE(grafts.first().key, missing);
+        QVERIFY(tree.isEager(node("bt-c")));
+
+        grafts.clear();
+        tree.poll(BroadcastTree::GRAFT_TIMEOUT + BroadcastTree::GRAFT_RETRY, grafts);
+        QCOMPARE(grafts.size(), 1);
+        QCOMPARE(grafts.first().peer, node("bt-d"));
+
+        // Nobody left to ask: anti-entropy has to find it
+        grafts.clear();
+        tree.poll(BroadcastTree::GRAFT_TIMEOUT + 2 * BroadcastTree::GRAFT_RETRY, grafts);
+        QVERIFY(grafts.isEmpty());
+        QVERIFY(!tree.isWaiting());
+    }
+
+    void testDeliveryAndDepartureCancelGrafts() {
+        BroadcastTree tree;
+        tree.announced(node("bt-e"), key("bt-o", 1), 0);
+        tree.announced(node("bt-f"), key("bt-o", 2), 0);
+        QVERIFY(tree.isNeighbor(node("bt-e")));
+        QVERIFY(!tree.isEager(node("bt-e")));
+
+        tree.delivered(key("bt-o", 1));
+        tree.removeNeighbor(node("bt-f"));
+        QVERIFY(!tree.isNeighbor(node("bt-f")));
+
+        QVector<BroadcastTree::Graft> grafts;
+        tree.poll(BroadcastTree::GRAFT_TIMEOUT, grafts);
+        QVERIFY(grafts.isEmpty());
+        QVERIFY(!tree.isWaiting());
+    }
+
+    void testKeyEncodingRoundTrip() {
+        QVector<MessageKey> keys;
+        keys << key("bt-o", 1) << key("bt-other", 0xFFFFFFFFu) << key("bt-o", 42);
+        QByteArray payload = BroadcastTree::encodeKeys(keys);
+
+        QVector<MessageKey> decoded;
+        QVERIFY(BroadcastTree::decodeKeys(payload, decoded));
+        QCOMPARE(decoded, keys);
+
+        QVector<MessageKey> rejected;
+        QVERIFY(!BroadcastTree::decodeKeys(payload.left(payload.size() - 1), rejected));
+        QVERIFY(!BroadcastTree::decodeKeys(QByteArray(), rejected));
+    }
+
+    void testTreeSettlesAndRepairsLoss() {
+        const int size = 128;
+        Cluster cluster(size);
+
+        // The first broadcast floods every link, and the redundant ones get pruned
+        QVERIFY(cluster.broadcast(0, key("bt-n0", 1)) >= 0);
+        QVERIFY(cluster.duplicates > 0);
+
+        // After that each node is pushed the message exactly once, whoever sends it
+        QVERIFY(cluster.broadcast(77, key("bt-n77", 1)) >= 0);
+        QCOMPARE(cluster.pushes, size - 1);
+        QCOMPARE(cluster.duplicates, 0);
+        QVERIFY2(cluster.maxHops() <= 14, qPrintable(QString("%1 hops").arg(cluster.maxHops())));
+
+        // Egress per node is its eager links, not the cluster size
+        int eagerLinks = 0;
+        for (const BroadcastTree& tree : cluster.trees) {
+            eagerLinks += tree.eager().size();
+        }
+        QCOMPARE(eagerLinks, 2 * (size - 1));
+
+        // A lost push is grafted from a lazy neighbor, and the subtree behind
+        // it still hears the message
+        cluster.victim = 5;
+        QVERIFY(cluster.broadcast(0, key("bt-n0", 2)) >= 0);
+        QVERIFY(cluster.deliveredAt[5] >= BroadcastTree::GRAFT_TIMEOUT);
+
+        // The grafted link replaced the lossy one: still one spanning tree
+        cluster.victim = -1;
+        QVERIFY(cluster.broadcast(0, key("bt-n0", 3)) >= 0);
+        QCOMPARE(cluster.pushes, size - 1);
+        QCOMPARE(cluster.duplicates, 0);
+    }
+};
+
+QTEST_MAIN(TestBroadcastTree)
+#include "test_broadcasttree.moc"
@@ -0,0 +1,194 @@
+#include <QtTest/QtTest>
+#include "../src/digesttree.h"
+#include "../src/messagelog.h"
+
+class TestDigestTree : public QObject {
+    Q_OBJECT
+
+private:
+    static NodeIndex node(const char* name) { return NodeRegistry::global().intern(name); }
+
+    static Message chat(const char* origin, int sequenceNumber) {
+        return Message(QString("digest %1").arg(sequenceNumber), origin, "broadcast", sequenceNumber);
+    }
+
+    struct Replica {
+        DigestTree tree;
+        VectorClock clock;
+        MessageLog store;
+
+        void add(const Message& message) {
+            NodeIndex origin = NodeRegistry::global().intern(message.getOrigin());
+            if (store.insert(origin, message)) {
+                tree.add(origin, message);
+                clock.insert(origin, static_cast<quint32>(message.getSequenceNumber()));
+            }
+        }
+    };
+
+    // Runs one digest round from a to b the way NetworkManager does, returning
+    // the number of messages pushed in either direction
+    static int sync(Replica& a, Replica& b, int* rounds = nullptr) {
+        DigestPayload message;
+        message.root = a.tree.root();
+        message.height = a.tree.height();
+
+        Replica* sender = &a;
+        Replica* receiver = &b;
+        int pushed = 0;
+        int exchanges = 0;
+        while (true) {
+            DigestPayload decoded;
+            if (!DigestPayload::decode(message.encode(), decoded)) {
+                return -1;
+            }
+            DigestPayload reply;
+            QVector<VectorClock::Gap> push;
+            receiver->tree.answer(decoded, receiver->clock, reply, push);
+            for (const VectorClock::Gap& gap : push) {
+                for (const Message& msg : receiver->store.range(gap.node, gap.from, gap.to)) {
+                    sender->add(msg);
+                    ++pushed;
+                }
+            }
+            ++exchanges;
+            if (reply.kind != DigestPayload::ORIGINS && reply.isEmpty()) {
+                break;
+            }
+            message = reply;
+            std::swap(sender, receiver);
+        }
+        if (rounds) {
+            *rounds = exchanges;
+        }
+        return pushed;
+    }
+
+private slots:
+    void testDigestIgnoresInsertionOrder() {
+        DigestTree forward;
+        DigestTree backward;
+        for (int seq = 1; seq <= 300; ++seq) {
+            forward.add(node("TA"), chat("TA", seq));
+            backward.add(node("TA"), chat("TA", 301 - seq));
+        }
+        QCOMPARE(forward.root(), backward.root());
+        QCOMPARE(forward.height(), backward.height());
+        QCOMPARE(forward.digest(node("TA"), 1, 0), backward.digest(node("TA"), 1, 0));
+
+        backward.add(node("TB"), chat("TB", 1));
+        QVERIFY(forward.root() != backward.root());
+    }
+
+    void testTreeGrowsWithHistory() {
+        DigestTree tree;
+        tree.add(node("TA"), chat("TA", 1));
+        QCOMPARE(tree.height(node("TA")), 0);
+        tree.add(node("TA"), chat("TA", DigestTree::LEAF_SPAN + 1));
+        QCOMPARE(tree.height(node("TA")), 1);
+        tree.add(node("TA"), chat("TA", DigestTree::LEAF_SPAN * DigestTree::FANOUT + 1));
+        QCOMPARE(tree.height(node("TA")), 2);
+
+        // Node 0 above the top still covers the whole origin
+        QCOMPARE(tree.digest(node("TA"), 5, 0), tree.digest(node("TA"), 2, 0));
+        QCOMPARE(tree.digest(node("TA"), 5, 1), quint64(0));
+        QCOMPARE(DigestTree::firstSequence(1, 1), quint32(DigestTree::LEAF_SPAN * DigestTree::FANOUT + 1));
+        QCOMPARE(DigestTree::lastSequence(DigestTree::MAX_HEIGHT, 0), 0xFFFFFFFFu);
+    }
+
+    void testIdenticalReplicasExchangeOnlyTheRoot() {
+        Replica a;
+        Replica b;
+        for (int seq = 1; seq <= 5000; ++seq) {
+            a.add(chat("TA", seq));
+            b.add(chat("TA", seq));
+        }
+        int rounds = 0;
+        QCOMPARE(sync(a, b, &rounds), 0);
+        QCOMPARE(rounds, 1);
+    }
+
+    void testSyncMovesOnlyTheDifference() {
+        Replica a;
+        Replica b;
+        for (int seq = 1; seq <= 5000; ++seq) {
+            a.add(chat("TA", seq));
+            if (seq != 17 && (seq < 3000 || seq > 3010)) {
+                b.add(chat("TA", seq));
+            }
+        }
+        for (int seq = 1; seq <= 40; ++seq) {
+            b.add(chat("TB", seq));  // Origin a has never heard of
+        }
+        a.add(chat("TC", 2));  // Only a later message of TC, on a only
+
+        QCOMPARE(sync(b, a), 12 + 40 + 1);
+        QCOMPARE(a.tree.root(), b.tree.root());
+        QVERIFY(a.clock == b.clock);
+        QCOMPARE(sync(a, b), 0);
+    }
+
+    void testEmptyReplicaReceivesEverything() {
+        Replica a;
+        Replica b;
+        for (int seq = 1; seq <= 200; ++seq) {
+            a.add(chat("TA", seq));
+        }
+        QCOMPARE(sync(b, a), 200);
+        QCOMPARE(b.tree.root(), a.tree.root());
+    }
+
+    void testLeavesRebuildTheTree() {
+        // A restart keeps the compacted prefix as leaf digests only, and
+        // merging the rest back in gives the tree that was never split
+        DigestTree whole;
+        DigestTree compacted;
+        DigestTree rest;
+        for (int seq = 1; seq <= 2000; ++seq) {
+            whole.add(node("TA"), chat("TA", seq));
+            (seq <= 1500 ? compacted : rest).add(node("TA"), chat("TA", seq));
+        }
+        compacted.add(node("TD"), chat("TD", 3));
+        whole.add(node("TD"), chat("TD", 3));
+
+        DigestTree restored;
+        QVERIFY(DigestTree::decodeLeaves(compacted.encodeLeaves(), restored));
+        QCOMPARE(restored.root(), compacted.root());
+        restored.merge(rest);
+        QCOMPARE(restored.root(), whole.root());
+        QCOMPARE(restored.height(node("TA")), whole.height(node("TA")));
+        QCOMPARE(restored.digest(node("TA"), 1, 1), whole.digest(node("TA"), 1, 1));
+
+        QByteArray truncated = compacted.encodeLeaves();
+        truncated.chop(3);
+        QVERIFY(!DigestTree::decodeLeaves(truncated, restored));
+        QCOMPARE(restored.root(), quint64(0));
+    }
+
+    void testPayloadRoundTrip() {
+        DigestPayload payload;
+        payload.kind = DigestPayload::DESCEND;
+        payload.nodes.append({"TA", 2, 7, 0x0123456789ABCDEFull});
+        payload.leaves.append({"TB", 3, 0xF0F0ull, true});
+
+        DigestPayload decoded;
+        QVERIFY(DigestPayload::decode(payload.encode(), decoded));
+        QCOMPARE(decoded.kind, DigestPayload::DESCEND);
+        QCOMPARE(decoded.nodes.size(), 1);
+        QCOMPARE(decoded.nodes.at(0).origin, QString("TA"));
+        QCOMPARE(decoded.nodes.at(0).level, 2);
+        QCOMPARE(decoded.nodes.at(0).index, 7u);
+        QCOMPARE(decoded.nodes.at(0).digest, 0x0123456789ABCDEFull);
+        QCOMPARE(decoded.leaves.size(), 1);
+        QCOMPARE(decoded.leaves.at(0).bitmap, 0xF0F0ull);
+        QVERIFY(decoded.leaves.at(0).final);
+
+        QByteArray truncated = payload.encode();
+        truncated.chop(3);
+        QVERIFY(!DigestPayload::decode(truncated, decoded));
+        QVERIFY(!DigestPayload::decode(QByteArray(1, '\x09'), decoded));
+    }
+};
+
+QTEST_MAIN(TestDigestTree)
+#include "test_digesttree.moc"
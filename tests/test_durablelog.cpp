@@ -0,0 +1,231 @@
+#include <QtTest/QtTest>
+#include <QTemporaryDir>
+#include <QFile>
+#include "../src/durablelog.h"
+
+class TestDurableLog : public QObject {
+    Q_OBJECT
+
+private:
+    static NodeIndex node(const char* name) { return NodeRegistry::global().intern(name); }
+
+    static Message chat(const char* origin, int sequenceNumber) {
+        Message msg(QString("durable %1").arg(sequenceNumber), origin, "broadcast", sequenceNumber);
+        VectorClock clock;
+        clock.set(node(origin), static_cast<quint32>(sequenceNumber));
+        msg.setVectorClock(clock);
+        return msg;
+    }
+
+private slots:
+    void testFlushAndRecover() {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+
+        DurableLog::Checkpoint checkpoint;
+        checkpoint.nextSequenceNumber = 4;
+        checkpoint.clock.set(node("DA"), 3);
+        checkpoint.clock.set(node("DC"), 9);  // Known from anti-entropy, not logged here
+        {
+            DurableLog log;
+            QVERIFY(log.open(dir.path()));
+            for (int seq = 1; seq <= 3; ++seq) {
+                log.append(chat("DA", seq));
+                log.append(chat("DB", seq));
+            }
+            QVERIFY(log.pendingBytes() > 0);
+            QVERIFY(log.flush(checkpoint));
+            QCOMPARE(log.pendingBytes(), qint64(0));
+        }
+
+        DurableLog reopened;
+        QVERIFY(reopened.open(dir.path()));
+        MessageLog store;
+        DurableLog::Checkpoint recovered;
+        QCOMPARE(reopened.recover(store, recovered), 6);
+        QCOMPARE(store.size(), 6);
+        QCOMPARE(store.find(node("DB"), 2)->getChatText(), QString("durable 2"));
+        QCOMPARE(recovered.nextSequenceNumber, 4);
+        QCOMPARE(recovered.clock.value(node("DA")), 3u);
+        QCOMPARE(recovered.clock.value(node("DB")), 3u);
+        QCOMPARE(recovered.clock.value(node("DC")), 9u);
+    }
+
+    void testUnflushedRecordsAreNotRecovered() {
+        QTemporaryDir dir;
+        {
+            DurableLog log;
+            QVERIFY(log.open(dir.path()));
+            log.append(chat("DA", 1));
+            QVERIFY(log.flush(DurableLog::Checkpoint()));
+            log.append(chat("DA", 2));  // Never flushed
+        }
+
+        DurableLog reopened;
+        QVERIFY(reopened.open(dir.path()));
+        MessageLog store;
+        DurableLog::Checkpoint recovered;
+        QCOMPARE(reopened.recover(store, recovered), 1);
+        QVERIFY(!store.contains(node("DA"), 2));
+    }
+
+    void testTornTailIsTruncated() {
+        QTemporaryDir dir;
+        QString segment;
+        {
+            DurableLog log;
+            QVERIFY(log.open(dir.path()));
+            log.append(chat("DA", 1));
+            log.append(chat("DA", 2));
+            QVERIFY(log.flush(DurableLog::Checkpoint()));
+            segment = dir.filePath("00000000.log");
+        }
+
+        // Chop the last record in half, as a crash mid-write would
+        QFile file(segment);
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        const qint64 fullSize = file.size();
+        QVERIFY(file.resize(fullSize - 5));
+        file.close();
+
+        DurableLog reopened;
+        QVERIFY(reopened.open(dir.path()));
+        MessageLog store;
+        DurableLog::Checkpoint recovered;
+        QCOMPARE(reopened.recover(store, recovered), 1);
+        QVERIFY(QFile(segment).size() < fullSize - 5);
+
+        // New records continue cleanly after the last good one
+        reopened.append(chat("DA", 2));
+        QVERIFY(reopened.flush(recovered));
+
+        DurableLog again;
+        QVERIFY(again.open(dir.path()));
+        MessageLog restored;
+        DurableLog::Checkpoint checkpoint;
+        QCOMPARE(again.recover(restored, checkpoint), 2);
+    }
+
+    void testCorruptRecordStopsReplay() {
+        QTemporaryDir dir;
+        {
+            DurableLog log;
+            QVERIFY(log.open(dir.path()));
+            log.append(chat("DA", 1));
+            log.append(chat("DA", 2));
+            QVERIFY(log.flush(DurableLog::Checkpoint()));
+        }
+
+        // Flip a byte in the second record's payload; its CRC no longer matches
+        QFile file(dir.filePath("00000000.log"));
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        QByteArray bytes = file.readAll();
+        QVERIFY(file.seek(bytes.size() - 2));
+        QVERIFY(file.write(QByteArray(1, static_cast<char>(bytes.at(bytes.size() - 2) ^ 0x5A))) == 1);
+        file.close();
+
+        DurableLog reopened;
+        QVERIFY(reopened.open(dir.path()));
+        MessageLog store;
+        DurableLog::Checkpoint recovered;
+        QCOMPARE(reopened.recover(store, recovered), 1);
+    }
+
+    void testRollsSegments() {
+        QTemporaryDir dir;
+        {
+            DurableLog log;
+            QVERIFY(log.open(dir.path()));
+            log.setSegmentSize(1);  // Every flush fills a segment
+            for (int seq = 1; seq <= 3; ++seq) {
+                log.append(chat("DA", seq));
+                QVERIFY(log.flush(DurableLog::Checkpoint()));
+            }
+        }
+
+        DurableLog reopened;
+        QVERIFY(reopened.open(dir.path()));
+        QCOMPARE(reopened.segmentCount(), 3);
+        MessageLog store;
+        DurableLog::Checkpoint recovered;
+        QCOMPARE(reopened.recover(store, recovered), 3);
+        QCOMPARE(recovered.clock.value(node("DA")), 3u);
+    }
+
+    void testCompactedHistoryIsSkippedAndDeleted() {
+        QTemporaryDir dir;
+        DurableLog::Checkpoint checkpoint;
+        {
+            DurableLog log;
+            QVERIFY(log.open(dir.path()));
+            log.setSegmentSize(1);
+            for (int seq = 1; seq <= 4; ++seq) {
+                log.append(chat("DE", seq));
+                log.append(chat("DF", seq));
+                checkpoint.clock.set(node("DE"), static_cast<quint32>(seq));
+                checkpoint.clock.set(node("DF"), static_cast<quint32>(seq));
+                QVERIFY(log.flush(checkpoint));
+            }
+            QCOMPARE(log.segmentCount(), 5);
+
+            // Segments holding only compacted messages go; one DF message keeps the second
+            checkpoint.compacted.set(node("DE"), 3);
+            checkpoint.compacted.set(node("DF"), 1);
+            checkpoint.compactedDigest = "compacted digest";
+            checkpoint.stable.set(node("DE"), 4);
+            QVERIFY(log.flush(checkpoint));
+            QCOMPARE(log.segmentCount(), 4);
+            QVERIFY(!QFile::exists(dir.filePath("00000000.log")));
+        }
+
+        DurableLog reopened;
+        QVERIFY(reopened.open(dir.path()));
+        MessageLog store;
+        DurableLog::Checkpoint recovered;
+        QCOMPARE(reopened.recover(store, recovered), 4);  // DE 4 and DF 2 to 4
+        QVERIFY(store.find(node("DE"), 3) == nullptr);
+        QVERIFY(store.contains(node("DE"), 3));  // Still held, so late duplicates are dropped
+        QVERIFY(store.find(node("DF"), 2) != nullptr);
+        QCOMPARE(recovered.clock.value(node("DE")), 4u);
+        QCOMPARE(recovered.compacted.value(node("DE")), 3u);
+        QCOMPARE(recovered.compactedDigest, QByteArray("compacted digest"));
+        QCOMPARE(recovered.stable.value(node("DE")), 4u);
+    }
+
+    void testRangeReadsThroughTheIndex() {
+        QTemporaryDir dir;
+        DurableLog log;
+        QVERIFY(log.open(dir.path()));
+        log.setSegmentSize(2 * 1024);
+        for (int seq = 1; seq <= 60; ++seq) {
+            log.append(chat("DG", seq));
+            log.append(chat("DH", seq));
+            if (seq % 5 == 0) {
+                QVERIFY(log.flush(DurableLog::Checkpoint()));
+            }
+        }
+        QVERIFY(log.segmentCount() > 2);
+
+        QList<Message> slice = log.range(node("DG"), 10, 25, 100);
+        QCOMPARE(slice.size(), 15);
+        QCOMPARE(slice.first().getSequenceNumber(), 11);
+        QCOMPARE(slice.last().getSequenceNumber(), 25);
+        for (const Message& msg : slice) {
+            QCOMPARE(msg.getOrigin(), QString("DG"));
+        }
+
+        // Including the synced stretch not indexed yet, and never past the limit
+        QCOMPARE(log.range(node("DH"), 50, 1000, 100).size(), 10);
+        QCOMPARE(log.range(node("DH"), 0, 1000, 7).size(), 7);
+        QCOMPARE(log.range(node("DH"), 0, 1000, 7).last().getSequenceNumber(), 7);
+
+        // A reopened log finds the same through the index files
+        log.close();
+        DurableLog reopened;
+        QVERIFY(reopened.open(dir.path()));
+        QCOMPARE(reopened.range(node("DG"), 10, 25, 100).size(), 15);
+    }
+};
+
+QTEST_MAIN(TestDurableLog)
+#include "test_durablelog.moc"
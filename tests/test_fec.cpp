@@ -0,0 +1,154 @@
+#include <QtTest/QtTest>
+#include "../src/fec.h"
+
+class TestFec : public QObject {
+    Q_OBJECT
+
+private:
+    static QVector<QByteArray> makeData(int count) {
+        QVector<QByteArray> data;
+        for (int i = 0; i < count; ++i) {
+            QByteArray symbol;
+            for (int b = 0; b < 20 + 7 * i; ++b) {
+                symbol.append(static_cast<char>((i * 31 + b * 17) & 0xFF));
+            }
+            data.append(symbol);
+        }
+        return data;
+    }
+
+    static QByteArray padded(const QByteArray& symbol, int length) {
+        return symbol + QByteArray(length - symbol.size(), '\0');
+    }
+
+private slots:
+    void testFirstParityIsXor() {
+        const QVector<QByteArray> data = makeData(5);
+        const QVector<QByteArray> parity = ErasureCode::encode(data, 2);
+        QCOMPARE(parity.size(), 2);
+        QCOMPARE(parity[0].size(), data.last().size());
+
+        QByteArray xored(parity[0].size(), '\0');
+        for (const QByteArray& symbol : data) {
+            for (int b = 0; b < symbol.size(); ++b) {
+                xored[b] = static_cast<char>(xored[b] ^ symbol[b]);
+            }
+        }
+        QCOMPARE(parity[0], xored);
+        QVERIFY(parity[1] != xored);
+    }
+
+    void testRecoversAnyErasuresUpToParity() {
+        // Every pattern of up to three lost data symbols out of eight, from
+        // whichever three parity symbols arrived
+        const int dataCount = 8;
+        const QVector<QByteArray> data = makeData(dataCount);
+        const QVector<QByteArray> parity = ErasureCode::encode(data, 4);
+        const int length = parity[0].size();
+
+        for (int lost = 1; lost < (1 << dataCount); ++lost) {
+            const int count = qPopulationCount(static_cast<quint32>(lost));
+            if (count > 3) {
+                continue;
+            }
+            QVector<QByteArray> received = data;
+            for (int i = 0; i < dataCount; ++i) {
+                if (lost & (1 << i)) {
+                    received[i] = QByteArray();
+                }
+            }
+            QHash<int, QByteArray> arrived;
+            for (int j = 0; j < 4; ++j) {
+                if (j != lost % 4) {
+                    arrived.insert(j, parity[j]);
+                }
+            }
+
+            QVERIFY(ErasureCode::decode(received, arrived));
+            for (int i = 0; i < dataCount; ++i) {
+                if (lost & (1 << i)) {
+                    QCOMPARE(received[i], padded(data[i], length));
+                }
+            }
+        }
+    }
+
+    void testTooManyErasuresFail() {
+        QVector<QByteArray> data = makeData(4);
+        const QVector<QByteArray> parity = ErasureCode::encode(data, 2);
+        data[0] = QByteArray();
+        data[2] = QByteArray();
+        QHash<int, QByteArray> arrived;
+        arrived.insert(1, parity[1]);
+        QVERIFY(!ErasureCode::decode(data, arrived));
+        QVERIFY(data[0].isNull());
+    }
+
+    void testEncoderBlocksAndParityPayload() {
+        FecEncoder encoder;
+        QVERIFY(!encoder.isEnabled());
+        encoder.configure(3, 2);
+        QVERIFY(encoder.isEnabled());
+
+        QVERIFY(!encoder.add(10, "first"));
+        QVERIFY(!encoder.add(12, "second datagram"));
+        QVERIFY(encoder.add(13, "third"));
+        FecEncoder::Block block = encoder.take();
+        QVERIFY(encoder.isEmpty());
+        QCOMPARE(block.id, quint32(1));
+        QCOMPARE(block.sequences, QVector<quint32>({10, 12, 13}));
+        QCOMPARE(block.parity.size(), 2);
+
+        // A partial block still gets parity
+        encoder.add(14, "fourth");
+        FecEncoder::Block partial = encoder.take();
+        QCOMPARE(partial.id, quint32(2));
+        QCOMPARE(partial.parity.size(), 2);
+        QCOMPARE(FecDecoder::unwrap(partial.parity[0]), QByteArray("fourth"));
+
+        FecDecoder::Parity parity;
+        QVERIFY(FecDecoder::decodeParity(FecDecoder::encodeParity(block, 1), parity));
+        QCOMPARE(parity.parityCount, 2);
+        QCOMPARE(parity.index, 1);
+        QCOMPARE(parity.sequences, block.sequences);
+        QCOMPARE(parity.symbol, block.parity[1]);
+        QVERIFY(!FecDecoder::decodeParity(FecDecoder::encodeParity(block, 1).left(3 + 12), parity));
+
+        // The lost middle datagram comes back from the other two and one parity symbol
+        QVector<QByteArray> symbols;
+        symbols << FecDecoder::wrap("first") << QByteArray() << FecDecoder::wrap("third");
+        QHash<int, QByteArray> arrived;
+        arrived.insert(parity.index, parity.symbol);
+        QVERIFY(ErasureCode::decode(symbols, arrived));
+        QCOMPARE(FecDecoder::unwrap(symbols[1]), QByteArray("second datagram"));
+        QVERIFY(FecDecoder::unwrap(QByteArray("\x00\x00\x00\x09""abc", 7)).isEmpty());
+    }
+
+    void testDecoderTracksOpenBlocks() {
+        const NodeIndex origin = NodeRegistry::global().intern("fec-origin");
+        FecDecoder::Parity parity;
+        parity.parityCount = 2;
+        parity.index = 0;
+        parity.sequences = QVector<quint32>({5, 6, 8});
+        parity.symbol = "xyz";
+
+        FecDecoder decoder;
+        const quint64 key = decoder.add(origin, 1, parity, 100);
+        QVERIFY(key != 0);
+        parity.index = 1;
+        QCOMPARE(decoder.add(origin, 1, parity, 150), key);
+        QCOMPARE(decoder.size(), 1);
+        QCOMPARE(decoder.find(key)->parity.size(), 2);
+        QCOMPARE(decoder.blockCovering(NodeRegistry::messageKey(origin, 8)), key);
+        QCOMPARE(decoder.blockCovering(NodeRegistry::messageKey(origin, 7)), quint64(0));
+
+        decoder.expire(100 + FecDecoder::BLOCK_TIMEOUT);
+        QCOMPARE(decoder.size(), 1);
+        decoder.expire(101 + FecDecoder::BLOCK_TIMEOUT);
+        QCOMPARE(decoder.size(), 0);
+        QCOMPARE(decoder.blockCovering(NodeRegistry::messageKey(origin, 8)), quint64(0));
+    }
+};
+
+QTEST_MAIN(TestFec)
+#include "test_fec.moc"
@@ -0,0 +1,155 @@
+#include <QtTest/QtTest>
+#include <QRandomGenerator>
+#include "../src/fragmentation.h"
+
+class TestFragmentation : public QObject {
+    Q_OBJECT
+
+private:
+    static QByteArray makeDatagram(int size) {
+        QByteArray datagram(size, Qt::Uninitialized);
+        for (int i = 0; i < size; ++i) {
+            datagram[i] = static_cast<char>(i * 31 + 7);
+        }
+        return datagram;
+    }
+
+private slots:
+    void testSplitAndReassembleOutOfOrder() {
+        NodeIndex sender = NodeRegistry::global().intern("FragSender");
+        const QByteArray original = makeDatagram(10000);
+        QList<QByteArray> payloads = Reassembler::split(original, 1000);
+        QCOMPARE(payloads.size(), 10);
+
+        // Shuffled, with a duplicate thrown in; completes exactly once
+        std::reverse(payloads.begin(), payloads.end());
+        payloads.insert(3, payloads.at(1));
+        Reassembler reassembler;
+        QByteArray datagram;
+        int completions = 0;
+        for (const QByteArray& payload : payloads) {
+            if (reassembler.add(sender, 1, payload, 0, datagram)) {
+                ++completions;
+            }
+        }
+        QCOMPARE(completions, 1);
+        QCOMPARE(datagram, original);
+        QVERIFY(reassembler.isEmpty());
+        QCOMPARE(reassembler.byteCount(), qint64(0));
+
+        // A resend arriving after completion does not start the transfer over
+        QVERIFY(!reassembler.add(sender, 1, payloads.first(), 10, datagram));
+        QVERIFY(reassembler.isEmpty());
+    }
+
+    void testStalledTransfersAreNackedThenDropped() {
+        NodeIndex sender = NodeRegistry::global().intern("FragSender");
+        const QList<QByteArray> payloads = Reassembler::split(makeDatagram(5000), 1000);
+        Reassembler reassembler;
+        QByteArray datagram;
+        for (int index : {0, 2, 4}) {
+            QVERIFY(!reassembler.add(sender, 7, payloads.at(index), 100, datagram));
+        }
+
+        QVector<Reassembler::Stalled> stalled;
+        reassembler.poll(120, 50, stalled);
+        QVERIFY(stalled.isEmpty());
+        reassembler.poll(150, 50, stalled);
+        QCOMPARE(stalled.size(), 1);
+        QCOMPARE(stalled.first().sender, sender);
+        QCOMPARE(stalled.first().transfer, 7u);
+        QCOMPARE(stalled.first().missing, QVector<quint16>({1, 3}));
+
+        // Not asked again until another interval passes
+        stalled.clear();
+        reassembler.poll(170, 50, stalled);
+        QVERIFY(stalled.isEmpty());
+
+        // The NACK round-trips, and the resends complete the transfer
+        QCOMPARE(Reassembler::decodeNack(Reassembler::encodeNack({1, 3})), QVector<quint16>({1, 3}));
+        QVERIFY(Reassembler::decodeNack(QByteArray("\x00\x05", 2)).isEmpty());
+        QVERIFY(!reassembler.add(sender, 7, payloads.at(1), 180, datagram));
+        QVERIFY(reassembler.add(sender, 7, payloads.at(3), 180, datagram));
+
+        // Without progress a transfer is eventually given up
+        reassembler.add(sender, 8, payloads.at(0), 200, datagram);
+        reassembler.poll(200 + Reassembler::TIMEOUT, 50, stalled);
+        QVERIFY(reassembler.isEmpty());
+        QCOMPARE(reassembler.byteCount(), qint64(0));
+    }
+
+    void testRejectsMalformedAndOversized() {
+        NodeIndex sender = NodeRegistry::global().intern("FragSender");
+        Reassembler reassembler;
+        QByteArray datagram;
+        QVERIFY(!reassembler.add(sender, 1, QByteArray("\x00\x02\x00\x02", 4), 0, datagram));  // No chunk
+        QVERIFY(!reassembler.add(sender, 1, QByteArray("\x00\x02\x00\x02x", 5), 0, datagram));  // Index past count
+        QVERIFY(!reassembler.add(sender, 1, QByteArray("\x00\x00\x00\x00x", 5), 0, datagram));  // No fragments
+        QVERIFY(reassembler.isEmpty());
+
+        QVERIFY(Reassembler::split(makeDatagram(Reassembler::MAX_FRAGMENTS * 10 + 1), 10).isEmpty());
+    }
+
+    void testBufferIsBounded() {
+        // Many partial transfers: the least recently active are evicted to stay in budget
+        NodeIndex sender = NodeRegistry::global().intern("FragSender");
+        const int chunk = 60000;
+        const QList<QByteArray> payloads = Reassembler::split(makeDatagram(2 * chunk), chunk);
+        Reassembler reassembler;
+        QByteArray datagram;
+        const int transfers = 2 * Reassembler::MAX_BYTES / chunk;
+        for (int i = 0; i < transfers; ++i) {
+            reassembler.add(sender, static_cast<quint32>(100 + i), payloads.first(), i, datagram);
+        }
+        QVERIFY(reassembler.byteCount() <= Reassembler::MAX_BYTES);
+        QVERIFY(reassembler.size() < transfers);
+
+        // The newest transfer survived and can still complete
+        QVERIFY(reassembler.add(sender, static_cast<quint32>(100 + transfers - 1), payloads.last(), transfers, datagram));
+    }
+
+    void testOpenTransfersAreChargedAndCappedPerSender() {
+        // A first fragment announcing many pieces costs its slots, not just its chunk
+        NodeIndex flooder = NodeRegistry::global().intern("FragFlooder");
+        NodeIndex other = NodeRegistry::global().intern("FragOther");
+        const QList<QByteArray> wide = Reassembler::split(makeDatagram(Reassembler::MAX_FRAGMENTS), 1);
+        Reassembler reassembler;
+        QByteArray datagram;
+        QVERIFY(!reassembler.add(other, 1, wide.first(), 0, datagram));
+        QCOMPARE(reassembler.byteCount(), qint64(1 + Reassembler::MAX_FRAGMENTS * sizeof(QByteArray)
+                                                 + Reassembler::TRANSFER_OVERHEAD));
+
+        // One sender's unfinished transfers displace its own stalest, not other senders'
+        for (int i = 0; i < 3 * Reassembler::MAX_TRANSFERS_PER_SENDER; ++i) {
+            reassembler.add(flooder, static_cast<quint32>(i), wide.first(), 1 + i, datagram);
+        }
+        QCOMPARE(reassembler.size(), Reassembler::MAX_TRANSFERS_PER_SENDER + 1);
+        QVERIFY(!reassembler.add(other, 1, wide.at(1), 100, datagram));  // Still open and collecting
+
+        // Finishing or timing out releases everything charged
+        for (int index = 2; index < wide.size(); ++index) {
+            reassembler.add(other, 1, wide.at(index), 100, datagram);
+        }
+        QCOMPARE(datagram.size(), Reassembler::MAX_FRAGMENTS);
+        QVector<Reassembler::Stalled> stalled;
+        reassembler.poll(1000 + Reassembler::TIMEOUT, 50, stalled);
+        QVERIFY(reassembler.isEmpty());
+        QCOMPARE(reassembler.byteCount(), qint64(0));
+    }
+
+    void testCacheServesResendsUntilExpiry() {
+        FragmentCache cache;
+        cache.insert(1, {QByteArray("a"), QByteArray("b"), QByteArray("c")}, 0);
+        QCOMPARE(cache.find(1, {2, 0, 9}, 100), QList<QByteArray>({QByteArray("c"), QByteArray("a")}));
+        QVERIFY(cache.find(2, {0}, 100).isEmpty());
+
+        cache.insert(2, {QByteArray("d")}, 5000);
+        QVERIFY(cache.find(1, {0}, FragmentCache::RETENTION).isEmpty());
+        QCOMPARE(cache.find(2, {0}, FragmentCache::RETENTION).size(), 1);
+        QCOMPARE(cache.size(), 1);
+        QCOMPARE(cache.byteCount(), qint64(1));
+    }
+};
+
+QTEST_MAIN(TestFragmentation)
+#include "test_fragmentation.moc"
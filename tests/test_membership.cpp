@@ -0,0 +1,240 @@
+#include <QtTest/QtTest>
+#include "../src/membership.h"
+
+class TestMembership : public QObject {
+    Q_OBJECT
+
+private:
+    static Membership::Update update(const QString& id, quint32 incarnation, Membership::State state, quint16 port = 9000) {
+        Membership::Update u;
+        u.id = id;
+        u.address = QHostAddress("127.0.0.1");
+        u.port = port;
+        u.incarnation = incarnation;
+        u.state = state;
+        return u;
+    }
+
+    static NodeIndex node(const QString& id) { return NodeRegistry::global().intern(id); }
+
+    // Sends gossip until nothing is left to spread
+    static void drain(Membership& membership) {
+        while (!membership.takeGossip(NodeRegistry::INVALID_NODE).isEmpty()) {
+        }
+    }
+
+private slots:
+    void testIncarnationsOrderUpdates() {
+        Membership membership;
+        membership.setSelf("mbr-self");
+        QVector<Membership::Change> changes;
+
+        QVERIFY(membership.apply(update("mbr-a", 0, Membership::ALIVE), 0, changes));
+        QCOMPARE(changes.size(), 1);
+        QVERIFY(changes.first().joined);
+        QCOMPARE(membership.aliveCount(), 1);
+
+        // Same incarnation: suspicion beats alive, death beats suspicion, never the reverse
+        QVERIFY(!membership.apply(update("mbr-a", 0, Membership::ALIVE), 1, changes));
+        QVERIFY(membership.apply(update("mbr-a", 0, Membership::SUSPECT), 2, changes));
+        QVERIFY(!membership.isAlive(node("mbr-a")));
+        QVERIFY(!membership.apply(update("mbr-a", 0, Membership::ALIVE), 3, changes));
+
+        // The member refutes with a higher incarnation
+        QVERIFY(membership.apply(update("mbr-a", 1, Membership::ALIVE), 4, changes));
+        QVERIFY(membership.isAlive(node("mbr-a")));
+        QVERIFY(!changes.last().joined);
+
+        QVERIFY(membership.apply(update("mbr-a", 1, Membership::DEAD), 5, changes));
+        QVERIFY(!membership.apply(update("mbr-a", 0, Membership::ALIVE), 6, changes));
+        QVERIFY(membership.apply(update("mbr-a", 2, Membership::ALIVE), 7, changes));
+        QVERIFY(changes.last().joined);
+        QCOMPARE(membership.aliveCount(), 1);
+
+        // Deaths of strangers are not news
+        QVERIFY(!membership.apply(update("mbr-b", 3, Membership::DEAD), 8, changes));
+        QVERIFY(!membership.contains(node("mbr-b")));
+    }
+
+    void testRefutesSuspicionOfItself() {
+        Membership membership;
+        membership.setSelf("mbr-self2");
+        drain(membership);
+        QCOMPARE(membership.incarnation(), quint32(0));
+
+        QVector<Membership::Change> changes;
+        QVERIFY(!membership.apply(update("mbr-self2", 0, Membership::SUSPECT), 0, changes));
+        QCOMPARE(membership.incarnation(), quint32(1));
+
+        // The refutation is gossiped with a null address, meaning "the sender"
+        QVector<Membership::Update> updates;
+        QVERIFY(Membership::decodeUpdates(membership.takeGossip(NodeRegistry::INVALID_NODE), updates));
+        QCOMPARE(updates.size(), 1);
+        QCOMPARE(updates.first().id, QString("mbr-self2"));
+        QCOMPARE(updates.first().incarnation, quint32(1));
+        QCOMPARE(updates.first().state, Membership::ALIVE);
+        QVERIFY(updates.first().address.isNull());
+    }
+
+    void testSuspicionExpires() {
+        Membership membership;
+        membership.setSelf("mbr-self3");
+        QVector<Membership::Change> changes;
+        membership.apply(update("mbr-c", 0, Membership::ALIVE), 0, changes);
+        membership.apply(update("mbr-d", 0, Membership::ALIVE), 0, changes);
+
+        QVERIFY(membership.suspect(node("mbr-c"), 1000));
+        QVERIFY(!membership.suspect(node("mbr-c"), 1000));
+        QCOMPARE(membership.aliveCount(), 1);
+
+        changes.clear();
+        membership.expireSuspects(1500, 100, changes);
+        QVERIFY(changes.isEmpty());
+        membership.expireSuspects(1000 + 100 * Membership::SUSPICION_MULTIPLIER * 2, 100, changes);
+        QCOMPARE(changes.size(), 1);
+        QCOMPARE(changes.first().state, Membership::DEAD);
+        QCOMPARE(membership.randomDeadMember(), node("mbr-c"));
+        QCOMPARE(membership.randomMembers(5, NodeRegistry::INVALID_NODE), QVector<NodeIndex>({node("mbr-d")}));
+    }
+
+    void testGossipIsBoundedAndRetired() {
+        Membership membership;
+        membership.setSelf("mbr-self4");
+        QVector<Membership::Change> changes;
+        for (int i = 0; i < 100; ++i) {
+            membership.apply(update(QString("mbr-g%1").arg(i), 0, Membership::ALIVE, 9000 + i), 0, changes);
+        }
+
+        QByteArray first = membership.takeGossip(NodeRegistry::INVALID_NODE);
+        QVERIFY(!first.isEmpty());
+        QVERIFY(first.size() <= Membership::MAX_GOSSIP_BYTES);
+
+        // Fewest-sent first: the next datagram carries updates the first did not
+        QVector<Membership::Update> a, b;
+        QVERIFY(Membership::decodeUpdates(first, a));
+        QVERIFY(Membership::decodeUpdates(membership.takeGossip(NodeRegistry::INVALID_NODE), b));
+        QVERIFY(!b.isEmpty());
+        for (const Membership::Update& u : b) {
+            for (const Membership::Update& v : a) {
+                QVERIFY(u.id != v.id);
+            }
+        }
+
+        // Each update retires after a few log2(N) sends
+        int datagrams = 2;
+        while (!membership.takeGossip(NodeRegistry::INVALID_NODE).isEmpty()) {
+            ++datagrams;
+        }
+        QCOMPARE(membership.pendingGossip(), 0);
+        QVERIFY(datagrams <= 2 * 101 * Membership::RETRANSMIT_MULTIPLIER * 7 / a.size());
+    }
+
+    void testDoubtedDestinationHearsFirst() {
+        Membership membership;
+        membership.setSelf("mbr-self5");
+        QVector<Membership::Change> changes;
+        membership.apply(update("mbr-e", 4, Membership::ALIVE), 0, changes);
+        membership.suspect(node("mbr-e"), 10);
+        drain(membership);
+
+        QVector<Membership::Update> updates;
+        QVERIFY(Membership::decodeUpdates(membership.takeGossip(node("mbr-e")), updates));
+        QCOMPARE(updates.size(), 1);
+        QCOMPARE(updates.first().id, QString("mbr-e"));
+        QCOMPARE(updates.first().state, Membership::SUSPECT);
+        QCOMPARE(updates.first().incarnation, quint32(4));
+    }
+
+    void testEncodingRoundTrip() {
+        QVector<Membership::Update> updates;
+        updates.append(update("mbr-v4", 7, Membership::SUSPECT, 9100));
+        Membership::Update v6 = update("mbr-v6", 1, Membership::LEFT, 9200);
+        v6.address = QHostAddress("::1");
+        updates.append(v6);
+        Membership::Update sender = update("mbr-sender", 2, Membership::ALIVE, 0);
+        sender.address = QHostAddress();
+        updates.append(sender);
+
+        QByteArray payload = Membership::encodeUpdates(updates);
+        QVector<Membership::Update> decoded;
+        QVERIFY(Membership::decodeUpdates(payload, decoded));
+        QCOMPARE(decoded.size(), 3);
+        QCOMPARE(decoded[0].address, QHostAddress("127.0.0.1"));
+        QCOMPARE(decoded[0].port, quint16(9100));
+        QCOMPARE(decoded[0].state, Membership::SUSPECT);
+        QCOMPARE(decoded[1].address, QHostAddress("::1"));
+        QCOMPARE(decoded[1].state, Membership::LEFT);
+        QVERIFY(decoded[2].address.isNull());
+
+        // A null address is where the datagram came from
+        Membership membership;
+        membership.setSelf("mbr-self6");
+        QVector<Membership::Change> changes;
+        membership.apply(payload, QHostAddress("10.0.0.9"), 9300, 0, changes);
+        const Membership::Member* member = membership.find(node("mbr-sender"));
+        QVERIFY(member);
+        QCOMPARE(member->address, QHostAddress("10.0.0.9"));
+        QCOMPARE(member->port, quint16(9300));
+
+        QVector<Membership::Update> rejected;
+        QVERIFY(!Membership::decodeUpdates(payload.left(payload.size() - 1), rejected));
+    }
+
+    void testJoinSpreadsInLogarithmicRounds() {
+        // 128 members who all know each other; a newcomer announces itself to
+        // one of them, and each round every node probes one other, both sides
+        // piggybacking gossip
+        const int size = 128;
+        QVector<Membership*> nodes;
+        QVector<Membership::Update> everyone;
+        for (int i = 0; i < size; ++i) {
+            nodes.append(new Membership());
+            nodes[i]->setSelf(QString("mbr-n%1").arg(i));
+            everyone.append(update(QString("mbr-n%1").arg(i), 0, Membership::ALIVE, static_cast<quint16>(10000 + i)));
+        }
+        QVector<Membership::Change> changes;
+        for (Membership* membership : nodes) {
+            for (const Membership::Update& u : everyone) {
+                membership->apply(u, 0, changes);
+            }
+            drain(*membership);
+        }
+
+        Membership newcomer;
+        newcomer.setSelf("mbr-newcomer");
+        nodes[0]->apply(newcomer.takeGossip(node("mbr-n0")), QHostAddress("127.0.0.1"), 20000, 0, changes);
+
+        QHash<NodeIndex, int> indexOf;
+        for (int i = 0; i < size; ++i) {
+            indexOf.insert(node(QString("mbr-n%1").arg(i)), i);
+        }
+
+        int rounds = 0;
+        auto informed = [&]() {
+            int count = 0;
+            for (Membership* membership : nodes) {
+                count += membership->contains(node("mbr-newcomer"));
+            }
+            return count;
+        };
+        while (informed() < size && rounds < 100) {
+            ++rounds;
+            for (int i = 0; i < size; ++i) {
+                NodeIndex target = nodes[i]->nextProbeTarget();
+                if (!indexOf.contains(target)) {
+                    continue;
+                }
+                Membership* peer = nodes[indexOf.value(target)];
+                peer->apply(nodes[i]->takeGossip(target), QHostAddress("127.0.0.1"), 0, rounds, changes);
+                nodes[i]->apply(peer->takeGossip(node(QString("mbr-n%1").arg(i))), QHostAddress("127.0.0.1"), 0, rounds, changes);
+            }
+        }
+        qDeleteAll(nodes);
+
+        // Infection doubles the informed set about every round: log2(128) = 7
+        QVERIFY2(rounds <= 14, qPrintable(QString("took %1 rounds").arg(rounds)));
+    }
+};
+
+QTEST_MAIN(TestMembership)
+#include "test_membership.moc"
@@ -0,0 +1,155 @@
+#include <QtTest/QtTest>
+#include "../src/messagelog.h"
+
+class TestMessageLog : public QObject {
+    Q_OBJECT
+
+private:
+    static NodeIndex node(const char* name) { return NodeRegistry::global().intern(name); }
+
+    static Message chat(const char* origin, int sequenceNumber) {
+        return Message(QString("msg %1").arg(sequenceNumber), origin, "broadcast", sequenceNumber);
+    }
+
+private slots:
+    void testInsertAndContains() {
+        MessageLog log;
+        QVERIFY(log.insert(node("A"), chat("A", 1)));
+        QVERIFY(log.insert(node("A"), chat("A", 2)));
+        QVERIFY(!log.insert(node("A"), chat("A", 2)));
+
+        QVERIFY(log.contains(node("A"), 1));
+        QVERIFY(log.contains(node("A"), 2));
+        QVERIFY(!log.contains(node("A"), 3));
+        QVERIFY(!log.contains(node("B"), 1));
+        QCOMPARE(log.size(), 2);
+        QCOMPARE(log.find(node("A"), 2)->getChatText(), QString("msg 2"));
+    }
+
+    void testOutOfOrderLeavesHoles() {
+        MessageLog log;
+        QVERIFY(log.insert(node("A"), chat("A", 5)));
+        QVERIFY(!log.contains(node("A"), 3));
+        QVERIFY(log.insert(node("A"), chat("A", 3)));
+        QVERIFY(log.contains(node("A"), 3));
+        QCOMPARE(log.size(), 2);
+    }
+
+    void testRangeIsSlice() {
+        MessageLog log;
+        for (int seq = 1; seq <= 10; ++seq) {
+            log.insert(node("A"), chat("A", seq));
+        }
+
+        QList<Message> slice = log.range(node("A"), 6, 10);
+        QCOMPARE(slice.size(), 4);
+        QCOMPARE(slice.first().getSequenceNumber(), 7);
+        QCOMPARE(slice.last().getSequenceNumber(), 10);
+
+        QCOMPARE(log.range(node("A"), 10, 20).size(), 0);
+        QCOMPARE(log.range(node("A"), 0, 3).size(), 3);
+    }
+
+    void testMissingForRemoteClock() {
+        MessageLog log;
+        VectorClock local;
+        for (int seq = 1; seq <= 4; ++seq) {
+            log.insert(node("A"), chat("A", seq));
+            log.insert(node("B"), chat("B", seq));
+        }
+        local.set(node("A"), 4);
+        local.set(node("B"), 4);
+
+        VectorClock remote;
+        remote.set(node("A"), 4);
+        remote.set(node("B"), 1);
+
+        QList<Message> missing = log.missingFor(local, remote);
+        QCOMPARE(missing.size(), 3);
+        for (const Message& msg : missing) {
+            QCOMPARE(msg.getOrigin(), QString("B"));
+            QVERIFY(msg.getSequenceNumber() > 1);
+        }
+    }
+
+    void testMissingForFillsRemoteHoles() {
+        MessageLog log;
+        VectorClock local;
+        for (int seq = 1; seq <= 6; ++seq) {
+            log.insert(node("R"), chat("R", seq));
+            local.insert(node("R"), static_cast<quint32>(seq));
+        }
+
+        // Remote got 1, 2 and 5 only
+        VectorClock remote;
+        remote.insert(node("R"), 1);
+        remote.insert(node("R"), 2);
+        remote.insert(node("R"), 5);
+
+        QList<Message> missing = log.missingFor(local, remote);
+        QCOMPARE(missing.size(), 3);
+        QCOMPARE(missing.at(0).getSequenceNumber(), 3);
+        QCOMPARE(missing.at(1).getSequenceNumber(), 4);
+        QCOMPARE(missing.at(2).getSequenceNumber(), 6);
+    }
+
+    void testCompactDropsStablePrefix() {
+        MessageLog log;
+        for (int seq = 1; seq <= 5; ++seq) {
+            if (seq != 4) {
+                log.insert(node("C"), chat("C", seq));
+            }
+        }
+        qint64 before = log.byteCount();
+        QVERIFY(before > 0);
+
+        // Stops at the hole at 4 even though the frontier is past it
+        qint64 reclaimed = 0;
+        QCOMPARE(log.compact(node("C"), 5, &reclaimed), 3);
+        QCOMPARE(log.size(), 1);
+        QCOMPARE(log.byteCount(), before - reclaimed);
+        QCOMPARE(log.find(node("C"), 2), static_cast<const Message*>(nullptr));
+
+        // Compacted messages still count as held, so duplicates are rejected
+        QVERIFY(log.contains(node("C"), 2));
+        QVERIFY(!log.insert(node("C"), chat("C", 2)));
+        QVERIFY(!log.contains(node("C"), 4));
+
+        QVERIFY(log.insert(node("C"), chat("C", 4)));
+        QCOMPARE(log.compact(node("C"), 5), 2);
+        QCOMPARE(log.size(), 0);
+        QCOMPARE(log.byteCount(), qint64(0));
+        QCOMPARE(log.range(node("C"), 0, 5).size(), 0);
+    }
+
+    void testChargesHolesAndDropsClocks() {
+        MessageLog log;
+        Message first = chat("H", 1);
+        VectorClock clock;
+        for (int i = 0; i < 100; ++i) {
+            clock.set(node(qPrintable(QString("H%1").arg(i))), 5);
+        }
+        first.setVectorClock(clock);
+        QVERIFY(log.insert(node("H"), first));
+        QVERIFY(log.find(node("H"), 1)->getVectorClock().isEmpty());
+        QCOMPARE(log.byteCount(), MessageLog::estimateBytes(chat("H", 1)));
+
+        // The 999 slots opened below 1001 are charged until they are filled
+        const qint64 before = log.byteCount();
+        QVERIFY(log.insert(node("H"), chat("H", 1001)));
+        QCOMPARE(log.byteCount(), before + 999 * qint64(sizeof(Message)) + MessageLog::estimateBytes(chat("H", 1001)));
+        QVERIFY(log.insert(node("H"), chat("H", 500)));
+        QCOMPARE(log.byteCount(), before + 999 * qint64(sizeof(Message)) + MessageLog::estimateBytes(chat("H", 1001))
+                                      + MessageLog::estimateBytes(chat("H", 500)) - qint64(sizeof(Message)));
+    }
+
+    void testRejectsAbsurdSequence() {
+        MessageLog log;
+        QVERIFY(!log.insert(node("A"), chat("A", MessageLog::MAX_SEQUENCE_GAP + 10)));
+        QVERIFY(!log.insert(node("A"), chat("A", 0)));
+        QCOMPARE(log.size(), 0);
+    }
+};
+
+QTEST_MAIN(TestMessageLog)
+#include "test_messagelog.moc"
@@ -0,0 +1,46 @@
+#include <QtTest/QtTest>
+#include "../src/noderegistry.h"
+
+class TestNodeRegistry : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testInternIsStable() {
+        NodeRegistry registry;
+        NodeIndex node1 = registry.intern("Node1");
+        NodeIndex node2 = registry.intern("Node2");
+
+        QVERIFY(node1 != node2);
+        QCOMPARE(registry.intern("Node1"), node1);
+        QCOMPARE(registry.find("Node2"), node2);
+        QCOMPARE(registry.name(node1), QString("Node1"));
+        QCOMPARE(registry.size(), 2);
+    }
+
+    void testIndicesAreDense() {
+        NodeRegistry registry;
+        for (int i = 0; i < 100; ++i) {
+            QCOMPARE(registry.intern(QString("Node%1").arg(i)), static_cast<NodeIndex>(i));
+        }
+    }
+
+    void testInternFromUtf8Bytes() {
+        NodeRegistry registry;
+        NodeIndex node = registry.intern("Node9001");
+        QByteArray utf8("Node9001");
+
+        QCOMPARE(registry.intern(utf8.constData(), utf8.size()), node);
+        QCOMPARE(registry.find("Unknown"), NodeRegistry::INVALID_NODE);
+        QVERIFY(registry.name(NodeRegistry::INVALID_NODE).isEmpty());
+    }
+
+    void testMessageKeyPacking() {
+        MessageKey key = NodeRegistry::messageKey(7, 42);
+        QCOMPARE(NodeRegistry::keyNode(key), static_cast<NodeIndex>(7));
+        QCOMPARE(NodeRegistry::keySequence(key), static_cast<quint32>(42));
+        QVERIFY(NodeRegistry::messageKey(7, 42) != NodeRegistry::messageKey(42, 7));
+    }
+};
+
+QTEST_MAIN(TestNodeRegistry)
+#include "test_noderegistry.moc"
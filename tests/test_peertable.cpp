@@ -0,0 +1,85 @@
+#include <QtTest/QtTest>
+#include "../src/peertable.h"
+
+class TestPeerTable : public QObject {
+    Q_OBJECT
+
+private:
+    static PeerInfo makePeer(const QString& id, const QString& host, quint16 port) {
+        return PeerInfo(id, NodeRegistry::global().intern(id), QHostAddress(host), port);
+    }
+
+private slots:
+    void testFindsByNodeAndAddress() {
+        PeerTable table;
+        table.insert(makePeer("TableA", "127.0.0.1", 9001));
+        table.insert(makePeer("TableB", "127.0.0.1", 9002));
+        table.insert(makePeer("TableC", "10.0.0.7", 9001));
+        QCOMPARE(table.size(), 3);
+
+        NodeIndex b = NodeRegistry::global().intern("TableB");
+        QVERIFY(table.contains(b));
+        QCOMPARE(table.find(b).value().peerId, QString("TableB"));
+        QCOMPARE(table.findByAddress(QHostAddress("127.0.0.1"), 9002), b);
+        QCOMPARE(table.findByAddress(QHostAddress("10.0.0.7"), 9001), NodeRegistry::global().intern("TableC"));
+        QCOMPARE(table.findByAddress(QHostAddress("10.0.0.7"), 9002), NodeRegistry::INVALID_NODE);
+        QCOMPARE(table.findByAddress(QHostAddress("127.0.0.2"), 9001), NodeRegistry::INVALID_NODE);
+    }
+
+    void testReplacingKeepsIndexesInStep() {
+        PeerTable table;
+        NodeIndex a = NodeRegistry::global().intern("TableA");
+        table.insert(makePeer("TableA", "127.0.0.1", 9001));
+        table.find(a).value().wireVersion = 3;
+
+        // Re-adding moves the peer and starts it afresh
+        table.insert(makePeer("TableA", "127.0.0.1", 9005));
+        QCOMPARE(table.size(), 1);
+        QCOMPARE(table.find(a).value().wireVersion, 0);
+        QCOMPARE(table.findByAddress(QHostAddress::LocalHost, 9001), NodeRegistry::INVALID_NODE);
+        QCOMPARE(table.findByAddress(QHostAddress::LocalHost, 9005), a);
+
+        // A new node on the same endpoint can't take it from a live peer...
+        table.insert(makePeer("TableD", "127.0.0.1", 9005));
+        NodeIndex d = NodeRegistry::global().intern("TableD");
+        QCOMPARE(table.findByAddress(QHostAddress::LocalHost, 9005), a);
+
+        // ...but takes it over once that one has gone; the old one keeps its entry
+        table.find(a).value().isActive = false;
+        table.relocate(d, QHostAddress::LocalHost, 9005);
+        QCOMPARE(table.findByAddress(QHostAddress::LocalHost, 9005), d);
+        QVERIFY(table.contains(a));
+
+        // Moving the old node away must not unindex the new owner
+        table.insert(makePeer("TableA", "127.0.0.1", 9006));
+        QCOMPARE(table.findByAddress(QHostAddress::LocalHost, 9005), d);
+        QCOMPARE(table.findByAddress(QHostAddress::LocalHost, 9006), a);
+    }
+
+    void testRelocateMovesTheEndpoint() {
+        PeerTable table;
+        NodeIndex e = NodeRegistry::global().intern("TableE");
+        table.insert(makePeer("TableE", "10.0.0.1", 9001));
+        table.find(e).value().wireVersion = 4;
+
+        // Unlike re-adding, relocating keeps what is known about the peer
+        QVERIFY(table.relocate(e, QHostAddress("10.0.0.2"), 9003) != table.end());
+        QCOMPARE(table.find(e).value().wireVersion, 4);
+        QCOMPARE(table.find(e).value().address, QHostAddress("10.0.0.2"));
+        QCOMPARE(table.findByAddress(QHostAddress("10.0.0.1"), 9001), NodeRegistry::INVALID_NODE);
+        QCOMPARE(table.findByAddress(QHostAddress("10.0.0.2"), 9003), e);
+        QVERIFY(table.relocate(NodeRegistry::global().intern("TableNobody"), QHostAddress("10.0.0.3"), 1) == table.end());
+    }
+
+    void testIpv6FallsBackToScan() {
+        PeerTable table;
+        table.insert(makePeer("TableV6", "::1", 9001));
+        QCOMPARE(PeerTable::endpointKey(QHostAddress("::1"), 9001), quint64(0));
+        QCOMPARE(table.findByAddress(QHostAddress("::1"), 9001), NodeRegistry::global().intern("TableV6"));
+        QCOMPARE(table.findByAddress(QHostAddress("::1"), 9002), NodeRegistry::INVALID_NODE);
+        QVERIFY(PeerTable::endpointKey(QHostAddress("0.0.0.0"), 0) != 0);
+    }
+};
+
+QTEST_MAIN(TestPeerTable)
+#include "test_peertable.moc"
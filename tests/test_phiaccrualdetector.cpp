@@ -0,0 +1,88 @@
+#include <QtTest/QtTest>
+#include <cmath>
+#include "../src/phiaccrualdetector.h"
+
+class TestPhiAccrualDetector : public QObject {
+    Q_OBJECT
+
+private:
+    // Heartbeats every interval ms up to and including time 'until'
+    static qint64 beat(PhiAccrualDetector& detector, qint64 from, qint64 until, qint64 interval) {
+        qint64 now = from;
+        for (; now <= until; now += interval) {
+            detector.heartbeat(now);
+        }
+        return now - interval;
+    }
+
+private slots:
+    void testNoHistory() {
+        PhiAccrualDetector detector(500);
+        QVERIFY(!detector.hasHistory());
+        QCOMPARE(detector.phi(100000), 0.0);
+
+        detector.heartbeat(1000);
+        QVERIFY(detector.hasHistory());
+        QCOMPARE(detector.meanInterval(), 500.0);  // The seed stands in for real intervals
+    }
+
+    void testPhiRisesWithSilence() {
+        PhiAccrualDetector detector(500, 1000);
+        qint64 last = beat(detector, 0, 10000, 500);
+        QCOMPARE(detector.meanInterval(), 500.0);
+
+        // On schedule nothing is suspected; at the mean plus the pause phi is
+        // log10(2), and a few intervals later it is far past any sane threshold
+        QVERIFY(detector.phi(last + 500) < 0.01);
+        QVERIFY(qAbs(detector.phi(last + 1500) - std::log10(2.0)) < 0.01);
+        QVERIFY(detector.phi(last + 2500) > 8.0);
+
+        double previous = 0.0;
+        for (qint64 silence = 0; silence <= 60000; silence += 100) {
+            double phi = detector.phi(last + silence);
+            QVERIFY(phi >= previous);
+            QVERIFY(std::isfinite(phi));
+            previous = phi;
+        }
+    }
+
+    void testJitterDelaysSuspicion() {
+        PhiAccrualDetector regular(500);
+        PhiAccrualDetector jittery(500);
+        qint64 last = beat(regular, 0, 10000, 500);
+        qint64 now = 0;
+        for (int i = 0; i < 40; ++i) {
+            now += i % 2 ? 200 : 800;
+            jittery.heartbeat(now);
+        }
+
+        QVERIFY(jittery.standardDeviation() > regular.standardDeviation());
+        QVERIFY(jittery.phi(now + 1200) < regular.phi(last + 1200));
+    }
+
+    void testWindowForgetsOldIntervals() {
+        PhiAccrualDetector detector(500);
+        qint64 last = beat(detector, 0, 500 * PhiAccrualDetector::WINDOW, 500);
+        last = beat(detector, last + 2000, last + 2000 * (PhiAccrualDetector::WINDOW + 1), 2000);
+        QCOMPARE(detector.meanInterval(), 2000.0);
+        QCOMPARE(detector.standardDeviation(), double(PhiAccrualDetector::MIN_STD_DEV));
+        QVERIFY(detector.phi(last + 1000) < 0.01);  // Slow but steady is not suspicious
+    }
+
+    void testReset() {
+        PhiAccrualDetector detector(500);
+        qint64 last = beat(detector, 0, 5000, 500);
+        QVERIFY(detector.phi(last + 5000) > 8.0);
+
+        detector.reset();
+        QVERIFY(!detector.hasHistory());
+        QCOMPARE(detector.phi(last + 5000), 0.0);
+
+        // The outage is not counted as an interval when heartbeats resume
+        detector.heartbeat(last + 60000);
+        QCOMPARE(detector.meanInterval(), 500.0);
+    }
+};
+
+QTEST_MAIN(TestPhiAccrualDetector)
+#include "test_phiaccrualdetector.moc"
@@ -0,0 +1,102 @@
+#include <QtTest/QtTest>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "../src/shardedstore.h"
+
+class TestShardedStore : public QObject {
+    Q_OBJECT
+
+private:
+    static NodeIndex node(const QString& name) { return NodeRegistry::global().intern(name); }
+
+    static Message chat(const QString& origin, int sequenceNumber) {
+        return Message(QString("msg %1").arg(sequenceNumber), origin, "broadcast", sequenceNumber);
+    }
+
+private slots:
+    void testBehavesLikeOneLog() {
+        // Origins spread over shards, but every query sees all of them
+        ShardedStore store(4);
+        VectorClock local;
+        for (int i = 0; i < 8; ++i) {
+            QString origin = QString("Shard%1").arg(i);
+            for (int seq = 1; seq <= 3; ++seq) {
+                QVERIFY(store.insert(node(origin), chat(origin, seq)));
+            }
+            QVERIFY(!store.insert(node(origin), chat(origin, 2)));
+            local.set(node(origin), 3);
+        }
+
+        QCOMPARE(store.size(), 24);
+        QCOMPARE(store.originsWithMessages().size(), 8);
+        QVERIFY(store.contains(node("Shard5"), 3));
+        QVERIFY(!store.contains(node("Shard5"), 4));
+        QCOMPARE(store.range(node("Shard6"), 1, 3).size(), 2);
+
+        VectorClock remote;
+        remote.set(node("Shard0"), 3);
+        QCOMPARE(store.missingFor(local, remote).size(), 21);
+
+        qint64 freed = 0;
+        QCOMPARE(store.compact(node("Shard7"), 2, &freed), 2);
+        QVERIFY(freed > 0);
+        QCOMPARE(store.size(), 22);
+    }
+
+    void testAbsorbRecoveredLog() {
+        MessageLog recovered;
+        for (int seq = 1; seq <= 5; ++seq) {
+            recovered.insert(node("Recovered1"), chat("Recovered1", seq));
+            recovered.insert(node("Recovered2"), chat("Recovered2", seq));
+        }
+
+        ShardedStore store(3);
+        store.absorb(recovered);
+        QCOMPARE(store.size(), 10);
+        QCOMPARE(recovered.size(), 0);
+        QVERIFY(store.contains(node("Recovered2"), 5));
+    }
+
+    void testConcurrentInsertsStoreOnce() {
+        // Every thread offers every message, as workers do with retransmits;
+        // each message must be accepted by exactly one of them
+        const int threads = 4;
+        const int origins = 16;
+        const int perOrigin = 500;
+        ShardedStore store(threads);
+
+        QVector<NodeIndex> nodes;
+        QVector<Message> messages;
+        for (int i = 0; i < origins; ++i) {
+            QString origin = QString("Concurrent%1").arg(i);
+            nodes.append(node(origin));
+            for (int seq = 1; seq <= perOrigin; ++seq) {
+                messages.append(chat(origin, seq));
+            }
+        }
+
+        std::atomic<int> accepted(0);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t]() {
+                // Different starting points so the threads really collide
+                for (int i = 0; i < messages.size(); ++i) {
+                    int index = (i + t * messages.size() / threads) % messages.size();
+                    if (store.insert(nodes[index / perOrigin], messages[index])) {
+                        ++accepted;
+                    }
+                }
+            });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+
+        QCOMPARE(accepted.load(), origins * perOrigin);
+        QCOMPARE(store.size(), origins * perOrigin);
+    }
+};
+
+QTEST_MAIN(TestShardedStore)
+#include "test_shardedstore.moc"
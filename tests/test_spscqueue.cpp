@@ -0,0 +1,66 @@
+#include <QtTest/QtTest>
+#include <thread>
+#include "../src/spscqueue.h"
+
+class TestSpscQueue : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testFifoOrder() {
+        SpscQueue<int> queue;
+        int value = 0;
+        QVERIFY(!queue.pop(value));
+
+        for (int i = 1; i <= 5; ++i) {
+            queue.push(i);
+        }
+        for (int i = 1; i <= 5; ++i) {
+            QVERIFY(queue.pop(value));
+            QCOMPARE(value, i);
+        }
+        QVERIFY(!queue.pop(value));
+    }
+
+    void testNodesAreRecycled() {
+        // Alternating push/pop cycles through the same few nodes; values must
+        // not leak between uses
+        SpscQueue<QString> queue;
+        QString value;
+        for (int i = 0; i < 1000; ++i) {
+            queue.push(QString("message %1").arg(i));
+            QVERIFY(queue.pop(value));
+            QCOMPARE(value, QString("message %1").arg(i));
+        }
+        QVERIFY(!queue.pop(value));
+    }
+
+    void testTwoThreads() {
+        const int count = 200000;
+        SpscQueue<QString> queue;
+
+        std::thread producer([&queue, count]() {
+            for (int i = 0; i < count; ++i) {
+                queue.push(QString::number(i));
+            }
+        });
+
+        int expected = 0;
+        bool inOrder = true;
+        QString value;
+        while (expected < count) {
+            if (queue.pop(value)) {
+                inOrder = inOrder && value == QString::number(expected);
+                ++expected;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        producer.join();
+
+        QVERIFY(inOrder);
+        QVERIFY(!queue.pop(value));
+    }
+};
+
+QTEST_MAIN(TestSpscQueue)
+#include "test_spscqueue.moc"
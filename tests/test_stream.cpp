@@ -0,0 +1,112 @@
+#include <QtTest/QtTest>
+#include "../src/congestionwindow.h"
+#include "../src/reorderbuffer.h"
+
+class TestStream : public QObject {
+    Q_OBJECT
+
+private:
+    static Message direct(int sequence, int previous) {
+        Message msg(QString("m%1").arg(sequence), "Sender", "Receiver", sequence);
+        msg.setPreviousSequence(previous);
+        return msg;
+    }
+
+private slots:
+    void testSlowStartThenAdditiveIncrease() {
+        CongestionWindow window;
+        QCOMPARE(window.window(), int(CongestionWindow::INITIAL_WINDOW));
+        QVERIFY(window.canSend(CongestionWindow::INITIAL_WINDOW - 1));
+        QVERIFY(!window.canSend(CongestionWindow::INITIAL_WINDOW));
+
+        // One round trip of ACKs doubles the window while in slow start
+        for (int i = 0; i < CongestionWindow::INITIAL_WINDOW; ++i) {
+            window.onAck();
+        }
+        QCOMPARE(window.window(), 2 * CongestionWindow::INITIAL_WINDOW);
+
+        // A loss halves it, and later ones from the same flight do not
+        window.onLoss(5, 20);
+        QCOMPARE(window.window(), CongestionWindow::INITIAL_WINDOW);
+        QVERIFY(!window.inSlowStart());
+        window.onLoss(12, 20);
+        QCOMPARE(window.window(), CongestionWindow::INITIAL_WINDOW);
+
+        // Congestion avoidance: about one more message per window's worth of ACKs
+        for (int i = 0; i <= CongestionWindow::INITIAL_WINDOW; ++i) {
+            window.onAck();
+        }
+        QCOMPARE(window.window(), CongestionWindow::INITIAL_WINDOW + 1);
+
+        // A loss sent after the cut is a new congestion event, down to the floor
+        for (int i = 0; i < 10; ++i) {
+            window.onLoss(100 + i * 100, 150 + i * 100);
+        }
+        QCOMPARE(window.window(), int(CongestionWindow::MIN_WINDOW));
+    }
+
+    void testWindowIsCapped() {
+        CongestionWindow window;
+        for (int i = 0; i < 10000; ++i) {
+            window.onAck();
+        }
+        QCOMPARE(window.window(), int(CongestionWindow::MAX_WINDOW));
+    }
+
+    void testSuccessorsReleaseInOrder() {
+        NodeIndex sender = NodeRegistry::global().intern("Sender");
+        ReorderBuffer buffer;
+
+        // 7 <- 9 <- 12 arrive backwards while 7 is lost
+        QVERIFY(buffer.hold(sender, direct(12, 9), 0));
+        QVERIFY(buffer.hold(sender, direct(9, 7), 0));
+        QVERIFY(!buffer.hold(sender, direct(10, 7), 0));  // 7 already has a successor waiting
+        QVERIFY(buffer.holds(NodeRegistry::messageKey(sender, 9)));
+        QCOMPARE(buffer.size(), 2);
+
+        Message next;
+        QVERIFY(!buffer.takeSuccessor(NodeRegistry::messageKey(sender, 6), next));
+        QVERIFY(buffer.takeSuccessor(NodeRegistry::messageKey(sender, 7), next));
+        QCOMPARE(next.getSequenceNumber(), 9);
+        QVERIFY(buffer.takeSuccessor(NodeRegistry::messageKey(sender, 9), next));
+        QCOMPARE(next.getSequenceNumber(), 12);
+        QVERIFY(buffer.isEmpty());
+        QVERIFY(!buffer.holds(NodeRegistry::messageKey(sender, 9)));
+        QCOMPARE(buffer.nextExpiry(), qint64(-1));
+    }
+
+    void testExpiryAndLimit() {
+        NodeIndex sender = NodeRegistry::global().intern("Sender");
+        ReorderBuffer buffer;
+        buffer.hold(sender, direct(3, 2), 100);
+        buffer.hold(sender, direct(5, 4), 200);
+        QCOMPARE(buffer.nextExpiry(), qint64(100 + ReorderBuffer::TIMEOUT));
+
+        // Nothing is due before its timeout
+        QList<Message> released;
+        buffer.takeExpired(100 + ReorderBuffer::TIMEOUT - 1, released);
+        QVERIFY(released.isEmpty());
+
+        // Taken entries are skipped; the rest expire oldest first
+        Message next;
+        QVERIFY(buffer.takeSuccessor(NodeRegistry::messageKey(sender, 2), next));
+        QCOMPARE(buffer.nextExpiry(), qint64(200 + ReorderBuffer::TIMEOUT));
+        buffer.takeExpired(200 + ReorderBuffer::TIMEOUT, released);
+        QCOMPARE(released.size(), 1);
+        QCOMPARE(released.first().getSequenceNumber(), 5);
+        QVERIFY(buffer.isEmpty());
+
+        // Over the limit the oldest goes at once
+        released.clear();
+        for (int i = 0; i <= ReorderBuffer::LIMIT; ++i) {
+            buffer.hold(sender, direct(1000 + 2 * i, 999 + 2 * i), 0);
+        }
+        buffer.takeExpired(0, released);
+        QCOMPARE(released.size(), 1);
+        QCOMPARE(released.first().getSequenceNumber(), 1000);
+        QCOMPARE(buffer.size(), int(ReorderBuffer::LIMIT));
+    }
+};
+
+QTEST_MAIN(TestStream)
+#include "test_stream.moc"
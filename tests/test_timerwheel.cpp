@@ -0,0 +1,152 @@
+#include <QtTest/QtTest>
+#include <QRandomGenerator>
+#include "../src/timerwheel.h"
+#include "../src/rttestimator.h"
+
+class TestTimerWheel : public QObject {
+    Q_OBJECT
+
+private:
+    // Advances one millisecond at a time, recording when each key fired
+    static QHash<quint64, qint64> runUntil(TimerWheel& wheel, qint64 from, qint64 to) {
+        QHash<quint64, qint64> firedAt;
+        QVector<quint64> expired;
+        for (qint64 now = from; now <= to; ++now) {
+            expired.clear();
+            wheel.advance(now, expired);
+            for (quint64 key : expired) {
+                firedAt.insert(key, now);
+            }
+        }
+        return firedAt;
+    }
+
+private slots:
+    void testFiresOnTheDeadlineAtEveryLevel() {
+        TimerWheel wheel(0);
+        const QVector<qint64> deadlines = {0, 1, 63, 64, 65, 4095, 4096, 4097, 262143, 262144, 300001};
+        for (int i = 0; i < deadlines.size(); ++i) {
+            wheel.schedule(deadlines[i], i);
+        }
+        QCOMPARE(wheel.size(), deadlines.size());
+
+        QHash<quint64, qint64> firedAt = runUntil(wheel, 0, 300001);
+        QCOMPARE(firedAt.size(), deadlines.size());
+        for (int i = 0; i < deadlines.size(); ++i) {
+            QCOMPARE(firedAt.value(i), deadlines[i]);
+        }
+        QVERIFY(wheel.isEmpty());
+    }
+
+    void testLargeStepsFireInDeadlineOrder() {
+        // Random deadlines, advanced in uneven jumps as a QTimer would
+        QRandomGenerator random(7);
+        TimerWheel wheel(1000);
+        QHash<quint64, qint64> deadlines;
+        for (quint64 key = 0; key < 2000; ++key) {
+            qint64 deadline = 1000 + random.bounded(500000);
+            wheel.schedule(deadline, key);
+            deadlines.insert(key, deadline);
+        }
+
+        QVector<quint64> expired;
+        qint64 lastDeadline = 0;
+        for (qint64 now = 1000; now <= 501000; now += 1 + random.bounded(5000)) {
+            int before = expired.size();
+            wheel.advance(now, expired);
+            for (int i = before; i < expired.size(); ++i) {
+                qint64 deadline = deadlines.value(expired[i]);
+                QVERIFY(deadline <= now);
+                QVERIFY(deadline >= lastDeadline);
+                lastDeadline = deadline;
+            }
+        }
+        wheel.advance(501000, expired);
+        QCOMPARE(expired.size(), deadlines.size());
+    }
+
+    void testCancel() {
+        TimerWheel wheel(0);
+        TimerId early = wheel.schedule(10, 1);
+        TimerId late = wheel.schedule(5000, 2);
+        wheel.schedule(20, 3);
+
+        QVERIFY(wheel.cancel(early));
+        QVERIFY(!wheel.cancel(early));
+        QVERIFY(wheel.cancel(late));
+        QVERIFY(!wheel.cancel(TimerWheel::INVALID_TIMER));
+
+        QHash<quint64, qint64> firedAt = runUntil(wheel, 0, 6000);
+        QCOMPARE(firedAt.size(), 1);
+        QCOMPARE(firedAt.value(3), qint64(20));
+
+        // The slot is reused; the old id must not cancel the new timer
+        TimerId reused = wheel.schedule(7000, 4);
+        QVERIFY(!wheel.cancel(early));
+        QVERIFY(wheel.cancel(reused));
+    }
+
+    void testPastDeadlineFiresOnNextTick() {
+        TimerWheel wheel(100);
+        QVector<quint64> expired;
+        wheel.advance(200, expired);
+        wheel.schedule(50, 9);
+        wheel.advance(201, expired);
+        QCOMPARE(expired, QVector<quint64>({9}));
+    }
+
+    void testNextDeadline() {
+        TimerWheel wheel(0);
+        QCOMPARE(wheel.nextDeadline(), qint64(-1));
+
+        wheel.schedule(30, 1);
+        QCOMPARE(wheel.nextDeadline(), qint64(30));
+
+        // Coarser timers report when they cascade, never after they are due
+        TimerWheel coarse(0);
+        coarse.schedule(5000, 2);
+        qint64 next = coarse.nextDeadline();
+        QVERIFY(next > 0 && next <= 5000);
+
+        QVector<quint64> expired;
+        while (expired.isEmpty()) {
+            next = coarse.nextDeadline();
+            QVERIFY(next <= 5000);
+            coarse.advance(next, expired);
+        }
+        QCOMPARE(next, qint64(5000));
+    }
+
+    void testRttEstimator() {
+        RttEstimator rtt;
+        QVERIFY(!rtt.hasSample());
+        QCOMPARE(rtt.rto(), qint64(RttEstimator::INITIAL_RTO));
+
+        // A steady 10 ms LAN settles near the floor, far below the initial second
+        for (int i = 0; i < 50; ++i) {
+            rtt.sample(10);
+        }
+        QCOMPARE(rtt.smoothedRtt(), qint64(10));
+        QVERIFY(rtt.rto() >= RttEstimator::MIN_RTO);
+        QVERIFY(rtt.rto() < 50);
+
+        // Jitter widens the timeout
+        RttEstimator noisy;
+        for (int i = 0; i < 50; ++i) {
+            noisy.sample(i % 2 ? 10 : 90);
+        }
+        QVERIFY(noisy.rto() > 90);
+
+        // Backoff doubles per retry, with at most a quarter of jitter on top
+        for (int retry = 0; retry < 4; ++retry) {
+            qint64 base = rtt.rto() << retry;
+            qint64 delay = rtt.backoff(retry);
+            QVERIFY(delay >= base);
+            QVERIFY(delay <= base + base / 4);
+        }
+        QVERIFY(rtt.backoff(30) <= RttEstimator::MAX_RTO + RttEstimator::MAX_RTO / 4);
+    }
+};
+
+QTEST_MAIN(TestTimerWheel)
+#include "test_timerwheel.moc"
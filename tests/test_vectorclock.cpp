@@ -0,0 +1,229 @@
+#include <QtTest/QtTest>
+#include "../src/vectorclock.h"
+
+class TestVectorClock : public QObject {
+    Q_OBJECT
+
+private:
+    static NodeIndex node(const char* name) { return NodeRegistry::global().intern(name); }
+
+private slots:
+    void testAdvanceOnlyMovesForward() {
+        VectorClock clock;
+        QCOMPARE(clock.value(node("A")), 0u);
+        QVERIFY(clock.advance(node("A"), 5));
+        QVERIFY(!clock.advance(node("A"), 3));
+        QCOMPARE(clock.value(node("A")), 5u);
+        QCOMPARE(clock.entryCount(), 1);
+    }
+
+    void testMergeTakesMaximum() {
+        VectorClock a;
+        a.set(node("A"), 5);
+        a.set(node("B"), 1);
+        VectorClock b;
+        b.set(node("B"), 4);
+        b.set(node("C"), 2);
+
+        a.merge(b);
+        QCOMPARE(a.value(node("A")), 5u);
+        QCOMPARE(a.value(node("B")), 4u);
+        QCOMPARE(a.value(node("C")), 2u);
+    }
+
+    void testMeetTakesMinimum() {
+        VectorClock a;
+        a.set(node("A"), 5);
+        a.set(node("B"), 2);
+
+        VectorClock b;
+        b.set(node("A"), 3);
+        b.set(node("B"), 7);
+
+        a.meet(b);
+        QCOMPARE(a.value(node("A")), 3u);
+        QCOMPARE(a.value(node("B")), 2u);
+
+        a.meet(VectorClock());
+        QVERIFY(a.isEmpty());
+    }
+
+    void testCompareAndDominates() {
+        VectorClock a;
+        a.set(node("A"), 2);
+        VectorClock b = a;
+        QCOMPARE(a.compare(b), VectorClock::EQUAL);
+
+        b.set(node("B"), 1);
+        QCOMPARE(a.compare(b), VectorClock::BEFORE);
+        QCOMPARE(b.compare(a), VectorClock::AFTER);
+        QVERIFY(b.dominates(a));
+        QVERIFY(!a.dominates(b));
+
+        a.set(node("A"), 3);
+        QCOMPARE(a.compare(b), VectorClock::CONCURRENT);
+        QVERIFY(!a.dominates(b));
+        QVERIFY(!b.dominates(a));
+    }
+
+    void testDiffListsMissingRanges() {
+        VectorClock local;
+        local.set(node("A"), 10);
+        local.set(node("B"), 3);
+        VectorClock remote;
+        remote.set(node("A"), 7);
+        remote.set(node("B"), 3);
+        remote.set(node("C"), 9);
+
+        QVector<VectorClock::Gap> gaps = local.diff(remote);
+        QCOMPARE(gaps.size(), 1);
+        QCOMPARE(gaps.at(0).node, node("A"));
+        QCOMPARE(gaps.at(0).from, 7u);
+        QCOMPARE(gaps.at(0).to, 10u);
+    }
+
+    void testInsertTracksHoles() {
+        VectorClock clock;
+        QVERIFY(clock.insert(node("H"), 1));
+        QVERIFY(clock.insert(node("H"), 2));
+        QVERIFY(clock.insert(node("H"), 7));
+        QVERIFY(clock.insert(node("H"), 4));
+        QVERIFY(!clock.insert(node("H"), 7));
+        QCOMPARE(clock.value(node("H")), 2u);
+        QCOMPARE(clock.highest(node("H")), 7u);
+        QVERIFY(clock.contains(node("H"), 4));
+        QVERIFY(!clock.contains(node("H"), 5));
+        QCOMPARE(clock.ranges(node("H")).size(), 2);
+
+        // Filling the holes folds the ranges back into the watermark
+        QVERIFY(clock.insert(node("H"), 3));
+        QVERIFY(clock.insert(node("H"), 6));
+        QCOMPARE(clock.value(node("H")), 4u);
+        QVERIFY(clock.insert(node("H"), 5));
+        QCOMPARE(clock.value(node("H")), 7u);
+        QVERIFY(!clock.hasRanges());
+    }
+
+    void testSliceKeepsHighestRanges() {
+        VectorClock clock;
+        clock.set(node("S"), 5);
+        clock.insert(node("S"), 8);
+        clock.insert(node("S"), 10);
+        clock.insert(node("S"), 12);
+        clock.set(node("Other"), 3);
+
+        // An ACK for S: the watermark, and only the ranges nearest the top
+        VectorClock slice = clock.slice(node("S"), 2);
+        QCOMPARE(slice.value(node("S")), 5u);
+        QCOMPARE(slice.value(node("Other")), 0u);
+        QVERIFY(!slice.contains(node("S"), 8));
+        QVERIFY(slice.contains(node("S"), 10));
+        QVERIFY(slice.contains(node("S"), 12));
+        QCOMPARE(slice.ranges(node("S")).size(), 2);
+
+        QVERIFY(clock.slice(node("Unknown"), 2).isEmpty());
+    }
+
+    void testDiffListsHoles() {
+        VectorClock local;
+        local.set(node("H"), 10);
+
+        // Remote has 1-3, 5 and 8-9: it lacks 4, 6-7 and 10
+        VectorClock remote;
+        for (quint32 seq : {1u, 2u, 3u, 5u, 8u, 9u}) {
+            remote.insert(node("H"), seq);
+        }
+
+        QVector<VectorClock::Gap> gaps = local.diff(remote);
+        QCOMPARE(gaps.size(), 3);
+        QCOMPARE(gaps.at(0).from, 3u);
+        QCOMPARE(gaps.at(0).to, 4u);
+        QCOMPARE(gaps.at(1).from, 5u);
+        QCOMPARE(gaps.at(1).to, 7u);
+        QCOMPARE(gaps.at(2).from, 9u);
+        QCOMPARE(gaps.at(2).to, 10u);
+
+        // Nothing to send the other way except what only remote has
+        QVERIFY(remote.diff(local).isEmpty());
+        QVERIFY(local.dominates(remote));
+        QVERIFY(!remote.dominates(local));
+        QCOMPARE(remote.compare(local), VectorClock::BEFORE);
+    }
+
+    void testMergeUnitesRanges() {
+        VectorClock a;
+        a.insert(node("H"), 1);
+        a.insert(node("H"), 4);
+        VectorClock b;
+        b.insert(node("H"), 3);
+        b.insert(node("H"), 9);
+        b.insert(node("H"), 2);
+
+        a.merge(b);
+        QCOMPARE(a.value(node("H")), 4u);
+        QCOMPARE(a.highest(node("H")), 9u);
+        QVERIFY(!a.contains(node("H"), 5));
+
+        // meet() keeps only what both have contiguously
+        b.insert(node("H"), 1);
+        a.meet(b);
+        QCOMPARE(a.value(node("H")), 3u);
+        QVERIFY(!a.hasRanges());
+    }
+
+    void testRangesRoundTrip() {
+        VectorClock clock;
+        clock.set(node("A"), 3);
+        clock.insert(node("A"), 6);
+        clock.insert(node("H"), 2);
+
+        QByteArray encoded;
+        clock.appendEntries(encoded);
+        int entriesSize = encoded.size();
+        clock.appendRanges(encoded);
+
+        VectorClock decoded;
+        QCOMPARE(decoded.readEntries(encoded.constData(), encoded.size(), clock.entryCount()), entriesSize);
+        QCOMPARE(decoded.readRanges(encoded.constData() + entriesSize, encoded.size() - entriesSize),
+                 encoded.size() - entriesSize);
+        QVERIFY(decoded == clock);
+        QVERIFY(decoded.contains(node("H"), 2));
+        QVERIFY(!decoded.contains(node("H"), 1));
+
+        VectorClock fromJson = VectorClock::fromVariantMap(clock.toVariantMap());
+        fromJson.addRangesFromVariantMap(clock.rangesToVariantMap());
+        QVERIFY(fromJson == clock);
+    }
+
+    void testVariantMapRoundTrip() {
+        QVariantMap map;
+        map["A"] = 4;
+        map["B"] = 0;
+        VectorClock clock = VectorClock::fromVariantMap(map);
+        QCOMPARE(clock.value(node("A")), 4u);
+        QCOMPARE(clock.entryCount(), 1);
+
+        QVariantMap back = clock.toVariantMap();
+        QCOMPARE(back.size(), 1);
+        QCOMPARE(back.value("A").toInt(), 4);
+    }
+
+    void testBinaryEntriesRoundTrip() {
+        VectorClock clock;
+        clock.set(node("A"), 70000);
+        clock.set(node("Node9001"), 12);
+
+        QByteArray encoded;
+        clock.appendEntries(encoded);
+
+        VectorClock decoded;
+        QCOMPARE(decoded.readEntries(encoded.constData(), encoded.size(), clock.entryCount()), encoded.size());
+        QVERIFY(decoded == clock);
+
+        VectorClock truncated;
+        QCOMPARE(truncated.readEntries(encoded.constData(), encoded.size() - 1, clock.entryCount()), -1);
+    }
+};
+
+QTEST_MAIN(TestVectorClock)
+#include "test_vectorclock.moc"
@@ -0,0 +1,240 @@
+#include <QtTest/QtTest>
+#include "../src/message.h"
+#include "../src/messageview.h"
+#include <QtEndian>
+
+class TestWireFormat : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testBinaryRoundTrip() {
+        Message original("Binary message", "Node1", "Node2", 7);
+        QVariantMap vc;
+        vc["Node1"] = 7;
+        vc["Node3"] = 12;
+        original.setVectorClock(VectorClock::fromVariantMap(vc));
+
+        QByteArray datagram = original.toDatagram(Message::BINARY_FORMAT);
+        QCOMPARE(Message::detectFormat(datagram), Message::BINARY_FORMAT);
+
+        Message decoded = Message::fromDatagram(datagram);
+        QCOMPARE(decoded.getChatText(), original.getChatText());
+        QCOMPARE(decoded.getOrigin(), original.getOrigin());
+        QCOMPARE(decoded.getDestination(), original.getDestination());
+        QCOMPARE(decoded.getSequenceNumber(), original.getSequenceNumber());
+        QCOMPARE(decoded.getType(), original.getType());
+        QCOMPARE(decoded.getMessageId(), original.getMessageId());
+        QCOMPARE(decoded.getVectorClock().toVariantMap().value("Node1").toInt(), 7);
+        QCOMPARE(decoded.getVectorClock().toVariantMap().value("Node3").toInt(), 12);
+        QCOMPARE(decoded.getWireVersion(), static_cast<int>(Message::WIRE_VERSION));
+    }
+
+    void testClockRangesRoundTrip() {
+        // Node1 has 1-3 and 6 from Node5: the hole at 4-5 must survive both encodings
+        NodeIndex node5 = NodeRegistry::global().intern("Node5");
+        VectorClock clock;
+        clock.set(node5, 3);
+        clock.insert(node5, 6);
+
+        Message request("", "Node1", "Node2", 0, Message::ANTI_ENTROPY_REQUEST);
+        request.setVectorClock(clock);
+
+        QByteArray binary = request.toDatagram(Message::BINARY_FORMAT);
+        QVERIFY(static_cast<quint8>(binary.at(3)) & Message::WIRE_FLAG_CLOCK_RANGES);
+        QVERIFY(Message::fromDatagram(binary).getVectorClock() == clock);
+        QVERIFY(Message::fromDatagram(request.toDatagram(Message::JSON_FORMAT)).getVectorClock() == clock);
+
+        // A decoder that ignores the flag still sees the watermark, never the hole
+        QCOMPARE(Message::fromDatagram(binary).getVectorClock().value(node5), 3u);
+
+        // Truncated range section
+        binary.chop(3);
+        qToBigEndian(static_cast<quint32>(binary.size()), binary.data() + 4);
+        QVERIFY(Message::fromDatagram(binary).getOrigin().isEmpty());
+    }
+
+    void testPayloadRoundTrip() {
+        Message digest("", "Node1", "Node2", 0, Message::ANTI_ENTROPY_DIGEST);
+        QByteArray payload("\x00\x01digest\xff", 9);
+        digest.setPayload(payload);
+
+        QByteArray binary = digest.toDatagram(Message::BINARY_FORMAT);
+        QVERIFY(static_cast<quint8>(binary.at(3)) & Message::WIRE_FLAG_PAYLOAD);
+        QCOMPARE(Message::fromDatagram(binary).getPayload(), payload);
+        QCOMPARE(Message::fromDatagram(binary).getType(), Message::ANTI_ENTROPY_DIGEST);
+        QCOMPARE(Message::fromDatagram(digest.toDatagram(Message::JSON_FORMAT)).getPayload(), payload);
+
+        // Payload length running past the datagram
+        binary.chop(2);
+        qToBigEndian(static_cast<quint32>(binary.size()), binary.data() + 4);
+        QVERIFY(Message::fromDatagram(binary).getOrigin().isEmpty());
+    }
+
+    void testBatchRoundTrip() {
+        QByteArray payload;
+        for (int seq = 1; seq <= 3; ++seq) {
+            Message::appendToBatch(payload, Message(QString("batched %1").arg(seq), "Node3", "broadcast", seq)
+                                                .toDatagram(Message::BINARY_FORMAT));
+        }
+        Message batch("", "Node1", "Node2", 0, Message::BATCH);
+        batch.setPayload(payload);
+
+        Message decoded = Message::fromDatagram(batch.toDatagram(Message::BINARY_FORMAT));
+        QCOMPARE(decoded.getType(), Message::BATCH);
+        const QList<QByteArray> datagrams = Message::unpackBatch(decoded.getPayload());
+        QCOMPARE(datagrams.size(), 3);
+        QCOMPARE(Message::fromDatagram(datagrams.at(2)).getChatText(), QString("batched 3"));
+        QCOMPARE(Message::fromDatagram(datagrams.at(2)).getSequenceNumber(), 3);
+
+        // An entry running past the payload rejects the whole batch
+        payload.chop(1);
+        QVERIFY(Message::unpackBatch(payload).isEmpty());
+        QVERIFY(Message::unpackBatch(QByteArray(1, '\x00')).isEmpty());
+    }
+
+    void testBinaryExplicitMessageId() {
+        // ACKs carry the id of the acknowledged message, not their own origin_sequence
+        Message ack("", "Node2", "Node1", 0, Message::ACK);
+        ack.setMessageId("Node1_42");
+
+        Message decoded = Message::fromDatagram(ack.toDatagram(Message::BINARY_FORMAT));
+        QCOMPARE(decoded.getType(), Message::ACK);
+        QCOMPARE(decoded.getMessageId(), QString("Node1_42"));
+    }
+
+    void testBinaryUnicodeText() {
+        Message original(QString::fromUtf8("h\xc3\xa9llo \xe2\x9c\x93"), "Node1", "broadcast", 3);
+        Message decoded = Message::fromDatagram(original.toDatagram(Message::BINARY_FORMAT));
+        QCOMPARE(decoded.getChatText(), original.getChatText());
+        QVERIFY(decoded.isBroadcast());
+    }
+
+    void testBinaryIsSmallerThanJson() {
+        Message msg("Hello", "Node1", "Node2", 1);
+        QVariantMap vc;
+        vc["Node1"] = 1;
+        vc["Node2"] = 4;
+        msg.setVectorClock(VectorClock::fromVariantMap(vc));
+
+        QVERIFY(msg.toDatagram(Message::BINARY_FORMAT).size() < msg.toDatagram(Message::JSON_FORMAT).size());
+    }
+
+    void testJsonAdvertisesWireVersion() {
+        Message original("Legacy path", "Node1", "Node2", 2);
+        QByteArray datagram = original.toDatagram(Message::JSON_FORMAT);
+        QCOMPARE(Message::detectFormat(datagram), Message::JSON_FORMAT);
+
+        Message decoded = Message::fromDatagram(datagram);
+        QCOMPARE(decoded.getChatText(), original.getChatText());
+        QCOMPARE(decoded.getWireVersion(), static_cast<int>(Message::WIRE_VERSION));
+    }
+
+    void testLegacyJsonHasNoWireVersion() {
+        // Datagram as produced by nodes that predate the binary format
+        QByteArray legacy("{\"ChatText\":\"old\",\"Destination\":\"Node2\",\"MessageId\":\"Node1_1\","
+                          "\"Origin\":\"Node1\",\"SequenceNumber\":1,\"Type\":0,\"VectorClock\":{}}");
+        Message decoded = Message::fromDatagram(legacy);
+        QVERIFY(decoded.isValid());
+        QCOMPARE(decoded.getWireVersion(), 0);
+    }
+
+    void testTruncatedBinaryRejected() {
+        Message original("Truncate me", "Node1", "Node2", 9);
+        QByteArray datagram = original.toDatagram(Message::BINARY_FORMAT);
+
+        QVERIFY(!Message::fromDatagram(datagram.left(Message::WIRE_HEADER_SIZE - 1)).isValid());
+        QVERIFY(!Message::fromDatagram(datagram.left(datagram.size() - 1)).isValid());
+    }
+
+    void testViewReadsHeaderInPlace() {
+        Message original("Viewed", "Node1", "broadcast", 11);
+        QByteArray datagram = original.toDatagram(Message::BINARY_FORMAT);
+
+        MessageView view(datagram.constData(), datagram.size());
+        QVERIFY(view.isValid());
+        QCOMPARE(view.getType(), Message::CHAT_MESSAGE);
+        QCOMPARE(view.getSequenceNumber(), 11);
+        QCOMPARE(view.getMessageIdSequence(), 11);
+        QVERIFY(view.originEquals(QByteArray("Node1")));
+        QVERIFY(!view.originEquals(QByteArray("Node12")));
+        QVERIFY(view.isBroadcast());
+        QCOMPARE(QByteArray(view.originData(), view.originSize()), QByteArray("Node1"));
+    }
+
+    void testViewAckMessageIdSequence() {
+        Message ack("", "Node2", "Node1", 0, Message::ACK);
+        ack.setMessageId("Node1_42");
+        QByteArray datagram = ack.toDatagram(Message::BINARY_FORMAT);
+
+        MessageView view(datagram.constData(), datagram.size());
+        QVERIFY(view.isValid());
+        QCOMPARE(view.getType(), Message::ACK);
+        QCOMPARE(view.getMessageIdSequence(), 42);
+        QVERIFY(view.destinationEquals(QByteArray("Node1")));
+    }
+
+    void testViewSeesCumulativeAck() {
+        // Node2 has 1-5 and 9 from Node1
+        NodeIndex node1 = NodeRegistry::global().intern("Node1");
+        VectorClock received;
+        received.set(node1, 5);
+        received.insert(node1, 9);
+
+        Message ack("", "Node2", "Node1", 0, Message::ACK);
+        ack.setVectorClock(received);
+        QByteArray datagram = ack.toDatagram(Message::BINARY_FORMAT);
+
+        MessageView view(datagram.constData(), datagram.size());
+        QVERIFY(view.isValid());
+        QVERIFY(view.hasVectorClock());
+        VectorClock decoded = view.toMessage().getVectorClock();
+        QVERIFY(decoded.contains(node1, 4));
+        QVERIFY(!decoded.contains(node1, 7));
+        QVERIFY(decoded.contains(node1, 9));
+
+        Message legacy("", "Node2", "Node1", 0, Message::ACK);
+        legacy.setMessageId("Node1_42");
+        datagram = legacy.toDatagram(Message::BINARY_FORMAT);
+        QVERIFY(!MessageView(datagram.constData(), datagram.size()).hasVectorClock());
+    }
+
+    void testPreviousSequenceRoundTrip() {
+        Message original("Second", "Node1", "Node2", 9);
+        original.setPreviousSequence(4);
+        original.setPayload("tail");
+
+        for (Message::WireFormat format : {Message::BINARY_FORMAT, Message::JSON_FORMAT}) {
+            Message decoded = Message::fromDatagram(original.toDatagram(format));
+            QCOMPARE(decoded.getPreviousSequence(), 4);
+            QCOMPARE(decoded.getPayload(), QByteArray("tail"));
+        }
+
+        // Older binary decoders stop before the field, so it must come last
+        QByteArray datagram = original.toDatagram(Message::BINARY_FORMAT);
+        QCOMPARE(qFromBigEndian<quint32>(datagram.constData() + datagram.size() - 4), 4u);
+        QCOMPARE(Message::fromDatagram(Message("First", "Node1", "Node2", 4).toDatagram(Message::BINARY_FORMAT))
+                     .getPreviousSequence(), 0);
+    }
+
+    void testViewRejectsJson() {
+        Message original("Json", "Node1", "Node2", 1);
+        QByteArray datagram = original.toDatagram(Message::JSON_FORMAT);
+        QVERIFY(!MessageView(datagram.constData(), datagram.size()).isValid());
+    }
+
+    void testViewToMessage() {
+        Message original("Materialize", "Node3", "Node1", 5);
+        QVariantMap vc;
+        vc["Node3"] = 5;
+        original.setVectorClock(VectorClock::fromVariantMap(vc));
+        QByteArray datagram = original.toDatagram(Message::BINARY_FORMAT);
+
+        Message decoded = MessageView(datagram.constData(), datagram.size()).toMessage();
+        QCOMPARE(decoded.getChatText(), original.getChatText());
+        QCOMPARE(decoded.getMessageId(), original.getMessageId());
+        QCOMPARE(decoded.getVectorClock().toVariantMap().value("Node3").toInt(), 5);
+    }
+};
+
+QTEST_MAIN(TestWireFormat)
+#include "test_wireformat.moc"